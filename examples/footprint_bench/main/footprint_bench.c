@@ -0,0 +1,55 @@
+/*
+ * SPDX-FileCopyrightText: 2024 Rossen Dobrinov
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/**
+ * Footprint benchmark: runs manager init, scan, known network add and connect
+ * cycle against benchmark network and compares footprint with Kconfig budgets.
+ * Budget violation aborts in manager (CONFIG_WIFIMGR_FP_ABORT), operation not
+ * measured in time aborts here - CI treats reset as failed run.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+#include "idf_wifi_manager.h"
+#include "sdkconfig.h"
+
+static const char *TAG = "fp_bench";
+
+static const char *const op_names[WM_FP_OP_MAX] = { "init", "scan", "known network", "connect" };
+
+static bool wait_op(wm_fp_op_t op) {
+    wm_footprint_t fp;
+    for(int i=0; i<CONFIG_BENCH_TIMEOUT * 10; i++) {
+        wm_get_footprint(&fp);
+        if(fp.op[op].count) return true;
+        vTaskDelay(pdMS_TO_TICKS(100));
+    }
+    ESP_LOGE(TAG, "%s not measured in %d s", op_names[op], CONFIG_BENCH_TIMEOUT);
+    return false;
+}
+
+void app_main(void) {
+    bool pass = (ESP_OK == wm_init_wifi_manager(NULL, NULL));
+    pass = pass && (ESP_OK == wm_scan_now()) && wait_op(WM_FP_SCAN);
+    pass = pass && (ESP_OK == wm_add_known_network(CONFIG_BENCH_SSID, CONFIG_BENCH_PASSWORD)) && wait_op(WM_FP_KN);
+    pass = pass && wait_op(WM_FP_CONNECT);
+
+    wm_footprint_t fp;
+    wm_get_footprint(&fp);
+    for(int i=0; i<WM_FP_OP_MAX; i++) {
+        printf("%-14s count %4lu last %6lu peak %6lu budget %6lu over %lu\n", op_names[i],
+            (unsigned long)fp.op[i].count, (unsigned long)fp.op[i].heap_last, (unsigned long)fp.op[i].heap_peak,
+            (unsigned long)fp.op[i].heap_budget, (unsigned long)fp.op[i].over_budget);
+        pass = pass && fp.op[i].count && !fp.op[i].over_budget;
+    }
+    printf("stack free mgr %lu scan %lu budget %lu, heap min free %lu\n", (unsigned long)fp.mgr_stack_free,
+        (unsigned long)fp.scan_stack_free, (unsigned long)fp.stack_budget, (unsigned long)fp.heap_min_free);
+    printf("FOOTPRINT %s\n", (pass) ? "PASS" : "FAIL");
+    if(!pass) abort();
+}
@@ -36,6 +36,8 @@
 #include "lwip/ip4_addr.h"
 #include "esp_netif_types.h"
 #include "../lwip/esp_netif_lwip_internal.h"
+#include "wm_config_codec.h"
+#include "wm_inet_probe.h"
 
 
 #define MACSTR "%X:%X:%X:%X:%X:%X"
@@ -67,6 +69,20 @@ typedef enum wm_event_types {
     WM_EVENT_DNS_CHANGE_FAIL,       /*!< DNS address not changed */
     WM_EVENT_AP_STA_CONNECTED,      /*!< Station connected to softAP */
     WM_EVENT_AP_STA_DISCONNECTED,   /*!< Station disconnected from softAP */
+    WM_EVENT_LINK_DEGRADED,         /*!< STA link quality below threshold */
+    WM_EVENT_LINK_RECOVERED,        /*!< STA link quality recovered */
+    WM_EVENT_INET_OK,               /*!< Internet reachable through STA */
+    WM_EVENT_INET_FAIL,             /*!< Internet not reachable through STA */
+    WM_EVENT_CAPTIVE_PORTAL,        /*!< Captive portal detected on STA network */
+    WM_EVENT_KN_BULK_DONE,          /*!< Known networks bulk operation applied */
+    WM_EVENT_CONN_PROFILE,          /*!< STA connection attempt finished, phase durations */
+    WM_EVENT_WD_RECOVERY,           /*!< Stuck state recovered by watchdog, wm_wd_stage_t */
+    WM_EVENT_SUSPENDED,             /*!< Radio stopped by suspend */
+    WM_EVENT_RESUMED,               /*!< Radio restarted by resume */
+    WM_EVENT_CFG_IMPORTED,          /*!< Configuration image applied */
+    WM_EVENT_SCAN_RESULTS,          /*!< Requested scan results cached, count of cached entries as uint32_t */
+    WM_EVENT_DNS_RANKED,            /*!< STA DNS servers raced and reordered, wm_dns_health_t */
+    WM_EVENT_FOOTPRINT_OVER,        /*!< Operation exceeded heap or stack budget, wm_fp_report_t */
     WM_EVENT_EVENT_TYPE_MAX         /*!< MAX EVENT */
 } wm_event_t;
 
@@ -86,9 +102,31 @@ typedef struct wm_net_ip_config {
 typedef struct wm_net_base_config {
     char ssid[33];                  /*!< WiFi SSID             */
     char password[64];              /*!< WiFi Password         */
+    bool hidden;                    /*!< Hidden SSID. STA: found by directed probe, AP: not broadcast */
     wm_net_ip_config_t ip_config;   /*!< Full IP configuration */
 } wm_net_base_config_t;
 
+/**
+ * @brief Type of softAP security. Pairwise cipher is always CCMP (hardware AES)
+*/
+typedef enum wm_ap_security {
+    WM_AP_SEC_WPA2,             /*!< WPA2-PSK, CCMP, PMF capable                    */
+    WM_AP_SEC_WPA2_WPA3,        /*!< WPA2-PSK/WPA3-SAE transition, CCMP, PMF capable*/
+    WM_AP_SEC_WPA3,             /*!< WPA3-SAE, CCMP, PMF required                   */
+    WM_AP_SEC_MAX               /*!< MAX SECURITY                                   */
+} wm_ap_security_t;
+
+/**
+ * @brief Type of softAP performance profile
+*/
+typedef struct wm_ap_profile {
+    wm_ap_security_t security;      /*!< Security when AP password is set, open otherwise                   */
+    wifi_bandwidth_t bandwidth;     /*!< WIFI_BW_HT20 or WIFI_BW_HT40. HT40 only with free secondary channel */
+    uint8_t max_clients;            /*!< Max connected stations, 1 - 10                                     */
+    uint16_t beacon_interval;       /*!< Beacon interval in TU, 100 - 60000                                 */
+    uint16_t inactive_time;         /*!< Station inactivity disconnect timeout in seconds, min 10           */
+} wm_ap_profile_t;
+
 /**
  * @brief Type of Wireless AP
 */
@@ -96,6 +134,7 @@ typedef struct wm_apmode_config {
     wm_net_base_config_t base_conf; /*!< Wireless IP and SSID Password config */
     wifi_country_t country;         /*!< Wireless driver country configuration*/
     uint32_t ap_channel;            /*!< Access point channel                 */
+    wm_ap_profile_t ap_profile;     /*!< Access point performance profile     */
 } wm_apmode_config_t;
 
 /**
@@ -106,6 +145,269 @@ typedef struct wm_known_net_config {
     uint32_t net_config_id;             /*!< Configuration ID                 */
 } wm_known_net_config_t;
 
+/**
+ * @brief Type of power save profile applied in connected idle state
+*/
+typedef enum wm_power_profile {
+    WM_POWER_MAX_THROUGHPUT,    /*!< No power save                                */
+    WM_POWER_BALANCED,          /*!< Modem sleep, wake every DTIM                 */
+    WM_POWER_LOW,               /*!< Modem sleep, wake every listen interval      */
+    WM_POWER_PROFILE_MAX        /*!< MAX PROFILE                                  */
+} wm_power_profile_t;
+
+/**
+ * @brief Type of power save status
+*/
+typedef struct wm_power_stats {
+    wm_power_profile_t profile;     /*!< Selected power profile                          */
+    wifi_ps_type_t ps_type;         /*!< Currently applied driver power save type        */
+    uint16_t listen_interval;       /*!< Listen interval used for association (beacons)  */
+    uint16_t duty_cycle;            /*!< Estimated radio duty cycle since init, permille */
+} wm_power_stats_t;
+
+#define WM_LINK_PHY_11B     (1 << 0)    /*!< 802.11b link  */
+#define WM_LINK_PHY_11G     (1 << 1)    /*!< 802.11g link  */
+#define WM_LINK_PHY_11N     (1 << 2)    /*!< 802.11n link  */
+#define WM_LINK_PHY_LR      (1 << 3)    /*!< Long range    */
+#define WM_LINK_PHY_11AX    (1 << 4)    /*!< 802.11ax link */
+
+/**
+ * @brief Type of STA link quality sample. Passed as event data for 
+ * WM_EVENT_LINK_DEGRADED and WM_EVENT_LINK_RECOVERED events
+*/
+typedef struct wm_link_quality {
+    int8_t rssi;            /*!< Last sampled RSSI                          */
+    int8_t rssi_avg;        /*!< Smoothed RSSI                              */
+    uint8_t phy_mode;       /*!< Negotiated PHY modes WM_LINK_PHY_x         */
+    uint8_t degraded;       /*!< Link degraded flag                         */
+    uint16_t beacon_loss;   /*!< Beacon timeouts in last sample period      */
+    uint16_t samples;       /*!< Samples since connection                   */
+    int8_t tx_power;        /*!< Applied max TX power, 0.25 dBm units       */
+} wm_link_quality_t;
+
+/**
+ * @brief Type of STA DNS servers health. Servers are listed in applied order
+ * MAIN, BACKUP, FALLBACK. Passed as event data for WM_EVENT_DNS_RANKED event
+*/
+typedef struct wm_dns_health {
+    uint8_t count;                  /*!< Raced servers count                        */
+    esp_ip4_addr_t server[3];       /*!< Server address                             */
+    int32_t rtt_ms[3];              /*!< Query round trip time, -1 no valid answer  */
+} wm_dns_health_t;
+
+/**
+ * @brief Type of manager operation measured by footprint meter
+*/
+typedef enum wm_fp_op {
+    WM_FP_INIT,             /*!< Manager init                               */
+    WM_FP_SCAN,             /*!< Scan start to processed scan results       */
+    WM_FP_KN,               /*!< Known network add, delete or bulk command  */
+    WM_FP_CONNECT,          /*!< STA connect to got IP or give up           */
+    WM_FP_OP_MAX
+} wm_fp_op_t;
+
+/**
+ * @brief Type of per operation heap footprint. Heap used is peak of heap allocated 
+ * by manager during operation above manager heap at operation start. WiFi driver, 
+ * netif, task stacks and other tasks allocations are not counted
+*/
+typedef struct wm_fp_op_stats {
+    uint32_t count;             /*!< Measured operations                */
+    uint32_t heap_last;         /*!< Heap used by last operation        */
+    uint32_t heap_peak;         /*!< Max heap used by operation         */
+    uint32_t heap_budget;       /*!< Heap budget, 0 not checked         */
+    uint32_t over_budget;       /*!< Operations over heap or stack budget */
+} wm_fp_op_stats_t;
+
+/**
+ * @brief Type of manager memory footprint
+*/
+typedef struct wm_footprint {
+    wm_fp_op_stats_t op[WM_FP_OP_MAX];  /*!< Per operation heap footprint                       */
+    uint32_t mgr_stack_free;            /*!< Manager task stack high-water mark, min free bytes */
+    uint32_t scan_stack_free;           /*!< Scan task stack high-water mark, min free bytes    */
+    uint32_t stack_budget;              /*!< Min free stack budget, 0 not checked               */
+    uint32_t heap_min_free;             /*!< System min free heap since boot                    */
+} wm_footprint_t;
+
+/**
+ * @brief Type of footprint budget violation. Passed as event data for WM_EVENT_FOOTPRINT_OVER event
+*/
+typedef struct wm_fp_report {
+    wm_fp_op_t op;              /*!< Operation                          */
+    uint32_t heap_used;         /*!< Heap used by operation             */
+    uint32_t mgr_stack_free;    /*!< Manager task min free stack        */
+    uint32_t scan_stack_free;   /*!< Scan task min free stack           */
+} wm_fp_report_t;
+
+/**
+ * @brief Type of known network bulk operation
+*/
+typedef enum wm_kn_op {
+    WM_KN_OP_ADD,       /*!< Add known network or replace one with same SSID and password       */
+    WM_KN_OP_DELETE     /*!< Delete known network by net_config_id or by SSID when ID is 0      */
+} wm_kn_op_t;
+
+/**
+ * @brief Type of single known network bulk operation entry
+*/
+typedef struct wm_kn_bulk_entry {
+    wm_kn_op_t op;                      /*!< Operation                                              */
+    wm_net_base_config_t net_config;    /*!< Network configuration. Only SSID is used for delete    */
+    uint32_t net_config_id;             /*!< Delete: ID to delete. Add: returned configuration ID   */
+    esp_err_t result;                   /*!< Per entry result                                       */
+} wm_kn_bulk_entry_t;
+
+/**
+ * @brief Type of known network bulk operation summary. Passed as event data
+ * for WM_EVENT_KN_BULK_DONE event
+*/
+typedef struct wm_kn_bulk_summary {
+    uint16_t added;     /*!< Added networks         */
+    uint16_t replaced;  /*!< Replaced networks      */
+    uint16_t deleted;   /*!< Deleted networks       */
+    uint16_t failed;    /*!< Failed entries         */
+    int16_t first_failed;   /*!< Index of first failed entry, -1 when none  */
+    esp_err_t first_err;    /*!< Result of first failed entry               */
+} wm_kn_bulk_summary_t;
+
+/**
+ * @brief Type of STA connection attempt timing breakdown. Passed as event data 
+ * for WM_EVENT_CONN_PROFILE event. Phase not reached is reported as 0
+*/
+typedef struct wm_conn_profile {
+    uint32_t scan_ms;       /*!< First scan start to scan done with selected AP     */
+    uint32_t connect_ms;    /*!< esp_wifi_connect to STA_CONNECTED incl. retries    */
+    uint32_t dhcp_ms;       /*!< STA_CONNECTED to GOT_IP                            */
+    uint32_t sntp_ms;       /*!< GOT_IP to SNTP time sync                           */
+    uint32_t total_ms;      /*!< Attempt start to last reached phase                */
+    uint8_t retries;        /*!< Connect retries                                    */
+    bool success;           /*!< IP address obtained                                */
+} wm_conn_profile_t;
+
+/**
+ * @brief Type of cached scan result entry
+*/
+typedef struct wm_scan_entry {
+    char ssid[33];                  /*!< SSID, NULL terminated          */
+    uint8_t bssid[6];               /*!< BSSID                          */
+    uint8_t channel;                /*!< Primary channel                */
+    int8_t rssi;                    /*!< RSSI when last seen            */
+    wifi_auth_mode_t authmode;      /*!< Authentication mode            */
+    uint32_t age_ms;                /*!< Time since AP was last seen    */
+} wm_scan_entry_t;
+
+/**
+ * @brief Type of cached scan results query filter
+*/
+typedef struct wm_scan_filter {
+    const char *ssid;               /*!< Exact SSID, NULL for any           */
+    int8_t min_rssi;                /*!< Min RSSI, 0 for any                */
+    uint32_t max_age_ms;            /*!< Max time since seen, 0 for any     */
+} wm_scan_filter_t;
+
+/**
+ * @brief Type of watchdog supervised stage. Passed as event data for WM_EVENT_WD_RECOVERY event
+*/
+typedef enum wm_wd_stage {
+    WM_WD_CONNECT,          /*!< Connect to STA_CONNECTED incl. retries and backoff */
+    WM_WD_DHCP,             /*!< STA_CONNECTED to GOT_IP                            */
+    WM_WD_MODE,             /*!< Failed WiFi mode switch                            */
+    WM_WD_SCAN,             /*!< Scan start to SCAN_DONE                            */
+    WM_WD_STAGE_MAX
+} wm_wd_stage_t;
+
+/**
+ * @brief Type of watchdog recovery counters
+*/
+typedef struct wm_wd_stats {
+    uint32_t recoveries;                        /*!< Recovered stalls, retries of same stall not counted   */
+    uint32_t stage_recoveries[WM_WD_STAGE_MAX]; /*!< Recovered stalls per stage                             */
+    uint32_t lost_events;                       /*!< Driver and deferred direct events dropped on full queue */
+} wm_wd_stats_t;
+
+/**
+ * @brief Type of manager command ID
+*/
+typedef enum wm_cmd_id {
+    WM_CMD_KN_ADD,          /*!< Add known network from net_config                      */
+    WM_CMD_KN_DEL,          /*!< Delete known network by net_ref ID or SSID             */
+    WM_CMD_KN_BULK,         /*!< Known networks bulk transaction                        */
+    WM_CMD_SET_COUNTRY,     /*!< Set country code                                       */
+    WM_CMD_AP_CONFIG,       /*!< Change AP mode configuration from net_config           */
+    WM_CMD_STA_DNS,         /*!< Set known network DNS by net_ref ID or SSID            */
+    WM_CMD_SEC_DNS,         /*!< Set secondary DNS server from net_ref                  */
+    WM_CMD_POWER_PROFILE,   /*!< Select power profile                                   */
+    WM_CMD_INET_PROBE,      /*!< Set internet reachability probe target                 */
+    WM_CMD_SUSPEND,         /*!< Stop radio and save STA connection for resume          */
+    WM_CMD_RESUME,          /*!< Restart radio and reconnect saved STA connection       */
+    WM_CMD_CFG_EXPORT,      /*!< Fill configuration image from running configuration    */
+    WM_CMD_CFG_IMPORT,      /*!< Validate and apply configuration image                 */
+    WM_CMD_AP_PROFILE,      /*!< Apply softAP performance profile                       */
+    WM_CMD_SCAN_NOW,        /*!< Request broadcast scan, coalesced with pending scans   */
+    WM_CMD_DIRECT_CB,       /*!< Register or remove direct event callback               */
+    WM_CMD_MAX
+} wm_cmd_id_t;
+
+/**
+ * @brief Direct event callback. Called synchronously from manager task when event is 
+ * posted, before event loop handlers. Event data is borrowed - valid only during call. 
+ * Callback must not block, it delays all manager processing
+ *
+ * @param[in] event_id Manager event ID
+ * @param[in] event_data Event data, same as event loop event data. NULL for events without data
+ * @param[in] event_data_size Event data size
+ * @param[in] cb_arg User argument passed to wm_register_direct_cb
+*/
+typedef void (*wm_direct_cb_t)(int32_t event_id, const void *event_data, size_t event_data_size, void *cb_arg);
+
+/**
+ * @brief Type of manager command. Commands are executed in order by manager task
+*/
+typedef struct wm_cmd {
+    wm_cmd_id_t cmd_id;                         /*!< Command ID                                                     */
+    union {
+        wm_net_base_config_t net_config;        /*!< WM_CMD_KN_ADD, WM_CMD_AP_CONFIG                                */
+        struct {
+            uint32_t net_config_id;             /*!< Known network ID. 0 selects network by SSID                    */
+            char ssid[33];                      /*!< Known network SSID                                             */
+            esp_ip4_addr_t dns_ip;              /*!< DNS server address                                             */
+        } net_ref;                              /*!< WM_CMD_KN_DEL, WM_CMD_STA_DNS, WM_CMD_SEC_DNS                  */
+        struct {
+            wm_kn_bulk_entry_t *entries;        /*!< Entries array. Must stay valid until command completion        */
+            size_t count;                       /*!< Number of entries                                              */
+            bool replace_all;                   /*!< Remove all known networks not added by this transaction        */
+        } bulk;                                 /*!< WM_CMD_KN_BULK                                                 */
+        char country_code[3];                   /*!< WM_CMD_SET_COUNTRY                                             */
+        wm_power_profile_t power_profile;       /*!< WM_CMD_POWER_PROFILE                                           */
+        struct {
+            char host[64];                      /*!< Probe host. Empty string disables probe                        */
+            char path[64];                      /*!< Probe HTTP path                                                */
+            uint16_t port;                      /*!< Probe TCP port                                                 */
+            uint16_t expected_status;           /*!< Expected HTTP status                                           */
+        } inet_probe;                           /*!< WM_CMD_INET_PROBE                                              */
+        wm_cfg_image_t *cfg_image;              /*!< WM_CMD_CFG_EXPORT, WM_CMD_CFG_IMPORT. Valid until completion   */
+        wm_ap_profile_t ap_profile;             /*!< WM_CMD_AP_PROFILE                                              */
+        struct {
+            int32_t event_id;                   /*!< Manager event ID                                               */
+            wm_direct_cb_t cb;                  /*!< Callback                                                       */
+            void *cb_arg;                       /*!< Callback argument                                              */
+            bool add;                           /*!< Register when true, remove otherwise                           */
+        } direct_cb;                            /*!< WM_CMD_DIRECT_CB                                               */
+    };
+} wm_cmd_t;
+
+/**
+ * @brief Command completion callback. Called from manager task context
+ *
+ * @param[in] cmd Executed command
+ * @param[in] result Command result
+ * @param[in] cb_arg User argument passed to wm_cmd_submit
+*/
+typedef void (*wm_cmd_done_cb_t)(const wm_cmd_t *cmd, esp_err_t result, void *cb_arg);
+
+#define WM_CMD_WAIT_FOREVER UINT32_MAX  /*!< wm_cmd_exec timeout for unlimited wait */
+
 /**
  * Control Interface functions
 */
@@ -124,6 +426,39 @@ typedef struct wm_known_net_config {
 */
 esp_err_t wm_init_wifi_manager( wm_apmode_config_t *full_ap_cfg, esp_event_loop_handle_t *p_uevent_loop);
 
+/**
+ * @brief Stop WiFi manager and release all resources. Manager tasks exit, event handlers 
+ * are unregistered and WiFi driver is deinitialized. No other WiFi manager function may 
+ * run concurrently. Must not be called from WiFi manager event handler
+ * 
+ * @return 
+ *  - ESP_OK Succeed
+ *  - ESP_ERR_NOT_ALLOWED WiFi manager not initialized
+ *  - ESP_ERR_INVALID_STATE Called from manager task context
+*/
+esp_err_t wm_deinit_wifi_manager(void);
+
+/**
+ * @brief Stop radio i.e. for OTA or other heavy local job. Known networks, blacklist 
+ * and connected AP are kept
+ * 
+ * @return 
+ *  - ESP_OK Succeed
+ *  - ESP_ERR_NOT_ALLOWED WiFi manager not initialized
+ *  - Other - Refer to esp_wifi_stop error codes
+*/
+esp_err_t wm_suspend_wifi_manager(void);
+
+/**
+ * @brief Restart radio. AP connected before suspend is reconnected directly without scan
+ * 
+ * @return 
+ *  - ESP_OK Succeed
+ *  - ESP_ERR_NOT_ALLOWED WiFi manager not initialized
+ *  - Other - Refer to esp_wifi_start error codes
+*/
+esp_err_t wm_resume_wifi_manager(void);
+
 /**
  * @brief Add new known netowrk by SSID and Password
  * 
@@ -140,6 +475,8 @@ esp_err_t wm_add_known_network( char *ssid, char *pwd );
 
 /**
  * @brief Add known network with full configuration (i.e. Static IP, Custom DNS server address...)
+ * Networks with hidden flag set are searched with directed probe requests when 
+ * broadcast scan does not find any known network
  * 
  * @param[in] known_network Pointer to full Wireless network coniguration
  * 
@@ -151,6 +488,25 @@ esp_err_t wm_add_known_network( char *ssid, char *pwd );
 */
 esp_err_t wm_add_known_network_config( wm_net_base_config_t *known_network);
 
+/**
+ * @brief Add, replace and delete many known networks in single transaction.
+ * All entries are validated and memory is allocated before known networks list is changed. 
+ * Changes are published as single snapshot and only when all entries are valid and result 
+ * fits in MAX_KNOWN_NETWORKS. Single WM_EVENT_KN_BULK_DONE event is posted.
+ * 
+ * @param[in,out] entries Array of operations. Result and net_config_id are filled per entry
+ * @param[in] count Number of entries
+ * @param[in] replace_all Remove all known networks not added by this transaction
+ * 
+ * @return 
+ *  - ESP_OK All entries applied
+ *  - ESP_ERR_NOT_FOUND Transaction applied, but delete found no network. Reported in entry result and summary
+ *  - ESP_ERR_INVALID_ARG One or more entries invalid. Nothing applied
+ *  - ESP_ERR_NOT_ALLOWED MAX_KNOWN_NETWORKS would be exceeded. Nothing applied
+ *  - ESP_ERR_NO_MEM Out of memory. Nothing applied
+*/
+esp_err_t wm_bulk_known_networks(wm_kn_bulk_entry_t *entries, size_t count, bool replace_all);
+
 /**
  * @brief Set WiFi country code 
  * 
@@ -225,6 +581,136 @@ void wm_del_known_net_by_id( uint32_t known_network_id );
 */
 void wm_del_known_net_by_ssid( char *ssid );
 
+/**
+ * @brief Notify manager for softAP client traffic. Scan slices are postponed
+ * while softAP clients are active. Call from application servers running on softAP,
+ * provisioning portal calls it for every HTTP request and DNS query.
+ * 
+ * @return
+*/
+void wm_ap_activity_notify(void);
+
+/**
+ * @brief Select power profile. Profile is applied immediately when station is connected 
+ * and softAP is stopped and on every next state change. Listen interval is applied on 
+ * next association
+ * 
+ * @param[in] profile Power profile
+ * 
+ * @return
+ *  - ESP_OK Succeed
+ *  - ESP_ERR_INVALID_ARG Unknown profile
+ *  - ESP_ERR_NOT_ALLOWED Manager not initialized
+*/
+esp_err_t wm_set_power_profile(wm_power_profile_t profile);
+
+/**
+ * @brief Apply softAP performance profile. Security, client limit and beacon interval are 
+ * applied with AP reconfiguration, bandwidth and inactivity timeout directly - WiFi is not 
+ * restarted. Connected stations may reassociate
+ * 
+ * @param[in] profile softAP profile
+ * 
+ * @return
+ *  - ESP_OK Succeed
+ *  - ESP_ERR_INVALID_ARG Profile out of range
+ *  - ESP_ERR_NOT_ALLOWED Manager not initialized
+ *  - Other - Refer to esp_wifi_set_config error codes
+*/
+esp_err_t wm_set_ap_profile(const wm_ap_profile_t *profile);
+
+/**
+ * @brief Get applied softAP performance profile
+ * 
+ * @param[out] profile softAP profile. Zero filled when manager not initialized
+ * 
+ * @return
+*/
+void wm_get_ap_profile(wm_ap_profile_t *profile);
+
+/**
+ * @brief Set internet reachability probe target. Applied on next STA connection
+ * 
+ * @param[in] host Host name or IPv4 address as NULL terminated string. NULL disables probe
+ * @param[in] port TCP port
+ * @param[in] path HTTP path as NULL terminated string
+ * @param[in] expected_status HTTP status code expected from probe target
+ * 
+ * @return
+ *  - ESP_OK Succeed
+ *  - ESP_ERR_INVALID_ARG Host or path too long
+ *  - ESP_ERR_NOT_ALLOWED Manager not initialized
+*/
+esp_err_t wm_set_inet_probe(const char *host, uint16_t port, const char *path, uint16_t expected_status);
+
+/**
+ * @brief Export full configuration as binary image. AP with its profile, country, 
+ * known networks with IP and DNS settings, secondary DNS, power profile, STA retries 
+ * and internet probe target are included. Image format is defined in wm_config_codec.h
+ * 
+ * @param[out] buf Image buffer. NULL to get required size
+ * @param[in,out] size Buffer size in, image size out
+ * 
+ * @return
+ *  - ESP_OK Succeed
+ *  - ESP_ERR_INVALID_SIZE Buffer too small. Required size is returned in size
+ *  - ESP_ERR_NO_MEM Out of memory
+ *  - ESP_ERR_NOT_ALLOWED Manager not initialized
+*/
+esp_err_t wm_export_config(uint8_t *buf, size_t *size);
+
+/**
+ * @brief Import binary configuration image. Image and all settings are validated 
+ * before any change. Country must be in channel plan, AP channel is clamped to it. 
+ * Image without AP profile keeps running profile. Known networks are replaced in one 
+ * transaction. Running configuration is unchanged 
+ * on error, WM_EVENT_CFG_IMPORTED is posted on success only
+ * 
+ * @param[in] buf Image
+ * @param[in] size Image size
+ * 
+ * @return
+ *  - ESP_OK Succeed
+ *  - ESP_ERR_INVALID_CRC Integrity check failed
+ *  - ESP_ERR_INVALID_VERSION Unsupported image version
+ *  - ESP_ERR_INVALID_SIZE Truncated image
+ *  - ESP_ERR_INVALID_ARG Malformed image, invalid setting or unknown country
+ *  - ESP_ERR_NOT_ALLOWED Manager not initialized or too many known networks
+ *  - Other Driver rejected configuration
+*/
+esp_err_t wm_import_config(const uint8_t *buf, size_t size);
+
+/**
+ * @brief Queue command for manager task. All configuration changes are executed
+ * by manager task in submit order. Setter APIs above are blocking wrappers of this function
+ *
+ * @param[in] cmd Command. Copied to queue
+ * @param[in] done_cb Completion callback called from manager task. NULL for none
+ * @param[in] cb_arg User argument for completion callback
+ *
+ * @return
+ *  - ESP_OK Command queued
+ *  - ESP_ERR_INVALID_ARG Unknown command
+ *  - ESP_ERR_TIMEOUT Command queue full
+ *  - ESP_ERR_NOT_ALLOWED Manager not initialized
+*/
+esp_err_t wm_cmd_submit(const wm_cmd_t *cmd, wm_cmd_done_cb_t done_cb, void *cb_arg);
+
+/**
+ * @brief Queue command for manager task and wait for its result.
+ * Called from completion callback command is executed immediately
+ *
+ * @param[in] cmd Command
+ * @param[in] timeout_ms Max wait time for queueing and execution. WM_CMD_WAIT_FOREVER for unlimited
+ *
+ * @return
+ *  - Command result
+ *  - ESP_ERR_TIMEOUT Command not completed in time. It's still executed later
+ *  - ESP_ERR_NO_MEM Out of memory
+ *  - ESP_ERR_NOT_ALLOWED Manager not initialized
+*/
+esp_err_t wm_cmd_exec(const wm_cmd_t *cmd, uint32_t timeout_ms);
+
 /**
  * Info API functions
 */
@@ -239,6 +725,15 @@ void wm_del_known_net_by_ssid( char *ssid );
 */
 wm_known_net_config_t *wm_get_known_networks(size_t *size);
 
+/**
+ * @brief Get version of published known networks snapshot. Version is incremented
+ * on every known networks change. Readers never block manager task
+ * 
+ * @return 
+ *      - Snapshot version, 0 when manager not initialized
+*/
+uint32_t wm_get_known_networks_version(void);
+
 /**
  * @brief Get wireless configuration of current AP mode internal settings
  * 
@@ -248,6 +743,142 @@ wm_known_net_config_t *wm_get_known_networks(size_t *size);
 */
 void wm_get_ap_config(wm_net_base_config_t *ap_conf);
 
+/**
+ * @brief Get last STA link quality sample
+ * 
+ * @param[out] link Link quality sample. Zero filled when station is not connected
+ * 
+ * @return
+*/
+void wm_get_link_quality(wm_link_quality_t *link);
+
+/**
+ * @brief Get result of last internet reachability probe
+ * 
+ * @param[out] result Probe result
+ * 
+ * @return
+*/
+void wm_get_inet_probe_result(wm_inet_probe_result_t *result);
+
+/**
+ * @brief Get last STA DNS servers race result
+ * 
+ * @param[out] health DNS servers health. Empty when race is disabled or not finished
+ * 
+ * @return
+*/
+void wm_get_dns_health(wm_dns_health_t *health);
+
+/**
+ * @brief Get heap use per manager operation and manager tasks stack high-water marks. 
+ * Benchmark (test/host/test_footprint.c, examples/footprint_bench) runs operations 
+ * and compares footprint with budgets
+ * 
+ * @param[out] fp Memory footprint. Empty when footprint meter is disabled
+ * 
+ * @return
+*/
+void wm_get_footprint(wm_footprint_t *fp);
+
+/**
+ * @brief Copy driver event trace log. Log format and host replay engine are in 
+ * wm_trace.h. Capture starts at manager init and stops when log buffer is full. 
+ * Capture waits while log is copied, interrupts are not disabled
+ * 
+ * @param[out] buf Log buffer. NULL to get log length
+ * @param[in] size Log buffer size
+ * @param[in] restart Start new log after copy
+ * 
+ * @return
+ *  - Log length. 0 when buffer is too small or trace capture is disabled
+*/
+size_t wm_get_trace(uint8_t *buf, size_t size, bool restart);
+
+/**
+ * @brief Get timing breakdown of last STA connection attempts
+ * 
+ * @param[out] profiles Array for attempts, newest first
+ * @param[in] max_count Array size
+ * 
+ * @return
+ *  - Number of attempts copied
+*/
+size_t wm_get_conn_profiles(wm_conn_profile_t *profiles, size_t max_count);
+
+/**
+ * @brief Get count of stuck state recoveries done by watchdog
+ * 
+ * @param[out] stats Recovery counters
+ * 
+ * @return
+*/
+void wm_get_wd_stats(wm_wd_stats_t *stats);
+
+/**
+ * @brief Get cached access points. Cache merges results of all manager broadcast and 
+ * per-channel scans deduplicated by BSSID. Hidden networks are not listed. Applications 
+ * should use cached results and wm_scan_now instead of own scans
+ * 
+ * @param[in] filter Query filter. NULL for all entries
+ * @param[out] entries Array for scan results
+ * @param[in] max_count Array size
+ * 
+ * @return
+ *  - Number of entries copied
+*/
+size_t wm_get_scan_results(const wm_scan_filter_t *filter, wm_scan_entry_t *entries, size_t max_count);
+
+/**
+ * @brief Request broadcast scan. Never waits for manager task. Request is queued in scan 
+ * scheduler and coalesced with pending requests and scans. WM_EVENT_SCAN_RESULTS is posted 
+ * when results are cached. Cache younger than coalesce time is reported without new scan.
+ * With stations on softAP request is served by softAP slice scheduler in idle windows and
+ * completed after one round of all channels. Request made while suspended is served after resume
+ * 
+ * @return
+ *  - ESP_OK Request queued
+ *  - ESP_ERR_TIMEOUT Command queue full
+ *  - ESP_ERR_NOT_ALLOWED Manager not initialized
+*/
+esp_err_t wm_scan_now(void);
+
+/**
+ * @brief Register direct callback for manager event. Callback is called from manager 
+ * task with borrowed event data, without event loop queueing and task switch. Event 
+ * is still posted to event loop. Events posted outside manager task (init, SNTP, scan task) 
+ * are copied to manager queue and callbacks run in manager task in post order. Manager API 
+ * calls from callback are queued and run after current event - return value reports queueing 
+ * only. Calls waiting for completion (deinit, bulk known networks, configuration export and 
+ * import) return ESP_ERR_INVALID_STATE
+ * 
+ * @param[in] event_id Manager event ID
+ * @param[in] cb Callback
+ * @param[in] cb_arg Callback argument
+ * 
+ * @return
+ *  - ESP_OK Succeed
+ *  - ESP_ERR_INVALID_ARG Invalid event ID or NULL callback
+ *  - ESP_ERR_NO_MEM All WIFIMGR_DIRECT_CB_MAX slots in use
+ *  - ESP_ERR_NOT_SUPPORTED Direct callbacks disabled
+ *  - ESP_ERR_NOT_ALLOWED Manager not initialized
+*/
+esp_err_t wm_register_direct_cb(int32_t event_id, wm_direct_cb_t cb, void *cb_arg);
+
+/**
+ * @brief Remove direct callback registered by wm_register_direct_cb
+ * 
+ * @param[in] event_id Manager event ID
+ * @param[in] cb Callback
+ * 
+ * @return
+ *  - ESP_OK Succeed
+ *  - ESP_ERR_NOT_FOUND Callback not registered for event
+ *  - ESP_ERR_NOT_SUPPORTED Direct callbacks disabled
+ *  - ESP_ERR_NOT_ALLOWED Manager not initialized
+*/
+esp_err_t wm_unregister_direct_cb(int32_t event_id, wm_direct_cb_t cb);
+
 /**
  * @brief Get internal ID for known network SSID
  * 
@@ -258,6 +889,15 @@ void wm_get_ap_config(wm_net_base_config_t *ap_conf);
 */
 uint32_t wm_get_kn_config_id(char *ssid);
 
+/**
+ * @brief Get power save status and estimated radio duty cycle
+ * 
+ * @param[out] stats Power save status
+ * 
+ * @return
+*/
+void wm_get_power_stats(wm_power_stats_t *stats);
+
 /**
  * Helper functions
 */
@@ -0,0 +1,148 @@
+/*
+ * SPDX-FileCopyrightText: 2024 Rossen Dobrinov
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/*
+ * Copyright 2024 Rossen Dobrinov
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * Binary configuration image codec. Plain C without ESP-IDF dependencies -
+ * same sources build on host for provisioning tools.
+ *
+ * Image layout, all fields little-endian:
+ *  - Header   'W' 'M' 'C' 'F' | version u8 | reserved u8 | records length u16
+ *  - Records  type u8 | length u8 | value
+ *  - Trailer  CRC32 (IEEE 802.3) of header and records
+ *
+ * Unknown record types are skipped. IPv4 addresses are stored in network
+ * byte order and held in lwIP ip4_addr_t.addr layout
+*/
+
+#ifndef _WM_CONFIG_CODEC_H_
+#define _WM_CONFIG_CODEC_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#define WM_CFG_VERSION      1       /*!< Image format version               */
+#define WM_CFG_MAX_NETS     30      /*!< Max known networks in image        */
+#define WM_CFG_HDR_SIZE     8       /*!< Header size                        */
+#define WM_CFG_NET_REC_SIZE 120     /*!< Max AP or known network record     */
+#define WM_CFG_MAX_SIZE     (WM_CFG_HDR_SIZE + (WM_CFG_MAX_NETS + 1) * WM_CFG_NET_REC_SIZE + 4 + 6 + 4 + 136 + 9 + 4)  /*!< Max image size */
+
+/**
+ * @brief Type of image record
+*/
+typedef enum wm_cfg_rec {
+    WM_CFG_REC_AP = 1,          /*!< AP network and channel         */
+    WM_CFG_REC_KN,              /*!< Known network                  */
+    WM_CFG_REC_COUNTRY,         /*!< Country code                   */
+    WM_CFG_REC_SEC_DNS,         /*!< Secondary DNS server           */
+    WM_CFG_REC_POLICY,          /*!< Power profile and STA retries  */
+    WM_CFG_REC_INET_PROBE,      /*!< Internet probe target          */
+    WM_CFG_REC_AP_PROFILE       /*!< AP performance profile         */
+} wm_cfg_rec_t;
+
+/**
+ * @brief Type of codec result
+*/
+typedef enum wm_cfg_err {
+    WM_CFG_OK,                  /*!< Succeed                        */
+    WM_CFG_ERR_SIZE,            /*!< Buffer too small or truncated  */
+    WM_CFG_ERR_MAGIC,           /*!< Not a configuration image      */
+    WM_CFG_ERR_VERSION,         /*!< Unsupported image version      */
+    WM_CFG_ERR_CRC,             /*!< Integrity check failed         */
+    WM_CFG_ERR_FORMAT           /*!< Malformed record               */
+} wm_cfg_err_t;
+
+/**
+ * @brief Type of network entry in configuration image
+*/
+typedef struct wm_cfg_net {
+    char ssid[33];              /*!< SSID, NULL terminated                          */
+    char password[65];          /*!< Password, NULL terminated                      */
+    bool hidden;                /*!< Hidden SSID                                    */
+    uint32_t ip;                /*!< Static IP, 0 for DHCP                          */
+    uint32_t netmask;           /*!< Static netmask                                 */
+    uint32_t gw;                /*!< Static gateway                                 */
+    uint32_t dns;               /*!< Primary DNS server                             */
+} wm_cfg_net_t;
+
+/**
+ * @brief Type of decoded configuration image
+*/
+typedef struct wm_cfg_image {
+    wm_cfg_net_t ap;                        /*!< AP network                             */
+    uint8_t ap_channel;                     /*!< AP channel, 0 auto                     */
+    char country[3];                        /*!< Country code                           */
+    uint32_t sec_dns;                       /*!< Secondary DNS server                   */
+    uint8_t power_profile;                  /*!< Power profile wm_power_profile_t       */
+    uint8_t max_sta_retry;                  /*!< STA connect retries                    */
+    char inet_host[64];                     /*!< Internet probe host, empty disabled    */
+    char inet_path[64];                     /*!< Internet probe HTTP path               */
+    uint16_t inet_port;                     /*!< Internet probe TCP port                */
+    uint16_t inet_status;                   /*!< Internet probe expected HTTP status    */
+    bool has_ap_profile;                    /*!< AP profile present, older images lack it   */
+    uint8_t ap_security;                    /*!< AP security wm_ap_security_t           */
+    uint8_t ap_bandwidth;                   /*!< AP bandwidth wifi_bandwidth_t          */
+    uint8_t ap_max_clients;                 /*!< AP max connected stations              */
+    uint16_t ap_beacon_interval;            /*!< AP beacon interval in TU               */
+    uint16_t ap_inactive_time;              /*!< AP station inactivity timeout, seconds */
+    uint8_t kn_count;                       /*!< Known networks count                   */
+    wm_cfg_net_t kn[WM_CFG_MAX_NETS];       /*!< Known networks                         */
+} wm_cfg_image_t;
+
+/**
+ * @brief Encode configuration image
+ *
+ * @param[in] image Configuration
+ * @param[out] buf Output buffer. NULL to get required size
+ * @param[in] buf_size Output buffer size
+ *
+ * @return
+ *  - Image size. 0 when buffer is too small or image is invalid
+*/
+size_t wm_cfg_encode(const wm_cfg_image_t *image, uint8_t *buf, size_t buf_size);
+
+/**
+ * @brief Check and decode configuration image
+ *
+ * @param[in] buf Image
+ * @param[in] size Image size
+ * @param[out] image Decoded configuration
+ *
+ * @return
+ *  - WM_CFG_OK Succeed
+ *  - Other - Refer to wm_cfg_err_t
+*/
+wm_cfg_err_t wm_cfg_decode(const uint8_t *buf, size_t size, wm_cfg_image_t *image);
+
+/**
+ * @brief CRC32 (IEEE 802.3) used for image trailer
+ *
+ * @param[in] crc Initial value, 0 for new calculation
+ * @param[in] buf Data
+ * @param[in] len Data length
+ *
+ * @return
+ *  - CRC32
+*/
+uint32_t wm_cfg_crc32(uint32_t crc, const uint8_t *buf, size_t len);
+
+#endif /* _WM_CONFIG_CODEC_H_ */
@@ -0,0 +1,98 @@
+/*
+ * SPDX-FileCopyrightText: 2024 Rossen Dobrinov
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/*
+ * Copyright 2024 Rossen Dobrinov
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+/**
+ * DNS server racing probe. Plain C over BSD sockets without ESP-IDF dependencies -
+ * same sources build on host and race local stand-in DNS servers on any UDP port.
+ *
+ * Single A query for probe host is sent to all servers at the same time from one
+ * socket. Any response with matching ID, including NXDOMAIN, proves server alive.
+ * SERVFAIL and REFUSED count as failed server.
+*/
+
+#ifndef _WM_DNS_PROBE_H_
+#define _WM_DNS_PROBE_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#define WM_DNS_MAX_SERVERS  3       /*!< MAIN, BACKUP and FALLBACK          */
+#define WM_DNS_RTT_FAIL     (-1)    /*!< No valid answer within timeout     */
+#ifndef WM_DNS_PORT
+#define WM_DNS_PORT         53      /*!< Server port, host tests override   */
+#endif
+
+/**
+ * @brief Build DNS A query
+ *
+ * @param[out] buf Query buffer
+ * @param[in] size Buffer size
+ * @param[in] id Transaction ID
+ * @param[in] host Host name
+ *
+ * @return
+ *  - Query length. 0 when host name is invalid or buffer is too small
+*/
+size_t wm_dns_query(uint8_t *buf, size_t size, uint16_t id, const char *host);
+
+/**
+ * @brief Check DNS response against query ID
+ *
+ * @param[in] buf Response
+ * @param[in] len Response length
+ * @param[in] id Expected transaction ID
+ *
+ * @return
+ *  - true Server answered with NOERROR or NXDOMAIN
+*/
+bool wm_dns_response_ok(const uint8_t *buf, size_t len, uint16_t id);
+
+/**
+ * @brief Race DNS servers with parallel queries and measure round trip time
+ *
+ * @param[in] servers IPv4 server addresses in network byte order
+ * @param[in] count Servers count, max WM_DNS_MAX_SERVERS
+ * @param[in] port UDP port, 53 for real servers
+ * @param[in] host Probe host name
+ * @param[in] timeout_ms Max wait for all answers
+ * @param[out] rtt_ms Round trip time per server. WM_DNS_RTT_FAIL when no valid answer
+ *
+ * @return
+ *  - Number of servers answered
+*/
+size_t wm_dns_race(const uint32_t *servers, size_t count, uint16_t port, const char *host, uint32_t timeout_ms, int32_t *rtt_ms);
+
+/**
+ * @brief Order servers by round trip time. Failed servers go last in original order
+ *
+ * @param[in] rtt_ms Round trip time per server
+ * @param[in] count Servers count, max WM_DNS_MAX_SERVERS
+ * @param[out] order Server indexes, fastest first
+ *
+ * @return
+ *
+*/
+void wm_dns_rank(const int32_t *rtt_ms, size_t count, uint8_t *order);
+
+#endif /* _WM_DNS_PROBE_H_ */
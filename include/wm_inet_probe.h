@@ -0,0 +1,91 @@
+/*
+ * SPDX-FileCopyrightText: 2024 Rossen Dobrinov
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/*
+ * Copyright 2024 Rossen Dobrinov
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * Internet reachability probe. Plain C over BSD sockets without ESP-IDF dependencies -
+ * same sources build on host and probe local stand-in HTTP servers on any port.
+ *
+ * Probe host is resolved, connected with timeout and asked for probe path with
+ * single HTTP/1.1 GET. Status line of the response is compared with expected
+ * status - any other status means captive portal.
+*/
+
+#ifndef _WM_INET_PROBE_H_
+#define _WM_INET_PROBE_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+/**
+ * @brief Type of internet reachability probe status
+*/
+typedef enum wm_inet_status {
+    WM_INET_NOT_CHECKED,    /*!< Probe not run                          */
+    WM_INET_OK,             /*!< Expected HTTP status received          */
+    WM_INET_DNS_FAIL,       /*!< Probe host not resolved                */
+    WM_INET_CONNECT_FAIL,   /*!< TCP connect failed or timed out        */
+    WM_INET_HTTP_FAIL,      /*!< No valid HTTP response                 */
+    WM_INET_CAPTIVE         /*!< Unexpected HTTP status, captive portal */
+} wm_inet_status_t;
+
+/**
+ * @brief Type of internet reachability probe result. Passed as event data for 
+ * WM_EVENT_INET_OK, WM_EVENT_INET_FAIL and WM_EVENT_CAPTIVE_PORTAL events
+*/
+typedef struct wm_inet_probe_result {
+    wm_inet_status_t status;    /*!< Probe status                   */
+    uint16_t http_status;       /*!< Received HTTP status code      */
+    uint16_t dns_ms;            /*!< DNS resolution time            */
+    uint16_t connect_ms;        /*!< TCP connect time               */
+    uint16_t http_ms;           /*!< HTTP request to response time  */
+} wm_inet_probe_result_t;
+
+/**
+ * @brief Parse HTTP response status line
+ *
+ * @param[in] buf Response start
+ * @param[in] len Response length
+ * @param[out] http_status Status code
+ *
+ * @return
+ *  - true Valid status line
+*/
+bool wm_inet_parse_status(const char *buf, size_t len, uint16_t *http_status);
+
+/**
+ * @brief Resolve probe host, connect and request probe path. Measure 
+ * time spent in each step
+ *
+ * @param[in] host Probe host
+ * @param[in] port Probe TCP port
+ * @param[in] path Probe HTTP path
+ * @param[in] expected_status Expected HTTP status
+ * @param[in] timeout_ms Connect, send and receive timeout
+ * @param[out] result Probe result
+ *
+ * @return
+ *
+*/
+void wm_inet_probe(const char *host, uint16_t port, const char *path, uint16_t expected_status, uint32_t timeout_ms, wm_inet_probe_result_t *result);
+
+#endif /* _WM_INET_PROBE_H_ */
@@ -0,0 +1,122 @@
+/*
+ * SPDX-FileCopyrightText: 2024 Rossen Dobrinov
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/*
+ * Copyright 2024 Rossen Dobrinov
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * Fixed item pool with heap fallback. Plain C without ESP-IDF dependencies -
+ * same sources build on host.
+ *
+ * Items are taken from caller provided storage. Free items are linked through
+ * their first bytes, so item size must hold a pointer. When storage is exhausted
+ * items come from heap and are returned to heap on release - steady state
+ * allocate and release cycles never touch heap. Heap functions can be replaced
+ * so owner accounts heap items with the rest of its memory.
+*/
+
+#ifndef _WM_POOL_H_
+#define _WM_POOL_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+/**
+ * @brief Zeroed heap allocation, calloc semantics
+*/
+typedef void *(*wm_pool_calloc_t)(size_t n, size_t size);
+
+/**
+ * @brief Heap release, free semantics
+*/
+typedef void (*wm_pool_free_t)(void *ptr);
+
+/**
+ * @brief Type of item pool
+*/
+typedef struct wm_pool {
+    uint8_t *base;              /*!< Items storage                      */
+    size_t item_size;           /*!< Item size, at least pointer size   */
+    size_t count;               /*!< Items in storage                   */
+    size_t available;           /*!< Free items in storage              */
+    void *free_list;            /*!< First free item                    */
+    wm_pool_calloc_t heap_calloc;   /*!< Heap allocation when storage is exhausted  */
+    wm_pool_free_t heap_free;       /*!< Heap release of items not in storage       */
+} wm_pool_t;
+
+/**
+ * @brief Initialize pool over storage. All items are free, heap items use
+ * calloc and free
+ *
+ * @param[out] pool Pool
+ * @param[in] base Items storage
+ * @param[in] item_size Item size
+ * @param[in] count Items in storage
+ *
+ * @return
+ *
+*/
+void wm_pool_init(wm_pool_t *pool, void *base, size_t item_size, size_t count);
+
+/**
+ * @brief Replace heap functions. Set before first heap item is allocated
+ *
+ * @param[in] pool Pool
+ * @param[in] heap_calloc Zeroed allocation, NULL restores calloc
+ * @param[in] heap_free Release, NULL restores free
+ *
+ * @return
+ *
+*/
+void wm_pool_set_heap(wm_pool_t *pool, wm_pool_calloc_t heap_calloc, wm_pool_free_t heap_free);
+
+/**
+ * @brief Get zeroed item. Heap is used only when storage is exhausted
+ *
+ * @param[in] pool Pool
+ *
+ * @return
+ *  - Item or NULL when out of memory
+*/
+void *wm_pool_alloc(wm_pool_t *pool);
+
+/**
+ * @brief Release item to storage or heap
+ *
+ * @param[in] pool Pool
+ * @param[in] item Item from wm_pool_alloc, NULL is ignored
+ *
+ * @return
+ *
+*/
+void wm_pool_free(wm_pool_t *pool, void *item);
+
+/**
+ * @brief Check if item belongs to pool storage
+ *
+ * @param[in] pool Pool
+ * @param[in] item Item
+ *
+ * @return
+ *  - true Item is in storage, false heap item
+*/
+bool wm_pool_owns(const wm_pool_t *pool, const void *item);
+
+#endif /* _WM_POOL_H_ */
@@ -0,0 +1,62 @@
+/*
+ * SPDX-FileCopyrightText: 2024 Rossen Dobrinov
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/*
+ * Copyright 2024 Rossen Dobrinov
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+/**
+ * Provisioning portal on softAP. Runs while softAP is up when enabled in Kconfig:
+ *  - DNS catch-all answering every A query with softAP address
+ *  - GET /           gzip compressed page served from flash
+ *  - GET /scan       cached scan results as JSON array
+ *  - POST /connect   form fields ssid, password, hidden - queues known network add
+ *  - Any other URI   redirect to portal page for OS captive portal detection
+ * Handlers only queue commands and never wait for manager task - manager task stops the
+ * portal and waits for running handler to return.
+*/
+
+#ifndef _WM_PORTAL_H_
+#define _WM_PORTAL_H_
+
+#include "esp_err.h"
+#include "esp_netif.h"
+
+/**
+ * @brief Start portal HTTP server and DNS catch-all. Called by manager task when softAP starts
+ *
+ * @param[in] ap_iface softAP network interface
+ *
+ * @return
+ *  - ESP_OK Succeed or portal already running
+ *  - ESP_ERR_INVALID_STATE softAP address not available
+ *  - ESP_ERR_NO_MEM DNS task not created
+ *  - Other - Refer to httpd_start error codes
+*/
+esp_err_t wm_portal_start(esp_netif_t *ap_iface);
+
+/**
+ * @brief Stop portal and release all resources. Called by manager task when softAP stops.
+ * Must not be called from portal HTTP handler
+ *
+ * @return
+*/
+void wm_portal_stop(void);
+
+#endif /* _WM_PORTAL_H_ */
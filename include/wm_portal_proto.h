@@ -0,0 +1,88 @@
+/*
+ * SPDX-FileCopyrightText: 2024 Rossen Dobrinov
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/*
+ * Copyright 2024 Rossen Dobrinov
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+/**
+ * Provisioning portal protocol helpers. Plain C without ESP-IDF dependencies -
+ * same sources build on host for portal tests with local DNS and HTTP clients.
+*/
+
+#ifndef _WM_PORTAL_PROTO_H_
+#define _WM_PORTAL_PROTO_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#define WM_DNS_MAX_MSG      512     /*!< Max DNS message size over UDP      */
+
+/**
+ * @brief Turn DNS query into catch-all answer in place. Every A query is answered with 
+ * portal address, other query types get empty answer
+ *
+ * @param[in,out] msg DNS message buffer
+ * @param[in] len Query length
+ * @param[in] buf_size Buffer size
+ * @param[in] ip Portal IPv4 address in network byte order
+ *
+ * @return
+ *  - Answer length. 0 when query is malformed and must be dropped
+*/
+size_t wm_dns_catch_all(uint8_t *msg, size_t len, size_t buf_size, uint32_t ip);
+
+/**
+ * @brief Get URL decoded value from application/x-www-form-urlencoded body
+ *
+ * @param[in] body Form body, NULL terminated
+ * @param[in] key Field name
+ * @param[out] value Decoded value, NULL terminated
+ * @param[in] value_size Value buffer size
+ *
+ * @return
+ *  - true Field found and fits in value buffer
+*/
+bool wm_form_value(const char *body, const char *key, char *value, size_t value_size);
+
+/**
+ * @brief Check WPA passphrase from form: empty for open network, 8 to 63 printable
+ * characters or 64 hex digits raw PSK
+ *
+ * @param[in] password Password, NULL terminated
+ *
+ * @return
+ *  - true Password is valid
+*/
+bool wm_form_password_valid(const char *password);
+
+/**
+ * @brief Escape string for JSON string literal. Control characters are dropped
+ *
+ * @param[out] dst Output buffer
+ * @param[in] dst_size Output buffer size
+ * @param[in] src String, NULL terminated
+ *
+ * @return
+ *  - Escaped length. Output is truncated on whole characters when buffer is too small
+*/
+size_t wm_json_escape(char *dst, size_t dst_size, const char *src);
+
+#endif /* _WM_PORTAL_PROTO_H_ */
@@ -0,0 +1,244 @@
+/*
+ * SPDX-FileCopyrightText: 2024 Rossen Dobrinov
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/*
+ * Copyright 2024 Rossen Dobrinov
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * Driver event trace log codec and replay engine. Plain C without ESP-IDF 
+ * dependencies - same sources build on host to turn field traces into 
+ * regression benchmarks.
+ *
+ * Log layout, all fields little-endian:
+ *  - Header   'W' 'M' 'T' 'R' | version u8 | flags u8 | start time u32 (ms)
+ *  - Records  type u8 | id u16 | length u8 | time delta varint (ms) | data
+ *
+ * Time delta is LEB128 encoded ms since previous record. Records are kept in 
+ * manager receive order - replay is deterministic by record order, not by time
+*/
+
+#ifndef _WM_TRACE_H_
+#define _WM_TRACE_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#define WM_TRACE_VERSION    1       /*!< Log format version                         */
+#define WM_TRACE_HDR_SIZE   10      /*!< Header size                                */
+#define WM_TRACE_DATA_MAX   255     /*!< Max record data, longer data is truncated  */
+#define WM_TRACE_REC_MAX    (4 + 5 + WM_TRACE_DATA_MAX)  /*!< Max record size       */
+#define WM_TRACE_TRUNCATED  0x01    /*!< Header flag - log buffer ran full          */
+
+/**
+ * @brief Type of log record
+*/
+typedef enum wm_trace_rec {
+    WM_TRACE_REC_WIFI = 1,      /*!< WIFI_EVENT, id is event ID, data is driver event data      */
+    WM_TRACE_REC_IP,            /*!< IP_EVENT, id is event ID, data is driver event data        */
+    WM_TRACE_REC_MSG,           /*!< Manager message, id is message type, data is message data  */
+    WM_TRACE_REC_SCAN_AP,       /*!< Scan record read by preceding WIFI_EVENT_SCAN_DONE         */
+    WM_TRACE_REC_EVENT,         /*!< Manager decision, id is posted WM_EVENT ID                 */
+    WM_TRACE_REC_HEAP           /*!< Free heap after message, data is u32                       */
+} wm_trace_rec_t;
+
+/**
+ * @brief Type of codec result
+*/
+typedef enum wm_trace_err {
+    WM_TRACE_OK,                /*!< Succeed                        */
+    WM_TRACE_END,               /*!< No more records                */
+    WM_TRACE_ERR_SIZE,          /*!< Buffer too small or truncated  */
+    WM_TRACE_ERR_MAGIC,         /*!< Not a trace log                */
+    WM_TRACE_ERR_VERSION,       /*!< Unsupported log version        */
+    WM_TRACE_ERR_FORMAT         /*!< Malformed record               */
+} wm_trace_err_t;
+
+/**
+ * @brief Type of log writer
+*/
+typedef struct wm_trace_writer {
+    uint8_t *buf;               /*!< Log buffer                                 */
+    size_t size;                /*!< Log buffer size                            */
+    size_t len;                 /*!< Log length                                 */
+    uint32_t last_ms;           /*!< Time of last record                        */
+    uint32_t dropped;           /*!< Records dropped after buffer ran full      */
+} wm_trace_writer_t;
+
+/**
+ * @brief Type of log reader
+*/
+typedef struct wm_trace_reader {
+    const uint8_t *buf;         /*!< Log                                        */
+    size_t len;                 /*!< Log length                                 */
+    size_t pos;                 /*!< Next record offset                         */
+    uint32_t time_ms;           /*!< Time of last read record since log start   */
+} wm_trace_reader_t;
+
+/**
+ * @brief Type of decoded record. Data points into log
+*/
+typedef struct wm_trace_item {
+    wm_trace_rec_t type;        /*!< Record type                                */
+    uint16_t id;                /*!< Event ID or message type                   */
+    uint32_t time_ms;           /*!< Time since log start                       */
+    uint8_t len;                /*!< Data length                                */
+    const uint8_t *data;        /*!< Data                                       */
+} wm_trace_item_t;
+
+/**
+ * @brief Type of scan record in log. Fields used by known AP selection and channel rating
+*/
+typedef struct wm_trace_ap {
+    uint8_t bssid[6];           /*!< BSSID                                      */
+    char ssid[33];              /*!< SSID, NULL terminated                      */
+    uint8_t primary;            /*!< Primary channel                            */
+    uint8_t second;             /*!< Secondary channel position                 */
+    int8_t rssi;                /*!< RSSI                                       */
+    uint8_t authmode;           /*!< Auth mode                                  */
+} wm_trace_ap_t;
+
+/**
+ * @brief Type of replay callbacks. NULL callbacks are skipped
+*/
+typedef struct wm_trace_replay_ops {
+    void (*input)(const wm_trace_item_t *item, void *arg);                          /*!< Driver event or manager message    */
+    void (*scan_ap)(const wm_trace_ap_t *ap, void *arg);                            /*!< Scan record of last SCAN_DONE      */
+    void (*decision)(const wm_trace_item_t *item, uint32_t latency_ms, void *arg);  /*!< Manager event, ms since last input */
+} wm_trace_replay_ops_t;
+
+/**
+ * @brief Type of replay report
+*/
+typedef struct wm_trace_summary {
+    uint32_t duration_ms;       /*!< Time of last record                        */
+    uint32_t inputs;            /*!< Driver events and manager messages         */
+    uint32_t scan_aps;          /*!< Scan records                               */
+    uint32_t decisions;         /*!< Manager events                             */
+    uint32_t latency_min_ms;    /*!< Min input to decision latency              */
+    uint32_t latency_max_ms;    /*!< Max input to decision latency              */
+    uint32_t latency_avg_ms;    /*!< Average input to decision latency          */
+    uint32_t heap_first;        /*!< First free heap sample, 0 no samples       */
+    uint32_t heap_min;          /*!< Lowest free heap sample                    */
+    uint32_t heap_peak_used;    /*!< Drop from first to lowest free heap        */
+    bool truncated;             /*!< Capture stopped on full buffer             */
+} wm_trace_summary_t;
+
+/**
+ * @brief Start new log in buffer
+ *
+ * @param[out] w Writer
+ * @param[in] buf Log buffer
+ * @param[in] size Log buffer size
+ * @param[in] now_ms Capture start time
+ *
+ * @return
+ *  - true Succeed
+ *  - false Buffer smaller than header
+*/
+bool wm_trace_start(wm_trace_writer_t *w, uint8_t *buf, size_t size, uint32_t now_ms);
+
+/**
+ * @brief Append record. After first record not fitting buffer all records are 
+ * dropped and log is flagged truncated, so log never misses events in the middle
+ *
+ * @param[in] w Writer
+ * @param[in] type Record type
+ * @param[in] id Event ID or message type
+ * @param[in] now_ms Event time
+ * @param[in] data Record data, NULL when len is 0
+ * @param[in] len Data length, truncated to WM_TRACE_DATA_MAX
+ *
+ * @return
+ *  - true Record added
+ *  - false Record dropped
+*/
+bool wm_trace_put(wm_trace_writer_t *w, wm_trace_rec_t type, uint16_t id, uint32_t now_ms, const void *data, size_t len);
+
+/**
+ * @brief Append scan record
+ *
+ * @param[in] w Writer
+ * @param[in] now_ms Event time
+ * @param[in] ap Scan record
+ *
+ * @return
+ *  - true Record added
+ *  - false Record dropped
+*/
+bool wm_trace_put_ap(wm_trace_writer_t *w, uint32_t now_ms, const wm_trace_ap_t *ap);
+
+/**
+ * @brief Check log header and prepare reader
+ *
+ * @param[out] r Reader
+ * @param[in] buf Log
+ * @param[in] len Log length
+ *
+ * @return
+ *  - WM_TRACE_OK Succeed
+ *  - Other - Refer to wm_trace_err_t
+*/
+wm_trace_err_t wm_trace_open(wm_trace_reader_t *r, const uint8_t *buf, size_t len);
+
+/**
+ * @brief Read next record
+ *
+ * @param[in] r Reader
+ * @param[out] item Record
+ *
+ * @return
+ *  - WM_TRACE_OK Record read
+ *  - WM_TRACE_END End of log
+ *  - Other - Refer to wm_trace_err_t
+*/
+wm_trace_err_t wm_trace_next(wm_trace_reader_t *r, wm_trace_item_t *item);
+
+/**
+ * @brief Decode scan record
+ *
+ * @param[in] item WM_TRACE_REC_SCAN_AP record
+ * @param[out] ap Scan record
+ *
+ * @return
+ *  - true Succeed
+ *  - false Not a valid scan record
+*/
+bool wm_trace_get_ap(const wm_trace_item_t *item, wm_trace_ap_t *ap);
+
+/**
+ * @brief Feed log records to callbacks in capture order and report decisions, 
+ * input to decision latencies and free heap samples. Same log gives same 
+ * callback sequence on every run. Engine does not run manager - callbacks feed 
+ * records to a manager instance, host tests post driver events to manager on 
+ * simulated driver (test/host/test_trace.c)
+ *
+ * @param[in] buf Log
+ * @param[in] len Log length
+ * @param[in] ops Callbacks, NULL for report only
+ * @param[in] arg Callbacks argument
+ * @param[out] summary Report, may be NULL
+ *
+ * @return
+ *  - WM_TRACE_OK Succeed
+ *  - Other - Refer to wm_trace_err_t
+*/
+wm_trace_err_t wm_trace_replay(const uint8_t *buf, size_t len, const wm_trace_replay_ops_t *ops, void *arg, wm_trace_summary_t *summary);
+
+#endif /* _WM_TRACE_H_ */
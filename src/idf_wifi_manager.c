@@ -24,10 +24,29 @@
 #include "esp_netif_sntp.h"
 #include "esp_log.h"
 #include "esp_rom_crc.h"
+#include "freertos/timers.h"
+#include "freertos/semphr.h"
+#include "esp_timer.h"
 #include "sdkconfig.h"
+#include "wm_pool.h"
+#if (CONFIG_WIFIMGR_FOOTPRINT == 1) || (CONFIG_WIFIMGR_TRACE == 1)
+#include "esp_heap_caps.h"
+#endif
+#if (CONFIG_WIFIMGR_TRACE == 1)
+#include "wm_trace.h"
+#endif
+#if (CONFIG_WIFIMGR_PORTAL == 1)
+#include "wm_portal.h"
+#endif
+#if (CONFIG_WIFIMGR_DNS_RACE == 1)
+#include "wm_dns_probe.h"
+#endif
 
 #include "esp_log.h"
 
+#define WM_S_TO_TICKS(s)    ((TickType_t)(s) * configTICK_RATE_HZ)  /*!< Seconds to ticks without 32 bit ms overflow */
+#define WM_MAX_STA_RETRY    5   /*!< Upper bound of WIFIMGR_MAX_STA_RETRY Kconfig range */
+
 /**
  * @brief Type of Wireless AP/STA interface coniguration
 */
@@ -40,8 +59,9 @@ typedef struct wm_wifi_iface {
  * @brief Type of Wireless network coniguration for known network node
 */
 typedef struct wm_wifi_base_config {
-    char *ssid;                     /*!< WiFi SSID             */
-    char *password;                 /*!< WiFi Password         */
+    char ssid[33];                  /*!< WiFi SSID             */
+    char password[65];              /*!< WiFi Password         */
+    bool hidden;                    /*!< Hidden SSID flag      */
     wm_net_ip_config_t ip_config;   /*!< Full IPv4 config      */
 } wm_wifi_base_config_t;
 
@@ -51,11 +71,24 @@ typedef struct wm_wifi_base_config {
 typedef struct wm_ll_known_network_node {
     struct {                                 
         wm_wifi_base_config_t net_config;   /*!< Wireless network configuration   */
-        uint32_t net_config_id;             /*!< Unique configuration ID          */
+        uint32_t net_config_id;             /*!< Unique configuration ID, CRC32 of SSID and password */
+        uint32_t ssid_hash;                 /*!< CRC32 of SSID - lookup key and blacklist ID         */
+        uint8_t last_channel;               /*!< Channel where network was last seen, 0 unknown */
     } payload;                              /*!< Node payload structure           */
     struct wm_ll_known_network_node *next;  /*!< Pointer to next linked list node */
 } wm_ll_known_network_node_t;
 
+/**
+ * @brief Type of published known networks snapshot. Immutable after publish,
+ * released by last reader
+*/
+typedef struct wm_kn_snapshot {
+    uint32_t version;                   /*!< Snapshot version, incremented on every publish   */
+    uint16_t refs;                      /*!< Readers holding snapshot, +1 while published      */
+    uint8_t count;                      /*!< Known networks count                              */
+    wm_known_net_config_t nets[];       /*!< Known networks copy in list order                 */
+} wm_kn_snapshot_t;
+
 /**
  * @brief Type of blacklisted AP data
 */
@@ -69,16 +102,343 @@ typedef struct wm_blist_data {
 */
 typedef struct wm_ll_blacklist_node {
     wm_blist_data_t payload;            /*!< Blacklist node payload data        */
+    TickType_t expires;                 /*!< Expiry tick, 0 never expires       */
     struct wm_ll_blacklist_node *next;  /*!< Pointer to next linked list node   */
 } wm_ll_blacklist_node_t;
 
+/**
+ * @brief Type of STA disconnect recovery action
+*/
+typedef enum wm_disc_action {
+    WM_DISC_RETRY,          /*!< Reconnect immediately                                  */
+    WM_DISC_BACKOFF,        /*!< Reconnect after exponential backoff                    */
+    WM_DISC_RESCAN,         /*!< Give up AP and rescan immediately                      */
+    WM_DISC_NEXT,           /*!< Blacklist AP for short time, select next candidate     */
+    WM_DISC_BLACKLIST       /*!< Blacklist AP for long time, select next candidate      */
+} wm_disc_action_t;
+
+/**
+ * @brief Type of disconnect reason classification entry
+*/
+typedef struct wm_disc_class {
+    uint8_t reason;         /*!< Driver disconnect reason wifi_err_reason_t */
+    uint8_t action;         /*!< Recovery action wm_disc_action_t           */
+} wm_disc_class_t;
+
+/**
+ * @brief Type of hidden networks directed scan queue
+*/
+typedef struct wm_hidden_scan_queue {
+    uint32_t net_config_id[CONFIG_WIFIMGR_MAX_KNOWN_NETWORKS];  /*!< Known network IDs ordered by last seen channel */
+    uint8_t count;                                              /*!< Queued probes count                            */
+    uint8_t pos;                                                /*!< Next probe position                            */
+    wifi_scan_channel_bitmap_t channels;                        /*!< Channel bitmap with hidden APs seen in scan    */
+    uint8_t ssid[33];                                           /*!< SSID of probe in progress                      */
+} wm_hidden_scan_queue_t;
+
+/**
+ * @brief Type of softAP client-aware scan scheduler
+*/
+typedef struct wm_ap_scan_sched {
+    TickType_t last_activity;   /*!< Tick of last softAP client activity          */
+    TickType_t last_refill;     /*!< Tick of last off-channel budget refill       */
+    uint32_t budget_ms;         /*!< Available off-channel time                   */
+    uint8_t channel;            /*!< Last sliced channel                          */
+    uint8_t req_slices;         /*!< Slices done since scan request               */
+} wm_ap_scan_sched_t;
+
+/**
+ * @brief Type of power save state holder
+*/
+typedef struct wm_power_state {
+    wm_power_profile_t profile; /*!< Selected power profile                     */
+    wifi_ps_type_t ps_type;     /*!< Applied driver power save type             */
+    TickType_t since;           /*!< Tick when ps_type was applied              */
+    uint64_t on_ticks;          /*!< Estimated radio on time before since, x1000*/
+    uint64_t total_ticks;       /*!< Total time before since                    */
+} wm_power_state_t;
+
+#if (CONFIG_WIFIMGR_LINK_MONITOR == 1)
+/**
+ * @brief Type of STA link quality monitor
+*/
+typedef struct wm_link_monitor {
+    TimerHandle_t timer;        /*!< Sample timer handle                        */
+    int32_t rssi_ewma;          /*!< Smoothed RSSI, 1/16 dBm                    */
+    uint16_t beacon_loss;       /*!< Beacon timeouts counter for current period */
+    wm_link_quality_t link;     /*!< Last link quality sample                   */
+    #if (CONFIG_WIFIMGR_TXP_CONTROL == 1)
+    int8_t txp;                 /*!< Applied max TX power, 0.25 dBm             */
+    int8_t txp_full;            /*!< Full TX power allowed by country, 0.25 dBm */
+    #endif
+} wm_link_monitor_t;
+#endif
+
+#if (CONFIG_WIFIMGR_INET_CHECK == 1)
+/**
+ * @brief Type of internet reachability probe configuration
+*/
+typedef struct wm_inet_probe {
+    char host[64];                      /*!< Probe host, empty disables probe       */
+    char path[64];                      /*!< Probe HTTP path                        */
+    uint16_t port;                      /*!< Probe TCP port                         */
+    uint16_t expected_status;           /*!< Expected HTTP status                   */
+    uint8_t link_seq;                   /*!< STA disconnect counter                 */
+    wm_inet_probe_result_t result;      /*!< Last probe result                      */
+} wm_inet_probe_t;
+#endif
+
+#if (CONFIG_WIFIMGR_FOOTPRINT == 1)
+/**
+ * @brief Type of footprint meter state
+*/
+typedef struct wm_fp_meter {
+    wm_footprint_t stats;                   /*!< Published footprint                    */
+    uint32_t live;                          /*!< Heap allocated by manager and not freed */
+    uint32_t start_live[WM_FP_OP_MAX];      /*!< Manager heap at operation start        */
+    uint32_t peak_live[WM_FP_OP_MAX];       /*!< Manager heap peak during operation     */
+    uint8_t open;                           /*!< Running operations bitmask             */
+} wm_fp_meter_t;
+#endif
+
+#if (CONFIG_WIFIMGR_DIRECT_CB == 1)
+/**
+ * @brief Type of direct event callback registration
+*/
+typedef struct wm_direct_slot {
+    int32_t event_id;                       /*!< Manager event ID                       */
+    wm_direct_cb_t cb;                      /*!< Callback, NULL for free slot           */
+    void *cb_arg;                           /*!< Callback argument                      */
+} wm_direct_slot_t;
+#endif
+
+#if (CONFIG_WIFIMGR_TRACE == 1)
+#define WM_TRACE_HEAP_STEP  256     /*!< Free heap change logged after message  */
+
+/**
+ * @brief Type of driver event trace capture
+*/
+typedef struct wm_trace_capture {
+    SemaphoreHandle_t lock;                 /*!< Log lock. Mutex - log copy may be long */
+    wm_trace_writer_t log;                  /*!< Log writer                             */
+    uint32_t heap_last;                     /*!< Last logged free heap                  */
+    uint8_t buf[CONFIG_WIFIMGR_TRACE_SIZE]; /*!< Log buffer                             */
+} wm_trace_capture_t;
+#endif
+
+#if (CONFIG_WIFIMGR_DNS_RACE == 1)
+/**
+ * @brief Type of STA DNS servers race state
+*/
+typedef struct wm_dns_race_state {
+    TimerHandle_t timer;                /*!< Re-evaluation timer                    */
+    uint8_t link_seq;                   /*!< STA disconnect counter                 */
+    bool probing;                       /*!< Race task running                      */
+    bool validate;                      /*!< Continue GOT_IP validation after race  */
+    wm_dns_health_t health;             /*!< Last race result in applied order      */
+} wm_dns_race_state_t;
+#endif
+
+/**
+ * @brief Type of manager task queue message
+*/
+typedef enum wm_msg_type {
+    WM_MSG_CMD,             /*!< API command            */
+    WM_MSG_WIFI_EVENT,      /*!< WiFi driver event      */
+    WM_MSG_IP_EVENT,        /*!< IP event               */
+    WM_MSG_SCAN_TICK,       /*!< Scan task period       */
+    WM_MSG_INET_RESULT,     /*!< Reachability result    */
+    WM_MSG_SNTP_SYNC,       /*!< SNTP time synchronized */
+    WM_MSG_RECONNECT,       /*!< Backoff reconnect      */
+    WM_MSG_WATCHDOG,        /*!< Watchdog deadline hit  */
+    WM_MSG_DNS_CHECK,       /*!< DNS race period        */
+    WM_MSG_DNS_RESULT,      /*!< DNS race result        */
+    WM_MSG_EXIT,            /*!< Manager task exit      */
+    WM_MSG_SIGNAL,          /*!< Wake for pending signals */
+    WM_MSG_RESYNC,          /*!< Driver state resync    */
+    WM_MSG_LINK_SAMPLE,     /*!< Link monitor period    */
+    WM_MSG_DIRECT           /*!< Deferred direct callbacks */
+} wm_msg_type_t;
+
+/**
+ * @brief Type of driver event data copied to manager queue
+*/
+typedef union wm_driver_event_data {
+    wifi_event_sta_scan_done_t scan_done;               /*!< WIFI_EVENT_SCAN_DONE           */
+    wifi_event_sta_disconnected_t sta_disconnected;     /*!< WIFI_EVENT_STA_DISCONNECTED    */
+    wifi_event_ap_staconnected_t ap_staconnected;       /*!< WIFI_EVENT_AP_STACONNECTED     */
+    wifi_event_ap_stadisconnected_t ap_stadisconnected; /*!< WIFI_EVENT_AP_STADISCONNECTED  */
+    ip_event_got_ip_t got_ip;                           /*!< IP_EVENT_STA_GOT_IP            */
+} wm_driver_event_data_t;
+
+#if (CONFIG_WIFIMGR_DIRECT_CB == 1)
+/**
+ * @brief Type of manager event data copied to manager queue. Events posted outside manager task.
+ * Every posted payload must fit - checked by wm_event_post at compile time
+*/
+typedef union wm_direct_data {
+    uint32_t id;                                        /*!< Scan results count, known network ID */
+    esp_netif_ip_info_t ip_info;                        /*!< WM_EVENT_GOT_IP                */
+    struct timeval time;                                /*!< WM_EVENT_GOT_TIME              */
+    wifi_ap_record_t ap_record;                         /*!< WM_EVENT_STA_CONNECT           */
+    wifi_event_ap_staconnected_t ap_staconnected;       /*!< WM_EVENT_AP_STA_CONNECTED      */
+    wifi_event_ap_stadisconnected_t ap_stadisconnected; /*!< WM_EVENT_AP_STA_DISCONNECTED   */
+    wm_kn_bulk_summary_t bulk_summary;                  /*!< WM_EVENT_KN_BULK_DONE          */
+    wm_blist_data_t blist;                              /*!< WM_EVENT_BL_ADD_OK             */
+    wm_wd_stage_t wd_stage;                             /*!< WM_EVENT_WD_RECOVERY           */
+    wm_conn_profile_t conn_profile;                     /*!< WM_EVENT_CONN_PROFILE          */
+    wm_fp_report_t fp_report;                           /*!< WM_EVENT_FOOTPRINT_OVER        */
+    wm_inet_probe_result_t inet_result;                 /*!< WM_EVENT_INET_OK               */
+    wm_dns_health_t dns_health;                         /*!< WM_EVENT_DNS_RANKED            */
+} wm_direct_data_t;
+#endif
+
+/**
+ * @brief Type of manager task queue message
+*/
+typedef struct wm_msg {
+    wm_msg_type_t type;                             /*!< Message type                   */
+    union {
+        struct {
+            wm_cmd_t cmd;                           /*!< Command                        */
+            wm_cmd_done_cb_t done_cb;               /*!< Completion callback            */
+            void *cb_arg;                           /*!< Completion callback argument   */
+        } cmd;                                      /*!< WM_MSG_CMD                     */
+        struct {
+            int32_t event_id;                       /*!< Driver event ID                */
+            wm_driver_event_data_t event_data;      /*!< Driver event data copy         */
+        } event;                                    /*!< WM_MSG_WIFI_EVENT, WM_MSG_IP_EVENT */
+        #if (CONFIG_WIFIMGR_DIRECT_CB == 1)
+        struct {
+            int32_t event_id;                       /*!< Manager event ID               */
+            uint16_t size;                          /*!< Event data size                */
+            wm_direct_data_t data;                  /*!< Event data copy                */
+        } direct;                                   /*!< WM_MSG_DIRECT                  */
+        #endif
+        #if (CONFIG_WIFIMGR_INET_CHECK == 1)
+        struct {
+            wm_inet_probe_result_t result;          /*!< Probe result                   */
+            uint8_t link_seq;                       /*!< Link sequence at probe start   */
+        } inet;                                     /*!< WM_MSG_INET_RESULT             */
+        #endif
+        #if (CONFIG_WIFIMGR_DNS_RACE == 1)
+        struct {
+            wm_dns_health_t health;                 /*!< Raced servers and round trip   */
+            uint8_t link_seq;                       /*!< Link sequence at race start    */
+        } dns;                                      /*!< WM_MSG_DNS_RESULT              */
+        #endif
+    };
+} wm_msg_t;
+
+/**
+ * @brief Type of blocking command completion holder. Released by last of caller and manager task
+*/
+typedef struct wm_cmd_sync {
+    SemaphoreHandle_t done;     /*!< Completion semaphore           */
+    esp_err_t result;           /*!< Command result                 */
+    uint8_t refs;               /*!< Holder references              */
+} wm_cmd_sync_t;
+
+/**
+ * @brief Type of STA connection attempt phase
+*/
+typedef enum wm_conn_phase {
+    WM_PHASE_SCAN_START,    /*!< First scan of attempt started  */
+    WM_PHASE_SCAN_DONE,     /*!< Last scan of attempt done      */
+    WM_PHASE_CONNECT,       /*!< esp_wifi_connect called        */
+    WM_PHASE_ASSOC,         /*!< STA_CONNECTED received         */
+    WM_PHASE_GOT_IP,        /*!< IP_EVENT_STA_GOT_IP received   */
+    WM_PHASE_SNTP,          /*!< SNTP time synchronized         */
+    WM_PHASE_MAX
+} wm_conn_phase_t;
+
+#if (CONFIG_WIFIMGR_CONN_PROFILER == 1)
+/**
+ * @brief Type of STA connection phase profiler
+*/
+typedef struct wm_conn_profiler {
+    int64_t ts[WM_PHASE_MAX];                                   /*!< Phase timestamps (us), 0 not reached   */
+    uint8_t retries;                                            /*!< Connect retries in attempt             */
+    bool open;                                                  /*!< Attempt in progress                    */
+    uint8_t head;                                               /*!< Next history slot                      */
+    uint8_t count;                                              /*!< Stored attempts                        */
+    wm_conn_profile_t history[CONFIG_WIFIMGR_CONN_PROFILE_HISTORY]; /*!< Last attempts ring buffer          */
+} wm_conn_profiler_t;
+#endif
+
+/**
+ * @brief Type of stuck state watchdog
+*/
+typedef struct wm_watchdog {
+    TickType_t deadline[WM_WD_STAGE_MAX];   /*!< Stage deadline tick, 0 not armed           */
+    uint8_t escalated;                      /*!< Stages with first recovery done (bitmask)  */
+    wifi_mode_t mode;                       /*!< Requested mode of failed mode switch       */
+    wm_wd_stats_t stats;                    /*!< Recovery counters                          */
+    TimerHandle_t timer;                    /*!< Nearest deadline timer                     */
+} wm_watchdog_t;
+
+#define WM_24G_CHANNELS 14  /*!< 2.4 GHz band channels */
+#if (CONFIG_SOC_WIFI_SUPPORT_5G == 1)
+#define WM_5G_CHANNELS  25  /*!< 5 GHz band channels 36-165 */
+#else
+#define WM_5G_CHANNELS  0
+#endif
+#define WM_CHAN_SLOTS   (WM_24G_CHANNELS + WM_5G_CHANNELS)  /*!< Sparse channel table size, 2.4 GHz first */
+#define WM_5G_BIT(slot) (1UL << ((slot) - WM_24G_CHANNELS + 1))   /*!< Driver 5 GHz channel bit of table slot */
+#define WM_5G_MIN_RSSI  (-75)   /*!< Weakest 5 GHz AP preferred over 2.4 GHz AP */
+#define WM_5G_UNII1     0x01    /*!< 5 GHz sub-band 36-48           */
+#define WM_5G_UNII2     0x02    /*!< 5 GHz sub-band 52-64, DFS      */
+#define WM_5G_UNII2E    0x04    /*!< 5 GHz sub-band 100-144, DFS    */
+#define WM_5G_UNII3     0x08    /*!< 5 GHz sub-band 149-165         */
+#define WM_TXP_FULL     84  /*!< Driver max TX power, 0.25 dBm */
+#define WM_TXP_MIN      8   /*!< Driver min TX power, 0.25 dBm */
+
+/**
+ * @brief Type of regulatory channel plan entry
+*/
+typedef struct wm_chan_plan {
+    char cc[2];             /*!< Country code           */
+    uint8_t schan;          /*!< First channel          */
+    uint8_t nchan;          /*!< Channels count         */
+    int8_t max_tx_power;    /*!< Max TX power (dBm)     */
+    uint8_t band5;          /*!< Allowed 5 GHz sub-bands*/
+} wm_chan_plan_t;
+
+#if (CONFIG_SOC_WIFI_SUPPORT_5G == 1)
+/**
+ * @brief Type of 5 GHz channel table entry
+*/
+typedef struct wm_5g_chan {
+    uint8_t channel;        /*!< Channel number         */
+    uint8_t unii;           /*!< Sub-band WM_5G_UNIIx   */
+} wm_5g_chan_t;
+#endif
+
+/**
+ * @brief Type of scan results cache
+*/
+typedef struct wm_scan_cache {
+    wm_scan_entry_t entry[CONFIG_WIFIMGR_SCAN_CACHE_SIZE];  /*!< Cached access points, age_ms unused    */
+    TickType_t seen[CONFIG_WIFIMGR_SCAN_CACHE_SIZE];        /*!< Tick when access point was last seen   */
+    uint8_t count;                                          /*!< Cached entries count                   */
+    TickType_t full_scan;                                   /*!< Tick of last broadcast scan, 0 none    */
+} wm_scan_cache_t;
+
+/**
+ * @brief Type of published scan results cache. Immutable after publish, released by last reader
+*/
+typedef struct wm_scan_snapshot {
+    uint16_t refs;                      /*!< Readers holding snapshot, +1 while published      */
+    wm_scan_cache_t cache;              /*!< Scan results cache copy                           */
+} wm_scan_snapshot_t;
+
 #if (CONFIG_WIFIMGR_AP_CHANNEL == 0)
 /**
  * @brief Type of Airband channel ranking
 */
 typedef struct wm_airband_rank {
-    uint8_t channel[13];    /*!< Count of all AP found in channel   */
-    int8_t rssi[13];        /*!< MAX rssi for channel               */
+    uint8_t channel[WM_CHAN_SLOTS];     /*!< Count of all AP found in channel   */
+    int8_t rssi[WM_CHAN_SLOTS];         /*!< MAX rssi for channel               */
 } wm_airband_rank_t;
 #endif
 
@@ -88,13 +448,26 @@ typedef struct wm_airband_rank {
 typedef struct wm_wifi_mgr_config {
     wm_ll_known_network_node_t *known_networks_head;    /*!< Pointer to first node for known network linked list  */
     wm_ll_blacklist_node_t *blacklist_head;             /*!< Pointer to first node for blacklisted AP linked list */
+    wm_pool_t kn_nodes;                                 /*!< Known network nodes allocator over kn_pool           */
+    wm_ll_known_network_node_t kn_pool[CONFIG_WIFIMGR_MAX_KNOWN_NETWORKS + 1]; /*!< Known network nodes pool, one spare for replace */
     wm_net_base_config_t ap_conf;                       /*!< Access point mode WiFi configuration holder          */
+    wm_ap_profile_t ap_profile;                         /*!< Access point performance profile                     */
+    wifi_second_chan_t ap_second;                       /*!< AP HT40 secondary channel, NONE when not free        */
     wifi_country_t country;                             /*!< Wireless Country Code information holder             */
     esp_ip4_addr_t sec_dns_server;                      /*!< Secondary DNS IPv4 Address                           */
     wm_wifi_iface_t ap;                                 /*!< AP mode interface and driver configuration           */
     wm_wifi_iface_t sta;                                /*!< STA mode interface and driver configuration          */
-    SemaphoreHandle_t kn_Semaphore;                     /*!< Known network list semaphore                         */
-    TaskHandle_t scanTask_handle;                       /*!< Scan task handle ( Not Used)                         */
+    wm_kn_snapshot_t *kn_snapshot;                      /*!< Published known networks for foreign readers         */
+    wm_scan_snapshot_t *scan_snapshot;                  /*!< Published scan results cache for foreign readers     */
+    TaskHandle_t scanTask_handle;                       /*!< Scan task handle                                     */
+    TaskHandle_t lifecycle_waiter;                      /*!< Task waiting for manager tasks exit                  */
+    esp_event_handler_instance_t wifi_evt;              /*!< WIFI_EVENT handler instance                          */
+    esp_event_handler_instance_t ip_evt;                /*!< IP_EVENT handler instance                            */
+    TaskHandle_t mgrTask_handle;                        /*!< Manager task handle                                  */
+    QueueHandle_t mgr_queue;                            /*!< Manager task commands and events queue               */
+    uint32_t signals;                                   /*!< Pending signal messages, bit per wm_msg_type_t       */
+    TickType_t scan_delay;                              /*!< Scan task period set by manager task                 */
+    TimerHandle_t retry_timer;                          /*!< Backoff reconnect timer                              */
     esp_event_loop_handle_t uevent_loop;                /*!< User event loop handler for event notification       */
     union {
         struct {
@@ -105,19 +478,150 @@ typedef struct wm_wifi_mgr_config {
             uint32_t sta_connect_retry:3;       /*!< Currend STA connect retry  */
             uint32_t max_sta_connect_retry:3;   /*!< MAX STA connect retry      */
             uint32_t known_ssid:1;              /*!< Known SSID found flag      */
-            uint32_t ap_channel:4;              /*!< Configured AP channel      */
-            uint32_t scanned_channel:4;         /*!< Number of scanned channel  */
             uint32_t blacklist_reason:1;        /*!< Blacklist reason flag      */
             uint32_t station_connected_to_ap:1; /*!< Flag. Station connected    */
-            uint32_t reserved_7:7;              /*!< Reserved                   */
+            uint32_t hidden_scanning:1;         /*!< Directed probe in progress */
+            uint32_t ap_slice_scan:1;           /*!< softAP client-aware scan   */
+            uint32_t inet_probing:1;            /*!< Reachability probe running */
+            uint32_t kn_publish_pending:1;      /*!< Snapshot publish failed    */
+            uint32_t suspended:1;               /*!< Radio stopped by suspend   */
+            uint32_t resume_sta:1;              /*!< Reconnect STA on resume    */
+            uint32_t scan_req:1;                /*!< Requested scan pending     */
+            uint32_t scan_publish_pending:1;    /*!< Scan publish failed        */
+            uint32_t exiting:1;                 /*!< Deinit waits for probe task*/
         };
         uint32_t state;                         /*!< State wrapper              */
     }; 
+    uint8_t ap_channel;                         /*!< Configured AP channel, 0 auto              */
+    uint8_t scanned_channel;                    /*!< Channel of single channel scan, 0 all      */
     wifi_ap_record_t found_known_ap;            /*!< Found known AP record when scan finnished  */
+    #if (CONFIG_WIFIMGR_AP_CHANNEL == 0)
+    wm_airband_rank_t airband;                  /*!< AP channel ranking, kept between scans     */
+    #endif
+    wm_hidden_scan_queue_t hidden_scan;         /*!< Hidden networks directed scan queue        */
+    wm_ap_scan_sched_t ap_scan;                 /*!< softAP client-aware scan scheduler         */
+    wm_power_state_t power;                     /*!< Power save state                           */
+    #if (CONFIG_WIFIMGR_LINK_MONITOR == 1)
+    wm_link_monitor_t link_mon;                 /*!< STA link quality monitor                   */
+    #endif
+    #if (CONFIG_WIFIMGR_INET_CHECK == 1)
+    wm_inet_probe_t inet;                       /*!< Internet reachability probe                */
+    #endif
+    #if (CONFIG_WIFIMGR_DNS_RACE == 1)
+    wm_dns_race_state_t dns;                    /*!< STA DNS servers race                       */
+    #endif
+    #if (CONFIG_WIFIMGR_CONN_PROFILER == 1)
+    wm_conn_profiler_t prof;                    /*!< Connection phase profiler                  */
+    #endif
+    wm_watchdog_t wd;                           /*!< Stuck state watchdog                       */
+    wm_scan_cache_t scan_cache;                 /*!< Scan results cache, manager task only      */
+    #if (CONFIG_WIFIMGR_DIRECT_CB == 1)
+    wm_direct_slot_t direct[CONFIG_WIFIMGR_DIRECT_CB_MAX];  /*!< Direct event callbacks     */
+    uint8_t direct_depth;                       /*!< Direct callbacks running, manager task only */
+    #endif
 } wm_wifi_mgr_config_t;
 
+/* Single instance - WiFi driver, default netifs and default event loop are process singletons */
 static wm_wifi_mgr_config_t *wm_run_conf = NULL; /*!< Running configuration */
 
+/**
+ * @brief Regulatory channel plans generated from wm_channel_plan.csv at build time
+*/
+static const wm_chan_plan_t wm_chan_plans[] = {
+#define WM_CHAN_PLAN(cc, schan, nchan, max_tx_power, band5) { { cc[0], cc[1] }, schan, nchan, max_tx_power, band5 },
+#include "wm_channel_plan.h"
+#undef WM_CHAN_PLAN
+};
+
+#if (CONFIG_SOC_WIFI_SUPPORT_5G == 1)
+/**
+ * @brief 5 GHz channels in sparse channel table order. Entry n is bit n+1 of driver 5 GHz channel bitmap
+*/
+static const wm_5g_chan_t wm_5g_chans[WM_5G_CHANNELS] = {
+    {  36, WM_5G_UNII1  }, {  40, WM_5G_UNII1  }, {  44, WM_5G_UNII1  }, {  48, WM_5G_UNII1  },
+    {  52, WM_5G_UNII2  }, {  56, WM_5G_UNII2  }, {  60, WM_5G_UNII2  }, {  64, WM_5G_UNII2  },
+    { 100, WM_5G_UNII2E }, { 104, WM_5G_UNII2E }, { 108, WM_5G_UNII2E }, { 112, WM_5G_UNII2E },
+    { 116, WM_5G_UNII2E }, { 120, WM_5G_UNII2E }, { 124, WM_5G_UNII2E }, { 128, WM_5G_UNII2E },
+    { 132, WM_5G_UNII2E }, { 136, WM_5G_UNII2E }, { 140, WM_5G_UNII2E }, { 144, WM_5G_UNII2E },
+    { 149, WM_5G_UNII3  }, { 153, WM_5G_UNII3  }, { 157, WM_5G_UNII3  }, { 161, WM_5G_UNII3  },
+    { 165, WM_5G_UNII3  }
+};
+#endif
+
+/**
+ * @brief Watchdog deadline per stage in ms
+*/
+static const uint32_t wm_wd_timeouts[WM_WD_STAGE_MAX] = {
+    CONFIG_WIFIMGR_WD_CONNECT_TIME,
+    CONFIG_WIFIMGR_WD_DHCP_TIME,
+    CONFIG_WIFIMGR_WD_MODE_TIME,
+    CONFIG_WIFIMGR_WD_SCAN_TIME
+};
+
+/**
+ * @brief Disconnect reason to recovery action table. Not listed reasons use WM_DISC_BACKOFF
+*/
+static const wm_disc_class_t wm_disc_classes[] = {
+    { WIFI_REASON_AUTH_EXPIRE,                      WM_DISC_RETRY       },
+    { WIFI_REASON_ASSOC_EXPIRE,                     WM_DISC_RETRY       },
+    { WIFI_REASON_NOT_AUTHED,                       WM_DISC_RETRY       },
+    { WIFI_REASON_NOT_ASSOCED,                      WM_DISC_RETRY       },
+    { WIFI_REASON_AP_TSF_RESET,                     WM_DISC_RETRY       },
+    { WIFI_REASON_ROAMING,                          WM_DISC_RETRY       },
+    { WIFI_REASON_SA_QUERY_TIMEOUT,                 WM_DISC_RETRY       },
+    { WIFI_REASON_AUTH_LEAVE,                       WM_DISC_BACKOFF     },  /* AP side kick */
+    { WIFI_REASON_ASSOC_LEAVE,                      WM_DISC_BACKOFF     },
+    { WIFI_REASON_CONNECTION_FAIL,                  WM_DISC_BACKOFF     },
+    { WIFI_REASON_ASSOC_COMEBACK_TIME_TOO_LONG,     WM_DISC_BACKOFF     },
+    { WIFI_REASON_BEACON_TIMEOUT,                   WM_DISC_RESCAN      },  /* AP gone or out of range */
+    { WIFI_REASON_NO_AP_FOUND,                      WM_DISC_RESCAN      },
+    { WIFI_REASON_NO_AP_FOUND_IN_RSSI_THRESHOLD,    WM_DISC_RESCAN      },
+    { WIFI_REASON_ASSOC_TOOMANY,                    WM_DISC_NEXT        },  /* AP full */
+    { WIFI_REASON_ASSOC_FAIL,                       WM_DISC_NEXT        },
+    { WIFI_REASON_BSS_TRANSITION_DISASSOC,          WM_DISC_NEXT        },
+    { WIFI_REASON_DISASSOC_PWRCAP_BAD,              WM_DISC_NEXT        },
+    { WIFI_REASON_DISASSOC_SUPCHAN_BAD,             WM_DISC_NEXT        },
+    { WIFI_REASON_MIC_FAILURE,                      WM_DISC_BLACKLIST   },  /* Wrong password */
+    { WIFI_REASON_4WAY_HANDSHAKE_TIMEOUT,           WM_DISC_BLACKLIST   },
+    { WIFI_REASON_GROUP_KEY_UPDATE_TIMEOUT,         WM_DISC_BLACKLIST   },
+    { WIFI_REASON_HANDSHAKE_TIMEOUT,                WM_DISC_BLACKLIST   },
+    { WIFI_REASON_AUTH_FAIL,                        WM_DISC_BLACKLIST   },
+    { WIFI_REASON_802_1X_AUTH_FAILED,               WM_DISC_BLACKLIST   },
+    { WIFI_REASON_IE_INVALID,                       WM_DISC_BLACKLIST   },  /* Incompatible security */
+    { WIFI_REASON_GROUP_CIPHER_INVALID,             WM_DISC_BLACKLIST   },
+    { WIFI_REASON_PAIRWISE_CIPHER_INVALID,          WM_DISC_BLACKLIST   },
+    { WIFI_REASON_AKMP_INVALID,                     WM_DISC_BLACKLIST   },
+    { WIFI_REASON_CIPHER_SUITE_REJECTED,            WM_DISC_BLACKLIST   },
+    { WIFI_REASON_NO_AP_FOUND_W_COMPATIBLE_SECURITY,WM_DISC_BLACKLIST   },
+    { WIFI_REASON_NO_AP_FOUND_IN_AUTHMODE_THRESHOLD,WM_DISC_BLACKLIST   },
+};
+static portMUX_TYPE wm_cmd_sync_lock = portMUX_INITIALIZER_UNLOCKED; /*!< Blocking command holder lock */
+static portMUX_TYPE wm_kn_snapshot_lock = portMUX_INITIALIZER_UNLOCKED; /*!< Snapshot pointer and references lock */
+static portMUX_TYPE wm_wd_lock = portMUX_INITIALIZER_UNLOCKED;          /*!< Watchdog counters lock */
+static portMUX_TYPE wm_sig_lock = portMUX_INITIALIZER_UNLOCKED;         /*!< Manager signals lock */
+static portMUX_TYPE wm_scan_snapshot_lock = portMUX_INITIALIZER_UNLOCKED; /*!< Scan snapshot pointer and references lock */
+static portMUX_TYPE wm_stats_lock = portMUX_INITIALIZER_UNLOCKED;       /*!< Power accounting, link and probe results lock */
+#if (CONFIG_WIFIMGR_CONN_PROFILER == 1)
+static portMUX_TYPE wm_prof_lock = portMUX_INITIALIZER_UNLOCKED;        /*!< Profiler history lock */
+#endif
+#if (CONFIG_WIFIMGR_FOOTPRINT == 1)
+static portMUX_TYPE wm_fp_lock = portMUX_INITIALIZER_UNLOCKED;          /*!< Footprint meter lock */
+static wm_fp_meter_t wm_fp = { 0 };     /*!< Footprint meter. Outlives running configuration to measure init */
+
+/**
+ * @brief Heap budget per operation in bytes, 0 not checked
+*/
+static const uint32_t wm_fp_budgets[WM_FP_OP_MAX] = {
+    CONFIG_WIFIMGR_FP_INIT_HEAP,
+    CONFIG_WIFIMGR_FP_SCAN_HEAP,
+    CONFIG_WIFIMGR_FP_KN_HEAP,
+    CONFIG_WIFIMGR_FP_CONNECT_HEAP
+};
+#endif
+#if (CONFIG_WIFIMGR_TRACE == 1)
+static wm_trace_capture_t wm_trace_cap = { 0 };  /*!< Trace capture. Outlives running configuration to keep log after deinit */
+#endif
+
 /**
  * Internal event functions
 */
@@ -160,878 +664,3978 @@ static void wm_ip_event_handler(void* arg, esp_event_base_t event_base, int32_t
  * @return 
  * 
 */
-static void wm_event_post(int32_t event_id, const void *event_data, size_t event_data_size);
+static void wm_event_post_data(int32_t event_id, const void *event_data, size_t event_data_size);
 
-/**
- * Internal Known network functions
-*/
+#if (CONFIG_WIFIMGR_DIRECT_CB == 1)
+/* Payload is copied for direct callbacks when posted outside manager task */
+#define wm_event_post(event_id, event_data, event_data_size) do { \
+    _Static_assert((event_data_size) <= sizeof(wm_direct_data_t), "Event data does not fit wm_direct_data_t"); \
+    wm_event_post_data((event_id), (event_data), (event_data_size)); \
+} while(0)
+#else
+#define wm_event_post(event_id, event_data, event_data_size) wm_event_post_data((event_id), (event_data), (event_data_size))
+#endif
 
 /**
- * @brief Create an internal known network holder
- * 
- * @param[in] ssid Pointer to NULL terminated string for network SSID
- * @param[in] pwd Pointer to NULL terminated string for network SSID
- * 
- * @return 
- *  - Pointer to newly created holder
+ * @brief Forward WiFi driver and IP events to manager task queue. Event data
+ * is copied, handlers are executed by manager task
+ *
+ * @param[in] arg Data, aside from event data, that is passed when handler is registred
+ * @param[in] event_base The base ID of event received
+ * @param[in] event_id The ID of event received
+ * @param[in] event_data The data, specific to the event
+ *
+ * @return
+ *
 */
-static wm_wifi_base_config_t *wm_create_known_network(char *ssid, char *pwd);
+static void wm_driver_event_forward(void* arg, esp_event_base_t event_base, int32_t event_id, void* event_data);
 
 /**
- * @brief Search for known network by SSID
- * 
- * @param[in] ssid Pointer to NULL terminated string for network SSID
- * 
- * @return 
- *  - Pointer to first found node or NULL if not found
+ * @brief Signal manager task from timer, callback or foreign task. Signal is kept 
+ * as pending bit and never lost on full queue - bits are checked after every message
+ *
+ * @param[in] type Message without payload to run in manager task
+ *
+ * @return
+ *
 */
-static wm_ll_known_network_node_t *wm_find_known_net_by_ssid( char *ssid );
+static void wm_mgr_signal(wm_msg_type_t type);
 
 /**
- * @brief Create an internal known network holder
- * 
- * @param[in] known_network_id Internal knonw network ID
- * 
- * @return 
- *  - Pointer to found node or NULL if not found
+ * @brief Run pending signals in manager task. Resync waits for empty queue -
+ * events queued before loss are applied first
+ *
+ * @param[in] msg Manager message buffer
+ *
+ * @return
+ *
 */
-static wm_ll_known_network_node_t *wm_find_known_net_by_id( uint32_t known_network_id );
+static void wm_mgr_signals(wm_msg_t *msg);
 
 /**
- * @brief Add new known networn node or replace existing with same ID.
- * Note: Calling this function will delete any blacklisted network with same SSID
- * i.e. calling wm_add_known_network or wm_add_known_network_config APIs will clear all
- * blacklisted MAC with same SSID
- * 
- * @param[in] known_network_id Internal knonw network ID
- * 
- * @return 
- *  - ESP_OK Succeed
- *  - ESP_ERR_NO_MEM Out of memory
- *  - ESP_ERR_INVALID_ARG Network SSID and/or PASSWORD do not meet criteria i.e. PASSWORD not empty and less than 8 characters
- *  - ESP_ERR_NOT_ALLOWED MAX_KNOWN_NETWORKS reached
+ * @brief Execute single message in manager task
+ *
+ * @param[in] msg Message
+ *
+ * @return
+ *
 */
-static esp_err_t wm_add_known_network_node( wm_wifi_base_config_t *known_network);
+static void wm_mgr_process(wm_msg_t *msg);
 
 /**
- * Blacklist opperating functions
+ * @brief Probe task is running and will send its result to manager queue
+ *
+ * @return true when manager task can not exit yet
+ *
 */
+static bool wm_mgr_probe_running(void);
 
 /**
- * @brief Add new bssid to blacklisted Access Points
- * 
- * @param[in] bssid MAC address of AP
- * 
- * @return 
- * 
+ * @brief Resync manager state with driver after lost events. Stuck scan is 
+ * stopped, missed link events are synthesized from driver and netif state
+ *
+ * @param[in] msg Manager message buffer, reused for synthesized events
+ *
+ * @return
+ *
 */
-static void wm_add_blist_bssid(wm_blist_data_t *bssid);
+static void wm_driver_resync(wm_msg_t *msg);
 
 /**
- * @brief Remove all blacklisted Access Points with same ID
- * 
- * @param[in] net_config_id Internal ID of blacklisted SSID.
- * 
- * @return 
- * 
+ * @brief Call direct callbacks registered for event. Event data is borrowed for the call.
+ * Events posted outside manager task are copied to manager queue and dispatched there
+ *
+ * @param[in] event_id The ID of event
+ * @param[in] event_data Event data
+ * @param[in] event_data_size Event data size
+ *
+ * @return
+ *
 */
-static void wm_del_blist_bssid(uint32_t net_config_id);
+static void wm_direct_dispatch(int32_t event_id, const void *event_data, size_t event_data_size);
 
 /**
- * @brief Check presence of bssid in blacklist
- * 
- * @param[in] bssid MAC address of AP
- * 
- * @return 
- *  - Pointer to node of blacklisted AP
+ * @brief Get size of driver event data copied to manager queue
+ *
+ * @param[in] event_base The base ID of event
+ * @param[in] event_id The ID of event
+ *
+ * @return
+ *  - Event data size, 0 for events without used data
 */
-static wm_ll_blacklist_node_t *wm_is_blacklisted(uint8_t *bssid);
+static size_t wm_driver_event_size(esp_event_base_t event_base, int32_t event_id);
 
 /**
- * Other functions
+ * Manager command functions
 */
 
 /**
- * @brief Set AP mode configuration to internal wifi_config_t holder
- * 
- * @param
- * 
- * @return 
- * 
+ * @brief Execute command in manager task context
+ *
+ * @param[in] cmd Command
+ *
+ * @return
+ *  - Command result
 */
-static void wm_apply_ap_driver_config();
+static esp_err_t wm_cmd_process(wm_cmd_t *cmd);
 
 /**
- * @brief Set DNS server address to netif interface
- * 
- * @param[in] iface Pointer to netif interface
- * @param[in] dns_server_ip IPv4 DNS server addres
- * @param[in] type Type of DNS server (ESP_NETIF_DNS_MAIN, ESP_NETIF_DNS_BACKUP or ESP_NETIF_DNS_FALLBACK)
- * 
- * @return 
- * 
+ * @brief Completion callback of blocking command. Store result and wake caller
+ *
+ * @param[in] cmd Executed command
+ * @param[in] result Command result
+ * @param[in] cb_arg Blocking command holder
+ *
+ * @return
+ *
 */
-static void wm_apply_netif_dns(esp_netif_t *iface, esp_ip4_addr_t *dns_server_ip, esp_netif_dns_type_t type );
+static void wm_cmd_sync_done(const wm_cmd_t *cmd, esp_err_t result, void *cb_arg);
 
 /**
- * @brief Set IPv4 address. 
- * This function set static IP or switch to DHCP for specifed interface. 
- * Also trigger extended events IP_SET_OK / IP_SET_FAIL
- * 
- * @param[in] iface Netif interface handler
- * @param[in] ip_info Full IPv4 configuration 
- * 
- * @return 
- * 
+ * @brief Drop reference to blocking command holder and free it with last reference
+ *
+ * @param[in] sync Blocking command holder
+ *
+ * @return
+ *
 */
-static void wm_set_interface_ip( wifi_interface_t iface, wm_net_ip_config_t *ip_info);
+static void wm_cmd_sync_release(wm_cmd_sync_t *sync);
 
 /**
- * @brief Free memory occupated by AP and/or STA driver configuration and 
- * running configuration itself. This function is called in case of critical 
- * initialization failure.
- * 
- * @param
- * 
- * @return 
- * 
+ * @brief Add or replace known network
+ *
+ * @param[in] known_network Full wireless network configuration
+ *
+ * @return
+ *  - ESP_OK Succeed
+ *  - ESP_ERR_NO_MEM Out of memory
+ *  - ESP_ERR_NOT_ALLOWED MAX_KNOWN_NETWORKS reached
 */
-static void wm_clear_pointers(void);
+static esp_err_t wm_cmd_kn_add(wm_net_base_config_t *known_network);
 
 /**
- * @brief Check SSID and PASSWORD for compliance
- * SSID must be 2-32 printable charachters, 
- * PASSWORD must be 0 or minimum 8 character in lenght
- * 
+ * @brief Delete known network by ID or by SSID when ID is 0
+ *
+ * @param[in] known_network_id Internal known network ID
  * @param[in] ssid Pointer to NULL terminated string for network SSID
- * @param[in] pwd Pointer to NULL terminated string for network SSID
- * 
- * @return 
- *  - ESP_OK compliance check passed
- *  - Other compliance check error
+ *
+ * @return
+ *  - ESP_OK Succeed
+ *  - ESP_ERR_NOT_FOUND Known network not found
 */
-static esp_err_t wm_check_ssid_pwd(char *ssid, char *pwd);
+static esp_err_t wm_cmd_kn_del(uint32_t known_network_id, char *ssid);
 
 /**
- * @brief Restart WiFi in WIFI_MODE_APSTA and apply working channel
- * Post event WM_EVENT_AP_START or extended event notifocation in case
- * of failed APSTA mode (APSTA_FAIL)
- * 
- * @param
- * 
- * @return 
- * 
+ * @brief Apply known networks bulk transaction. See wm_bulk_known_networks
+ *
+ * @param[in,out] entries Array of operations
+ * @param[in] count Number of entries
+ * @param[in] replace_all Remove all known networks not added by this transaction
+ *
+ * @return
+ *  - ESP_OK All entries applied
+ *  - ESP_ERR_NOT_FOUND Applied, delete found no network
+ *  - Other Nothing applied
 */
-static void wm_restart_ap(void);
+static esp_err_t wm_cmd_kn_bulk(wm_kn_bulk_entry_t *entries, size_t count, bool replace_all);
 
 /**
- * System functions
+ * @brief Set country code
+ *
+ * @param[in] cc Pointer to NULL terminated string for country code
+ *
+ * @return
+ *  - ESP_OK Succeed
 */
+static esp_err_t wm_cmd_set_country(char *cc);
 
-#if (CONFIG_WIFIMGR_RUN_SNTP_WHEN_STA == 1)
 /**
- * @brief SNTP service callback called when tyme sync event occured
- * 
- * @param[in] tv Structure returned by gettimeofday system call
- * 
+ * @brief Apply country to running driver and clamp AP channel to it
+ *
+ * @param[in] country Country from channel plan
+ *
  * @return
+ *  - ESP_OK Succeed
+ *  - Other Driver rejected country, nothing changed
 */
-static void wm_sntp_sync_cb(struct timeval *tv);
-#endif
+static esp_err_t wm_apply_country(const wifi_country_t *country);
+
+/**
+ * @brief Apply AP mode configuration
+ *
+ * @param[in] ap_conf Full wireless network configuration
+ *
+ * @return
+ *  - ESP_OK Succeed
+ *  - Other Driver configuration failed
+*/
+static esp_err_t wm_cmd_ap_config(wm_net_base_config_t *ap_conf);
 
 /**
- * @brief Scan task function
+ * @brief Validate and apply softAP performance profile without WiFi restart
  * 
- * @param[in] pvParameters A NULL value that is passed as the paramater to the created task
+ * @param[in] profile softAP profile
  * 
+ * @return 
+ *  - ESP_OK Succeed
+ *  - ESP_ERR_INVALID_ARG Profile out of range
+ *  - Other - Refer to esp_wifi_set_config error codes
+*/
+static esp_err_t wm_cmd_ap_profile(wm_ap_profile_t *profile);
+
+/**
+ * @brief Set primary DNS server for known network by ID or by SSID when ID is 0
+ *
+ * @param[in] dns_ip IPv4 DNS server address
+ * @param[in] known_network_id Internal known network ID
+ * @param[in] ssid Pointer to NULL terminated string for network SSID
+ *
  * @return
+ *  - ESP_OK Succeed
+ *  - ESP_ERR_NOT_FOUND Known network not found
 */
-static void vScanTask(void *pvParameters);
+static esp_err_t wm_cmd_sta_dns(esp_ip4_addr_t dns_ip, uint32_t known_network_id, char *ssid);
 
+/**
+ * @brief Set internet reachability probe target
+ *
+ * @param[in] host Host name or IPv4 address. NULL or empty disables probe
+ * @param[in] port TCP port
+ * @param[in] path HTTP path
+ * @param[in] expected_status Expected HTTP status
+ *
+ * @return
+ *  - ESP_OK Succeed
+ *  - ESP_ERR_INVALID_ARG Host or path too long
+ *  - ESP_ERR_NOT_SUPPORTED Internet check disabled
+*/
+static esp_err_t wm_cmd_inet_probe(const char *host, uint16_t port, const char *path, uint16_t expected_status);
 
-ESP_EVENT_DEFINE_BASE(WM_EVENT);
+/**
+ * @brief Stop radio, timers and supervision. STA connection is kept in driver 
+ * configuration for resume. Driver stop events are dropped while suspended
+ *
+ * @return
+ *  - ESP_OK Succeed
+ *  - Other - Refer to esp_wifi_stop error codes
+*/
+static esp_err_t wm_cmd_suspend(void);
 
+/**
+ * @brief Queue broadcast scan request in scan scheduler. Fresh cache completes request at once
+ *
+ * @return
+ *  - ESP_OK Succeed
+ *  - ESP_ERR_INVALID_STATE Radio suspended
+*/
+static esp_err_t wm_cmd_scan_now(void);
 
-esp_err_t wm_init_wifi_manager( wm_apmode_config_t *full_ap_cfg, esp_event_loop_handle_t *p_uevent_loop) {
-    
-    if(wm_run_conf) { return ESP_OK; }
+/**
+ * @brief Register or remove direct event callback. Registering same callback for 
+ * same event again replaces its argument
+ *
+ * @param[in] event_id Manager event ID
+ * @param[in] cb Callback
+ * @param[in] cb_arg Callback argument
+ * @param[in] add Register when true, remove otherwise
+ *
+ * @return
+ *  - ESP_OK Succeed
+ *  - ESP_ERR_NO_MEM No free callback slot
+ *  - ESP_ERR_NOT_FOUND Callback to remove not registered
+*/
+static esp_err_t wm_cmd_direct_cb(int32_t event_id, wm_direct_cb_t cb, void *cb_arg, bool add);
 
-    /* Disable wifi log info*/
-    esp_log_level_set("wifi", ESP_LOG_ERROR);
+/**
+ * @brief Fill configuration image from running configuration
+ *
+ * @param[out] image Configuration image
+ *
+ * @return
+ *  - ESP_OK Succeed
+*/
+static esp_err_t wm_cmd_cfg_export(wm_cfg_image_t *image);
 
-    /* Init NVS*/
-    esp_err_t err = nvs_flash_init();
-    if (err == ESP_ERR_NVS_NO_FREE_PAGES || err == ESP_ERR_NVS_NEW_VERSION_FOUND) {
-        err = nvs_flash_erase();
-        if( err != ESP_OK ) return err; 
-        err = nvs_flash_init();
-    }
-    if( err != ESP_OK ) return err; 
+/**
+ * @brief Validate and apply configuration image. Known networks are replaced by 
+ * bulk transaction before other settings are changed
+ *
+ * @param[in] image Configuration image
+ *
+ * @return
+ *  - ESP_OK Succeed
+ *  - ESP_ERR_INVALID_ARG Invalid setting or country not in channel plan
+ *  - ESP_ERR_NO_MEM Out of memory
+ *  - ESP_ERR_NOT_ALLOWED Too many known networks
+ *  - Other Driver rejected configuration
+ *  Running configuration is unchanged on any error
+*/
+static esp_err_t wm_cmd_cfg_import(wm_cfg_image_t *image);
 
-    /* Init netif */
-    err = esp_netif_init();
-    if( err != ESP_OK ) return err;
+/**
+ * @brief Copy network configuration to image network entry
+ *
+ * @param[out] dst Image network entry
+ * @param[in] ssid SSID
+ * @param[in] password Password, 64 characters PSK is not NULL terminated
+ * @param[in] hidden Hidden SSID flag
+ * @param[in] ip_config IP configuration
+ *
+ * @return
+*/
+static void wm_cfg_net_export(wm_cfg_net_t *dst, const char *ssid, const char *password, bool hidden, const wm_net_ip_config_t *ip_config);
 
-    /* Create default event loop */
-    err = esp_event_loop_create_default();
-    if((err != ESP_OK) && (err != ESP_ERR_INVALID_STATE)) return err; 
+/**
+ * @brief Copy image network entry to network configuration
+ *
+ * @param[out] dst Network configuration
+ * @param[in] src Image network entry
+ *
+ * @return
+*/
+static void wm_cfg_net_import(wm_net_base_config_t *dst, const wm_cfg_net_t *src);
 
-    wm_run_conf = (wm_wifi_mgr_config_t *)calloc(1, sizeof(wm_wifi_mgr_config_t));
-    if(wm_run_conf) {
-        wm_run_conf->uevent_loop = (p_uevent_loop) ? *p_uevent_loop : NULL;
-        wm_run_conf->state = 0UL;
-        /* Init wifi interfaces */
-        wm_run_conf->ap.iface = esp_netif_create_default_wifi_ap();
-        wm_run_conf->sta.iface = esp_netif_create_default_wifi_sta();
-        /* Setup initial driver configuration */
-        wm_run_conf->ap.driver_config = (wifi_config_t *)calloc(1, sizeof(wifi_config_t));
-        wm_run_conf->sta.driver_config = (wifi_config_t *)calloc(1, sizeof(wifi_config_t));
-        if(!wm_run_conf->ap.driver_config || !wm_run_conf->sta.driver_config) {
-            wm_clear_pointers();
-            return ESP_ERR_NO_MEM;
-        }
+/**
+ * @brief Restart radio. Saved STA connection is reconnected by STA_START handler 
+ * with pinned BSSID and channel
+ *
+ * @return
+ *  - ESP_OK Succeed
+ *  - Other - Refer to esp_wifi_start error codes
+*/
+static esp_err_t wm_cmd_resume(void);
 
-        /* Apply ap configuration - passed or default */
-        if(!full_ap_cfg) {
-            wm_run_conf->ap_conf = (wm_net_base_config_t) {
-                .ssid = CONFIG_WIFIMGR_AP_SSID,
-                .password = CONFIG_WIFIMGR_AP_PWD,
-                .ip_config.static_ip = {{ IPADDR_ANY }, { IPADDR_ANY }, { IPADDR_ANY },},
-                .ip_config.pri_dns_server = { IPADDR_ANY }
-            };
-            wm_run_conf->ap_channel = CONFIG_WIFIMGR_AP_CHANNEL;
+/**
+ * @brief Start periodic scan when manager state allows it and set next scan task period
+ *
+ * @param
+ *
+ * @return
+ *
+*/
+static void wm_scan_tick(void);
 
-            wm_run_conf->max_sta_connect_retry = CONFIG_WIFIMGR_MAX_STA_RETRY;
-            wm_run_conf->country = (wifi_country_t ) {
-                .cc = CONFIG_WIFIMGR_COUNTRY_CODE,
-                .schan = 1,
-                .nchan = ((0 == strcmp(CONFIG_WIFIMGR_COUNTRY_CODE, "US")) || (0 == strcmp(CONFIG_WIFIMGR_COUNTRY_CODE, "01")) )? 11 : 13,
-                .policy = WIFI_COUNTRY_POLICY_AUTO
-            };
-        } else {
-            wm_run_conf->ap_conf = full_ap_cfg->base_conf;
-            wm_run_conf->ap_channel = full_ap_cfg->ap_channel;
-            wm_run_conf->country = full_ap_cfg->country;
-        }
+/**
+ * Internal Known network functions
+*/
 
-        if(wm_run_conf->ap_channel)
-            if(((0 == strcmp(CONFIG_WIFIMGR_COUNTRY_CODE, "US")) || (0 == strcmp(CONFIG_WIFIMGR_COUNTRY_CODE, "01"))) && wm_run_conf->ap_channel >11 ) wm_run_conf->ap_channel = 11;
+/**
+ * @brief Create known network node from pool. Heap is used only when pool is exhausted
+ * i.e. by bulk transaction replacing many networks
+ * 
+ * @param[in] net_config Wireless network configuration
+ * 
+ * @return 
+ *  - Pointer to newly created node or NULL when out of memory
+*/
+static wm_ll_known_network_node_t *wm_create_known_network(wm_net_base_config_t *net_config);
 
-        /* Apply static IP to AP if any */
-        if( wm_run_conf->ap_conf.ip_config.static_ip.ip.addr != IPADDR_ANY ) {
-            wm_set_interface_ip(WIFI_IF_AP, &wm_run_conf->ap_conf.ip_config);
-        }
+/**
+ * @brief Search for known network by SSID
+ * 
+ * @param[in] ssid Pointer to NULL terminated string for network SSID
+ * 
+ * @return 
+ *  - Pointer to first found node or NULL if not found
+*/
+static wm_ll_known_network_node_t *wm_find_known_net_by_ssid( char *ssid );
 
-        /* Init default WIFI configuration*/
-        wifi_init_config_t *_initconf = (wifi_init_config_t *)calloc(1, sizeof(wifi_init_config_t));
-        *_initconf = (wifi_init_config_t)WIFI_INIT_CONFIG_DEFAULT();
-        err = esp_wifi_init(_initconf);
-        if( ESP_OK != err) {
-            wm_clear_pointers();
-            return err;
-        }
-        free(_initconf);
+/**
+ * @brief Create an internal known network holder
+ * 
+ * @param[in] known_network_id Internal knonw network ID
+ * 
+ * @return 
+ *  - Pointer to found node or NULL if not found
+*/
+static wm_ll_known_network_node_t *wm_find_known_net_by_id( uint32_t known_network_id );
 
-        /* Storage */
-        if( esp_wifi_set_storage(WIFI_STORAGE_RAM) != ESP_OK ) {
-            wm_clear_pointers();
-            return ESP_FAIL;
-        }
+/**
+ * @brief Add new known networn node or replace existing with same ID in place.
+ * Note: Calling this function will delete any blacklisted network with same SSID
+ * i.e. calling wm_add_known_network or wm_add_known_network_config APIs will clear all
+ * blacklisted MAC with same SSID. Called from manager task only
+ * 
+ * @param[in] work Known network node from wm_create_known_network. Released on failure
+ * 
+ * @return 
+ *  - ESP_OK Succeed
+ *  - ESP_ERR_NOT_ALLOWED MAX_KNOWN_NETWORKS reached
+*/
+static esp_err_t wm_add_known_network_node( wm_ll_known_network_node_t *work);
 
-        /* Apply country data */
-        if( esp_wifi_set_country(&(wm_run_conf->country))) {
-            wm_clear_pointers();
-            return ESP_FAIL;  
-        }
+/**
+ * @brief Release known network node to pool or heap
+ * 
+ * @param[in] node Known network node
+ * 
+ * @return 
+ * 
+*/
+static void wm_free_known_network_node( wm_ll_known_network_node_t *node);
 
-        /* Event handlers registation */
-        err = esp_event_handler_instance_register(WIFI_EVENT, ESP_EVENT_ANY_ID, &wm_wifi_event_handler, NULL, NULL);
-        if( ESP_OK != err) {
-            wm_clear_pointers();
-            return err;
-        }
-        err = esp_event_handler_instance_register(IP_EVENT, ESP_EVENT_ANY_ID, &wm_ip_event_handler, NULL, NULL);
-        if( ESP_OK != err) {
-            wm_clear_pointers();
-            return err;
-        }
+/**
+ * @brief Publish copy of known networks list as new snapshot. Previous snapshot 
+ * is released when its last reader is done. Called from manager task after list change
+ * 
+ * @param
+ * 
+ * @return 
+ *  - ESP_OK Succeed
+ *  - ESP_ERR_NO_MEM Out of memory. Previous snapshot stays published, retried on next scan tick
+*/
+static esp_err_t wm_kn_publish(void);
 
-        /* Setup AP mode */
-        wm_apply_ap_driver_config();
+/**
+ * @brief Take reference to current known networks snapshot. Never blocks
+ * 
+ * @param
+ * 
+ * @return 
+ *  - Pointer to snapshot or NULL before first publish
+*/
+static wm_kn_snapshot_t *wm_kn_snapshot_acquire(void);
 
-        /* Set initial WiFi mode */
-        err = esp_wifi_set_mode(WIFI_MODE_APSTA);
-        if(err != ESP_OK) {
-            wm_clear_pointers();
-            return err;    
-        };
+/**
+ * @brief Drop reference to known networks snapshot, free it with last reference
+ * 
+ * @param[in] snap Snapshot from wm_kn_snapshot_acquire
+ * 
+ * @return 
+ * 
+*/
+static void wm_kn_snapshot_release(wm_kn_snapshot_t *snap);
 
-        /* Apply initial AP configuration */
-        err = esp_wifi_set_config(WIFI_IF_AP, wm_run_conf->ap.driver_config);
-        if(err != ESP_OK) {
-            wm_clear_pointers();
-            return err;
-        };
+/**
+ * Blacklist opperating functions
+*/
 
-        /* Apply empty STA configuration */
-        err = esp_wifi_set_config(WIFI_IF_STA, wm_run_conf->sta.driver_config);
-        if(err != ESP_OK) {
-            wm_clear_pointers();
-            return err;
-        };
+/**
+ * @brief Add new bssid to blacklisted Access Points or renew its expiry
+ * 
+ * @param[in] bssid MAC address of AP
+ * @param[in] duration_s Blacklist duration in seconds, 0 until cleared by successful connect
+ * 
+ * @return 
+ * 
+*/
+static void wm_add_blist_bssid(wm_blist_data_t *bssid, uint32_t duration_s);
 
-        /* Set bandwidth to HT20 */
-        esp_wifi_set_bandwidth(WIFI_IF_AP, WIFI_BW_HT20);
-        err = esp_wifi_start();
-        if( err != ESP_OK ) {
-            wm_clear_pointers();
-            return err;
-        } else { 
-            wm_event_post(WM_EVENT_AP_START, NULL, 0);
-            esp_netif_ip_info_t *event_data = (esp_netif_ip_info_t *)malloc(sizeof(wifi_init_config_t));
-            esp_netif_get_ip_info( wm_run_conf->ap.iface, event_data);
-            wm_event_post(WM_EVENT_GOT_IP, event_data, sizeof(esp_netif_ip_info_t));
-            free(event_data);
-        };
-        wm_run_conf->kn_Semaphore = xSemaphoreCreateBinary();
-        xSemaphoreGive(wm_run_conf->kn_Semaphore);
+/**
+ * @brief Remove all blacklisted Access Points with same ID
+ * 
+ * @param[in] net_config_id Internal ID of blacklisted SSID.
+ * 
+ * @return 
+ * 
+*/
+static void wm_del_blist_bssid(uint32_t net_config_id);
+
+/**
+ * @brief Check presence of bssid in blacklist
+ * 
+ * @param[in] bssid MAC address of AP
+ * 
+ * @return 
+ *  - Pointer to node of blacklisted AP
+*/
+static wm_ll_blacklist_node_t *wm_is_blacklisted(uint8_t *bssid);
+
+/**
+ * @brief Remove blacklisted Access Points with expired blacklist time
+ * 
+ * @param
+ * 
+ * @return 
+ * 
+*/
+static void wm_blist_expire(void);
+
+/**
+ * Disconnect recovery functions
+*/
+
+/**
+ * @brief Find recovery action for driver disconnect reason
+ * 
+ * @param[in] reason Driver disconnect reason
+ * 
+ * @return 
+ *  - Recovery action
+*/
+static wm_disc_action_t wm_disc_classify(uint8_t reason);
+
+/**
+ * @brief Stop STA reconnect attempts to current AP. Blacklist AP for action 
+ * dependent time and reenable scanning
+ * 
+ * @param[in] action Recovery action
+ * 
+ * @return 
+ * 
+*/
+static void wm_disc_give_up(wm_disc_action_t action);
+
+/**
+ * @brief Backoff timer callback. Queue reconnect to manager task
+ * 
+ * @param[in] xTimer Timer handle
+ * 
+ * @return
+*/
+static void vRetryTimer(TimerHandle_t xTimer);
+
+/**
+ * Watchdog functions
+*/
+
+/**
+ * @brief Start stage deadline. Rearming running stage restarts its deadline
+ * 
+ * @param[in] stage Supervised stage
+ * 
+ * @return 
+ * 
+*/
+static void wm_wd_arm(wm_wd_stage_t stage);
+
+/**
+ * @brief Stop stage deadline
+ * 
+ * @param[in] stage Supervised stage
+ * 
+ * @return 
+ * 
+*/
+static void wm_wd_disarm(wm_wd_stage_t stage);
+
+/**
+ * @brief Set watchdog timer to nearest armed deadline or stop it
+ * 
+ * @param
+ * 
+ * @return 
+ * 
+*/
+static void wm_wd_schedule(void);
+
+/**
+ * @brief Run recovery action for all stages with passed deadline. Connect and DHCP 
+ * first disconnect gracefully, second expiry drops AP without waiting for driver
+ * 
+ * @param
+ * 
+ * @return 
+ * 
+*/
+static void wm_wd_check(void);
+
+/**
+ * @brief Watchdog timer callback. Queue deadline check to manager task
+ * 
+ * @param[in] xTimer Timer handle
+ * 
+ * @return
+*/
+static void vWatchdogTimer(TimerHandle_t xTimer);
+
+/**
+ * Hidden network scan functions
+*/
+
+/**
+ * @brief Fill directed scan queue with hidden known networks ordered by last seen channel.
+ * Networks with unknown channel are placed at the end of queue
+ * 
+ * @param[in] channels Bitmap of channels where APs with hidden SSID were found by broadcast scan
+ * 
+ * @return 
+ * 
+*/
+static void wm_hidden_scan_prepare(wifi_scan_channel_bitmap_t channels);
+
+/**
+ * @brief Start directed probe scan for next queued hidden network. Scan is limited to last 
+ * seen channel when hidden AP is present there or to all channels with hidden APs
+ * 
+ * @param
+ * 
+ * @return 
+ *  - true Directed scan started
+ *  - false Queue is empty or scan start failed
+*/
+static bool wm_hidden_scan_next(void);
+
+/**
+ * SoftAP scan scheduler functions
+*/
+
+/**
+ * @brief Start single channel scan while stations are connected to softAP. 
+ * Slice is started only in idle window after last client activity and when 
+ * off-channel budget allows it. Budget refills with CONFIG_WIFIMGR_AP_SCAN_MAX_OFFCHAN 
+ * percents of elapsed time
+ * 
+ * @param
+ * 
+ * @return 
+ *  - true Scan slice started
+ *  - false Scan slice postponed
+*/
+static bool wm_ap_scan_slice(void);
+
+/**
+ * @brief Check for remaining stations connected to softAP and update flag
+ * 
+ * @param
+ * 
+ * @return 
+ * 
+*/
+static void wm_ap_update_clients(void);
+
+/**
+ * Power save functions
+*/
+
+/**
+ * @brief Apply driver power save type for current manager state. 
+ * No sleep while connecting or softAP running, profile power save when 
+ * station is connected and idle
+ * 
+ * @param
+ * 
+ * @return 
+ * 
+*/
+static void wm_apply_power_state(void);
+
+/**
+ * @brief Estimated radio duty cycle for driver power save type
+ * 
+ * @param[in] ps_type Driver power save type
+ * 
+ * @return 
+ *  - Duty cycle in permille
+*/
+static uint16_t wm_ps_duty_cycle(wifi_ps_type_t ps_type);
+
+/**
+ * Connection profiler functions
+*/
+
+/**
+ * @brief Timestamp connection attempt phase. Scan start or connect opens new attempt, 
+ * repeated connect counts retry. Scan done keeps last timestamp, other phases first one
+ * 
+ * @param[in] phase Reached phase
+ * 
+ * @return 
+ * 
+*/
+static void wm_prof_mark(wm_conn_phase_t phase);
+
+/**
+ * @brief Close open connection attempt, store it in history and post WM_EVENT_CONN_PROFILE. 
+ * Attempt is successful when IP address was obtained
+ * 
+ * @param
+ * 
+ * @return 
+ * 
+*/
+static void wm_prof_finish(void);
+
+/**
+ * Footprint meter functions
+*/
+
+/**
+ * @brief Open operation and record manager heap at start. Reopen restarts measurement
+ * 
+ * @param[in] op Operation
+ * 
+ * @return 
+ * 
+*/
+static void wm_fp_begin(wm_fp_op_t op);
+
+/**
+ * @brief Close operation, update footprint and check budgets. Post 
+ * WM_EVENT_FOOTPRINT_OVER or abort on violation
+ * 
+ * @param[in] op Operation
+ * 
+ * @return 
+ * 
+*/
+static void wm_fp_end(wm_fp_op_t op);
+
+/**
+ * @brief Follow scan and connect operations by manager state flags. Scan is open
+ * while scanning is on hold, connect while STA is connecting
+ * 
+ * @return 
+ * 
+*/
+static void wm_fp_track(void);
+
+/**
+ * @brief Close all open operations without measurement. Failed init and deinit
+ * 
+ * @return 
+ * 
+*/
+static void wm_fp_cancel(void);
+
+/**
+ * @brief Manager heap allocation. All manager owned memory comes from here, 
+ * driver, netif and task stacks do not. Counted by footprint meter
+ * 
+ * @param[in] size Block size
+ * 
+ * @return
+ *  - Block or NULL when out of memory
+*/
+static void *wm_fp_malloc(size_t size);
+
+/**
+ * @brief Zeroed manager heap allocation. Counted by footprint meter, also used 
+ * by known network pool when storage is exhausted
+ * 
+ * @param[in] n Number of items
+ * @param[in] size Item size
+ * 
+ * @return
+ *  - Block or NULL when out of memory
+*/
+static void *wm_fp_calloc(size_t n, size_t size);
+
+/**
+ * @brief Manager heap free. Subtracts block size from manager heap
+ * 
+ * @param[in] ptr Block from wm_fp_malloc or wm_fp_calloc, NULL is ignored
+ * 
+ * @return 
+ * 
+*/
+static void wm_fp_free(void *ptr);
+
+#if (CONFIG_WIFIMGR_FOOTPRINT == 1)
+/**
+ * @brief Count manager heap allocation. Adds block size to manager heap and 
+ * raises peak of open operations
+ * 
+ * @param[in] ptr Allocated memory or NULL
+ * 
+ * @return
+ *  - ptr
+*/
+static void *wm_fp_count(void *ptr);
+#endif
+
+/**
+ * Trace capture functions
+*/
+
+/**
+ * @brief Start new trace log. Previous log is discarded
+ * 
+ * @return 
+ * 
+*/
+static void wm_capture_start(void);
+
+/**
+ * @brief Log driver event or manager message received by manager task
+ * 
+ * @param[in] msg Manager message
+ * 
+ * @return 
+ * 
+*/
+static void wm_capture_msg(const wm_msg_t *msg);
+
+/**
+ * @brief Log scan records read by WIFI_EVENT_SCAN_DONE handler
+ * 
+ * @param[in] records Scan records
+ * @param[in] count Records count
+ * 
+ * @return 
+ * 
+*/
+static void wm_capture_scan(const wifi_ap_record_t *records, uint16_t count);
+
+/**
+ * @brief Log manager event posted to application as decision
+ * 
+ * @param[in] event_id The ID of event
+ * @param[in] event_data Event data
+ * @param[in] event_data_size Event data size
+ * 
+ * @return 
+ * 
+*/
+static void wm_capture_event(int32_t event_id, const void *event_data, size_t event_data_size);
+
+/**
+ * @brief Log free heap after manager message when changed by WM_TRACE_HEAP_STEP
+ * 
+ * @return 
+ * 
+*/
+static void wm_capture_heap(void);
+
+/**
+ * Other functions
+*/
+
+/**
+ * @brief Set AP mode configuration to internal wifi_config_t holder
+ * 
+ * @param
+ * 
+ * @return 
+ * 
+*/
+static void wm_apply_ap_driver_config();
+
+/**
+ * @brief Merge scan records into scan results cache by BSSID and drop aged entries. Oldest 
+ * entry is replaced when cache is full. Hidden networks are skipped
+ * 
+ * @param[in] records Scan records
+ * @param[in] count Scan records count
+ * @param[in] full_scan Records are from broadcast scan on all channels
+ * 
+ * @return
+*/
+static void wm_scan_cache_update(const wifi_ap_record_t *records, uint16_t count, bool full_scan);
+
+/**
+ * @brief Publish copy of scan results cache for foreign readers. Previous snapshot is
+ * freed by its last reader
+ * 
+ * @param
+ * 
+ * @return 
+ *  - ESP_OK Succeed
+ *  - ESP_ERR_NO_MEM Out of memory. Previous snapshot stays published, retried on next scan tick
+*/
+static esp_err_t wm_scan_publish(void);
+
+/**
+ * @brief Take reference to current scan results snapshot. Never blocks
+ * 
+ * @param
+ * 
+ * @return 
+ *  - Pointer to snapshot or NULL before first publish
+*/
+static wm_scan_snapshot_t *wm_scan_snapshot_acquire(void);
+
+/**
+ * @brief Drop reference to scan results snapshot, free it with last reference
+ * 
+ * @param[in] snap Snapshot from wm_scan_snapshot_acquire
+ * 
+ * @return 
+ * 
+*/
+static void wm_scan_snapshot_release(wm_scan_snapshot_t *snap);
+
+/**
+ * @brief Check cached entry against query filter
+ * 
+ * @param[in] filter Query filter. NULL matches all
+ * @param[in] entry Cached entry with age_ms set
+ * 
+ * @return 
+ *  - true Entry matches
+*/
+static bool wm_scan_filter_match(const wm_scan_filter_t *filter, const wm_scan_entry_t *entry);
+
+/**
+ * @brief Apply AP bandwidth and station inactivity timeout from profile to running driver
+ * 
+ * @return
+*/
+static void wm_apply_ap_profile(void);
+
+/**
+ * @brief Fill softAP profile with Kconfig defaults
+ * 
+ * @param[out] profile softAP profile
+ * 
+ * @return
+*/
+static void wm_default_ap_profile(wm_ap_profile_t *profile);
+
+/**
+ * @brief Check softAP profile ranges
+ * 
+ * @param[in] profile softAP profile
+ * 
+ * @return 
+ *  - ESP_OK Valid profile
+ *  - ESP_ERR_INVALID_ARG Profile out of range
+*/
+static esp_err_t wm_check_ap_profile(const wm_ap_profile_t *profile);
+
+/**
+ * @brief Select HT40 secondary channel inside country plan. Above is preferred in
+ * 2.4 GHz band, 5 GHz channels use fixed 40 MHz pairs
+ * 
+ * @param[in] channel AP primary channel
+ * @param[in] ap_count Found AP count per channel table slot or NULL to skip occupancy check
+ * 
+ * @return 
+ *  - Secondary channel. WIFI_SECOND_CHAN_NONE when no free secondary channel
+*/
+static wifi_second_chan_t wm_ap_second_chan(uint8_t channel, const uint8_t *ap_count);
+
+/**
+ * @brief Fill driver country configuration from regulatory channel plan
+ * 
+ * @param[in] cc Country code
+ * @param[out] country Driver country configuration
+ * 
+ * @return 
+ *  - ESP_OK Succeed
+ *  - ESP_ERR_NOT_FOUND Unknown country code. World safe plan "01" is filled
+*/
+static esp_err_t wm_country_from_plan(const char *cc, wifi_country_t *country);
+
+/**
+ * @brief Clamp AP channel to country channel plan. 5 GHz channel not allowed 
+ * for AP falls back to default AP channel
+ * 
+ * @param[in] country Driver country configuration
+ * @param[in] channel Channel number
+ * 
+ * @return 
+ *  - Channel inside plan. Channel 0 (auto) is kept
+*/
+static uint8_t wm_clamp_channel(const wifi_country_t *country, uint8_t channel);
+
+/**
+ * Channel table functions
+*/
+
+/**
+ * @brief Get sparse channel table slot of channel
+ * 
+ * @param[in] channel Channel number
+ * 
+ * @return 
+ *  - Table slot. -1 when channel is not in table
+*/
+static int wm_chan_slot(uint8_t channel);
+
+/**
+ * @brief Get channel of sparse channel table slot
+ * 
+ * @param[in] slot Table slot
+ * 
+ * @return 
+ *  - Channel number
+*/
+static uint8_t wm_slot_chan(int slot);
+
+/**
+ * @brief Check channel against country plan and band rules. softAP is not
+ * started on 5 GHz DFS channels and on 5 GHz when WIFIMGR_AP_5G is disabled
+ * 
+ * @param[in] country Driver country configuration
+ * @param[in] channel Channel number
+ * @param[in] ap Apply softAP rules
+ * 
+ * @return 
+ *  - true Channel allowed
+*/
+static bool wm_chan_allowed(const wifi_country_t *country, uint8_t channel, bool ap);
+
+/**
+ * @brief Get next allowed channel in table order with wrap around
+ * 
+ * @param[in] channel Current channel, 0 for first allowed channel
+ * @param[in] ap Apply softAP rules
+ * 
+ * @return 
+ *  - Channel number. 0 when no channel is allowed
+*/
+static uint8_t wm_next_channel(uint8_t channel, bool ap);
+
+/**
+ * @brief Count allowed channels
+ * 
+ * @param[in] ap Apply softAP rules
+ * 
+ * @return 
+ *  - Allowed channels count
+*/
+static uint8_t wm_chan_count(bool ap);
+
+/**
+ * @brief Set channel bit in driver scan channel bitmap
+ * 
+ * @param[in,out] bitmap Scan channel bitmap
+ * @param[in] channel Channel number. Channels outside table are ignored
+ * 
+ * @return 
+ * 
+*/
+static void wm_chan_bitmap_set(wifi_scan_channel_bitmap_t *bitmap, uint8_t channel);
+
+/**
+ * @brief Test channel bit in driver scan channel bitmap
+ * 
+ * @param[in] bitmap Scan channel bitmap
+ * @param[in] channel Channel number
+ * 
+ * @return 
+ *  - true Channel bit set
+*/
+static bool wm_chan_bitmap_has(const wifi_scan_channel_bitmap_t *bitmap, uint8_t channel);
+
+/**
+ * @brief Score found AP for known network candidate selection. 5 GHz AP above
+ * WM_5G_MIN_RSSI gets WIFIMGR_5G_MARGIN bonus
+ * 
+ * @param[in] record Found AP record
+ * 
+ * @return 
+ *  - Score, higher is better
+*/
+static int wm_ap_score(const wifi_ap_record_t *record);
+
+#if (CONFIG_WIFIMGR_AP_CHANNEL == 0)
+/**
+ * @brief Account found AP in AP channel ranking. 2.4 GHz AP occupies overlapping 
+ * neighbour channels, 5 GHz AP its own and HT40 secondary channel only
+ * 
+ * @param[in,out] airband Channel ranking
+ * @param[in] record Found AP record
+ * 
+ * @return 
+ * 
+*/
+static void wm_airband_add(wm_airband_rank_t *airband, const wifi_ap_record_t *record);
+
+/**
+ * @brief Count AP in channel table slot and keep strongest RSSI
+ * 
+ * @param[in,out] airband Channel ranking
+ * @param[in] slot Channel table slot
+ * @param[in] rssi Found AP RSSI
+ * 
+ * @return 
+ * 
+*/
+static void wm_airband_mark(wm_airband_rank_t *airband, int slot, int8_t rssi);
+
+/**
+ * @brief Rate channel for softAP. 2.4 GHz channel is averaged with neighbours 
+ * inside country plan, 5 GHz channel gets WIFIMGR_5G_MARGIN preference
+ * 
+ * @param[in] airband Channel ranking
+ * @param[in] slot Channel table slot
+ * 
+ * @return 
+ *  - Channel rate, lower is better
+*/
+static float wm_airband_score(const wm_airband_rank_t *airband, int slot);
+#endif
+
+/**
+ * @brief Set DNS server address to netif interface
+ * 
+ * @param[in] iface Pointer to netif interface
+ * @param[in] dns_server_ip IPv4 DNS server addres
+ * @param[in] type Type of DNS server (ESP_NETIF_DNS_MAIN, ESP_NETIF_DNS_BACKUP or ESP_NETIF_DNS_FALLBACK)
+ * 
+ * @return 
+ * 
+*/
+static void wm_apply_netif_dns(esp_netif_t *iface, esp_ip4_addr_t *dns_server_ip, esp_netif_dns_type_t type );
+
+/**
+ * @brief Set IPv4 address. 
+ * This function set static IP or switch to DHCP for specifed interface. 
+ * Also trigger extended events IP_SET_OK / IP_SET_FAIL
+ * 
+ * @param[in] iface Netif interface handler
+ * @param[in] ip_info Full IPv4 configuration 
+ * 
+ * @return 
+ * 
+*/
+static void wm_set_interface_ip( wifi_interface_t iface, wm_net_ip_config_t *ip_info);
+
+/**
+ * @brief Free memory occupated by AP and/or STA driver configuration and 
+ * running configuration itself. Unregisters event handlers, deletes timers and 
+ * queue, frees lists and destroys interfaces. This function is called in case 
+ * of critical initialization failure and by deinit.
+ * 
+ * @param
+ * 
+ * @return 
+ * 
+*/
+static void wm_clear_pointers(void);
+
+/**
+ * @brief Undo failed initialization before manager task runs. Stop and deinit 
+ * WiFi driver when it was initialized, then free running configuration
+ * 
+ * @param[in] err Initialization error
+ * @param[in] driver WiFi driver initialized
+ * 
+ * @return 
+ *  - err
+*/
+static esp_err_t wm_init_abort(esp_err_t err, bool driver);
+
+/**
+ * @brief Check SSID and PASSWORD for compliance
+ * SSID must be 2-32 printable charachters, 
+ * PASSWORD must be 0 or minimum 8 character in lenght
+ * 
+ * @param[in] ssid Pointer to NULL terminated string for network SSID
+ * @param[in] pwd Pointer to NULL terminated string for network SSID
+ * 
+ * @return 
+ *  - ESP_OK compliance check passed
+ *  - Other compliance check error
+*/
+static esp_err_t wm_check_ssid_pwd(char *ssid, char *pwd);
+
+/**
+ * @brief Restart WiFi in WIFI_MODE_APSTA and apply working channel
+ * Post event WM_EVENT_AP_START or extended event notifocation in case
+ * of failed APSTA mode (APSTA_FAIL)
+ * 
+ * @param
+ * 
+ * @return 
+ * 
+*/
+static void wm_restart_ap(void);
+
+/**
+ * @brief Switch WiFi to WIFI_MODE_STA when STA connection is validated
+ * Post event WM_EVENT_AP_STOP or extended event notification in case
+ * of failed STA mode (STA_MODE_FAIL)
+ * 
+ * @param
+ * 
+ * @return 
+ * 
+*/
+static void wm_stop_ap(void);
+
+#if (CONFIG_WIFIMGR_INET_CHECK == 1)
+/**
+ * Internet reachability functions
+*/
+
+/**
+ * @brief Apply probe result in manager task. Stop AP on success, otherwise
+ * blacklist connected AP and disconnect to fail over
+ *
+ * @param[in] result Probe result
+ * @param[in] link_seq Link sequence at probe start
+ *
+ * @return
+ *
+*/
+static void wm_inet_probe_done(wm_inet_probe_result_t *result, uint8_t link_seq);
+#endif
+
+/**
+ * @brief Validate STA upstream after got IP. Start reachability probe when
+ * enabled, otherwise stop AP
+ *
+ * @return
+ *
+*/
+static void wm_sta_validate(void);
+
+#if (CONFIG_WIFIMGR_DNS_RACE == 1)
+/**
+ * DNS race functions
+*/
+
+/**
+ * @brief Collect STA DNS servers in use and configured secondary server and
+ * start race task. Secondary server takes FALLBACK slot when all slots are in use
+ *
+ * @return
+ *  - true Race task started
+ *  - false Race running, nothing to race or no memory
+*/
+static bool wm_dns_race_start(void);
+
+/**
+ * @brief Apply race result in manager task. Reorder STA DNS servers by round
+ * trip time and schedule next race. Failed race is repeated sooner
+ *
+ * @param[in] health Raced servers in current order with round trip time
+ * @param[in] link_seq Link sequence at race start
+ *
+ * @return
+ *
+*/
+static void wm_dns_race_done(wm_dns_health_t *health, uint8_t link_seq);
+
+/**
+ * @brief Stop race timer and drop running race result
+ *
+ * @return
+ *
+*/
+static void wm_dns_race_stop(void);
+#endif
+
+/**
+ * System functions
+*/
+
+#if (CONFIG_WIFIMGR_RUN_SNTP_WHEN_STA == 1)
+/**
+ * @brief SNTP service callback called when tyme sync event occured
+ * 
+ * @param[in] tv Structure returned by gettimeofday system call
+ * 
+ * @return
+*/
+static void wm_sntp_sync_cb(struct timeval *tv);
+#endif
+
+#if (CONFIG_WIFIMGR_LINK_MONITOR == 1)
+/**
+ * @brief Link monitor timer callback. Signal link sample to manager task
+ * 
+ * @param[in] xTimer Timer handle
+ * 
+ * @return
+*/
+static void vLinkMonitorTimer(TimerHandle_t xTimer);
+
+/**
+ * @brief Sample connected AP RSSI and PHY mode in manager task, smooth RSSI, 
+ * update TX power and post WM_EVENT_LINK_DEGRADED or WM_EVENT_LINK_RECOVERED 
+ * on threshold crossing
+ * 
+ * @return
+*/
+static void wm_link_sample(void);
+
+/**
+ * @brief Reset link monitor and start or stop sampling
+ * 
+ * @param[in] run Start sampling when true, stop otherwise
+ * 
+ * @return
+*/
+static void wm_link_monitor_run(bool run);
+
+#if (CONFIG_WIFIMGR_TXP_CONTROL == 1)
+/**
+ * @brief Closed loop TX power step. Reduce max TX power while smoothed RSSI
+ * stays above degraded threshold plus margin, raise it when margin shrinks and
+ * restore full power on beacon loss or degraded link
+ * 
+ * @param[in] mon Link monitor
+ * @param[in] link Current sample, not yet published
+ * 
+ * @return
+*/
+static void wm_txp_update(wm_link_monitor_t *mon, const wm_link_quality_t *link);
+
+/**
+ * @brief Apply driver max TX power
+ * 
+ * @param[in] txp Max TX power in 0.25 dBm. WM_TXP_FULL for full country power
+ * 
+ * @return
+*/
+static void wm_txp_set(int8_t txp);
+#endif
+#endif
+
+/**
+ * @brief Manager task function. Single owner of running configuration - executes
+ * API commands, driver events and scan ticks in queue order
+ *
+ * @param[in] pvParameters A NULL value that is passed as the paramater to the created task
+ *
+ * @return
+*/
+static void vManagerTask(void *pvParameters);
+
+/**
+ * @brief Scan task function. Queue scan tick to manager task every scan period
+ *
+ * @param[in] pvParameters A NULL value that is passed as the paramater to the created task
+ *
+ * @return
+*/
+static void vScanTask(void *pvParameters);
+
+#if (CONFIG_WIFIMGR_INET_CHECK == 1)
+/**
+ * @brief Internet reachability probe task function. Queue result to manager task
+ *
+ * @param[in] pvParameters Allocated copy of probe configuration, freed by task
+ * 
+ * @return
+*/
+static void vInetProbeTask(void *pvParameters);
+#endif
+
+#if (CONFIG_WIFIMGR_DNS_RACE == 1)
+/**
+ * @brief DNS race task function. Queue result message to manager task
+ *
+ * @param[in] pvParameters Prepared WM_MSG_DNS_RESULT message. Freed by task
+ * 
+ * @return
+*/
+static void vDnsRaceTask(void *pvParameters);
+
+/**
+ * @brief DNS race timer callback. Queue race request to manager task
+ *
+ * @param[in] xTimer Timer handle
+ * 
+ * @return
+*/
+static void vDnsRaceTimer(TimerHandle_t xTimer);
+#endif
+
+
+ESP_EVENT_DEFINE_BASE(WM_EVENT);
+
+
+esp_err_t wm_init_wifi_manager( wm_apmode_config_t *full_ap_cfg, esp_event_loop_handle_t *p_uevent_loop) {
+    
+    if(wm_run_conf) { return ESP_OK; }
+    wm_capture_start();
+
+    /* Disable wifi log info*/
+    esp_log_level_set("wifi", ESP_LOG_ERROR);
+
+    /* Init NVS*/
+    esp_err_t err = nvs_flash_init();
+    if (err == ESP_ERR_NVS_NO_FREE_PAGES || err == ESP_ERR_NVS_NEW_VERSION_FOUND) {
+        err = nvs_flash_erase();
+        if( err != ESP_OK ) return err; 
+        err = nvs_flash_init();
+    }
+    if( err != ESP_OK ) return err; 
+
+    /* Init netif */
+    err = esp_netif_init();
+    if( err != ESP_OK ) return err;
+
+    /* Create default event loop */
+    err = esp_event_loop_create_default();
+    if((err != ESP_OK) && (err != ESP_ERR_INVALID_STATE)) return err; 
+
+    wm_fp_begin(WM_FP_INIT);
+    wm_run_conf = (wm_wifi_mgr_config_t *)wm_fp_calloc(1, sizeof(wm_wifi_mgr_config_t));
+    if(wm_run_conf) {
+        wm_run_conf->uevent_loop = (p_uevent_loop) ? *p_uevent_loop : NULL;
+        wm_run_conf->state = 0UL;
+        wm_pool_init(&wm_run_conf->kn_nodes, wm_run_conf->kn_pool, sizeof(wm_ll_known_network_node_t), CONFIG_WIFIMGR_MAX_KNOWN_NETWORKS + 1);
+        wm_pool_set_heap(&wm_run_conf->kn_nodes, wm_fp_calloc, wm_fp_free);
+        #if defined(CONFIG_WIFIMGR_POWER_PROFILE_MAX_THROUGHPUT)
+        wm_run_conf->power.profile = WM_POWER_MAX_THROUGHPUT;
+        #elif defined(CONFIG_WIFIMGR_POWER_PROFILE_LOW_POWER)
+        wm_run_conf->power.profile = WM_POWER_LOW;
+        #else
+        wm_run_conf->power.profile = WM_POWER_BALANCED;
+        #endif
+        /* Init wifi interfaces */
+        wm_run_conf->ap.iface = esp_netif_create_default_wifi_ap();
+        wm_run_conf->sta.iface = esp_netif_create_default_wifi_sta();
+        /* Setup initial driver configuration */
+        wm_run_conf->ap.driver_config = (wifi_config_t *)wm_fp_calloc(1, sizeof(wifi_config_t));
+        wm_run_conf->sta.driver_config = (wifi_config_t *)wm_fp_calloc(1, sizeof(wifi_config_t));
+        if(!wm_run_conf->ap.driver_config || !wm_run_conf->sta.driver_config) return wm_init_abort(ESP_ERR_NO_MEM, false);
+
+        /* Manager task owns running configuration */
+        wm_run_conf->mgr_queue = xQueueCreate(CONFIG_WIFIMGR_CMD_QUEUE_LEN, sizeof(wm_msg_t));
+        if(!wm_run_conf->mgr_queue || (ESP_OK != wm_kn_publish())) return wm_init_abort(ESP_ERR_NO_MEM, false);
+
+        /* Apply ap configuration - passed or default */
+        if(!full_ap_cfg) {
+            wm_run_conf->ap_conf = (wm_net_base_config_t) {
+                .ssid = CONFIG_WIFIMGR_AP_SSID,
+                .password = CONFIG_WIFIMGR_AP_PWD,
+                .ip_config.static_ip = {{ IPADDR_ANY }, { IPADDR_ANY }, { IPADDR_ANY },},
+                .ip_config.pri_dns_server = { IPADDR_ANY }
+            };
+            wm_run_conf->ap_channel = CONFIG_WIFIMGR_AP_CHANNEL;
+
+            wm_run_conf->max_sta_connect_retry = CONFIG_WIFIMGR_MAX_STA_RETRY;
+            wm_country_from_plan(CONFIG_WIFIMGR_COUNTRY_CODE, &wm_run_conf->country);
+            wm_default_ap_profile(&wm_run_conf->ap_profile);
+        } else {
+            wm_run_conf->ap_conf = full_ap_cfg->base_conf;
+            wm_run_conf->ap_channel = full_ap_cfg->ap_channel;
+            wm_run_conf->country = full_ap_cfg->country;
+            /* Configuration not created by wm_create_apmode_config falls back to defaults */
+            if(ESP_OK == wm_check_ap_profile(&full_ap_cfg->ap_profile)) wm_run_conf->ap_profile = full_ap_cfg->ap_profile;
+            else wm_default_ap_profile(&wm_run_conf->ap_profile);
+        }
+
+        wm_run_conf->ap_channel = wm_clamp_channel(&wm_run_conf->country, wm_run_conf->ap_channel);
+
+        /* Apply static IP to AP if any */
+        if( wm_run_conf->ap_conf.ip_config.static_ip.ip.addr != IPADDR_ANY ) {
+            wm_set_interface_ip(WIFI_IF_AP, &wm_run_conf->ap_conf.ip_config);
+        }
+
+        /* Init default WIFI configuration*/
+        wifi_init_config_t *_initconf = (wifi_init_config_t *)wm_fp_calloc(1, sizeof(wifi_init_config_t));
+        if(!_initconf) return wm_init_abort(ESP_ERR_NO_MEM, false);
+        *_initconf = (wifi_init_config_t)WIFI_INIT_CONFIG_DEFAULT();
+        err = esp_wifi_init(_initconf);
+        wm_fp_free(_initconf);
+        if( ESP_OK != err) return wm_init_abort(err, false);
+
+        /* Storage */
+        if( esp_wifi_set_storage(WIFI_STORAGE_RAM) != ESP_OK ) return wm_init_abort(ESP_FAIL, true);
+
+        /* Apply country data */
+        if( esp_wifi_set_country(&(wm_run_conf->country))) return wm_init_abort(ESP_FAIL, true);
+        #if (CONFIG_SOC_WIFI_SUPPORT_5G == 1)
+        /* Scan and connect on both bands. Not fatal - 2.4 GHz keeps working */
+        esp_wifi_set_band_mode(WIFI_BAND_MODE_AUTO);
+        #endif
+
+        /* Event handlers registation */
+        err = esp_event_handler_instance_register(WIFI_EVENT, ESP_EVENT_ANY_ID, &wm_driver_event_forward, NULL, &wm_run_conf->wifi_evt);
+        if(err != ESP_OK) return wm_init_abort(err, true);
+        err = esp_event_handler_instance_register(IP_EVENT, ESP_EVENT_ANY_ID, &wm_driver_event_forward, NULL, &wm_run_conf->ip_evt);
+        if(err != ESP_OK) return wm_init_abort(err, true);
+
+        /* Setup AP mode */
+        wm_apply_ap_driver_config();
+
+        /* Set initial WiFi mode */
+        err = esp_wifi_set_mode(WIFI_MODE_APSTA);
+        if(err != ESP_OK) return wm_init_abort(err, true);
+
+        /* Apply initial AP configuration */
+        err = esp_wifi_set_config(WIFI_IF_AP, wm_run_conf->ap.driver_config);
+        if(err != ESP_OK) return wm_init_abort(err, true);
+
+        /* Apply empty STA configuration */
+        err = esp_wifi_set_config(WIFI_IF_STA, wm_run_conf->sta.driver_config);
+        if(err != ESP_OK) return wm_init_abort(err, true);
+
+        err = esp_wifi_start();
+        if( err != ESP_OK ) return wm_init_abort(err, true);
+        wm_apply_ap_profile();
+        wm_event_post(WM_EVENT_AP_START, NULL, 0);
+        portENTER_CRITICAL(&wm_stats_lock);
+        wm_run_conf->power.since = xTaskGetTickCount();
+        wm_run_conf->power.ps_type = WIFI_PS_MIN_MODEM;     /* Driver default */
+        portEXIT_CRITICAL(&wm_stats_lock);
+        wm_apply_power_state();
+        esp_netif_ip_info_t ap_ip_info = { 0 };
+        esp_netif_get_ip_info( wm_run_conf->ap.iface, &ap_ip_info);
+        wm_event_post(WM_EVENT_GOT_IP, &ap_ip_info, sizeof(esp_netif_ip_info_t));
+        #if (CONFIG_WIFIMGR_INET_CHECK == 1)
+        wm_cmd_inet_probe(CONFIG_WIFIMGR_INET_CHECK_HOST, CONFIG_WIFIMGR_INET_CHECK_PORT, CONFIG_WIFIMGR_INET_CHECK_PATH, CONFIG_WIFIMGR_INET_CHECK_STATUS);
+        #endif
+        #if (CONFIG_WIFIMGR_LINK_MONITOR == 1)
+        wm_run_conf->link_mon.timer = xTimerCreate("wlinkmon", pdMS_TO_TICKS(CONFIG_WIFIMGR_LINK_SAMPLE_PERIOD), pdTRUE, NULL, vLinkMonitorTimer);
+        #endif
+        #if (CONFIG_WIFIMGR_DNS_RACE == 1)
+        wm_run_conf->dns.timer = xTimerCreate("wdnsrace", WM_S_TO_TICKS(CONFIG_WIFIMGR_DNS_RACE_PERIOD), pdFALSE, NULL, vDnsRaceTimer);
+        #endif
+        wm_run_conf->retry_timer = xTimerCreate("wretry", pdMS_TO_TICKS(CONFIG_WIFIMGR_RETRY_BACKOFF), pdFALSE, NULL, vRetryTimer);
+        wm_run_conf->wd.timer = xTimerCreate("wwdog", pdMS_TO_TICKS(CONFIG_WIFIMGR_WD_MODE_TIME), pdFALSE, NULL, vWatchdogTimer);
+        wm_run_conf->scanning = 1;
+        wm_run_conf->scan_delay = (2500 / portTICK_PERIOD_MS);
+        if(pdPASS != xTaskCreate(vManagerTask, "wmgr", CONFIG_WIFIMGR_MGR_TASK_STACK, NULL, 15, &wm_run_conf->mgrTask_handle)) {
+            return wm_init_abort(ESP_ERR_NO_MEM, true);
+        }
+        #if (CONFIG_WIFIMGR_PORTAL == 1)
+        /* Portal handlers queue commands - manager task must run */
+        wm_portal_start(wm_run_conf->ap.iface);
+        #endif
+        if(pdPASS != xTaskCreate(vScanTask, "wscan", CONFIG_WIFIMGR_SCAN_TASK_STACK, NULL, 15, &wm_run_conf->scanTask_handle)) {
+            /* Manager task runs - regular deinit stops portal, driver and task */
+            wm_run_conf->scanTask_handle = NULL;
+            wm_deinit_wifi_manager();
+            return ESP_ERR_NO_MEM;
+        }
+        wm_fp_end(WM_FP_INIT);
+    } else {
+        wm_fp_cancel();
+        return ESP_ERR_NO_MEM;
+    }
+
+    return ESP_OK;
+}
+
+esp_err_t wm_deinit_wifi_manager(void) {
+    if(!wm_run_conf) return ESP_ERR_NOT_ALLOWED;    /* Safety check */
+    /* Manager task can not wait for own exit */
+    if(xTaskGetCurrentTaskHandle() == wm_run_conf->mgrTask_handle) return ESP_ERR_INVALID_STATE;
+    /* No new driver events */
+    if(wm_run_conf->wifi_evt) esp_event_handler_instance_unregister(WIFI_EVENT, ESP_EVENT_ANY_ID, wm_run_conf->wifi_evt);
+    if(wm_run_conf->ip_evt) esp_event_handler_instance_unregister(IP_EVENT, ESP_EVENT_ANY_ID, wm_run_conf->ip_evt);
+    wm_run_conf->wifi_evt = NULL;
+    wm_run_conf->ip_evt = NULL;
+    wm_run_conf->lifecycle_waiter = xTaskGetCurrentTaskHandle();
+    /* Scan task exits on notification */
+    if(wm_run_conf->scanTask_handle) {
+        xTaskNotifyGive(wm_run_conf->scanTask_handle);
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+    }
+    wm_cmd_t cmd = { .cmd_id = WM_CMD_SUSPEND };
+    wm_cmd_exec(&cmd, WM_CMD_WAIT_FOREVER);
+    /* Manager task processes all queued commands before exit and notifies after last probe result */
+    const wm_msg_t msg = { .type = WM_MSG_EXIT };
+    xQueueSend(wm_run_conf->mgr_queue, &msg, portMAX_DELAY);
+    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+    esp_wifi_deinit();
+    wm_clear_pointers();
+    return ESP_OK;
+}
+
+esp_err_t wm_suspend_wifi_manager(void) {
+    if(!wm_run_conf) return ESP_ERR_NOT_ALLOWED;    /* Safety check */
+    wm_cmd_t cmd = { .cmd_id = WM_CMD_SUSPEND };
+    return wm_cmd_exec(&cmd, CONFIG_WIFIMGR_CMD_TIMEOUT);
+}
+
+esp_err_t wm_resume_wifi_manager(void) {
+    if(!wm_run_conf) return ESP_ERR_NOT_ALLOWED;    /* Safety check */
+    wm_cmd_t cmd = { .cmd_id = WM_CMD_RESUME };
+    return wm_cmd_exec(&cmd, CONFIG_WIFIMGR_CMD_TIMEOUT);
+}
+
+esp_err_t wm_add_known_network( char *ssid, char *pwd) {
+    if(!wm_run_conf) return ESP_ERR_NOT_ALLOWED;    /* Safety check */
+    if(!ssid || !pwd || (ESP_OK != wm_check_ssid_pwd(ssid, pwd))) return ESP_ERR_INVALID_ARG;
+    wm_cmd_t cmd = { .cmd_id = WM_CMD_KN_ADD };
+    strncpy(cmd.net_config.ssid, ssid, sizeof(cmd.net_config.ssid) - 1);
+    strncpy(cmd.net_config.password, pwd, sizeof(cmd.net_config.password));   /* 64 characters PSK is not NULL terminated */
+    return wm_cmd_exec(&cmd, CONFIG_WIFIMGR_CMD_TIMEOUT);
+}
+
+esp_err_t wm_add_known_network_config( wm_net_base_config_t *known_network) {
+    if(!wm_run_conf) return ESP_ERR_NOT_ALLOWED;    /* Safety check */
+    if(!known_network || (ESP_OK != wm_check_ssid_pwd(known_network->ssid, known_network->password))) return ESP_ERR_INVALID_ARG;
+    wm_cmd_t cmd = { .cmd_id = WM_CMD_KN_ADD, .net_config = *known_network };
+    return wm_cmd_exec(&cmd, CONFIG_WIFIMGR_CMD_TIMEOUT);
+}
+
+esp_err_t wm_set_power_profile(wm_power_profile_t profile) {
+    if(!wm_run_conf) return ESP_ERR_NOT_ALLOWED;    /* Safety check */
+    if(profile >= WM_POWER_PROFILE_MAX) return ESP_ERR_INVALID_ARG;
+    wm_cmd_t cmd = { .cmd_id = WM_CMD_POWER_PROFILE, .power_profile = profile };
+    return wm_cmd_exec(&cmd, CONFIG_WIFIMGR_CMD_TIMEOUT);
+}
+
+esp_err_t wm_set_ap_profile(const wm_ap_profile_t *profile) {
+    if(!wm_run_conf) return ESP_ERR_NOT_ALLOWED;    /* Safety check */
+    if(!profile || (ESP_OK != wm_check_ap_profile(profile))) return ESP_ERR_INVALID_ARG;
+    wm_cmd_t cmd = { .cmd_id = WM_CMD_AP_PROFILE, .ap_profile = *profile };
+    return wm_cmd_exec(&cmd, CONFIG_WIFIMGR_CMD_TIMEOUT);
+}
+
+esp_err_t wm_scan_now(void) {
+    if(!wm_run_conf) return ESP_ERR_NOT_ALLOWED;    /* Safety check */
+    wm_cmd_t cmd = { .cmd_id = WM_CMD_SCAN_NOW };
+    /* Completion is WM_EVENT_SCAN_RESULTS - caller never waits for manager task */
+    return wm_cmd_submit(&cmd, NULL, NULL);
+}
+
+esp_err_t wm_register_direct_cb(int32_t event_id, wm_direct_cb_t cb, void *cb_arg) {
+    if(!wm_run_conf) return ESP_ERR_NOT_ALLOWED;    /* Safety check */
+    #if (CONFIG_WIFIMGR_DIRECT_CB == 1)
+    wm_cmd_t cmd = { .cmd_id = WM_CMD_DIRECT_CB, .direct_cb = { .event_id = event_id, .cb = cb, .cb_arg = cb_arg, .add = true } };
+    return wm_cmd_exec(&cmd, CONFIG_WIFIMGR_CMD_TIMEOUT);
+    #else
+    return ESP_ERR_NOT_SUPPORTED;
+    #endif
+}
+
+esp_err_t wm_unregister_direct_cb(int32_t event_id, wm_direct_cb_t cb) {
+    if(!wm_run_conf) return ESP_ERR_NOT_ALLOWED;    /* Safety check */
+    #if (CONFIG_WIFIMGR_DIRECT_CB == 1)
+    wm_cmd_t cmd = { .cmd_id = WM_CMD_DIRECT_CB, .direct_cb = { .event_id = event_id, .cb = cb, .add = false } };
+    return wm_cmd_exec(&cmd, CONFIG_WIFIMGR_CMD_TIMEOUT);
+    #else
+    return ESP_ERR_NOT_SUPPORTED;
+    #endif
+}
+
+esp_err_t wm_set_inet_probe(const char *host, uint16_t port, const char *path, uint16_t expected_status) {
+    if(!wm_run_conf) return ESP_ERR_NOT_ALLOWED;    /* Safety check */
+    #if (CONFIG_WIFIMGR_INET_CHECK == 1)
+    wm_cmd_t cmd = { .cmd_id = WM_CMD_INET_PROBE, .inet_probe = { .port = port, .expected_status = expected_status } };
+    if(host) {
+        if(!path || (strlen(host) >= sizeof(cmd.inet_probe.host)) || (strlen(path) >= sizeof(cmd.inet_probe.path))) return ESP_ERR_INVALID_ARG;
+        strcpy(cmd.inet_probe.host, host);
+        strcpy(cmd.inet_probe.path, path);
+    }
+    return wm_cmd_exec(&cmd, CONFIG_WIFIMGR_CMD_TIMEOUT);
+    #else
+    return ESP_ERR_NOT_SUPPORTED;
+    #endif
+}
+
+esp_err_t wm_bulk_known_networks(wm_kn_bulk_entry_t *entries, size_t count, bool replace_all) {
+    if(!wm_run_conf) return ESP_ERR_NOT_ALLOWED;    /* Safety check */
+    if(!entries && count) return ESP_ERR_INVALID_ARG;
+    wm_cmd_t cmd = { .cmd_id = WM_CMD_KN_BULK, .bulk = { .entries = entries, .count = count, .replace_all = replace_all } };
+    /* Entries are owned by manager task until completion - no timeout */
+    return wm_cmd_exec(&cmd, WM_CMD_WAIT_FOREVER);
+}
+
+esp_err_t wm_export_config(uint8_t *buf, size_t *size) {
+    if(!wm_run_conf) return ESP_ERR_NOT_ALLOWED;    /* Safety check */
+    if(!size) return ESP_ERR_INVALID_ARG;
+    wm_cfg_image_t *image = (wm_cfg_image_t *)wm_fp_calloc(1, sizeof(wm_cfg_image_t));
+    if(!image) return ESP_ERR_NO_MEM;
+    wm_cmd_t cmd = { .cmd_id = WM_CMD_CFG_EXPORT, .cfg_image = image };
+    /* Image is owned by manager task until completion - no timeout */
+    esp_err_t err = wm_cmd_exec(&cmd, WM_CMD_WAIT_FOREVER);
+    if(err == ESP_OK) {
+        size_t required = wm_cfg_encode(image, NULL, 0);
+        if(buf && (*size >= required)) *size = wm_cfg_encode(image, buf, *size);
+        else {
+            if(buf) err = ESP_ERR_INVALID_SIZE;
+            *size = required;
+        }
+    }
+    wm_fp_free(image);
+    return err;
+}
+
+esp_err_t wm_import_config(const uint8_t *buf, size_t size) {
+    if(!wm_run_conf) return ESP_ERR_NOT_ALLOWED;    /* Safety check */
+    wm_cfg_image_t *image = (wm_cfg_image_t *)wm_fp_calloc(1, sizeof(wm_cfg_image_t));
+    if(!image) return ESP_ERR_NO_MEM;
+    esp_err_t err = ESP_OK;
+    switch(wm_cfg_decode(buf, size, image)) {
+        case WM_CFG_OK: break;
+        case WM_CFG_ERR_CRC: err = ESP_ERR_INVALID_CRC; break;
+        case WM_CFG_ERR_VERSION: err = ESP_ERR_INVALID_VERSION; break;
+        case WM_CFG_ERR_SIZE: err = ESP_ERR_INVALID_SIZE; break;
+        default: err = ESP_ERR_INVALID_ARG; break;
+    }
+    if(err == ESP_OK) {
+        wm_cmd_t cmd = { .cmd_id = WM_CMD_CFG_IMPORT, .cfg_image = image };
+        /* Image is owned by manager task until completion - no timeout */
+        err = wm_cmd_exec(&cmd, WM_CMD_WAIT_FOREVER);
+    }
+    wm_fp_free(image);
+    return err;
+}
+
+esp_err_t wm_cmd_submit(const wm_cmd_t *cmd, wm_cmd_done_cb_t done_cb, void *cb_arg) {
+    if(!wm_run_conf) return ESP_ERR_NOT_ALLOWED;    /* Safety check */
+    if(!cmd || (cmd->cmd_id >= WM_CMD_MAX)) return ESP_ERR_INVALID_ARG;
+    wm_msg_t *msg = (wm_msg_t *)wm_fp_calloc(1, sizeof(wm_msg_t));
+    if(!msg) return ESP_ERR_NO_MEM;
+    msg->type = WM_MSG_CMD;
+    msg->cmd.cmd = *cmd;
+    msg->cmd.done_cb = done_cb;
+    msg->cmd.cb_arg = cb_arg;
+    /* Manager task can't wait for room in own queue */
+    TickType_t wait = (xTaskGetCurrentTaskHandle() == wm_run_conf->mgrTask_handle) ? 0 : pdMS_TO_TICKS(CONFIG_WIFIMGR_CMD_TIMEOUT);
+    esp_err_t err = (pdTRUE == xQueueSend(wm_run_conf->mgr_queue, msg, wait)) ? ESP_OK : ESP_ERR_TIMEOUT;
+    wm_fp_free(msg);
+    return err;
+}
+
+esp_err_t wm_cmd_exec(const wm_cmd_t *cmd, uint32_t timeout_ms) {
+    if(!wm_run_conf) return ESP_ERR_NOT_ALLOWED;    /* Safety check */
+    if(!cmd || (cmd->cmd_id >= WM_CMD_MAX)) return ESP_ERR_INVALID_ARG;
+    if(xTaskGetCurrentTaskHandle() == wm_run_conf->mgrTask_handle) {
+        #if (CONFIG_WIFIMGR_DIRECT_CB == 1)
+        if(wm_run_conf->direct_depth) {
+            /* Called from direct callback inside event handler - run after current message.
+               Unbounded commands borrow caller buffers and can't outlive the call */
+            if(timeout_ms == WM_CMD_WAIT_FOREVER) return ESP_ERR_INVALID_STATE;
+            return wm_cmd_submit(cmd, NULL, NULL);
+        }
+        #endif
+        /* Called from completion callback - manager task can't wait for itself */
+        wm_cmd_t *local = (wm_cmd_t *)wm_fp_calloc(1, sizeof(wm_cmd_t));
+        if(!local) return ESP_ERR_NO_MEM;
+        *local = *cmd;
+        esp_err_t err = wm_cmd_process(local);
+        wm_fp_free(local);
+        return err;
+    }
+    wm_cmd_sync_t *sync = (wm_cmd_sync_t *)wm_fp_calloc(1, sizeof(wm_cmd_sync_t));
+    if(!sync) return ESP_ERR_NO_MEM;
+    sync->done = xSemaphoreCreateBinary();
+    if(!sync->done) {
+        wm_fp_free(sync);
+        return ESP_ERR_NO_MEM;
+    }
+    sync->refs = 2;     /* Caller and manager task */
+    esp_err_t err = wm_cmd_submit(cmd, wm_cmd_sync_done, sync);
+    if(err != ESP_OK) {
+        vSemaphoreDelete(sync->done);
+        wm_fp_free(sync);
+        return err;
+    }
+    if(xSemaphoreTake(sync->done, (timeout_ms == WM_CMD_WAIT_FOREVER) ? portMAX_DELAY : pdMS_TO_TICKS(timeout_ms)) == pdTRUE) err = sync->result;
+    else err = ESP_ERR_TIMEOUT;
+    wm_cmd_sync_release(sync);
+    return err;
+}
+
+void wm_ap_activity_notify(void) {
+    if(!wm_run_conf) return;    /* Safety check */
+    wm_run_conf->ap_scan.last_activity = xTaskGetTickCount();
+}
+
+void wm_set_country(char *cc) {
+    if(!wm_run_conf || !cc) return;    /* Safety check */
+    wm_cmd_t cmd = { .cmd_id = WM_CMD_SET_COUNTRY };
+    strncpy(cmd.country_code, cc, sizeof(cmd.country_code) - 1);
+    wm_cmd_exec(&cmd, CONFIG_WIFIMGR_CMD_TIMEOUT);
+}
+
+void wm_change_ap_mode_config( wm_net_base_config_t *ap_conf ) {
+    if(!wm_run_conf || !ap_conf) return;    /* Safety check */
+    wm_cmd_t cmd = { .cmd_id = WM_CMD_AP_CONFIG, .net_config = *ap_conf };
+    wm_cmd_exec(&cmd, CONFIG_WIFIMGR_CMD_TIMEOUT);
+}
+
+void wm_set_sta_dns_by_id(esp_ip4_addr_t dns_ip, uint32_t known_network_id) {
+    if(!wm_run_conf) return;    /* Safety check */
+    if(known_network_id) {
+        wm_cmd_t cmd = { .cmd_id = WM_CMD_STA_DNS, .net_ref = { .net_config_id = known_network_id, .dns_ip = dns_ip } };
+        wm_cmd_exec(&cmd, CONFIG_WIFIMGR_CMD_TIMEOUT);
+    }
+}
+
+void wm_set_sta_dns_by_ssid(esp_ip4_addr_t dns_ip, char *ssid) {
+    if(!wm_run_conf) return;    /* Safety check */
+    if(ssid) {
+        wm_cmd_t cmd = { .cmd_id = WM_CMD_STA_DNS, .net_ref = { .dns_ip = dns_ip } };
+        strncpy(cmd.net_ref.ssid, ssid, sizeof(cmd.net_ref.ssid) - 1);
+        wm_cmd_exec(&cmd, CONFIG_WIFIMGR_CMD_TIMEOUT);
+    }
+}
+
+void wm_set_secondary_dns(esp_ip4_addr_t dns_ip) {
+    if(!wm_run_conf) return;    /* Safety check */
+    wm_cmd_t cmd = { .cmd_id = WM_CMD_SEC_DNS, .net_ref = { .dns_ip = dns_ip } };
+    wm_cmd_exec(&cmd, CONFIG_WIFIMGR_CMD_TIMEOUT);
+}
+
+void wm_del_known_net_by_id( uint32_t known_network_id ) {
+    if(!wm_run_conf) return;    /* Safety check */
+    if(!known_network_id) {
+        wm_event_post(WM_EVENT_KN_DEL_FAIL, NULL, 0);
+        return;
+    }
+    wm_cmd_t cmd = { .cmd_id = WM_CMD_KN_DEL, .net_ref = { .net_config_id = known_network_id } };
+    wm_cmd_exec(&cmd, CONFIG_WIFIMGR_CMD_TIMEOUT);
+}
+
+void wm_del_known_net_by_ssid( char *ssid ) {
+    if(!wm_run_conf) return;    /* Safety check */
+    if(!ssid) {
+        wm_event_post(WM_EVENT_KN_DEL_FAIL, NULL, 0);
+        return;
+    }
+    wm_cmd_t cmd = { .cmd_id = WM_CMD_KN_DEL };
+    strncpy(cmd.net_ref.ssid, ssid, sizeof(cmd.net_ref.ssid) - 1);
+    wm_cmd_exec(&cmd, CONFIG_WIFIMGR_CMD_TIMEOUT);
+}
+
+wm_known_net_config_t *wm_get_known_networks(size_t *size) {
+    *size = 0;
+    if(!wm_run_conf) return NULL;     /* Safety check */
+    wm_kn_snapshot_t *snap = wm_kn_snapshot_acquire();
+    wm_known_net_config_t *known_net = NULL;
+    if(snap && snap->count) {
+        known_net = (wm_known_net_config_t *)wm_fp_calloc(snap->count, sizeof(wm_known_net_config_t));
+        if(known_net) {
+            memcpy(known_net, snap->nets, snap->count * sizeof(wm_known_net_config_t));
+            *size = snap->count;
+        }
+    }
+    wm_kn_snapshot_release(snap);
+    return (*size) ? known_net : NULL;
+}
+
+uint32_t wm_get_known_networks_version(void) {
+    if(!wm_run_conf) return 0;    /* Safety check */
+    wm_kn_snapshot_t *snap = wm_kn_snapshot_acquire();
+    uint32_t version = (snap) ? snap->version : 0;
+    wm_kn_snapshot_release(snap);
+    return version;
+}
+
+void wm_get_ap_config(wm_net_base_config_t *ap_conf) {
+    if(!wm_run_conf) return;    /* Safety check */
+    memcpy(ap_conf, (char *)&wm_run_conf->ap_conf, sizeof(wm_net_base_config_t));
+}
+
+void wm_get_ap_profile(wm_ap_profile_t *profile) {
+    if(!profile) return;
+    memset(profile, 0, sizeof(wm_ap_profile_t));
+    if(!wm_run_conf) return;    /* Safety check */
+    *profile = wm_run_conf->ap_profile;
+}
+
+void wm_get_power_stats(wm_power_stats_t *stats) {
+    if(!wm_run_conf || !stats) return;    /* Safety check */
+    /* Manager task moves accounting on power save change - copy it whole */
+    portENTER_CRITICAL(&wm_stats_lock);
+    wm_power_state_t power = wm_run_conf->power;
+    portEXIT_CRITICAL(&wm_stats_lock);
+    TickType_t elapsed = xTaskGetTickCount() - power.since;
+    uint64_t total = power.total_ticks + elapsed;
+    uint64_t on = power.on_ticks + (uint64_t)elapsed * wm_ps_duty_cycle(power.ps_type);
+    stats->profile = power.profile;
+    stats->ps_type = power.ps_type;
+    stats->listen_interval = (power.profile == WM_POWER_LOW) ? CONFIG_WIFIMGR_PS_LISTEN_INTERVAL : 3;
+    stats->duty_cycle = (total) ? (uint16_t)(on / total) : 1000;
+}
+
+void wm_get_inet_probe_result(wm_inet_probe_result_t *result) {
+    if(!result) return;
+    memset(result, 0, sizeof(wm_inet_probe_result_t));
+    if(!wm_run_conf) return;    /* Safety check */
+    #if (CONFIG_WIFIMGR_INET_CHECK == 1)
+    portENTER_CRITICAL(&wm_stats_lock);
+    *result = wm_run_conf->inet.result;
+    portEXIT_CRITICAL(&wm_stats_lock);
+    #endif
+}
+
+void wm_get_dns_health(wm_dns_health_t *health) {
+    if(!health) return;
+    memset(health, 0, sizeof(wm_dns_health_t));
+    if(!wm_run_conf) return;    /* Safety check */
+    #if (CONFIG_WIFIMGR_DNS_RACE == 1)
+    portENTER_CRITICAL(&wm_stats_lock);
+    *health = wm_run_conf->dns.health;
+    portEXIT_CRITICAL(&wm_stats_lock);
+    #endif
+}
+
+void wm_get_footprint(wm_footprint_t *fp) {
+    if(!fp) return;
+    memset(fp, 0, sizeof(wm_footprint_t));
+    if(!wm_run_conf) return;    /* Safety check */
+    #if (CONFIG_WIFIMGR_FOOTPRINT == 1)
+    portENTER_CRITICAL(&wm_fp_lock);
+    *fp = wm_fp.stats;
+    portEXIT_CRITICAL(&wm_fp_lock);
+    fp->heap_min_free = heap_caps_get_minimum_free_size(MALLOC_CAP_8BIT);
+    #endif
+}
+
+size_t wm_get_trace(uint8_t *buf, size_t size, bool restart) {
+    size_t len = 0;
+    if(!wm_run_conf) return 0;    /* Safety check */
+    #if (CONFIG_WIFIMGR_TRACE == 1)
+    if(!wm_trace_cap.lock) return 0;
+    /* Writers wait for copy, interrupts stay enabled */
+    xSemaphoreTake(wm_trace_cap.lock, portMAX_DELAY);
+    len = wm_trace_cap.log.len;
+    if(buf) {
+        if(size < len) len = 0;
+        else memcpy(buf, wm_trace_cap.buf, len);
+    }
+    /* New log starts before next record - no record lost between copy and restart */
+    if(buf && len && restart) {
+        wm_trace_start(&wm_trace_cap.log, wm_trace_cap.buf, sizeof(wm_trace_cap.buf), (uint32_t)(esp_timer_get_time() / 1000));
+        wm_trace_cap.heap_last = 0;
+    }
+    xSemaphoreGive(wm_trace_cap.lock);
+    #endif
+    return len;
+}
+
+size_t wm_get_conn_profiles(wm_conn_profile_t *profiles, size_t max_count) {
+    size_t count = 0;
+    if(!wm_run_conf || !profiles) return 0;    /* Safety check */
+    #if (CONFIG_WIFIMGR_CONN_PROFILER == 1)
+    wm_conn_profiler_t *prof = &wm_run_conf->prof;
+    portENTER_CRITICAL(&wm_prof_lock);
+    for(; (count < max_count) && (count < prof->count); count++) {
+        profiles[count] = prof->history[(prof->head + CONFIG_WIFIMGR_CONN_PROFILE_HISTORY - 1 - count) % CONFIG_WIFIMGR_CONN_PROFILE_HISTORY];
+    }
+    portEXIT_CRITICAL(&wm_prof_lock);
+    #endif
+    return count;
+}
+
+void wm_get_wd_stats(wm_wd_stats_t *stats) {
+    if(!stats) return;
+    memset(stats, 0, sizeof(wm_wd_stats_t));
+    if(!wm_run_conf) return;    /* Safety check */
+    portENTER_CRITICAL(&wm_wd_lock);
+    *stats = wm_run_conf->wd.stats;
+    portEXIT_CRITICAL(&wm_wd_lock);
+}
+
+size_t wm_get_scan_results(const wm_scan_filter_t *filter, wm_scan_entry_t *entries, size_t max_count) {
+    if(!wm_run_conf || !entries) return 0;    /* Safety check */
+    size_t count = 0;
+    TickType_t now = xTaskGetTickCount();
+    /* Filtering runs on immutable snapshot - merge of next scan is never blocked */
+    wm_scan_snapshot_t *snap = wm_scan_snapshot_acquire();
+    if(!snap) return 0;
+    for(int i=0; (i < snap->cache.count) && (count < max_count); i++) {
+        entries[count] = snap->cache.entry[i];
+        entries[count].age_ms = (uint32_t)(now - snap->cache.seen[i]) * portTICK_PERIOD_MS;
+        if(wm_scan_filter_match(filter, &entries[count])) count++;
+    }
+    wm_scan_snapshot_release(snap);
+    return count;
+}
+
+void wm_get_link_quality(wm_link_quality_t *link) {
+    if(!link) return;
+    memset(link, 0, sizeof(wm_link_quality_t));
+    if(!wm_run_conf) return;    /* Safety check */
+    #if (CONFIG_WIFIMGR_LINK_MONITOR == 1)
+    portENTER_CRITICAL(&wm_stats_lock);
+    if(wm_run_conf->sta_connected) *link = wm_run_conf->link_mon.link;
+    portEXIT_CRITICAL(&wm_stats_lock);
+    #endif
+}
+
+uint32_t wm_get_kn_config_id(char *ssid) {
+    if(!wm_run_conf || !ssid) return 0;    /* Safety check */
+    uint32_t net_config_id = 0;
+    wm_kn_snapshot_t *snap = wm_kn_snapshot_acquire();
+    for(uint8_t i=0; snap && !net_config_id && (i<snap->count); i++) {
+        if(!strcmp(ssid, snap->nets[i].net_config.ssid)) net_config_id = snap->nets[i].net_config_id;
+    }
+    wm_kn_snapshot_release(snap);
+    return net_config_id;
+}
+
+void wm_create_apmode_config( wm_apmode_config_t *full_ap_cfg) {
+    if(!full_ap_cfg) return;
+    *full_ap_cfg = (wm_apmode_config_t) {
+        .base_conf = (wm_net_base_config_t) {
+            .ssid = CONFIG_WIFIMGR_AP_SSID,
+            .password = CONFIG_WIFIMGR_AP_PWD,
+            .ip_config.static_ip = {{ IPADDR_ANY }, { IPADDR_ANY }, { IPADDR_ANY }},
+            .ip_config.pri_dns_server = { IPADDR_ANY }
+        },
+        .ap_channel = CONFIG_WIFIMGR_AP_CHANNEL
+    };
+    wm_country_from_plan(CONFIG_WIFIMGR_COUNTRY_CODE, &full_ap_cfg->country);
+    wm_default_ap_profile(&full_ap_cfg->ap_profile);
+}
+
+uint8_t wm_netmask_to_cidr(uint32_t nm)
+{
+    nm = nm - ((nm >> 1) & ((u32_t)0x55555555UL));
+    nm = (nm & ((u32_t)0x33333333UL)) + ((nm >> 2) & ((u32_t)0x33333333UL));
+    nm = (nm + (nm >> 4)) & ((u32_t)0x0F0F0F0FUL);
+    nm = nm + (nm >> 8);
+    nm = nm + (nm >> 16);
+    return (uint8_t)( nm & ((u32_t)0x0000003FUL));
+}
+
+/**
+ * Internal event functions
+*/
+
+static void wm_wifi_event_handler(void* arg, esp_event_base_t event_base, int32_t event_id, void* event_data) {
+    if(wm_run_conf->suspended) return;  /* Radio stop notifications */
+    if (event_base == WIFI_EVENT) {
+        if(event_id == WIFI_EVENT_SCAN_DONE) {
+            wm_wd_disarm(WM_WD_SCAN);
+            if(((wifi_event_sta_scan_done_t *)event_data)->status == 0) {
+                uint16_t found_ap_count = 0;
+                wifi_scan_channel_bitmap_t hidden_channels = { 0 };
+                bool directed = wm_run_conf->hidden_scanning;
+                #if (CONFIG_WIFIMGR_AP_CHANNEL == 0)
+                wm_airband_rank_t *airband = &wm_run_conf->airband;
+                #endif
+                wm_blist_expire();
+                esp_wifi_scan_get_ap_num(&found_ap_count);
+                wifi_ap_record_t *found_ap_info = (wifi_ap_record_t *)wm_fp_calloc(found_ap_count, sizeof(wifi_ap_record_t));
+                esp_wifi_scan_get_ap_records(&found_ap_count, found_ap_info);
+                wm_capture_scan(found_ap_info, found_ap_count);
+                if(!wm_run_conf->scanned_channel || wm_run_conf->ap_slice_scan) {
+                    memset(&(wm_run_conf->found_known_ap), 0, sizeof(wifi_ap_record_t));
+                }
+                #if (CONFIG_WIFIMGR_AP_CHANNEL == 0)
+                if(directed) {
+                    /* Directed probes do not update ranking */
+                } else if(!wm_run_conf->scanned_channel) {
+                    memset(&airband->channel, 0, sizeof(airband->channel));
+                    memset(&airband->rssi, 0b10011111, sizeof(airband->rssi)); /* set min RSSI */
+                } else {
+                    /* Single channel scan refreshes own slot, other slots are kept from previous scans */
+                    int slot = wm_chan_slot(wm_run_conf->scanned_channel);
+                    if(slot >= 0) {
+                        airband->channel[slot] = 0;
+                        airband->rssi[slot] = 0b10011111;
+                    }
+                }
+                #endif
+
+                if(!directed) {
+                    bool scan_done = !wm_run_conf->scanned_channel;
+                    if(wm_run_conf->ap_slice_scan && wm_run_conf->scan_req) scan_done = (++(wm_run_conf->ap_scan.req_slices) >= wm_chan_count(false));
+                    wm_scan_cache_update(found_ap_info, found_ap_count, scan_done);
+                    if(scan_done && wm_run_conf->scan_req) {
+                        /* Any broadcast scan or full round of softAP slices completes pending request */
+                        uint32_t cached = wm_run_conf->scan_cache.count;
+                        wm_run_conf->scan_req = 0;
+                        wm_event_post(WM_EVENT_SCAN_RESULTS, &cached, sizeof(uint32_t));
+                    }
+                }
+                wm_run_conf->known_ssid = 0;
+                for(int i=0; ( i<found_ap_count ); i++) {
+                    if(!found_ap_info[i].ssid[0]) wm_chan_bitmap_set(&hidden_channels, found_ap_info[i].primary);
+                    if((!wm_run_conf->scanned_channel || wm_run_conf->ap_slice_scan) && !wm_is_blacklisted(found_ap_info[i].bssid)) {
+                        /* Strongest known AP. 5 GHz AP wins within preference margin */
+                        if(!wm_run_conf->known_ssid || (wm_ap_score(&found_ap_info[i]) > wm_ap_score(&wm_run_conf->found_known_ap))) {
+                            wm_ll_known_network_node_t *found_ssid = wm_find_known_net_by_ssid((char *)found_ap_info[i].ssid);
+                            if(found_ssid) {
+                                /* AP in list found in known networks */
+                                wm_run_conf->found_known_ap = found_ap_info[i];
+                                wm_run_conf->known_ssid = 1;
+                                found_ssid->payload.last_channel = found_ap_info[i].primary;
+                            }
+                        }
+                    }
+                    #if (CONFIG_WIFIMGR_AP_CHANNEL == 0)
+                    if((wm_run_conf->ap_channel == 0) && !directed) wm_airband_add(airband, &found_ap_info[i]);
+                    #endif
+                }
+                #if (CONFIG_WIFIMGR_AP_CHANNEL == 0)
+                if((wm_run_conf->ap_channel == 0) && !directed) {
+                    int iRatedChannel = 0;
+                    float fRatedRSSI = 0.0f, fCalcRSSI = 0.0f;
+                    /* Rank only channels allowed for AP by country plan and band rules */
+                    for(int i=0; i<WM_CHAN_SLOTS; i++) {
+                        if(!wm_chan_allowed(&wm_run_conf->country, wm_slot_chan(i), true)) continue;
+                        fCalcRSSI = wm_airband_score(airband, i);
+                        if( fRatedRSSI>fCalcRSSI ) {
+                            fRatedRSSI = fCalcRSSI;
+                            iRatedChannel = wm_slot_chan(i);
+                        }
+                    }
+                    if( wm_run_conf->ap.driver_config->ap.channel != iRatedChannel ) {
+                        wm_run_conf->ap.driver_config->ap.channel = iRatedChannel;
+                    };
+                    /* HT40 only over unused secondary channel */
+                    if(iRatedChannel) wm_run_conf->ap_second = wm_ap_second_chan(iRatedChannel, airband->channel);
+                }
+                #endif
+                wm_fp_free(found_ap_info);
+                if(!wm_run_conf->sta_connected && !wm_run_conf->scanned_channel && !wm_run_conf->known_ssid) {
+                    /* Broadcast scan found nothing. Probe for hidden known networks before fallback */
+                    if(!directed) wm_hidden_scan_prepare(hidden_channels);
+                    if(wm_hidden_scan_next()) return;
+                }
+                wm_run_conf->hidden_scanning = 0;
+                wm_run_conf->hidden_scan.count = 0;
+                wm_run_conf->ap_slice_scan = 0;
+                wm_run_conf->scanning = 1;
+                if(!(wm_run_conf->sta_connected)) {
+                    wm_prof_mark(WM_PHASE_SCAN_DONE);
+                    if(strlen((char *)wm_run_conf->found_known_ap.ssid) > 0 ) {
+                        if(!wm_run_conf->sta_connecting) {
+                            /* Known networks are changed only by manager task - pointer is safe here */
+                            wm_ll_known_network_node_t *net_conf = wm_find_known_net_by_ssid((char *)wm_run_conf->found_known_ap.ssid);
+                            if(net_conf) {
+                                strcpy((char *)wm_run_conf->sta.driver_config->sta.ssid, net_conf->payload.net_config.ssid);
+                                strncpy((char *)wm_run_conf->sta.driver_config->sta.password, net_conf->payload.net_config.password, sizeof(wm_run_conf->sta.driver_config->sta.password));
+                                wm_run_conf->sta.driver_config->sta.bssid_set = 1;
+                                memcpy(wm_run_conf->sta.driver_config->sta.bssid, wm_run_conf->found_known_ap.bssid, 6);
+                                wm_run_conf->sta.driver_config->sta.channel = wm_run_conf->found_known_ap.primary;
+                                wm_run_conf->sta.driver_config->sta.listen_interval = (wm_run_conf->power.profile == WM_POWER_LOW) ? CONFIG_WIFIMGR_PS_LISTEN_INTERVAL : 0;
+                                if( ESP_OK == esp_wifi_set_config(WIFI_IF_STA, wm_run_conf->sta.driver_config)) {
+                                    wm_run_conf->sta_connecting = 1;
+                                    wm_run_conf->sta_connect_retry = 0;
+                                    wm_apply_power_state();
+                                    wm_wd_arm(WM_WD_CONNECT);
+                                    wm_prof_mark(WM_PHASE_CONNECT);
+                                    esp_wifi_connect();
+                                } else {
+                                    /* Notification for failed connect */
+                                    wm_event_post(WM_EVENT_STA_MODE_FAIL, NULL, 0);
+                                }
+                            }
+                        }
+                    } else {
+                        wm_restart_ap();
+                    }
+                }
+            } else {
+                /* Failed scan. Drop pending directed probes and reenable scanning */
+                wm_run_conf->hidden_scanning = 0;
+                wm_run_conf->hidden_scan.count = 0;
+                wm_run_conf->ap_slice_scan = 0;
+                wm_run_conf->scanning = 1;
+            }
+            return;
+        }
+
+        if ( event_id == WIFI_EVENT_STA_START) {
+            esp_wifi_connect();
+            return;
+        }
+
+        if ( event_id == WIFI_EVENT_STA_CONNECTED ) {
+            wm_prof_mark(WM_PHASE_ASSOC);
+            wm_wd_disarm(WM_WD_CONNECT);
+            wm_wd_arm(WM_WD_DHCP);
+            wm_event_post(WM_EVENT_STA_CONNECT, &wm_run_conf->found_known_ap, sizeof(wifi_ap_record_t));
+            /* Delete all blacklisted AP when one is successfuly connected */
+            wm_del_blist_bssid(esp_rom_crc32_le(0, (const unsigned char *)wm_run_conf->sta.driver_config->sta.ssid, strlen((const char *)wm_run_conf->sta.driver_config->sta.ssid)));
+            wm_ll_known_network_node_t *net_conf = wm_find_known_net_by_ssid((char *)wm_run_conf->found_known_ap.ssid);
+            /* Network deleted while connecting falls back to DHCP */
+            wm_set_interface_ip(WIFI_IF_STA, (net_conf) ? &(net_conf->payload.net_config.ip_config) : NULL);
+
+            wm_run_conf->blacklist_reason = 0;
+            #if (CONFIG_WIFIMGR_LINK_MONITOR == 1)
+            wm_link_monitor_run(true);
+            #endif
+            #if (CONFIG_WIFIMGR_RUN_SNTP_WHEN_STA == 1)
+            esp_sntp_config_t *sntp_config = (esp_sntp_config_t *)wm_fp_malloc(sizeof(esp_sntp_config_t));
+            *sntp_config = (esp_sntp_config_t) { 
+                .smooth_sync = 0, 
+                .server_from_dhcp = 0, 
+                .wait_for_sync = 1, 
+                .start = 1, 
+                .sync_cb = wm_sntp_sync_cb,     //((void *)0)
+                .renew_servers_after_new_IP = 0, 
+                .ip_event_to_renew = IP_EVENT_STA_GOT_IP, 
+                .index_of_first_server = 0, 
+                .num_of_servers = (1), 
+                .servers = {"pool.ntp.org"} // From config???
+                };
+            esp_netif_sntp_init(sntp_config);
+            wm_fp_free(sntp_config);
+            #endif
+            return;
+        }
+
+        if (event_id == WIFI_EVENT_STA_DISCONNECTED) {
+            #if (CONFIG_WIFIMGR_RUN_SNTP_WHEN_STA == 1)
+                /* Destroy sntp */
+                esp_netif_sntp_deinit();
+            #endif
+            #if (CONFIG_WIFIMGR_LINK_MONITOR == 1)
+            wm_link_monitor_run(false);
+            #endif
+            #if (CONFIG_WIFIMGR_INET_CHECK == 1)
+            wm_run_conf->inet.link_seq++;
+            #endif
+            #if (CONFIG_WIFIMGR_DNS_RACE == 1)
+            wm_dns_race_stop();
+            #endif
+            /* Established link lost - attempt is over */
+            if(wm_run_conf->sta_connected) wm_prof_finish();
+            wm_disc_action_t action = wm_disc_classify(((wifi_event_sta_disconnected_t *)event_data)->reason);
+            if(wm_run_conf->blacklist_reason) action = WM_DISC_BLACKLIST;
+            else if((wm_run_conf->sta_connect_retry >= wm_run_conf->max_sta_connect_retry) && (action < WM_DISC_RESCAN)) action = WM_DISC_NEXT;
+            if(action <= WM_DISC_BACKOFF) {
+                /* Lost link or DHCP supervised again as connect attempt */
+                wm_wd_disarm(WM_WD_DHCP);
+                if(!wm_run_conf->wd.deadline[WM_WD_CONNECT]) wm_wd_arm(WM_WD_CONNECT);
+            }
+            if(action == WM_DISC_RETRY) {
+                wm_prof_mark(WM_PHASE_CONNECT);
+                esp_wifi_connect();
+                wm_run_conf->sta_connect_retry++;
+            } else if(action == WM_DISC_BACKOFF) {
+                /* Scanning stays on hold until backoff reconnect */
+                xTimerChangePeriod(wm_run_conf->retry_timer, pdMS_TO_TICKS(CONFIG_WIFIMGR_RETRY_BACKOFF << wm_run_conf->sta_connect_retry), 0);
+                wm_run_conf->sta_connect_retry++;
+            } else wm_disc_give_up(action);
+        }
+        #if (CONFIG_WIFIMGR_LINK_MONITOR == 1)
+        if (event_id == WIFI_EVENT_STA_BEACON_TIMEOUT) {
+            wm_run_conf->link_mon.beacon_loss++;
+            #if (CONFIG_WIFIMGR_TXP_CONTROL == 1)
+            /* Missed beacons - do not wait for next sample */
+            wm_txp_set(WM_TXP_FULL);
+            #endif
+            return;
+        }
+        #endif
+        /* Control station connected to softAP */
+        if (event_id == WIFI_EVENT_AP_STACONNECTED) {
+            /* Budget accrues only while clients are attached */
+            if(!wm_run_conf->station_connected_to_ap) wm_run_conf->ap_scan.last_refill = xTaskGetTickCount();
+            wm_run_conf->station_connected_to_ap = 1;
+            wm_run_conf->ap_scan.last_activity = xTaskGetTickCount();
+            wm_event_post(WM_EVENT_AP_STA_CONNECTED, event_data, sizeof(wifi_event_ap_staconnected_t));
+        }
+
+        if (event_id == WIFI_EVENT_AP_STADISCONNECTED) {
+            wm_ap_update_clients();
+            wm_run_conf->ap_scan.last_activity = xTaskGetTickCount();
+            wm_event_post(WM_EVENT_AP_STA_DISCONNECTED, event_data, sizeof(wifi_event_ap_stadisconnected_t));
+        }
+    }
+}
+
+static void wm_ip_event_handler(void* arg, esp_event_base_t event_base, int32_t event_id, void* event_data) {
+    if(wm_run_conf->suspended) return;
+    if (event_base == IP_EVENT && event_id == IP_EVENT_STA_GOT_IP) {
+        wm_run_conf->sta_connect_retry = 0;
+        wm_event_post(WM_EVENT_GOT_IP, (void *)&(((ip_event_got_ip_t *)event_data)->ip_info), sizeof(esp_netif_ip_info_t));
+        wm_run_conf->sta_connected = 1;
+        wm_run_conf->sta_connecting = 0;
+        wm_wd_disarm(WM_WD_DHCP);
+        wm_prof_mark(WM_PHASE_GOT_IP);
+        #if (CONFIG_WIFIMGR_RUN_SNTP_WHEN_STA == 0)
+        wm_prof_finish();
+        #endif
+        #if (CONFIG_WIFIMGR_DNS_RACE == 1)
+        /* Reachability probe resolves with ranked servers */
+        if(wm_dns_race_start()) {
+            wm_run_conf->dns.validate = true;
+            return;
+        }
+        xTimerChangePeriod(wm_run_conf->dns.timer, WM_S_TO_TICKS(CONFIG_WIFIMGR_DNS_RACE_PERIOD), 0);
+        #endif
+        wm_sta_validate();
+    }
+    if (event_base == IP_EVENT && event_id == IP_EVENT_AP_STAIPASSIGNED) {
+        /* DHCP lease is client activity on softAP */
+        wm_run_conf->ap_scan.last_activity = xTaskGetTickCount();
+    }
+}
+
+static void wm_event_post_data(int32_t event_id, const void *event_data, size_t event_data_size) {
+    wm_capture_event(event_id, event_data, event_data_size);
+    wm_direct_dispatch(event_id, event_data, event_data_size);
+    if(wm_run_conf->uevent_loop) esp_event_post_to(wm_run_conf->uevent_loop, WM_EVENT, event_id, event_data, event_data_size, 1);
+    else esp_event_post(WM_EVENT, event_id, event_data, event_data_size, 1);
+    return;
+}
+
+static void wm_driver_event_forward(void* arg, esp_event_base_t event_base, int32_t event_id, void* event_data) {
+    size_t size = wm_driver_event_size(event_base, event_id);
+    wm_msg_t msg = { .type = (event_base == WIFI_EVENT) ? WM_MSG_WIFI_EVENT : WM_MSG_IP_EVENT, .event = { .event_id = event_id } };
+    if(event_data && size) memcpy(&msg.event.event_data, event_data, size);
+    /* Bounded wait - never block default event loop for long */
+    if(pdTRUE == xQueueSend(wm_run_conf->mgr_queue, &msg, pdMS_TO_TICKS(100))) return;
+    portENTER_CRITICAL(&wm_wd_lock);
+    wm_run_conf->wd.stats.lost_events++;
+    portEXIT_CRITICAL(&wm_wd_lock);
+    wm_mgr_signal(WM_MSG_RESYNC);
+}
+
+static void wm_mgr_signal(wm_msg_type_t type) {
+    const wm_msg_t wake = { .type = WM_MSG_SIGNAL };
+    portENTER_CRITICAL(&wm_sig_lock);
+    wm_run_conf->signals |= (1u << type);
+    portEXIT_CRITICAL(&wm_sig_lock);
+    /* Full queue wakes manager anyway */
+    xQueueSend(wm_run_conf->mgr_queue, &wake, 0);
+}
+
+static void wm_mgr_signals(wm_msg_t *msg) {
+    bool queued = uxQueueMessagesWaiting(wm_run_conf->mgr_queue);
+    portENTER_CRITICAL(&wm_sig_lock);
+    uint32_t pending = wm_run_conf->signals;
+    wm_run_conf->signals = (queued) ? (pending & (1u << WM_MSG_RESYNC)) : 0;
+    portEXIT_CRITICAL(&wm_sig_lock);
+    if(queued) pending &= ~(1u << WM_MSG_RESYNC);
+    for(uint32_t type=0; pending; type++) {
+        if(!(pending & (1u << type))) continue;
+        pending &= ~(1u << type);
+        msg->type = (wm_msg_type_t)type;
+        wm_mgr_process(msg);
+    }
+}
+
+static void wm_driver_resync(wm_msg_t *msg) {
+    if(wm_run_conf->suspended) return;
+    if(!wm_run_conf->scanning) {
+        /* SCAN_DONE lost - driver is idle or result is stale */
+        esp_wifi_scan_stop();
+        wm_wd_disarm(WM_WD_SCAN);
+        wm_run_conf->hidden_scanning = 0;
+        wm_run_conf->hidden_scan.count = 0;
+        wm_run_conf->ap_slice_scan = 0;
         wm_run_conf->scanning = 1;
-        xTaskCreate(vScanTask, "wscan", 2048, NULL, 15, &wm_run_conf->scanTask_handle);
-    } else return ESP_ERR_NO_MEM;
+    }
+    wifi_ap_record_t *ap_info = (wifi_ap_record_t *)wm_fp_calloc(1, sizeof(wifi_ap_record_t));
+    bool assoc = ap_info && (ESP_OK == esp_wifi_sta_get_ap_info(ap_info));
+    wm_fp_free(ap_info);
+    memset(&msg->event, 0, sizeof(msg->event));
+    msg->type = WM_MSG_WIFI_EVENT;
+    if(!assoc && (wm_run_conf->sta_connected || wm_run_conf->wd.deadline[WM_WD_DHCP])) {
+        /* STA_DISCONNECTED lost */
+        msg->event.event_id = WIFI_EVENT_STA_DISCONNECTED;
+        msg->event.event_data.sta_disconnected.reason = WIFI_REASON_UNSPECIFIED;
+        wm_mgr_process(msg);
+    } else if(assoc && wm_run_conf->sta_connecting) {
+        if(wm_run_conf->wd.deadline[WM_WD_CONNECT]) {
+            /* STA_CONNECTED lost */
+            msg->event.event_id = WIFI_EVENT_STA_CONNECTED;
+            wm_mgr_process(msg);
+        }
+        esp_netif_ip_info_t ip_info = { 0 };
+        if((ESP_OK == esp_netif_get_ip_info(wm_run_conf->sta.iface, &ip_info)) && ip_info.ip.addr) {
+            /* IP_EVENT_STA_GOT_IP lost */
+            memset(&msg->event, 0, sizeof(msg->event));
+            msg->type = WM_MSG_IP_EVENT;
+            msg->event.event_id = IP_EVENT_STA_GOT_IP;
+            msg->event.event_data.got_ip.esp_netif = wm_run_conf->sta.iface;
+            msg->event.event_data.got_ip.ip_info = ip_info;
+            wm_mgr_process(msg);
+        }
+    }
+    /* AP client events lost */
+    wm_ap_update_clients();
+}
+
+static void wm_direct_dispatch(int32_t event_id, const void *event_data, size_t event_data_size) {
+    #if (CONFIG_WIFIMGR_DIRECT_CB == 1)
+    if(xTaskGetCurrentTaskHandle() != wm_run_conf->mgrTask_handle) {
+        /* Init task, timers and SNTP - callbacks run in manager task in post order */
+        wm_msg_t *msg = (wm_msg_t *)wm_fp_calloc(1, sizeof(wm_msg_t));
+        bool sent = false;
+        if(msg) {
+            msg->type = WM_MSG_DIRECT;
+            msg->direct.event_id = event_id;
+            msg->direct.size = (uint16_t)event_data_size;
+            if(event_data && event_data_size) memcpy(&msg->direct.data, event_data, event_data_size);
+            /* Bounded wait - SNTP callback runs in TCP/IP task manager task may call into */
+            sent = (pdTRUE == xQueueSend(wm_run_conf->mgr_queue, msg, pdMS_TO_TICKS(100)));
+            wm_fp_free(msg);
+        }
+        if(!sent) {
+            /* Lost like dropped driver event */
+            portENTER_CRITICAL(&wm_wd_lock);
+            wm_run_conf->wd.stats.lost_events++;
+            portEXIT_CRITICAL(&wm_wd_lock);
+            wm_mgr_signal(WM_MSG_RESYNC);
+        }
+        return;
+    }
+    /* Callbacks may register or remove callbacks - call from copy */
+    wm_direct_slot_t calls[CONFIG_WIFIMGR_DIRECT_CB_MAX];
+    int count = 0;
+    for(int i=0; i<CONFIG_WIFIMGR_DIRECT_CB_MAX; i++) {
+        if(wm_run_conf->direct[i].cb && (wm_run_conf->direct[i].event_id == event_id)) calls[count++] = wm_run_conf->direct[i];
+    }
+    /* Commands from callbacks are deferred, handler state stays consistent */
+    wm_run_conf->direct_depth++;
+    for(int i=0; i<count; i++) calls[i].cb(event_id, event_data, event_data_size, calls[i].cb_arg);
+    wm_run_conf->direct_depth--;
+    #endif
+}
+
+static size_t wm_driver_event_size(esp_event_base_t event_base, int32_t event_id) {
+    if(event_base == WIFI_EVENT) {
+        switch(event_id) {
+            case WIFI_EVENT_SCAN_DONE: return sizeof(wifi_event_sta_scan_done_t);
+            case WIFI_EVENT_STA_DISCONNECTED: return sizeof(wifi_event_sta_disconnected_t);
+            case WIFI_EVENT_AP_STACONNECTED: return sizeof(wifi_event_ap_staconnected_t);
+            case WIFI_EVENT_AP_STADISCONNECTED: return sizeof(wifi_event_ap_stadisconnected_t);
+            default: return 0;
+        }
+    }
+    if((event_base == IP_EVENT) && (event_id == IP_EVENT_STA_GOT_IP)) return sizeof(ip_event_got_ip_t);
+    return 0;
+}
+
+/**
+ * Manager command functions
+*/
+
+static esp_err_t wm_cmd_process(wm_cmd_t *cmd) {
+    switch(cmd->cmd_id) {
+        case WM_CMD_KN_ADD: return wm_cmd_kn_add(&cmd->net_config);
+        case WM_CMD_KN_DEL: return wm_cmd_kn_del(cmd->net_ref.net_config_id, cmd->net_ref.ssid);
+        case WM_CMD_KN_BULK: return wm_cmd_kn_bulk(cmd->bulk.entries, cmd->bulk.count, cmd->bulk.replace_all);
+        case WM_CMD_SET_COUNTRY: return wm_cmd_set_country(cmd->country_code);
+        case WM_CMD_AP_CONFIG: return wm_cmd_ap_config(&cmd->net_config);
+        case WM_CMD_STA_DNS: return wm_cmd_sta_dns(cmd->net_ref.dns_ip, cmd->net_ref.net_config_id, cmd->net_ref.ssid);
+        case WM_CMD_SEC_DNS:
+            wm_run_conf->sec_dns_server = cmd->net_ref.dns_ip;
+            return ESP_OK;
+        case WM_CMD_POWER_PROFILE:
+            if(cmd->power_profile >= WM_POWER_PROFILE_MAX) return ESP_ERR_INVALID_ARG;
+            wm_run_conf->power.profile = cmd->power_profile;
+            wm_apply_power_state();
+            return ESP_OK;
+        case WM_CMD_INET_PROBE: return wm_cmd_inet_probe(cmd->inet_probe.host, cmd->inet_probe.port, cmd->inet_probe.path, cmd->inet_probe.expected_status);
+        case WM_CMD_SUSPEND: return wm_cmd_suspend();
+        case WM_CMD_RESUME: return wm_cmd_resume();
+        case WM_CMD_CFG_EXPORT: return (cmd->cfg_image) ? wm_cmd_cfg_export(cmd->cfg_image) : ESP_ERR_INVALID_ARG;
+        case WM_CMD_CFG_IMPORT: return (cmd->cfg_image) ? wm_cmd_cfg_import(cmd->cfg_image) : ESP_ERR_INVALID_ARG;
+        case WM_CMD_AP_PROFILE: return wm_cmd_ap_profile(&cmd->ap_profile);
+        case WM_CMD_SCAN_NOW: return wm_cmd_scan_now();
+        case WM_CMD_DIRECT_CB:
+            if(!cmd->direct_cb.cb || (cmd->direct_cb.event_id < 0) || (cmd->direct_cb.event_id >= WM_EVENT_EVENT_TYPE_MAX)) return ESP_ERR_INVALID_ARG;
+            return wm_cmd_direct_cb(cmd->direct_cb.event_id, cmd->direct_cb.cb, cmd->direct_cb.cb_arg, cmd->direct_cb.add);
+        default: return ESP_ERR_INVALID_ARG;
+    }
+}
+
+static void wm_cmd_sync_done(const wm_cmd_t *cmd, esp_err_t result, void *cb_arg) {
+    wm_cmd_sync_t *sync = (wm_cmd_sync_t *)cb_arg;
+    sync->result = result;
+    xSemaphoreGive(sync->done);
+    wm_cmd_sync_release(sync);
+}
+
+static void wm_cmd_sync_release(wm_cmd_sync_t *sync) {
+    portENTER_CRITICAL(&wm_cmd_sync_lock);
+    bool last = !(--(sync->refs));
+    portEXIT_CRITICAL(&wm_cmd_sync_lock);
+    if(last) {
+        /* Caller timed out before completion or completion after caller wake up */
+        vSemaphoreDelete(sync->done);
+        wm_fp_free(sync);
+    }
+}
+
+static esp_err_t wm_cmd_kn_add(wm_net_base_config_t *known_network) {
+    wm_ll_known_network_node_t *work = wm_create_known_network(known_network);
+    if(!work) {
+        wm_event_post(WM_EVENT_KN_ADD_NOMEM, NULL, 0);
+        return ESP_ERR_NO_MEM;
+    }
+    return wm_add_known_network_node(work);
+}
+
+static esp_err_t wm_cmd_kn_del(uint32_t known_network_id, char *ssid) {
+    wm_ll_known_network_node_t *work = wm_run_conf->known_networks_head;
+    wm_ll_known_network_node_t *prev = NULL;
+    while(work && (known_network_id ? (known_network_id != work->payload.net_config_id) : strcmp(ssid, work->payload.net_config.ssid))) {
+        prev = work;
+        work = work->next;
+    }
+    if(!work) {
+        wm_event_post(WM_EVENT_KN_DEL_FAIL, NULL, 0);
+        return ESP_ERR_NOT_FOUND;
+    }
+    if(!prev) wm_run_conf->known_networks_head = work->next; //head node going to be deleted
+    else prev->next = work->next;
+    (wm_run_conf->known_net_count)--;
+    wm_kn_publish();
+    wm_event_post(WM_EVENT_KN_DEL_OK, &(work->payload.net_config_id), sizeof(uint32_t));
+    /* Free SSID and Password and release node */
+    wm_free_known_network_node(work);
+    return ESP_OK;
+}
+
+static esp_err_t wm_cmd_kn_bulk(wm_kn_bulk_entry_t *entries, size_t count, bool replace_all) {
+    if(!entries && count) return ESP_ERR_INVALID_ARG;
+    wm_kn_bulk_summary_t summary = { .first_failed = -1 };
+    esp_err_t err = ESP_OK;
+
+    /* Validate all entries before any change */
+    for(size_t i=0; i<count; i++) {
+        entries[i].result = ESP_OK;
+        if(entries[i].op == WM_KN_OP_ADD) {
+            if(ESP_OK != wm_check_ssid_pwd(entries[i].net_config.ssid, entries[i].net_config.password)) entries[i].result = ESP_ERR_INVALID_ARG;
+        } else if(entries[i].op != WM_KN_OP_DELETE) {
+            entries[i].result = ESP_ERR_INVALID_ARG;
+        } else if(!entries[i].net_config_id && (strlen(entries[i].net_config.ssid) < 2)) {
+            entries[i].result = ESP_ERR_INVALID_ARG;
+        }
+        if(entries[i].result != ESP_OK) err = ESP_ERR_INVALID_ARG;
+    }
+    if(err != ESP_OK) return err;
+
+    /* Allocate new nodes and work arrays before any change */
+    size_t max_nodes = CONFIG_WIFIMGR_MAX_KNOWN_NETWORKS + 1 + count;
+    wm_ll_known_network_node_t **new_nodes = (wm_ll_known_network_node_t **)wm_fp_calloc(count + 1, sizeof(wm_ll_known_network_node_t *));
+    wm_ll_known_network_node_t **final = (wm_ll_known_network_node_t **)wm_fp_calloc(max_nodes, sizeof(wm_ll_known_network_node_t *));
+    wm_ll_known_network_node_t **old = (wm_ll_known_network_node_t **)wm_fp_calloc(CONFIG_WIFIMGR_MAX_KNOWN_NETWORKS + 1, sizeof(wm_ll_known_network_node_t *));
+    err = (new_nodes && final && old) ? ESP_OK : ESP_ERR_NO_MEM;
+    for(size_t i=0; (err == ESP_OK) && (i<count); i++) {
+        if(entries[i].op != WM_KN_OP_ADD) continue;
+        new_nodes[i] = wm_create_known_network(&entries[i].net_config);
+        if(!new_nodes[i]) {
+            entries[i].result = err = ESP_ERR_NO_MEM;
+            break;
+        }
+        entries[i].net_config_id = new_nodes[i]->payload.net_config_id;
+    }
+
+    if(err == ESP_OK) {
+        size_t old_count = 0, final_count = 0;
+        for(wm_ll_known_network_node_t *work = wm_run_conf->known_networks_head; work && (old_count < CONFIG_WIFIMGR_MAX_KNOWN_NETWORKS + 1); work = work->next) {
+            old[old_count++] = work;
+            if(!replace_all) final[final_count++] = work;
+        }
+        /* Apply operations to final set */
+        for(size_t i=0; i<count; i++) {
+            size_t pos = 0;
+            if(entries[i].op == WM_KN_OP_ADD) {
+                while((pos < final_count) && (final[pos]->payload.net_config_id != entries[i].net_config_id)) pos++;
+                if(pos < final_count) summary.replaced++;
+                else {
+                    final_count++;
+                    summary.added++;
+                    if(final_count > CONFIG_WIFIMGR_MAX_KNOWN_NETWORKS) entries[i].result = err = ESP_ERR_NOT_ALLOWED;
+                }
+                final[pos] = new_nodes[i];
+            } else {
+                if(entries[i].net_config_id) {
+                    while((pos < final_count) && (final[pos]->payload.net_config_id != entries[i].net_config_id)) pos++;
+                } else {
+                    while((pos < final_count) && strcmp(final[pos]->payload.net_config.ssid, entries[i].net_config.ssid)) pos++;
+                }
+                if(pos < final_count) {
+                    memmove(&final[pos], &final[pos+1], (final_count - pos - 1) * sizeof(wm_ll_known_network_node_t *));
+                    final_count--;
+                    summary.deleted++;
+                } else {
+                    entries[i].result = ESP_ERR_NOT_FOUND;
+                    if(!summary.failed++) {
+                        summary.first_failed = i;
+                        summary.first_err = ESP_ERR_NOT_FOUND;
+                    }
+                }
+            }
+        }
+        if((err == ESP_OK) && (final_count > CONFIG_WIFIMGR_MAX_KNOWN_NETWORKS)) err = ESP_ERR_NOT_ALLOWED;
+        if(err == ESP_OK) {
+            /* Commit - relink nodes in final order */
+            for(size_t i=0; i<final_count; i++) final[i]->next = (i+1 < final_count) ? final[i+1] : NULL;
+            wm_run_conf->known_networks_head = (final_count) ? final[0] : NULL;
+            wm_run_conf->known_net_count = final_count;
+            for(size_t i=0; i<count; i++) {
+                if(entries[i].op == WM_KN_OP_ADD) {
+                    wm_del_blist_bssid(new_nodes[i]->payload.ssid_hash);
+                }
+            }
+        }
+        if(err == ESP_OK) {
+            wm_kn_publish();
+            /* Release nodes dropped from list. New nodes replaced in same transaction are dropped too */
+            for(size_t i=0; i<old_count; i++) {
+                size_t pos = 0;
+                while((pos < final_count) && (final[pos] != old[i])) pos++;
+                if(pos == final_count) wm_free_known_network_node(old[i]);
+            }
+            for(size_t i=0; i<count; i++) {
+                if(!new_nodes[i]) continue;
+                size_t pos = 0;
+                while((pos < final_count) && (final[pos] != new_nodes[i])) pos++;
+                if(pos == final_count) wm_free_known_network_node(new_nodes[i]);
+            }
+            wm_event_post(WM_EVENT_KN_BULK_DONE, &summary, sizeof(wm_kn_bulk_summary_t));
+        }
+    }
+
+    if((err != ESP_OK) && new_nodes) {
+        for(size_t i=0; i<count; i++) if(new_nodes[i]) wm_free_known_network_node(new_nodes[i]);
+    }
+    wm_fp_free(new_nodes);
+    wm_fp_free(final);
+    wm_fp_free(old);
+    /* Applied transaction still reports entries that failed */
+    return (err == ESP_OK) ? summary.first_err : err;
+}
+
+static esp_err_t wm_cmd_set_country(char *cc) {
+    wifi_country_t *new_country = (wifi_country_t *)wm_fp_calloc(1, sizeof(wifi_country_t));
+    if(!new_country) return ESP_ERR_NO_MEM;
+    esp_err_t err = wm_country_from_plan(cc, new_country);
+    if(err == ESP_OK) err = wm_apply_country(new_country);
+    wm_fp_free(new_country);
+    wm_event_post((err == ESP_OK) ? WM_EVENT_CC_SET_OK : WM_EVENT_CC_SET_FAIL, NULL, 0);
+    return err;
+}
+
+static esp_err_t wm_apply_country(const wifi_country_t *country) {
+    /* Applied by running driver - no WiFi restart */
+    esp_err_t err = esp_wifi_set_country(country);
+    if(err == ESP_OK) {
+        memcpy(&wm_run_conf->country, country, sizeof(wifi_country_t));
+        wm_run_conf->ap_channel = wm_clamp_channel(&wm_run_conf->country, wm_run_conf->ap_channel);
+        uint8_t ap_channel = wm_run_conf->ap.driver_config->ap.channel;
+        if(ap_channel != wm_clamp_channel(&wm_run_conf->country, ap_channel)) {
+            /* AP channel not allowed by new plan */
+            wm_apply_ap_driver_config();
+            esp_wifi_set_config(WIFI_IF_AP, wm_run_conf->ap.driver_config);
+        }
+    }
+    return err;
+}
+
+static esp_err_t wm_cmd_ap_config(wm_net_base_config_t *ap_conf) {
+    memcpy(&wm_run_conf->ap_conf, ap_conf, sizeof(wm_net_base_config_t));
+    if(ap_conf->ip_config.static_ip.ip.addr != IPADDR_ANY) wm_set_interface_ip(WIFI_IF_AP, &wm_run_conf->ap_conf.ip_config);
+    else wm_set_interface_ip(WIFI_IF_AP, NULL);
+    wm_apply_ap_driver_config();
+    return esp_wifi_set_config(WIFI_IF_AP, wm_run_conf->ap.driver_config);
+}
+
+static esp_err_t wm_cmd_ap_profile(wm_ap_profile_t *profile) {
+    if(ESP_OK != wm_check_ap_profile(profile)) return ESP_ERR_INVALID_ARG;
+    wm_run_conf->ap_profile = *profile;
+    wm_apply_ap_driver_config();
+    esp_err_t err = esp_wifi_set_config(WIFI_IF_AP, wm_run_conf->ap.driver_config);
+    if(err == ESP_OK) wm_apply_ap_profile();
+    return err;
+}
+
+static esp_err_t wm_cmd_sta_dns(esp_ip4_addr_t dns_ip, uint32_t known_network_id, char *ssid) {
+    wm_ll_known_network_node_t *work = (known_network_id) ? wm_find_known_net_by_id(known_network_id) : wm_find_known_net_by_ssid(ssid);
+    if(!work) return ESP_ERR_NOT_FOUND;
+    work->payload.net_config.ip_config.pri_dns_server = dns_ip;
+    wm_kn_publish();
+    return ESP_OK;
+}
+
+static esp_err_t wm_cmd_inet_probe(const char *host, uint16_t port, const char *path, uint16_t expected_status) {
+    #if (CONFIG_WIFIMGR_INET_CHECK == 1)
+    if(!host || !host[0]) {
+        wm_run_conf->inet.host[0] = 0;
+        return ESP_OK;
+    }
+    if(!path || (strlen(host) >= sizeof(wm_run_conf->inet.host)) || (strlen(path) >= sizeof(wm_run_conf->inet.path))) return ESP_ERR_INVALID_ARG;
+    strcpy(wm_run_conf->inet.host, host);
+    strcpy(wm_run_conf->inet.path, path);
+    wm_run_conf->inet.port = port;
+    wm_run_conf->inet.expected_status = expected_status;
+    return ESP_OK;
+    #else
+    return ESP_ERR_NOT_SUPPORTED;
+    #endif
+}
+
+static esp_err_t wm_cmd_suspend(void) {
+    if(wm_run_conf->suspended) return ESP_OK;
+    esp_err_t err = esp_wifi_stop();
+    if(err != ESP_OK) return err;
+    #if (CONFIG_WIFIMGR_PORTAL == 1)
+    wm_portal_stop();
+    #endif
+    #if (CONFIG_WIFIMGR_RUN_SNTP_WHEN_STA == 1)
+    esp_netif_sntp_deinit();
+    #endif
+    #if (CONFIG_WIFIMGR_LINK_MONITOR == 1)
+    wm_link_monitor_run(false);
+    #endif
+    #if (CONFIG_WIFIMGR_INET_CHECK == 1)
+    wm_run_conf->inet.link_seq++;
+    #endif
+    #if (CONFIG_WIFIMGR_DNS_RACE == 1)
+    wm_dns_race_stop();
+    #endif
+    xTimerStop(wm_run_conf->retry_timer, 0);
+    for(int i=0; i<WM_WD_STAGE_MAX; i++) wm_wd_disarm(i);
+    wm_prof_finish();
+    wm_run_conf->resume_sta = (wm_run_conf->sta_connected || wm_run_conf->sta_connecting);
+    wm_run_conf->suspended = 1;
+    /* Clear connecting and connected bits */
+    wm_run_conf->state &= 0xFFFFFFFCUL;
+    wm_run_conf->hidden_scanning = 0;
+    wm_run_conf->hidden_scan.count = 0;
+    wm_run_conf->ap_slice_scan = 0;
+    wm_event_post(WM_EVENT_SUSPENDED, NULL, 0);
+    return ESP_OK;
+}
+
+static esp_err_t wm_cmd_resume(void) {
+    if(!wm_run_conf->suspended) return ESP_OK;
+    wm_run_conf->suspended = 0;
+    wm_run_conf->scanning = 1;
+    if(wm_run_conf->resume_sta) {
+        /* Driver keeps STA config with pinned BSSID - STA_START connects without scan */
+        wm_run_conf->sta_connecting = 1;
+        wm_run_conf->sta_connect_retry = 0;
+        wm_wd_arm(WM_WD_CONNECT);
+        wm_prof_mark(WM_PHASE_CONNECT);
+    }
+    esp_err_t err = esp_wifi_start();
+    if(err != ESP_OK) {
+        wm_wd_disarm(WM_WD_CONNECT);
+        wm_prof_finish();
+        wm_run_conf->sta_connecting = 0;
+        wm_run_conf->suspended = 1;
+        return err;
+    }
+    wm_apply_ap_profile();
+    wm_apply_power_state();
+    #if (CONFIG_WIFIMGR_PORTAL == 1)
+    wifi_mode_t mode = WIFI_MODE_NULL;
+    if((ESP_OK == esp_wifi_get_mode(&mode)) && (mode == WIFI_MODE_APSTA)) wm_portal_start(wm_run_conf->ap.iface);
+    #endif
+    wm_event_post(WM_EVENT_RESUMED, NULL, 0);
+    return ESP_OK;
+}
+
+static esp_err_t wm_cmd_scan_now(void) {
+    #if (CONFIG_WIFIMGR_SCAN_COALESCE_TIME > 0)
+    TickType_t full_scan = wm_run_conf->scan_cache.full_scan;
+    if(full_scan && ((xTaskGetTickCount() - full_scan) < pdMS_TO_TICKS(CONFIG_WIFIMGR_SCAN_COALESCE_TIME))) {
+        uint32_t count = wm_run_conf->scan_cache.count;
+        wm_event_post(WM_EVENT_SCAN_RESULTS, &count, sizeof(uint32_t));
+        return ESP_OK;
+    }
+    #endif
+    if(!wm_run_conf->scan_req) {
+        /* Kept while suspended - served after resume */
+        wm_run_conf->scan_req = 1;
+        wm_run_conf->ap_scan.req_slices = 0;
+        /* Served by scheduler on next tick - do not wait for scan period */
+        wm_mgr_signal(WM_MSG_SCAN_TICK);
+    }
+    return ESP_OK;
+}
+
+static esp_err_t wm_cmd_direct_cb(int32_t event_id, wm_direct_cb_t cb, void *cb_arg, bool add) {
+    #if (CONFIG_WIFIMGR_DIRECT_CB == 1)
+    wm_direct_slot_t *free_slot = NULL;
+    for(int i=0; i<CONFIG_WIFIMGR_DIRECT_CB_MAX; i++) {
+        wm_direct_slot_t *slot = &wm_run_conf->direct[i];
+        if(!slot->cb) {
+            if(!free_slot) free_slot = slot;
+        } else if((slot->event_id == event_id) && (slot->cb == cb)) {
+            if(add) slot->cb_arg = cb_arg;
+            else memset(slot, 0, sizeof(wm_direct_slot_t));
+            return ESP_OK;
+        }
+    }
+    if(!add) return ESP_ERR_NOT_FOUND;
+    if(!free_slot) return ESP_ERR_NO_MEM;
+    *free_slot = (wm_direct_slot_t){ .event_id = event_id, .cb = cb, .cb_arg = cb_arg };
+    return ESP_OK;
+    #else
+    return ESP_ERR_NOT_SUPPORTED;
+    #endif
+}
+
+static esp_err_t wm_cmd_cfg_export(wm_cfg_image_t *image) {
+    memset(image, 0, sizeof(wm_cfg_image_t));
+    wm_cfg_net_export(&image->ap, wm_run_conf->ap_conf.ssid, wm_run_conf->ap_conf.password, wm_run_conf->ap_conf.hidden, &wm_run_conf->ap_conf.ip_config);
+    image->ap_channel = wm_run_conf->ap_channel;
+    image->has_ap_profile = true;
+    image->ap_security = wm_run_conf->ap_profile.security;
+    image->ap_bandwidth = wm_run_conf->ap_profile.bandwidth;
+    image->ap_max_clients = wm_run_conf->ap_profile.max_clients;
+    image->ap_beacon_interval = wm_run_conf->ap_profile.beacon_interval;
+    image->ap_inactive_time = wm_run_conf->ap_profile.inactive_time;
+    memcpy(image->country, wm_run_conf->country.cc, 2);
+    image->sec_dns = wm_run_conf->sec_dns_server.addr;
+    image->power_profile = wm_run_conf->power.profile;
+    image->max_sta_retry = wm_run_conf->max_sta_connect_retry;
+    #if (CONFIG_WIFIMGR_INET_CHECK == 1)
+    strcpy(image->inet_host, wm_run_conf->inet.host);
+    strcpy(image->inet_path, wm_run_conf->inet.path);
+    image->inet_port = wm_run_conf->inet.port;
+    image->inet_status = wm_run_conf->inet.expected_status;
+    #endif
+    for(wm_ll_known_network_node_t *work = wm_run_conf->known_networks_head; work && (image->kn_count < WM_CFG_MAX_NETS); work = work->next) {
+        wm_wifi_base_config_t *net = &work->payload.net_config;
+        wm_cfg_net_export(&image->kn[image->kn_count++], net->ssid, net->password, net->hidden, &net->ip_config);
+    }
+    return ESP_OK;
+}
+
+static esp_err_t wm_cmd_cfg_import(wm_cfg_image_t *image) {
+    /* Image without AP profile keeps running one */
+    wm_ap_profile_t ap_profile = wm_run_conf->ap_profile;
+    if(image->has_ap_profile) {
+        ap_profile = (wm_ap_profile_t) {
+            .security = (wm_ap_security_t)image->ap_security,
+            .bandwidth = (wifi_bandwidth_t)image->ap_bandwidth,
+            .max_clients = image->ap_max_clients,
+            .beacon_interval = image->ap_beacon_interval,
+            .inactive_time = image->ap_inactive_time
+        };
+    }
+    /* Validate all settings before any change */
+    if((ESP_OK != wm_check_ssid_pwd(image->ap.ssid, image->ap.password)) || (image->ap_channel && (wm_chan_slot(image->ap_channel) < 0)) ||
+        (image->power_profile >= WM_POWER_PROFILE_MAX) || (image->max_sta_retry < 1) || (image->max_sta_retry > WM_MAX_STA_RETRY) ||
+        (ESP_OK != wm_check_ap_profile(&ap_profile))) return ESP_ERR_INVALID_ARG;
+    if(image->kn_count > CONFIG_WIFIMGR_MAX_KNOWN_NETWORKS) return ESP_ERR_NOT_ALLOWED;
+    for(uint8_t i=0; i<image->kn_count; i++) {
+        if(ESP_OK != wm_check_ssid_pwd(image->kn[i].ssid, image->kn[i].password)) return ESP_ERR_INVALID_ARG;
+    }
+    wm_kn_bulk_entry_t *entries = (wm_kn_bulk_entry_t *)wm_fp_calloc(image->kn_count + 1, sizeof(wm_kn_bulk_entry_t));
+    wm_net_base_config_t *ap_conf = (wm_net_base_config_t *)wm_fp_calloc(2, sizeof(wm_net_base_config_t));   /* New and running */
+    wifi_country_t *country = (wifi_country_t *)wm_fp_calloc(2, sizeof(wifi_country_t));                     /* New and running */
+    esp_err_t err = (entries && ap_conf && country) ? ESP_OK : ESP_ERR_NO_MEM;
+    /* Country must be in channel plan, AP channel is clamped to it */
+    if((err == ESP_OK) && (ESP_OK != wm_country_from_plan(image->country, &country[0]))) err = ESP_ERR_INVALID_ARG;
+    uint8_t ap_channel = wm_run_conf->ap_channel;
+    wm_ap_profile_t running_profile = wm_run_conf->ap_profile;
+    bool applied = false;
+    if(err == ESP_OK) {
+        for(uint8_t i=0; i<image->kn_count; i++) {
+            entries[i].op = WM_KN_OP_ADD;
+            wm_cfg_net_import(&entries[i].net_config, &image->kn[i]);
+        }
+        wm_cfg_net_import(&ap_conf[0], &image->ap);
+        ap_conf[1] = wm_run_conf->ap_conf;
+        country[1] = wm_run_conf->country;
+        /* Driver settings first - running ones are restored when a later step fails */
+        err = wm_apply_country(&country[0]);
+        applied = (err == ESP_OK);
+    }
+    if(err == ESP_OK) {
+        /* AP driver config carries profile security, clients and beacon */
+        wm_run_conf->ap_channel = wm_clamp_channel(&country[0], image->ap_channel);
+        wm_run_conf->ap_profile = ap_profile;
+        err = wm_cmd_ap_config(&ap_conf[0]);
+    }
+    /* Known networks transaction changes nothing on error */
+    if(err == ESP_OK) err = wm_cmd_kn_bulk(entries, image->kn_count, true);
+    if(err == ESP_OK) {
+        wm_run_conf->sec_dns_server.addr = image->sec_dns;
+        wm_run_conf->max_sta_connect_retry = image->max_sta_retry;
+        wm_run_conf->power.profile = image->power_profile;
+        wm_apply_ap_profile();
+        wm_apply_power_state();
+        #if (CONFIG_WIFIMGR_INET_CHECK == 1)
+        wm_cmd_inet_probe(image->inet_host, image->inet_port, image->inet_path, image->inet_status);
+        #endif
+        wm_event_post(WM_EVENT_CFG_IMPORTED, NULL, 0);
+    } else if(applied) {
+        wm_apply_country(&country[1]);
+        wm_run_conf->ap_channel = ap_channel;
+        wm_run_conf->ap_profile = running_profile;
+        wm_cmd_ap_config(&ap_conf[1]);
+    }
+    wm_fp_free(entries);
+    wm_fp_free(ap_conf);
+    wm_fp_free(country);
+    return err;
+}
+
+static void wm_cfg_net_export(wm_cfg_net_t *dst, const char *ssid, const char *password, bool hidden, const wm_net_ip_config_t *ip_config) {
+    strncpy(dst->ssid, ssid, sizeof(dst->ssid) - 1);
+    memcpy(dst->password, password, strnlen(password, sizeof(dst->password) - 1));
+    dst->hidden = hidden;
+    dst->ip = ip_config->static_ip.ip.addr;
+    dst->netmask = ip_config->static_ip.netmask.addr;
+    dst->gw = ip_config->static_ip.gw.addr;
+    dst->dns = ip_config->pri_dns_server.addr;
+}
+
+static void wm_cfg_net_import(wm_net_base_config_t *dst, const wm_cfg_net_t *src) {
+    memset(dst, 0, sizeof(wm_net_base_config_t));
+    strcpy(dst->ssid, src->ssid);
+    memcpy(dst->password, src->password, strnlen(src->password, sizeof(dst->password)));
+    dst->hidden = src->hidden;
+    dst->ip_config.static_ip.ip.addr = src->ip;
+    dst->ip_config.static_ip.netmask.addr = src->netmask;
+    dst->ip_config.static_ip.gw.addr = src->gw;
+    dst->ip_config.pri_dns_server.addr = src->dns;
+}
+
+static void wm_scan_tick(void) {
+    static wifi_scan_config_t cfg = {NULL, NULL, 0, true, WIFI_SCAN_TYPE_ACTIVE, (wifi_scan_time_t){{0, 120}, 320}, 255, (wifi_scan_channel_bitmap_t){0UL, 0UL}};
+    wifi_mode_t wifi_run_mode = WIFI_MODE_MAX;
+    TickType_t xDelayTicks = wm_run_conf->scan_delay;
+    if(wm_run_conf->kn_publish_pending) wm_kn_publish();
+    if(wm_run_conf->scan_publish_pending) wm_scan_publish();
+    if(wm_run_conf->suspended) return;
+    if(wm_run_conf->scan_req && wm_run_conf->scanning && !wm_run_conf->sta_connecting && !wm_run_conf->inet_probing) {
+        if(wm_run_conf->station_connected_to_ap && (esp_wifi_get_mode(&wifi_run_mode) == ESP_OK) && (wifi_run_mode == WIFI_MODE_APSTA)) {
+            /* Stations on softAP - request is served by single channel slices in idle windows, 
+               completed after one channel round */
+            if(wm_ap_scan_slice()) {
+                wm_run_conf->scanning = 0;
+                wm_wd_arm(WM_WD_SCAN);
+            }
+            wm_run_conf->scan_delay = (CONFIG_WIFIMGR_AP_SCAN_SLICE_INTERVAL / portTICK_PERIOD_MS);
+            return;
+        }
+        /* Requested broadcast scan - also runs without known networks and while STA is connected */
+        cfg.channel = 0;
+        wm_run_conf->scanned_channel = 0;
+        if(ESP_OK == esp_wifi_scan_start(&cfg, false)) {
+            wm_run_conf->scanning = 0;
+            wm_wd_arm(WM_WD_SCAN);
+            return;
+        }
+    }
+    if(esp_wifi_get_mode(&wifi_run_mode) == ESP_OK) {
+        if((wm_run_conf->sta_connect_retry >= wm_run_conf->max_sta_connect_retry) || (wifi_run_mode == WIFI_MODE_APSTA) || ((wifi_run_mode == WIFI_MODE_STA) && (wm_run_conf->sta_connected))) {
+            if ( !(wm_run_conf->sta_connecting) && !(wm_run_conf->inet_probing) && (wm_run_conf->scanning) ) {
+                if(wm_run_conf->known_networks_head) {
+                    bool started = false;
+                    if(!(wm_run_conf->sta_connected)) {
+                        if(!(wm_run_conf->station_connected_to_ap)) {
+                            cfg.channel = 0;
+                            wm_run_conf->scanned_channel = 0;
+                            started = (ESP_OK == esp_wifi_scan_start(&cfg, false));
+                        } else {
+                            /* Stations on softAP - single channel slices in idle windows */
+                            started = wm_ap_scan_slice();
+                        }
+                        if(started) wm_prof_mark(WM_PHASE_SCAN_START);
+                    } 
+                    #if (CONFIG_WIFIMGR_AP_CHANNEL == 0)
+                    else {
+                        /* Refresh ranking of channels allowed for AP, one per tick */
+                        cfg.channel = wm_next_channel(cfg.channel, true);
+                        wm_run_conf->scanned_channel = cfg.channel;
+                        started = cfg.channel && (ESP_OK == esp_wifi_scan_start(&cfg, false));
+                    }
+                    #endif
+                    wm_run_conf->scanning = !started; // Reenabled by SCAN_DONE when scan is started
+                    if(started) wm_wd_arm(WM_WD_SCAN);
+                    if(wm_run_conf->sta_connected) xDelayTicks = (5000 / portTICK_PERIOD_MS);
+                    else if(wm_run_conf->station_connected_to_ap) xDelayTicks = (CONFIG_WIFIMGR_AP_SCAN_SLICE_INTERVAL / portTICK_PERIOD_MS);
+                    else xDelayTicks = (2500 / portTICK_PERIOD_MS);
+                } else wm_restart_ap();
+            } 
+        } else { xDelayTicks = (1000 / portTICK_PERIOD_MS); }
+    } else { xDelayTicks = (500 / portTICK_PERIOD_MS); }
+    wm_run_conf->scan_delay = xDelayTicks;
+}
+
+/**
+ * Internal Known network functions
+*/
+
+static wm_ll_known_network_node_t *wm_create_known_network(wm_net_base_config_t *net_config) {
+    wm_ll_known_network_node_t *work = (wm_ll_known_network_node_t *)wm_pool_alloc(&wm_run_conf->kn_nodes);
+    if(!work) return NULL;
+    size_t ssid_len = strnlen(net_config->ssid, sizeof(work->payload.net_config.ssid) - 1);
+    size_t pwd_len = strnlen(net_config->password, sizeof(net_config->password));    /* 64 characters PSK is not NULL terminated */
+    memcpy(work->payload.net_config.ssid, net_config->ssid, ssid_len);
+    memcpy(work->payload.net_config.password, net_config->password, pwd_len);
+    work->payload.net_config.hidden = net_config->hidden;
+    work->payload.net_config.ip_config = net_config->ip_config;
+    work->payload.ssid_hash = esp_rom_crc32_le(0, (const unsigned char *)work->payload.net_config.ssid, ssid_len);
+    work->payload.net_config_id = esp_rom_crc32_le(work->payload.ssid_hash, (const unsigned char *)work->payload.net_config.password, pwd_len);
+    return work;
+}
+
+static wm_ll_known_network_node_t *wm_find_known_net_by_ssid( char *ssid ) {
+    wm_ll_known_network_node_t *work = NULL;
+    if(ssid) {
+        /* Compare precomputed hash first, string only on hash match */
+        uint32_t ssid_hash = esp_rom_crc32_le(0, (const unsigned char *)ssid, strlen(ssid));
+        work = wm_run_conf->known_networks_head;
+        bool found = false;
+        while(!found && work) {
+            found = (work->payload.ssid_hash == ssid_hash) && !strcmp(ssid, work->payload.net_config.ssid);
+            if(!found) work = work->next;
+        }
+    }
+    return work;
+}
 
+static wm_ll_known_network_node_t *wm_find_known_net_by_id( uint32_t known_network_id ) {
+    wm_ll_known_network_node_t *work = NULL;
+    if(known_network_id) {
+        work = wm_run_conf->known_networks_head;
+        bool found = false;
+        while(!found && work) {
+            found = (work->payload.net_config_id == known_network_id);
+            if(!found) work = work->next;
+        }
+    }
+    return work;
+}
+
+static esp_err_t wm_add_known_network_node( wm_ll_known_network_node_t *work) {
+    wm_ll_known_network_node_t *old = wm_find_known_net_by_id(work->payload.net_config_id);
+    if(!old && (wm_run_conf->known_net_count >= CONFIG_WIFIMGR_MAX_KNOWN_NETWORKS)) {
+        wm_free_known_network_node(work);
+        wm_event_post(WM_EVENT_KN_ADD_MAX_REACHED, NULL, 0);
+        return ESP_ERR_NOT_ALLOWED;
+    }
+    wm_del_blist_bssid(work->payload.ssid_hash);
+    if(old) {
+        /* Replace in place - keeps list order and count, no delete event */
+        wm_ll_known_network_node_t **link = &wm_run_conf->known_networks_head;
+        while(*link != old) link = &((*link)->next);
+        work->payload.last_channel = old->payload.last_channel;
+        work->next = old->next;
+        *link = work;
+    } else {
+        work->next = wm_run_conf->known_networks_head;
+        wm_run_conf->known_networks_head = work;
+        (wm_run_conf->known_net_count)++;
+    }
+    wm_kn_publish();
+    if(old) wm_free_known_network_node(old);
+    wm_event_post(WM_EVENT_KN_ADD_OK, &(work->payload.net_config_id), sizeof(uint32_t));
     return ESP_OK;
 }
 
-esp_err_t wm_add_known_network( char *ssid, char *pwd) {
-    if(!wm_run_conf) return ESP_ERR_NOT_ALLOWED;    /* Safety check */
-    if(ESP_OK != wm_check_ssid_pwd(ssid, pwd)) return ESP_ERR_INVALID_ARG;
-    wm_wifi_base_config_t *new_network = wm_create_known_network(ssid, pwd);
-    if(!new_network) return ESP_ERR_NO_MEM;
-    esp_err_t err = wm_add_known_network_node(new_network);
-    free(new_network);
-    return err;
+static void wm_free_known_network_node( wm_ll_known_network_node_t *node) {
+    wm_pool_free(&wm_run_conf->kn_nodes, node);
 }
 
-esp_err_t wm_add_known_network_config( wm_net_base_config_t *known_network) {
-    if(!wm_run_conf) return ESP_ERR_NOT_ALLOWED;    /* Safety check */
-    if(ESP_OK != wm_check_ssid_pwd(known_network->ssid, known_network->password)) return ESP_ERR_INVALID_ARG;
-    wm_wifi_base_config_t *new_network = wm_create_known_network(known_network->ssid, known_network->password);
-    if(!new_network) return ESP_ERR_NO_MEM;
-    new_network->ip_config = known_network->ip_config;
-    esp_err_t err = wm_add_known_network_node(new_network);
-    free(new_network);
-    return err;
+static esp_err_t wm_kn_publish(void) {
+    wm_kn_snapshot_t *snap = (wm_kn_snapshot_t *)wm_fp_calloc(1, sizeof(wm_kn_snapshot_t) + wm_run_conf->known_net_count * sizeof(wm_known_net_config_t));
+    if(!snap) {
+        wm_run_conf->kn_publish_pending = 1;
+        return ESP_ERR_NO_MEM;
+    }
+    for(wm_ll_known_network_node_t *work = wm_run_conf->known_networks_head; work && (snap->count < wm_run_conf->known_net_count); work = work->next) {
+        wm_known_net_config_t *net = &snap->nets[(snap->count)++];
+        net->net_config.ip_config = work->payload.net_config.ip_config;
+        net->net_config.hidden = work->payload.net_config.hidden;
+        net->net_config_id = work->payload.net_config_id;
+        strcpy(net->net_config.ssid, work->payload.net_config.ssid);
+        strncpy(net->net_config.password, work->payload.net_config.password, sizeof(net->net_config.password));
+    }
+    snap->refs = 1;     /* Published reference */
+    /* Pointer exchange - readers holding previous snapshot keep it until release */
+    portENTER_CRITICAL(&wm_kn_snapshot_lock);
+    wm_kn_snapshot_t *prev = wm_run_conf->kn_snapshot;
+    snap->version = (prev) ? prev->version + 1 : 1;
+    wm_run_conf->kn_snapshot = snap;
+    portEXIT_CRITICAL(&wm_kn_snapshot_lock);
+    wm_run_conf->kn_publish_pending = 0;
+    if(prev) wm_kn_snapshot_release(prev);
+    return ESP_OK;
 }
 
-void wm_set_country(char *cc) {
-    if(!wm_run_conf) return;    /* Safety check */
-    wifi_country_t *new_country = (wifi_country_t *)calloc(1, sizeof(wifi_country_t));
-    *new_country = (wifi_country_t ){
-        .cc = "",
-        .schan = 1,
-        .nchan = ((0 == strcmp(cc, "US")) || (0 == strcmp(cc, "01")) )? 11 : 13,
-        .policy=WIFI_COUNTRY_POLICY_AUTO
-    };
-    new_country->cc[0] = cc[0];
-    new_country->cc[1] = cc[1];
-    memcpy(&wm_run_conf->country, new_country, sizeof(wifi_country_t));
-    free(new_country);
-    return;
-    wm_event_post((esp_wifi_set_country(&(wm_run_conf->country)) == ESP_OK ) ? WM_EVENT_CC_SET_OK : WM_EVENT_CC_SET_FAIL, NULL, 0);
+static wm_kn_snapshot_t *wm_kn_snapshot_acquire(void) {
+    portENTER_CRITICAL(&wm_kn_snapshot_lock);
+    wm_kn_snapshot_t *snap = wm_run_conf->kn_snapshot;
+    if(snap) (snap->refs)++;
+    portEXIT_CRITICAL(&wm_kn_snapshot_lock);
+    return snap;
 }
 
-void wm_change_ap_mode_config( wm_net_base_config_t *ap_conf ) {
-    if(!wm_run_conf) return;    /* Safety check */
-    memcpy(&wm_run_conf->ap_conf, ap_conf, sizeof(wm_net_base_config_t));
-    if(ap_conf->ip_config.static_ip.ip.addr != IPADDR_ANY) wm_set_interface_ip(WIFI_IF_AP, &ap_conf->ip_config);
-    else wm_set_interface_ip(WIFI_IF_AP, NULL);
-    wm_apply_ap_driver_config();
-    esp_wifi_set_config(WIFI_IF_AP, wm_run_conf->ap.driver_config);
+static void wm_kn_snapshot_release(wm_kn_snapshot_t *snap) {
+    if(!snap) return;
+    portENTER_CRITICAL(&wm_kn_snapshot_lock);
+    bool last = !(--(snap->refs));
+    portEXIT_CRITICAL(&wm_kn_snapshot_lock);
+    if(last) wm_fp_free(snap);
 }
 
-void wm_set_sta_dns_by_id(esp_ip4_addr_t dns_ip, uint32_t known_network_id) {
-    if(!wm_run_conf) return;    /* Safety check */
-    if(known_network_id) {
-        wm_ll_known_network_node_t *work = wm_find_known_net_by_id(known_network_id);
-        if(work) work->payload.net_config.ip_config.pri_dns_server = dns_ip;
+/**
+ * Blacklist operating functions
+*/
+
+static void wm_add_blist_bssid(wm_blist_data_t *bssid, uint32_t duration_s) {
+    if(!bssid) return;
+    TickType_t expires = 0;
+    if(duration_s) {
+        expires = xTaskGetTickCount() + WM_S_TO_TICKS(duration_s);
+        if(!expires) expires = 1;   /* 0 is reserved for never */
+    }
+    wm_ll_blacklist_node_t *bnode = wm_is_blacklisted(bssid->bssid);
+    if(bnode) {
+        bnode->payload.net_config_id = bssid->net_config_id;
+        bnode->expires = expires;
+    } else {
+        wm_ll_blacklist_node_t *node = (wm_ll_blacklist_node_t *)wm_fp_calloc(1, sizeof(wm_ll_blacklist_node_t));
+        if(node) {
+            memcpy(node->payload.bssid, bssid, sizeof(wm_blist_data_t));
+            node->expires = expires;
+            node->next = wm_run_conf->blacklist_head;
+            wm_run_conf->blacklist_head = node;
+            wm_event_post(WM_EVENT_BL_ADD_OK, bssid, sizeof(wm_blist_data_t));
+        }
     }
 }
 
-void wm_set_sta_dns_by_ssid(esp_ip4_addr_t dns_ip, char *ssid) {
-    if(!wm_run_conf) return;    /* Safety check */
-    if(ssid) {
-        wm_ll_known_network_node_t *work = wm_find_known_net_by_ssid(ssid);
-        if(work) work->payload.net_config.ip_config.pri_dns_server = dns_ip;
+static void wm_del_blist_bssid(uint32_t net_config_id) {
+    wm_ll_blacklist_node_t *work = wm_run_conf->blacklist_head;
+    wm_ll_blacklist_node_t *prev = NULL;
+    bool found = false;
+    while(!found && work) {
+        found = (net_config_id == work->payload.net_config_id);
+        if(!found) {
+            prev = work;
+            work = work->next;
+        } else {
+            if(prev) prev->next = work->next;
+            else wm_run_conf->blacklist_head = work->next;
+            wm_event_post(WM_EVENT_BL_DEL_OK, NULL, 0);
+            wm_fp_free(work);
+            work = (prev) ? prev->next : wm_run_conf->blacklist_head;
+        }
     }
 }
 
-void wm_set_secondary_dns(esp_ip4_addr_t dns_ip) {
-    if(!wm_run_conf) return;    /* Safety check */
-    wm_run_conf->sec_dns_server = dns_ip;
+static wm_ll_blacklist_node_t *wm_is_blacklisted(uint8_t *bssid) {
+    wm_ll_blacklist_node_t *work = wm_run_conf->blacklist_head;
+    bool found = false;
+    while(!found && work) {
+        found = !memcmp(work->payload.bssid, bssid, 6);
+        if(!found) work = work->next;
+    }
+    return work;
 }
 
-void wm_del_known_net_by_id( uint32_t known_network_id ) {
-    if(!wm_run_conf) return;    /* Safety check */
-    if(!known_network_id) {
-        wm_event_post(WM_EVENT_KN_DEL_FAIL, NULL, 0);
-        return;
-    }
-    wm_ll_known_network_node_t *work = wm_run_conf->known_networks_head;
-    wm_ll_known_network_node_t *prev = NULL;
-    bool for_delete = false;
-    while( !for_delete && work) {
-        for_delete = (known_network_id == work->payload.net_config_id);
-        if(for_delete) {
-            if(xSemaphoreTake(wm_run_conf->kn_Semaphore, (TickType_t) 1) == pdTRUE) {
-                if(!prev) wm_run_conf->known_networks_head = work->next; //head node going to be deleted
-                else prev->next = work->next;
-                (wm_run_conf->known_net_count)--;
-                xSemaphoreGive(wm_run_conf->kn_Semaphore);
-                /* Free SSID and Password and release node */
-                wm_event_post(WM_EVENT_KN_DEL_OK, &(work->payload.net_config_id), sizeof(uint32_t));
-                free(work->payload.net_config.ssid);
-                free(work->payload.net_config.password);
-                free(work);
-            } else wm_event_post(WM_EVENT_KN_DEL_FAIL, &(work->payload.net_config_id), sizeof(uint32_t));
+static void wm_blist_expire(void) {
+    TickType_t now = xTaskGetTickCount();
+    wm_ll_blacklist_node_t *work = wm_run_conf->blacklist_head;
+    wm_ll_blacklist_node_t *prev = NULL;
+    while(work) {
+        if(work->expires && ((int32_t)(now - work->expires) >= 0)) {
+            if(prev) prev->next = work->next;
+            else wm_run_conf->blacklist_head = work->next;
+            wm_event_post(WM_EVENT_BL_DEL_OK, NULL, 0);
+            wm_fp_free(work);
+            work = (prev) ? prev->next : wm_run_conf->blacklist_head;
         } else {
             prev = work;
             work = work->next;
         }
     }
-    if(!for_delete) wm_event_post(WM_EVENT_KN_DEL_FAIL, NULL, 0);
-    return;
 }
 
-void wm_del_known_net_by_ssid( char *ssid ) {
-    if(!wm_run_conf) return;    /* Safety check */
-    wm_del_known_net_by_id(wm_get_kn_config_id(ssid));
-    return;
+/**
+ * Disconnect recovery functions
+*/
+
+static wm_disc_action_t wm_disc_classify(uint8_t reason) {
+    for(size_t i=0; i<(sizeof(wm_disc_classes) / sizeof(wm_disc_class_t)); i++) {
+        if(wm_disc_classes[i].reason == reason) return (wm_disc_action_t)wm_disc_classes[i].action;
+    }
+    return WM_DISC_BACKOFF;
 }
 
-wm_known_net_config_t *wm_get_known_networks(size_t *size) {
-    *size = 0;
-    if(!wm_run_conf) return NULL;     /* Safety check */
-    wm_ll_known_network_node_t *work = wm_run_conf->known_networks_head;
-    wm_known_net_config_t *known_net = NULL;
-    if(work) {
-        known_net = (wm_known_net_config_t *)calloc(wm_run_conf->known_net_count, sizeof(wm_known_net_config_t));
-        while(work && (*size < wm_run_conf->known_net_count)) {
-            known_net[*size].net_config.ip_config = work->payload.net_config.ip_config;
-            known_net[*size].net_config_id = work->payload.net_config_id;
-            strcpy(known_net[*size].net_config.ssid, work->payload.net_config.ssid);
-            strcpy(known_net[*size].net_config.password, work->payload.net_config.password);
-            (*size)++;
-            work = work->next;
+static void wm_disc_give_up(wm_disc_action_t action) {
+    wm_prof_finish();
+    xTimerStop(wm_run_conf->retry_timer, 0);
+    wm_wd_disarm(WM_WD_CONNECT);
+    wm_wd_disarm(WM_WD_DHCP);
+    /* Clear connecting and connected bits */
+    wm_run_conf->state &= 0xFFFFFFFCUL;
+    /* Attempts are over also before retry limit - scan tick runs in STA mode */
+    wm_run_conf->sta_connect_retry = wm_run_conf->max_sta_connect_retry;
+    wm_run_conf->scanning = 1;
+    wm_apply_power_state();
+    wm_event_post(WM_EVENT_STA_DISCONNECT, NULL, 0);
+    if(action >= WM_DISC_NEXT) {
+        wm_blist_data_t *bbssid = (wm_blist_data_t *)wm_fp_calloc(1, sizeof(wm_blist_data_t));
+        if(bbssid) {
+            memcpy(bbssid->bssid, wm_run_conf->sta.driver_config->sta.bssid, 6);
+            bbssid->net_config_id = esp_rom_crc32_le(0, (const unsigned char *)wm_run_conf->sta.driver_config->sta.ssid, strlen((const char *)wm_run_conf->sta.driver_config->sta.ssid));
+            wm_add_blist_bssid(bbssid, (action == WM_DISC_NEXT) ? CONFIG_WIFIMGR_BLACKLIST_SHORT_TIME : CONFIG_WIFIMGR_BLACKLIST_TIME);
+            wm_fp_free(bbssid);
         }
-    } else {
-        *size = 0;
     }
-    return (*size) ? known_net : NULL;
+    wm_run_conf->blacklist_reason = 0;
+    /* Select next candidate without waiting for scan period */
+    wm_mgr_signal(WM_MSG_SCAN_TICK);
 }
 
-void wm_get_ap_config(wm_net_base_config_t *ap_conf) {
-    if(!wm_run_conf) return;    /* Safety check */
-    memcpy(ap_conf, (char *)&wm_run_conf->ap_conf, sizeof(wm_net_base_config_t));
+static void vRetryTimer(TimerHandle_t xTimer) {
+    /* Lost reconnect would leave sta_connecting set - signal is not lost on full queue */
+    wm_mgr_signal(WM_MSG_RECONNECT);
 }
 
-uint32_t wm_get_kn_config_id(char *ssid) {
-    if(!wm_run_conf) return 0;    /* Safety check */
-    wm_ll_known_network_node_t *work = wm_find_known_net_by_ssid(ssid);
-    return (work) ? work->payload.net_config_id : 0;
-}
+/**
+ * Watchdog functions
+*/
 
-void wm_create_apmode_config( wm_apmode_config_t *full_ap_cfg) {
-    if(!full_ap_cfg) return;
-    *full_ap_cfg = (wm_apmode_config_t) {
-        .base_conf = (wm_net_base_config_t) {
-            .ssid = CONFIG_WIFIMGR_AP_SSID,
-            .password = CONFIG_WIFIMGR_AP_PWD,
-            .ip_config.static_ip = {{ IPADDR_ANY }, { IPADDR_ANY }, { IPADDR_ANY }},
-            .ip_config.pri_dns_server = { IPADDR_ANY }
-        },
-        .country = (wifi_country_t ){ 
-            .cc = CONFIG_WIFIMGR_COUNTRY_CODE,
-            .schan = 1,
-            .nchan = ((0 == strcmp(CONFIG_WIFIMGR_COUNTRY_CODE, "US")) || (0 == strcmp(CONFIG_WIFIMGR_COUNTRY_CODE, "01")) )? 11 : 13,
-            .policy = WIFI_COUNTRY_POLICY_AUTO
-        },
-        .ap_channel = CONFIG_WIFIMGR_AP_CHANNEL
-    };
+static void wm_wd_arm(wm_wd_stage_t stage) {
+    TickType_t deadline = xTaskGetTickCount() + pdMS_TO_TICKS(wm_wd_timeouts[stage]);
+    wm_run_conf->wd.deadline[stage] = (deadline) ? deadline : 1;   /* 0 is reserved for not armed */
+    wm_run_conf->wd.escalated &= ~(1 << stage);
+    wm_wd_schedule();
 }
 
-uint8_t wm_netmask_to_cidr(uint32_t nm)
-{
-    nm = nm - ((nm >> 1) & ((u32_t)0x55555555UL));
-    nm = (nm & ((u32_t)0x33333333UL)) + ((nm >> 2) & ((u32_t)0x33333333UL));
-    nm = (nm + (nm >> 4)) & ((u32_t)0x0F0F0F0FUL);
-    nm = nm + (nm >> 8);
-    nm = nm + (nm >> 16);
-    return (uint8_t)( nm & ((u32_t)0x0000003FUL));
+static void wm_wd_disarm(wm_wd_stage_t stage) {
+    if(!wm_run_conf->wd.deadline[stage]) return;
+    wm_run_conf->wd.deadline[stage] = 0;
+    wm_run_conf->wd.escalated &= ~(1 << stage);
+    wm_wd_schedule();
 }
 
-/**
- * Internal event functions
-*/
-
-static void wm_wifi_event_handler(void* arg, esp_event_base_t event_base, int32_t event_id, void* event_data) {
-    if (event_base == WIFI_EVENT) {
-        if(event_id == WIFI_EVENT_SCAN_DONE) {
-            if(((wifi_event_sta_scan_done_t *)event_data)->status == 0) {
-                uint16_t found_ap_count = 0;
-                #if (CONFIG_WIFIMGR_AP_CHANNEL == 0)
-                wm_airband_rank_t airband;
-                #endif
-                esp_wifi_scan_get_ap_num(&found_ap_count);
-                wifi_ap_record_t *found_ap_info = (wifi_ap_record_t *)calloc(found_ap_count, sizeof(wifi_ap_record_t));
-                esp_wifi_scan_get_ap_records(&found_ap_count, found_ap_info);
-                if(!wm_run_conf->scanned_channel) {
-                    memset(&(wm_run_conf->found_known_ap), 0, sizeof(wifi_ap_record_t));
-                #if (CONFIG_WIFIMGR_AP_CHANNEL == 0)
-                    memset(&airband.channel, 0, sizeof(airband.channel));
-                    memset(&airband.rssi, 0b10011111, sizeof(airband.rssi)); /* set min RSSI */
-                #endif
-                }
-                #if (CONFIG_WIFIMGR_AP_CHANNEL == 0)
-                else {
-                    airband.channel[wm_run_conf->scanned_channel-1] = 0;
-                    airband.rssi[wm_run_conf->scanned_channel-1] = 0b10011111;
-                }
-                #endif
+static void wm_wd_schedule(void) {
+    TickType_t now = xTaskGetTickCount();
+    TickType_t nearest = portMAX_DELAY;
+    for(int i=0; i<WM_WD_STAGE_MAX; i++) {
+        if(!wm_run_conf->wd.deadline[i]) continue;
+        int32_t left = (int32_t)(wm_run_conf->wd.deadline[i] - now);
+        if(left < 1) left = 1;
+        if((TickType_t)left < nearest) nearest = left;
+    }
+    if(nearest == portMAX_DELAY) xTimerStop(wm_run_conf->wd.timer, 0);
+    else xTimerChangePeriod(wm_run_conf->wd.timer, nearest, 0);
+}
 
-                wm_run_conf->known_ssid = 0;
-                for(int i=0; ( i<found_ap_count ); i++) {
-                    if(!wm_run_conf->known_ssid && !wm_run_conf->scanned_channel) {
-                        /* If not blacklisted */
-                        if(!wm_is_blacklisted(found_ap_info[i].bssid)) {
-                            wm_ll_known_network_node_t *found_ssid = wm_find_known_net_by_ssid((char *)found_ap_info[i].ssid);
-                            if(found_ssid) {
-                                /* AP in list found in known networks */
-                                wm_run_conf->found_known_ap = found_ap_info[i];
-                                wm_run_conf->known_ssid = 1;
-                            }
-                        }
-                    }
-                    #if (CONFIG_WIFIMGR_AP_CHANNEL == 0)
-                    if(wm_run_conf->ap_channel == 0) {
-                        airband.channel[found_ap_info[i].primary-1]++;
-                        if(airband.rssi[found_ap_info[i].primary-1] < found_ap_info[i].rssi) {airband.rssi[found_ap_info[i].primary-1] = found_ap_info[i].rssi;}
-                        if(found_ap_info[i].primary-2 > 0) {
-                            airband.channel[found_ap_info[i].primary-2]++;
-                            if(airband.rssi[found_ap_info[i].primary-2] < found_ap_info[i].rssi) {airband.rssi[found_ap_info[i].primary-2] = found_ap_info[i].rssi;}
-                        }
-                        if(found_ap_info[i].primary < 13 ) {
-                            airband.channel[found_ap_info[i].primary]++;
-                            if(airband.rssi[found_ap_info[i].primary] < found_ap_info[i].rssi) {airband.rssi[found_ap_info[i].primary] = found_ap_info[i].rssi;}
-                        }
-                        if(found_ap_info[i].second != WIFI_SECOND_CHAN_NONE ) {
-                            for(int b=1; b<5; b++) {
-                                if( (found_ap_info[i].second == WIFI_SECOND_CHAN_ABOVE) ) { 
-                                    if((found_ap_info[i].primary+b) < 13 ) {
-                                        airband.channel[found_ap_info[i].primary+b]++;
-                                        if(airband.rssi[found_ap_info[i].primary+b] < found_ap_info[i].rssi) {airband.rssi[found_ap_info[i].primary+b] = found_ap_info[i].rssi;}
-                                    }
-                                } else {
-                                    if((found_ap_info[i].primary-b-1) > 0 ) {
-                                        airband.channel[found_ap_info[i].primary-b-1]++;
-                                        if(airband.rssi[found_ap_info[i].primary-b-1] < found_ap_info[i].rssi) {airband.rssi[found_ap_info[i].primary-b-1] = found_ap_info[i].rssi;}
-                                    }
-                                }
-                            }
-                        }
-                    }
-                    #endif
-                }
-                #if (CONFIG_WIFIMGR_AP_CHANNEL == 0)
-                if(wm_run_conf->ap_channel == 0) {
-                    int iRatedChannel = 0;
-                    float fRatedRSSI = 0.0f, fCalcRSSI = 0.0f;
-                    for(int i=0; i<13; i++) {
-                        if(i==0) { fCalcRSSI = (float)(airband.channel[i] + airband.rssi[i]*10 + airband.channel[i+1] + airband.rssi[i+1]*10)/2; }
-                        else if (i==12) { fCalcRSSI = (float)(airband.channel[i] + airband.rssi[i]*10 + airband.channel[i-1] + airband.rssi[i-1]*10)/2; }
-                        else { fCalcRSSI = (float)(airband.channel[i] + airband.rssi[i]*10 + airband.channel[i-1] + airband.rssi[i-1]*10+ airband.channel[i+1] + airband.rssi[i+1]*10)/3;}
-                        if( fRatedRSSI>fCalcRSSI ) {
-                            fRatedRSSI = fCalcRSSI;
-                            iRatedChannel = i+1;
-                        }
-                    }
-                    if( wm_run_conf->ap.driver_config->ap.channel != iRatedChannel ) {
-                        wm_run_conf->ap.driver_config->ap.channel = iRatedChannel;
-                    };
+static void wm_wd_check(void) {
+    wm_watchdog_t *wd = &wm_run_conf->wd;
+    TickType_t now = xTaskGetTickCount();
+    for(int i=0; i<WM_WD_STAGE_MAX; i++) {
+        if(!wd->deadline[i] || ((int32_t)(now - wd->deadline[i]) < 0)) continue;
+        bool escalated = wd->escalated & (1 << i);
+        wd->deadline[i] = 0;
+        switch(i) {
+            case WM_WD_CONNECT:
+            case WM_WD_DHCP:
+                if(!escalated) {
+                    /* Disconnect event selects next candidate */
+                    wm_run_conf->sta_connect_retry = wm_run_conf->max_sta_connect_retry;
+                    xTimerStop(wm_run_conf->retry_timer, 0);
+                    esp_wifi_disconnect();
+                    wm_wd_arm(i);
+                    wd->escalated |= (1 << i);
+                } else {
+                    /* Driver did not report disconnect */
+                    wm_disc_give_up(WM_DISC_NEXT);
                 }
-                #endif
-                free(found_ap_info);
+                break;
+            case WM_WD_MODE:
+                /* Failed switch rearms stage. Retries belong to same stall */
+                if(wd->mode == WIFI_MODE_APSTA) wm_restart_ap();
+                else wm_stop_ap();
+                if(wd->deadline[i]) wd->escalated |= (1 << i);
+                break;
+            case WM_WD_SCAN:
+                esp_wifi_scan_stop();
+                wm_run_conf->hidden_scanning = 0;
+                wm_run_conf->hidden_scan.count = 0;
+                wm_run_conf->ap_slice_scan = 0;
                 wm_run_conf->scanning = 1;
-                if(!(wm_run_conf->sta_connected)) {
-                    if(strlen((char *)wm_run_conf->found_known_ap.ssid) > 0 ) {
-                        if(!wm_run_conf->sta_connecting) {
-                            /* Take semaphore to have safety pointer to known network */
-                            if(xSemaphoreTake(wm_run_conf->kn_Semaphore, (TickType_t) 1) == pdTRUE) {
-                                wm_ll_known_network_node_t *net_conf = wm_find_known_net_by_ssid((char *)wm_run_conf->found_known_ap.ssid);
-                                if(net_conf) {
-                                    strcpy((char *)wm_run_conf->sta.driver_config->sta.ssid, net_conf->payload.net_config.ssid);
-                                    strcpy((char *)wm_run_conf->sta.driver_config->sta.password, net_conf->payload.net_config.password);
-                                    xSemaphoreGive(wm_run_conf->kn_Semaphore);
-                                    wm_run_conf->sta.driver_config->sta.bssid_set = 1;
-                                    memcpy(wm_run_conf->sta.driver_config->sta.bssid, wm_run_conf->found_known_ap.bssid, 6);
-                                    wm_run_conf->sta.driver_config->sta.channel = wm_run_conf->found_known_ap.primary;
-                                    if( ESP_OK == esp_wifi_set_config(WIFI_IF_STA, wm_run_conf->sta.driver_config)) {
-                                        wm_run_conf->sta_connecting = 1;
-                                        wm_run_conf->sta_connect_retry = 0;
-                                        esp_wifi_connect();
-                                    } else {
-                                        /* Notification for failed connect */
-                                        wm_event_post(WM_EVENT_STA_MODE_FAIL, NULL, 0);
-                                    }
-                                } else xSemaphoreGive(wm_run_conf->kn_Semaphore);
-                            }
-                        }
-                    } else {
-                        wm_restart_ap();
-                    }
-                }
-            }
-            return;
+                break;
+            default:
+                break;
         }
-
-        if ( event_id == WIFI_EVENT_STA_START) {
-            esp_wifi_connect();
-            return;
+        if(!escalated) {
+            /* One recovery per stall - escalation and retries are not counted */
+            portENTER_CRITICAL(&wm_wd_lock);
+            wd->stats.recoveries++;
+            wd->stats.stage_recoveries[i]++;
+            portEXIT_CRITICAL(&wm_wd_lock);
         }
+        wm_wd_stage_t stage = (wm_wd_stage_t)i;
+        wm_event_post(WM_EVENT_WD_RECOVERY, &stage, sizeof(wm_wd_stage_t));
+    }
+    wm_wd_schedule();
+}
 
-        if ( event_id == WIFI_EVENT_STA_CONNECTED ) {
-            wm_event_post(WM_EVENT_STA_CONNECT, &wm_run_conf->found_known_ap, sizeof(wifi_ap_record_t));
-            /* Delete all blacklisted AP when one is successfuly connected */
-            wm_del_blist_bssid(esp_rom_crc32_le(0, (const unsigned char *)wm_run_conf->sta.driver_config->sta.ssid, strlen((const char *)wm_run_conf->sta.driver_config->sta.ssid)));
-            wm_set_interface_ip(WIFI_IF_STA, &((wm_find_known_net_by_ssid((char *)wm_run_conf->found_known_ap.ssid))->payload.net_config.ip_config));
+static void vWatchdogTimer(TimerHandle_t xTimer) {
+    /* One-shot timer - lost message would leave stage unsupervised */
+    wm_mgr_signal(WM_MSG_WATCHDOG);
+}
 
-            wm_run_conf->blacklist_reason = 0;
-            #if (CONFIG_WIFIMGR_RUN_SNTP_WHEN_STA == 1)
-            esp_sntp_config_t *sntp_config = (esp_sntp_config_t *)malloc(sizeof(esp_sntp_config_t));
-            *sntp_config = (esp_sntp_config_t) { 
-                .smooth_sync = 0, 
-                .server_from_dhcp = 0, 
-                .wait_for_sync = 1, 
-                .start = 1, 
-                .sync_cb = wm_sntp_sync_cb,     //((void *)0)
-                .renew_servers_after_new_IP = 0, 
-                .ip_event_to_renew = IP_EVENT_STA_GOT_IP, 
-                .index_of_first_server = 0, 
-                .num_of_servers = (1), 
-                .servers = {"pool.ntp.org"} // From config???
-                };
-            esp_netif_sntp_init(sntp_config);
-            free(sntp_config);
-            #endif
-            return;
-        }
+/**
+ * Hidden network scan functions
+*/
 
-        if (event_id == WIFI_EVENT_STA_DISCONNECTED) {
-            #if (CONFIG_WIFIMGR_RUN_SNTP_WHEN_STA == 1)
-                /* Destroy sntp */
-                esp_netif_sntp_deinit();
-            #endif
-            wm_run_conf->blacklist_reason |= ((((wifi_event_sta_disconnected_t *)event_data)->reason) > 201);
-            if (wm_run_conf->sta_connect_retry < wm_run_conf->max_sta_connect_retry) {
-                esp_wifi_connect();
-                wm_run_conf->sta_connect_retry++;
-            } else {
-                /* Clear connecting and connected bits */
-                wm_run_conf->state &= 0xFFFFFFFCUL;
-                wm_run_conf->scanning = 1;
-                wm_event_post(WM_EVENT_STA_DISCONNECT, NULL, 0);
-                if(wm_run_conf->blacklist_reason) {
-                    wm_blist_data_t *bbssid = (wm_blist_data_t *)calloc(1, sizeof(wm_blist_data_t));
-                    if(bbssid) {
-                        memcpy(bbssid->bssid, wm_run_conf->sta.driver_config->sta.bssid, 6);
-                        bbssid->net_config_id = esp_rom_crc32_le(0, (const unsigned char *)wm_run_conf->sta.driver_config->sta.ssid, strlen((const char *)wm_run_conf->sta.driver_config->sta.ssid));
-                        wm_add_blist_bssid(bbssid);
-                        free(bbssid);
-                        bbssid = NULL;
-                    }
-                }
-                wm_run_conf->blacklist_reason = 0;
+static void wm_hidden_scan_prepare(wifi_scan_channel_bitmap_t channels) {
+    wm_hidden_scan_queue_t *queue = &wm_run_conf->hidden_scan;
+    queue->count = 0;
+    queue->pos = 0;
+    queue->channels = channels;
+    /* No AP with hidden SSID around - nothing to probe for */
+    if(!channels.ghz_2_channels && !channels.ghz_5_channels) return;
+    wm_ll_known_network_node_t *work = wm_run_conf->known_networks_head;
+    while(work && (queue->count < CONFIG_WIFIMGR_MAX_KNOWN_NETWORKS)) {
+        if(work->payload.net_config.hidden) {
+            /* Insertion by last seen channel, unknown channel (0) goes last */
+            uint8_t key = (work->payload.last_channel) ? work->payload.last_channel : 0xFF;
+            int i = queue->count;
+            while(i > 0) {
+                wm_ll_known_network_node_t *cmp = wm_find_known_net_by_id(queue->net_config_id[i-1]);
+                uint8_t cmp_key = (cmp && cmp->payload.last_channel) ? cmp->payload.last_channel : 0xFF;
+                if(cmp_key <= key) break;
+                queue->net_config_id[i] = queue->net_config_id[i-1];
+                i--;
             }
+            queue->net_config_id[i] = work->payload.net_config_id;
+            queue->count++;
         }
-        /* Control station connected to softAP */
-        if (event_id == WIFI_EVENT_AP_STACONNECTED) {
-            wm_run_conf->station_connected_to_ap = 1;
-            wm_event_post(WM_EVENT_AP_STA_CONNECTED, event_data, sizeof(wifi_event_ap_staconnected_t));
+        work = work->next;
+    }
+}
+
+static bool wm_hidden_scan_next(void) {
+    wm_hidden_scan_queue_t *queue = &wm_run_conf->hidden_scan;
+    wifi_scan_config_t cfg = {NULL, NULL, 0, false, WIFI_SCAN_TYPE_ACTIVE, (wifi_scan_time_t){{0, CONFIG_WIFIMGR_HIDDEN_SCAN_TIME}, 320}, 255, (wifi_scan_channel_bitmap_t){0UL, 0UL}};
+    while(queue->pos < queue->count) {
+        wm_ll_known_network_node_t *net = wm_find_known_net_by_id(queue->net_config_id[(queue->pos)++]);
+        if(!net) continue;  /* Deleted meanwhile */
+        strcpy((char *)queue->ssid, net->payload.net_config.ssid);
+        cfg.ssid = queue->ssid;
+        if(net->payload.last_channel && wm_chan_bitmap_has(&queue->channels, net->payload.last_channel)) {
+            cfg.channel = net->payload.last_channel;
+        } else {
+            cfg.channel_bitmap = queue->channels;
+        }
+        if(ESP_OK == esp_wifi_scan_start(&cfg, false)) {
+            wm_run_conf->hidden_scanning = 1;
+            wm_wd_arm(WM_WD_SCAN);
+            return true;
         }
+        break;
+    }
+    queue->count = 0;
+    wm_run_conf->hidden_scanning = 0;
+    return false;
+}
+
+/**
+ * SoftAP scan scheduler functions
+*/
+
+static bool wm_ap_scan_slice(void) {
+    wm_ap_scan_sched_t *sched = &wm_run_conf->ap_scan;
+    TickType_t now = xTaskGetTickCount();
+    /* Refill off-channel budget, max one full channel round */
+    uint32_t budget_max = wm_chan_count(false) * CONFIG_WIFIMGR_AP_SCAN_DWELL;
+    /* Elapsed time past full budget adds nothing - clamp before scaling */
+    TickType_t elapsed = now - sched->last_refill;
+    TickType_t fill = pdMS_TO_TICKS((budget_max * 100) / CONFIG_WIFIMGR_AP_SCAN_MAX_OFFCHAN) + 1;
+    if(elapsed > fill) elapsed = fill;
+    sched->budget_ms += (elapsed * portTICK_PERIOD_MS * CONFIG_WIFIMGR_AP_SCAN_MAX_OFFCHAN) / 100;
+    if(sched->budget_ms > budget_max) sched->budget_ms = budget_max;
+    sched->last_refill = now;
+    /* Wait for idle window and enough budget */
+    if((now - sched->last_activity) < pdMS_TO_TICKS(CONFIG_WIFIMGR_AP_SCAN_IDLE_TIME)) return false;
+    if(sched->budget_ms < CONFIG_WIFIMGR_AP_SCAN_DWELL) return false;
+    sched->channel = wm_next_channel(sched->channel, false);
+    wifi_scan_config_t cfg = {NULL, NULL, sched->channel, false, WIFI_SCAN_TYPE_ACTIVE, (wifi_scan_time_t){{0, CONFIG_WIFIMGR_AP_SCAN_DWELL}, CONFIG_WIFIMGR_AP_SCAN_DWELL}, 0, (wifi_scan_channel_bitmap_t){0UL, 0UL}};
+    wm_run_conf->scanned_channel = sched->channel;
+    wm_run_conf->ap_slice_scan = 1;
+    if(ESP_OK != esp_wifi_scan_start(&cfg, false)) {
+        wm_run_conf->ap_slice_scan = 0;
+        return false;
+    }
+    sched->budget_ms -= CONFIG_WIFIMGR_AP_SCAN_DWELL;
+    return true;
+}
+
+static void wm_ap_update_clients(void) {
+    wifi_sta_list_t *sta_list = (wifi_sta_list_t *)wm_fp_calloc(1, sizeof(wifi_sta_list_t));
+    if(sta_list) {
+        wm_run_conf->station_connected_to_ap = ((ESP_OK == esp_wifi_ap_get_sta_list(sta_list)) && (sta_list->num > 0));
+        wm_fp_free(sta_list);
+    } else wm_run_conf->station_connected_to_ap = 0;
+}
+
+/**
+ * Power save functions
+*/
+
+static void wm_apply_power_state(void) {
+    static const wifi_ps_type_t profile_ps[WM_POWER_PROFILE_MAX] = { WIFI_PS_NONE, WIFI_PS_MIN_MODEM, WIFI_PS_MAX_MODEM };
+    wifi_mode_t wifi_run_mode = WIFI_MODE_NULL;
+    wifi_ps_type_t ps_type = WIFI_PS_NONE;
+    if((esp_wifi_get_mode(&wifi_run_mode) == ESP_OK) && (wifi_run_mode == WIFI_MODE_STA) && wm_run_conf->sta_connected) {
+        ps_type = profile_ps[wm_run_conf->power.profile];
+    }
+    if((ps_type != wm_run_conf->power.ps_type) && (ESP_OK == esp_wifi_set_ps(ps_type))) {
+        /* Account time spent in previous power save type */
+        portENTER_CRITICAL(&wm_stats_lock);
+        TickType_t now = xTaskGetTickCount();
+        wm_run_conf->power.on_ticks += (uint64_t)(now - wm_run_conf->power.since) * wm_ps_duty_cycle(wm_run_conf->power.ps_type);
+        wm_run_conf->power.total_ticks += (now - wm_run_conf->power.since);
+        wm_run_conf->power.since = now;
+        wm_run_conf->power.ps_type = ps_type;
+        portEXIT_CRITICAL(&wm_stats_lock);
+    }
+}
 
-        if (event_id == WIFI_EVENT_AP_STADISCONNECTED) {
-            wm_run_conf->station_connected_to_ap = 0;
-            wm_event_post(WM_EVENT_AP_STA_DISCONNECTED, event_data, sizeof(wifi_event_ap_stadisconnected_t));
-        }
+static uint16_t wm_ps_duty_cycle(wifi_ps_type_t ps_type) {
+    /* Radio wakes ~5ms per received beacon (102.4ms), DTIM 1 assumed */
+    switch(ps_type) {
+        case WIFI_PS_MIN_MODEM: return 49;
+        case WIFI_PS_MAX_MODEM: return 49 / CONFIG_WIFIMGR_PS_LISTEN_INTERVAL + 1;
+        default: return 1000;
     }
 }
 
-static void wm_ip_event_handler(void* arg, esp_event_base_t event_base, int32_t event_id, void* event_data) {
-    if (event_base == IP_EVENT && event_id == IP_EVENT_STA_GOT_IP) {
-        wm_run_conf->sta_connect_retry = 0;
-        wm_event_post(WM_EVENT_GOT_IP, (void *)&(((ip_event_got_ip_t *)event_data)->ip_info), sizeof(esp_netif_ip_info_t));
-        wm_run_conf->sta_connected = 1;
-        wm_run_conf->sta_connecting = 0;
-        if(esp_wifi_set_mode(WIFI_MODE_STA) != ESP_OK) {
-            /* It's a warning state - Station connected, but AP is still running */
-            wm_event_post(WM_EVENT_STA_MODE_FAIL, NULL, 0);
-        } else { wm_event_post(WM_EVENT_AP_STOP, NULL, 0); }
+/**
+ * Connection profiler functions
+*/
+
+static void wm_prof_mark(wm_conn_phase_t phase) {
+    #if (CONFIG_WIFIMGR_CONN_PROFILER == 1)
+    wm_conn_profiler_t *prof = &wm_run_conf->prof;
+    if(!prof->open) {
+        if((phase != WM_PHASE_SCAN_START) && (phase != WM_PHASE_CONNECT)) return;
+        memset(prof->ts, 0, sizeof(prof->ts));
+        prof->retries = 0;
+        prof->open = true;
+    } else if(prof->ts[phase] && (phase != WM_PHASE_SCAN_DONE)) {
+        if(phase == WM_PHASE_CONNECT) prof->retries++;
+        return;
     }
+    prof->ts[phase] = esp_timer_get_time();
+    #endif
 }
 
-static void wm_event_post(int32_t event_id, const void *event_data, size_t event_data_size) {
-    if(wm_run_conf->uevent_loop) esp_event_post_to(wm_run_conf->uevent_loop, WM_EVENT, event_id, event_data, event_data_size, 1);
-    else esp_event_post(WM_EVENT, event_id, event_data, event_data_size, 1);
-    return;
+static void wm_prof_finish(void) {
+    #if (CONFIG_WIFIMGR_CONN_PROFILER == 1)
+    wm_conn_profiler_t *prof = &wm_run_conf->prof;
+    if(!prof->open) return;
+    prof->open = false;
+    int64_t *ts = prof->ts;
+    int64_t first = 0, last = 0;
+    for(int i=0; i<WM_PHASE_MAX; i++) {
+        if(!ts[i]) continue;
+        if(!first || ts[i] < first) first = ts[i];
+        if(ts[i] > last) last = ts[i];
+    }
+    wm_conn_profile_t profile = {
+        .scan_ms = (ts[WM_PHASE_SCAN_START] && ts[WM_PHASE_SCAN_DONE]) ? (ts[WM_PHASE_SCAN_DONE] - ts[WM_PHASE_SCAN_START]) / 1000 : 0,
+        .connect_ms = (ts[WM_PHASE_CONNECT] && ts[WM_PHASE_ASSOC]) ? (ts[WM_PHASE_ASSOC] - ts[WM_PHASE_CONNECT]) / 1000 : 0,
+        .dhcp_ms = (ts[WM_PHASE_ASSOC] && ts[WM_PHASE_GOT_IP]) ? (ts[WM_PHASE_GOT_IP] - ts[WM_PHASE_ASSOC]) / 1000 : 0,
+        .sntp_ms = (ts[WM_PHASE_GOT_IP] && ts[WM_PHASE_SNTP]) ? (ts[WM_PHASE_SNTP] - ts[WM_PHASE_GOT_IP]) / 1000 : 0,
+        .total_ms = (last - first) / 1000,
+        .retries = prof->retries,
+        .success = (ts[WM_PHASE_GOT_IP] != 0)
+    };
+    portENTER_CRITICAL(&wm_prof_lock);
+    prof->history[prof->head] = profile;
+    prof->head = (prof->head + 1) % CONFIG_WIFIMGR_CONN_PROFILE_HISTORY;
+    if(prof->count < CONFIG_WIFIMGR_CONN_PROFILE_HISTORY) prof->count++;
+    portEXIT_CRITICAL(&wm_prof_lock);
+    wm_event_post(WM_EVENT_CONN_PROFILE, &profile, sizeof(wm_conn_profile_t));
+    #endif
 }
 
 /**
- * Internal Known network functions
+ * Footprint meter functions
 */
 
-static wm_wifi_base_config_t *wm_create_known_network(char *ssid, char *pwd) {
-    wm_wifi_base_config_t *new_network = calloc(1, sizeof(wm_wifi_base_config_t));
-    if(!new_network) return NULL;
-    size_t len = strlen(ssid);
-    len = (len>32) ? 32 : len;
-    new_network->ssid = calloc(len+1, sizeof(char));
-    if(!new_network->ssid) {
-        free(new_network);
-        return NULL;
+static void wm_fp_begin(wm_fp_op_t op) {
+    #if (CONFIG_WIFIMGR_FOOTPRINT == 1)
+    portENTER_CRITICAL(&wm_fp_lock);
+    wm_fp.start_live[op] = wm_fp.live;
+    wm_fp.peak_live[op] = wm_fp.live;
+    wm_fp.open |= (1 << op);
+    portEXIT_CRITICAL(&wm_fp_lock);
+    #endif
+}
+
+static void wm_fp_end(wm_fp_op_t op) {
+    #if (CONFIG_WIFIMGR_FOOTPRINT == 1)
+    wm_fp_report_t report = {
+        .op = op,
+        .mgr_stack_free = (wm_run_conf->mgrTask_handle) ? uxTaskGetStackHighWaterMark(wm_run_conf->mgrTask_handle) : 0,
+        .scan_stack_free = (wm_run_conf->scanTask_handle) ? uxTaskGetStackHighWaterMark(wm_run_conf->scanTask_handle) : 0
+    };
+    /* Task not created yet reports 0 and is not checked */
+    bool over = (report.mgr_stack_free && (report.mgr_stack_free < CONFIG_WIFIMGR_FP_STACK_MIN_FREE));
+    over |= (report.scan_stack_free && (report.scan_stack_free < CONFIG_WIFIMGR_FP_STACK_MIN_FREE));
+    portENTER_CRITICAL(&wm_fp_lock);
+    bool open = (wm_fp.open & (1 << op));
+    if(open) {
+        wm_fp.open &= ~(1 << op);
+        report.heap_used = wm_fp.peak_live[op] - wm_fp.start_live[op];
+        over |= (wm_fp_budgets[op] && (report.heap_used > wm_fp_budgets[op]));
+        wm_fp_op_stats_t *stats = &wm_fp.stats.op[op];
+        stats->count++;
+        stats->heap_last = report.heap_used;
+        if(report.heap_used > stats->heap_peak) stats->heap_peak = report.heap_used;
+        stats->heap_budget = wm_fp_budgets[op];
+        if(over) stats->over_budget++;
+        wm_fp.stats.mgr_stack_free = report.mgr_stack_free;
+        wm_fp.stats.scan_stack_free = report.scan_stack_free;
+        wm_fp.stats.stack_budget = CONFIG_WIFIMGR_FP_STACK_MIN_FREE;
     }
-    memcpy(new_network->ssid, ssid, len);
-    len = strlen(pwd);
-    len = (len>64) ? 64 : len;
-    new_network->password = calloc(len+1, sizeof(char));
-    if(!new_network->password) {
-        free(new_network->ssid);
-        free(new_network);
-        return NULL;
+    portEXIT_CRITICAL(&wm_fp_lock);
+    if(open && over) {
+        wm_event_post(WM_EVENT_FOOTPRINT_OVER, &report, sizeof(wm_fp_report_t));
+        #if (CONFIG_WIFIMGR_FP_ABORT == 1)
+        abort();    /* Benchmark build - memory regression fails the run */
+        #endif
     }
-    memcpy(new_network->password, pwd, len);
-    return new_network;
+    #endif
 }
 
-static wm_ll_known_network_node_t *wm_find_known_net_by_ssid( char *ssid ) {
-    wm_ll_known_network_node_t *work = NULL;
-    if(ssid) {
-        work = wm_run_conf->known_networks_head;
-        bool found = false;
-        while(!found && work) {
-            found = !strcmp(ssid, work->payload.net_config.ssid);
-            if(!found) work = work->next;
-        }
+static void wm_fp_track(void) {
+    #if (CONFIG_WIFIMGR_FOOTPRINT == 1)
+    bool scan = !wm_run_conf->scanning, connect = wm_run_conf->sta_connecting;
+    portENTER_CRITICAL(&wm_fp_lock);
+    uint8_t open = wm_fp.open;
+    portEXIT_CRITICAL(&wm_fp_lock);
+    /* Only manager task opens and closes scan and connect */
+    if(scan != !!(open & (1 << WM_FP_SCAN))) {
+        if(scan) wm_fp_begin(WM_FP_SCAN);
+        else wm_fp_end(WM_FP_SCAN);
     }
-    return work;
+    if(connect != !!(open & (1 << WM_FP_CONNECT))) {
+        if(connect) wm_fp_begin(WM_FP_CONNECT);
+        else wm_fp_end(WM_FP_CONNECT);
+    }
+    #endif
 }
 
-static wm_ll_known_network_node_t *wm_find_known_net_by_id( uint32_t known_network_id ) {
-    wm_ll_known_network_node_t *work = NULL;
-    if(known_network_id) {
-        work = wm_run_conf->known_networks_head;
-        bool found = false;
-        while(!found && work) {
-            found = (work->payload.net_config_id == known_network_id);
-            if(!found) work = work->next;
-        }
+static void wm_fp_cancel(void) {
+    #if (CONFIG_WIFIMGR_FOOTPRINT == 1)
+    portENTER_CRITICAL(&wm_fp_lock);
+    wm_fp.open = 0;
+    portEXIT_CRITICAL(&wm_fp_lock);
+    #endif
+}
+
+static void *wm_fp_malloc(size_t size) {
+    #if (CONFIG_WIFIMGR_FOOTPRINT == 1)
+    return wm_fp_count(malloc(size));
+    #else
+    return malloc(size);
+    #endif
+}
+
+static void *wm_fp_calloc(size_t n, size_t size) {
+    #if (CONFIG_WIFIMGR_FOOTPRINT == 1)
+    return wm_fp_count(calloc(n, size));
+    #else
+    return calloc(n, size);
+    #endif
+}
+
+static void wm_fp_free(void *ptr) {
+    if(!ptr) return;
+    #if (CONFIG_WIFIMGR_FOOTPRINT == 1)
+    uint32_t used = heap_caps_get_allocated_size(ptr);
+    portENTER_CRITICAL(&wm_fp_lock);
+    /* Blocks returned to user and freed there are never subtracted */
+    wm_fp.live = (wm_fp.live > used) ? wm_fp.live - used : 0;
+    portEXIT_CRITICAL(&wm_fp_lock);
+    #endif
+    free(ptr);
+}
+
+#if (CONFIG_WIFIMGR_FOOTPRINT == 1)
+static void *wm_fp_count(void *ptr) {
+    if(!ptr) return NULL;
+    uint32_t used = heap_caps_get_allocated_size(ptr);
+    portENTER_CRITICAL(&wm_fp_lock);
+    wm_fp.live += used;
+    for(int i=0; i<WM_FP_OP_MAX; i++) {
+        if((wm_fp.open & (1 << i)) && (wm_fp.live > wm_fp.peak_live[i])) wm_fp.peak_live[i] = wm_fp.live;
     }
-    return work;
+    portEXIT_CRITICAL(&wm_fp_lock);
+    return ptr;
 }
+#endif
 
-static esp_err_t wm_add_known_network_node( wm_wifi_base_config_t *known_network) {
-    if(wm_run_conf->known_net_count >= CONFIG_WIFIMGR_MAX_KNOWN_NETWORKS) {
-        wm_event_post(WM_EVENT_KN_ADD_MAX_REACHED, NULL, 0);
-        return ESP_ERR_NOT_ALLOWED;
+/**
+ * Trace capture functions
+*/
+
+static void wm_capture_start(void) {
+    #if (CONFIG_WIFIMGR_TRACE == 1)
+    /* Created once by first init, kept with log */
+    if(!wm_trace_cap.lock) wm_trace_cap.lock = xSemaphoreCreateMutex();
+    if(!wm_trace_cap.lock) return;
+    xSemaphoreTake(wm_trace_cap.lock, portMAX_DELAY);
+    wm_trace_start(&wm_trace_cap.log, wm_trace_cap.buf, sizeof(wm_trace_cap.buf), (uint32_t)(esp_timer_get_time() / 1000));
+    wm_trace_cap.heap_last = 0;
+    xSemaphoreGive(wm_trace_cap.lock);
+    #endif
+}
+
+static void wm_capture_msg(const wm_msg_t *msg) {
+    #if (CONFIG_WIFIMGR_TRACE == 1)
+    wm_trace_rec_t type = WM_TRACE_REC_MSG;
+    uint16_t id = msg->type;
+    const void *data = NULL;
+    size_t len = 0;
+    switch(msg->type) {
+        case WM_MSG_CMD:
+            data = &msg->cmd.cmd.cmd_id;
+            len = sizeof(msg->cmd.cmd.cmd_id);
+            break;
+        case WM_MSG_WIFI_EVENT:
+        case WM_MSG_IP_EVENT:
+            type = (msg->type == WM_MSG_WIFI_EVENT) ? WM_TRACE_REC_WIFI : WM_TRACE_REC_IP;
+            id = (uint16_t)msg->event.event_id;
+            data = &msg->event.event_data;
+            len = wm_driver_event_size((msg->type == WM_MSG_WIFI_EVENT) ? WIFI_EVENT : IP_EVENT, msg->event.event_id);
+            break;
+        #if (CONFIG_WIFIMGR_INET_CHECK == 1)
+        case WM_MSG_INET_RESULT:
+            data = &msg->inet.result;
+            len = sizeof(msg->inet.result);
+            break;
+        #endif
+        #if (CONFIG_WIFIMGR_DNS_RACE == 1)
+        case WM_MSG_DNS_RESULT:
+            data = &msg->dns.health;
+            len = sizeof(msg->dns.health);
+            break;
+        #endif
+        case WM_MSG_EXIT:
+            return;
+        default:
+            break;
     }
-    wm_ll_known_network_node_t *work = calloc(1, sizeof(wm_ll_known_network_node_t));
-    if(work) {
-        if(xSemaphoreTake(wm_run_conf->kn_Semaphore, (TickType_t) 1) == pdTRUE) {
-            work->payload.net_config = *known_network;
-            work->payload.net_config_id = esp_rom_crc32_le(0, (const unsigned char *)known_network->ssid, strlen(known_network->ssid));
-            wm_del_blist_bssid(work->payload.net_config_id);
-            work->payload.net_config_id = esp_rom_crc32_le(work->payload.net_config_id, (const unsigned char *)known_network->password, strlen(known_network->password));
-            if(wm_find_known_net_by_id(work->payload.net_config_id)) wm_del_known_net_by_id(work->payload.net_config_id); /* Prevents false event flood */
-            /* Semaphore */
-            work->next = wm_run_conf->known_networks_head;
-            wm_run_conf->known_networks_head = work;
-            (wm_run_conf->known_net_count)++;
-            /* release */
-            xSemaphoreGive(wm_run_conf->kn_Semaphore);
-            wm_event_post(WM_EVENT_KN_ADD_OK, &(work->payload.net_config_id), sizeof(uint32_t));
-            return ESP_OK;
-        } else free(work);
+    if(!wm_trace_cap.lock) return;
+    uint32_t now_ms = (uint32_t)(esp_timer_get_time() / 1000);
+    xSemaphoreTake(wm_trace_cap.lock, portMAX_DELAY);
+    wm_trace_put(&wm_trace_cap.log, type, id, now_ms, data, len);
+    xSemaphoreGive(wm_trace_cap.lock);
+    #endif
+}
+
+static void wm_capture_scan(const wifi_ap_record_t *records, uint16_t count) {
+    #if (CONFIG_WIFIMGR_TRACE == 1)
+    if(!records || !wm_trace_cap.lock) return;
+    uint32_t now_ms = (uint32_t)(esp_timer_get_time() / 1000);
+    for(int i=0; i<count; i++) {
+        wm_trace_ap_t ap = {
+            .primary = records[i].primary,
+            .second = (uint8_t)records[i].second,
+            .rssi = records[i].rssi,
+            .authmode = (uint8_t)records[i].authmode
+        };
+        memcpy(ap.bssid, records[i].bssid, sizeof(ap.bssid));
+        strncpy(ap.ssid, (const char *)records[i].ssid, sizeof(ap.ssid) - 1);
+        xSemaphoreTake(wm_trace_cap.lock, portMAX_DELAY);
+        bool added = wm_trace_put_ap(&wm_trace_cap.log, now_ms, &ap);
+        xSemaphoreGive(wm_trace_cap.lock);
+        if(!added) break;
+    }
+    #endif
+}
+
+static void wm_capture_event(int32_t event_id, const void *event_data, size_t event_data_size) {
+    #if (CONFIG_WIFIMGR_TRACE == 1)
+    if(!wm_trace_cap.lock) return;
+    uint32_t now_ms = (uint32_t)(esp_timer_get_time() / 1000);
+    xSemaphoreTake(wm_trace_cap.lock, portMAX_DELAY);
+    wm_trace_put(&wm_trace_cap.log, WM_TRACE_REC_EVENT, (uint16_t)event_id, now_ms, event_data, event_data ? event_data_size : 0);
+    xSemaphoreGive(wm_trace_cap.lock);
+    #endif
+}
+
+static void wm_capture_heap(void) {
+    #if (CONFIG_WIFIMGR_TRACE == 1)
+    if(!wm_trace_cap.lock) return;
+    uint32_t free_heap = heap_caps_get_free_size(MALLOC_CAP_8BIT);
+    uint8_t data[4] = { free_heap & 0xFF, (free_heap >> 8) & 0xFF, (free_heap >> 16) & 0xFF, free_heap >> 24 };
+    uint32_t now_ms = (uint32_t)(esp_timer_get_time() / 1000);
+    xSemaphoreTake(wm_trace_cap.lock, portMAX_DELAY);
+    uint32_t diff = (free_heap > wm_trace_cap.heap_last) ? free_heap - wm_trace_cap.heap_last : wm_trace_cap.heap_last - free_heap;
+    if(!wm_trace_cap.heap_last || (diff >= WM_TRACE_HEAP_STEP)) {
+        if(wm_trace_put(&wm_trace_cap.log, WM_TRACE_REC_HEAP, 0, now_ms, data, sizeof(data))) wm_trace_cap.heap_last = free_heap;
     }
-    wm_event_post(WM_EVENT_KN_ADD_NOMEM, NULL, 0);
-    return ESP_ERR_NO_MEM;
+    xSemaphoreGive(wm_trace_cap.lock);
+    #endif
 }
 
 /**
- * Blacklist operating functions
+ * Other functions
 */
 
-static void wm_add_blist_bssid(wm_blist_data_t *bssid) {
-    if(!bssid) return;
-    wm_ll_blacklist_node_t *bnode = wm_is_blacklisted(bssid->bssid);
-    if(bnode) {
-        bnode->payload.net_config_id = bssid->net_config_id;
+static void wm_apply_ap_driver_config() {
+    strcpy((char *)wm_run_conf->ap.driver_config->ap.ssid, wm_run_conf->ap_conf.ssid);
+    wm_run_conf->ap.driver_config->ap.channel = wm_clamp_channel(&wm_run_conf->country, (wm_run_conf->ap_channel != 0) ? wm_run_conf->ap_channel : CONFIG_WIFIMGR_DEFAULT_AP_CHANNEL);
+    wm_run_conf->ap.driver_config->ap.max_connection = wm_run_conf->ap_profile.max_clients;
+    wm_run_conf->ap.driver_config->ap.beacon_interval = wm_run_conf->ap_profile.beacon_interval;
+    wm_run_conf->ap.driver_config->ap.ssid_hidden = wm_run_conf->ap_conf.hidden;
+    strncpy((char *)wm_run_conf->ap.driver_config->ap.password, wm_run_conf->ap_conf.password, sizeof(wm_run_conf->ap.driver_config->ap.password));
+    if(wm_run_conf->ap.driver_config->ap.password[0]) {
+        static const wifi_auth_mode_t sec_auth[WM_AP_SEC_MAX] = { WIFI_AUTH_WPA2_PSK, WIFI_AUTH_WPA2_WPA3_PSK, WIFI_AUTH_WPA3_PSK };
+        wm_run_conf->ap.driver_config->ap.authmode = sec_auth[wm_run_conf->ap_profile.security];
+        /* CCMP only - TKIP caps rate and skips hardware AES */
+        wm_run_conf->ap.driver_config->ap.pairwise_cipher = WIFI_CIPHER_TYPE_CCMP;
+        wm_run_conf->ap.driver_config->ap.pmf_cfg = (wifi_pmf_config_t) { .capable = true, .required = (wm_run_conf->ap_profile.security == WM_AP_SEC_WPA3) };
+        wm_run_conf->ap.driver_config->ap.sae_pwe_h2e = WPA3_SAE_PWE_BOTH;
     } else {
-        wm_ll_blacklist_node_t *node = (wm_ll_blacklist_node_t *)calloc(1, sizeof(wm_ll_blacklist_node_t));
-        if(node) {
-            memcpy(node->payload.bssid, bssid, sizeof(wm_blist_data_t));
-            node->next = wm_run_conf->blacklist_head;
-            wm_run_conf->blacklist_head = node;
-            wm_event_post(WM_EVENT_BL_ADD_OK, bssid, sizeof(wm_blist_data_t));
-        }
+        wm_run_conf->ap.driver_config->ap.authmode = WIFI_AUTH_OPEN;
+        wm_run_conf->ap.driver_config->ap.pairwise_cipher = WIFI_CIPHER_TYPE_NONE;
+        wm_run_conf->ap.driver_config->ap.pmf_cfg = (wifi_pmf_config_t) { .capable = false, .required = false };
     }
+    if(wm_run_conf->ap_channel) wm_run_conf->ap_second = wm_ap_second_chan(wm_run_conf->ap.driver_config->ap.channel, NULL);
 }
 
-static void wm_del_blist_bssid(uint32_t net_config_id) {
-    wm_ll_blacklist_node_t *work = wm_run_conf->blacklist_head;
-    wm_ll_blacklist_node_t *prev = NULL;
-    bool found = false;
-    while(!found && work) {
-        found = (net_config_id == work->payload.net_config_id);
-        if(!found) {
-            prev = work;
-            work = work->next;
-        } else {
-            if(prev) prev->next = work->next;
-            else wm_run_conf->blacklist_head = work->next;
-            wm_event_post(WM_EVENT_BL_DEL_OK, NULL, 0);
-            free(work);
-            work = (prev) ? prev->next : wm_run_conf->blacklist_head;
+static void wm_scan_cache_update(const wifi_ap_record_t *records, uint16_t count, bool full_scan) {
+    /* Cache is owned by manager task, readers get published copy */
+    wm_scan_cache_t *cache = &wm_run_conf->scan_cache;
+    TickType_t now = xTaskGetTickCount();
+    /* Drop aged entries - order is not kept */
+    for(int i=cache->count-1; i>=0; i--) {
+        if((now - cache->seen[i]) > WM_S_TO_TICKS(CONFIG_WIFIMGR_SCAN_CACHE_MAX_AGE)) {
+            cache->count--;
+            cache->entry[i] = cache->entry[cache->count];
+            cache->seen[i] = cache->seen[cache->count];
         }
     }
+    for(int i=0; i<count; i++) {
+        if(!records[i].ssid[0]) continue;
+        int slot = 0;
+        while((slot < cache->count) && memcmp(cache->entry[slot].bssid, records[i].bssid, sizeof(records[i].bssid))) slot++;
+        if(slot == CONFIG_WIFIMGR_SCAN_CACHE_SIZE) {
+            /* Full - replace oldest, weakest of same age */
+            slot = 0;
+            for(int j=1; j<cache->count; j++) {
+                TickType_t age = now - cache->seen[j], oldest = now - cache->seen[slot];
+                if((age > oldest) || ((age == oldest) && (cache->entry[j].rssi < cache->entry[slot].rssi))) slot = j;
+            }
+            if((cache->seen[slot] == now) && (cache->entry[slot].rssi >= records[i].rssi)) continue;
+        } else if(slot == cache->count) cache->count++;
+        wm_scan_entry_t *entry = &cache->entry[slot];
+        memcpy(entry->ssid, records[i].ssid, sizeof(entry->ssid));
+        memcpy(entry->bssid, records[i].bssid, sizeof(entry->bssid));
+        entry->channel = records[i].primary;
+        entry->rssi = records[i].rssi;
+        entry->authmode = records[i].authmode;
+        cache->seen[slot] = now;
+    }
+    if(full_scan) cache->full_scan = now;
+    wm_scan_publish();
 }
 
-static wm_ll_blacklist_node_t *wm_is_blacklisted(uint8_t *bssid) {
-    wm_ll_blacklist_node_t *work = wm_run_conf->blacklist_head;
-    bool found = false;
-    while(!found && work) {
-        found = !memcmp(work->payload.bssid, bssid, 6);
-        if(!found) work = work->next;
+static esp_err_t wm_scan_publish(void) {
+    wm_scan_snapshot_t *snap = (wm_scan_snapshot_t *)wm_fp_malloc(sizeof(wm_scan_snapshot_t));
+    if(!snap) {
+        wm_run_conf->scan_publish_pending = 1;
+        return ESP_ERR_NO_MEM;
     }
-    return work;
+    snap->cache = wm_run_conf->scan_cache;
+    snap->refs = 1;     /* Published reference */
+    /* Pointer exchange - readers holding previous snapshot keep it until release */
+    portENTER_CRITICAL(&wm_scan_snapshot_lock);
+    wm_scan_snapshot_t *prev = wm_run_conf->scan_snapshot;
+    wm_run_conf->scan_snapshot = snap;
+    portEXIT_CRITICAL(&wm_scan_snapshot_lock);
+    wm_run_conf->scan_publish_pending = 0;
+    if(prev) wm_scan_snapshot_release(prev);
+    return ESP_OK;
+}
+
+static wm_scan_snapshot_t *wm_scan_snapshot_acquire(void) {
+    portENTER_CRITICAL(&wm_scan_snapshot_lock);
+    wm_scan_snapshot_t *snap = wm_run_conf->scan_snapshot;
+    if(snap) (snap->refs)++;
+    portEXIT_CRITICAL(&wm_scan_snapshot_lock);
+    return snap;
+}
+
+static void wm_scan_snapshot_release(wm_scan_snapshot_t *snap) {
+    if(!snap) return;
+    portENTER_CRITICAL(&wm_scan_snapshot_lock);
+    bool last = !(--(snap->refs));
+    portEXIT_CRITICAL(&wm_scan_snapshot_lock);
+    if(last) wm_fp_free(snap);
+}
+
+static bool wm_scan_filter_match(const wm_scan_filter_t *filter, const wm_scan_entry_t *entry) {
+    if(!filter) return true;
+    if(filter->ssid && strcmp(filter->ssid, entry->ssid)) return false;
+    if(filter->min_rssi && (entry->rssi < filter->min_rssi)) return false;
+    return (!filter->max_age_ms || (entry->age_ms <= filter->max_age_ms));
+}
+
+static void wm_apply_ap_profile(void) {
+    esp_wifi_set_bandwidth(WIFI_IF_AP, ((wm_run_conf->ap_profile.bandwidth == WIFI_BW_HT40) && (wm_run_conf->ap_second != WIFI_SECOND_CHAN_NONE)) ? WIFI_BW_HT40 : WIFI_BW_HT20);
+    esp_wifi_set_inactive_time(WIFI_IF_AP, wm_run_conf->ap_profile.inactive_time);
+}
+
+static void wm_default_ap_profile(wm_ap_profile_t *profile) {
+    *profile = (wm_ap_profile_t) {
+        #if defined(CONFIG_WIFIMGR_AP_SEC_WPA3)
+        .security = WM_AP_SEC_WPA3,
+        #elif defined(CONFIG_WIFIMGR_AP_SEC_WPA2_WPA3)
+        .security = WM_AP_SEC_WPA2_WPA3,
+        #else
+        .security = WM_AP_SEC_WPA2,
+        #endif
+        #if (CONFIG_WIFIMGR_AP_HT40 == 1)
+        .bandwidth = WIFI_BW_HT40,
+        #else
+        .bandwidth = WIFI_BW_HT20,
+        #endif
+        .max_clients = CONFIG_WIFIMGR_AP_MAX_CLIENTS,
+        .beacon_interval = CONFIG_WIFIMGR_AP_BEACON_INTERVAL,
+        .inactive_time = CONFIG_WIFIMGR_AP_INACTIVE_TIME
+    };
+}
+
+static esp_err_t wm_check_ap_profile(const wm_ap_profile_t *profile) {
+    if((profile->security >= WM_AP_SEC_MAX) || ((profile->bandwidth != WIFI_BW_HT20) && (profile->bandwidth != WIFI_BW_HT40))) return ESP_ERR_INVALID_ARG;
+    if((profile->max_clients < 1) || (profile->max_clients > 10)) return ESP_ERR_INVALID_ARG;
+    if((profile->beacon_interval < 100) || (profile->beacon_interval > 60000) || (profile->inactive_time < 10)) return ESP_ERR_INVALID_ARG;
+    return ESP_OK;
+}
+
+static wifi_second_chan_t wm_ap_second_chan(uint8_t channel, const uint8_t *ap_count) {
+    #if (CONFIG_SOC_WIFI_SUPPORT_5G == 1)
+    if(channel > WM_24G_CHANNELS) {
+        /* Fixed pairs 36/40 ... 157/161 - odd 20 MHz block index is lower channel of pair */
+        bool above = (((channel <= 144) ? channel : channel - 1) / 4) & 1;
+        uint8_t second = above ? channel + 4 : channel - 4;
+        if(!wm_chan_allowed(&wm_run_conf->country, second, true) || (ap_count && ap_count[wm_chan_slot(second)])) return WIFI_SECOND_CHAN_NONE;
+        return above ? WIFI_SECOND_CHAN_ABOVE : WIFI_SECOND_CHAN_BELOW;
+    }
+    #endif
+    int last = wm_run_conf->country.schan + wm_run_conf->country.nchan - 1;
+    if(((channel + 4) <= last) && (!ap_count || !ap_count[channel + 3])) return WIFI_SECOND_CHAN_ABOVE;
+    if(((channel - 4) >= wm_run_conf->country.schan) && (!ap_count || !ap_count[channel - 5])) return WIFI_SECOND_CHAN_BELOW;
+    return WIFI_SECOND_CHAN_NONE;
+}
+
+static esp_err_t wm_country_from_plan(const char *cc, wifi_country_t *country) {
+    const wm_chan_plan_t *plan = &wm_chan_plans[0];    /* World safe "01" */
+    esp_err_t err = ESP_ERR_NOT_FOUND;
+    for(size_t i=0; cc && (i<(sizeof(wm_chan_plans) / sizeof(wm_chan_plan_t))); i++) {
+        if((wm_chan_plans[i].cc[0] == cc[0]) && (wm_chan_plans[i].cc[1] == cc[1])) {
+            plan = &wm_chan_plans[i];
+            err = ESP_OK;
+            break;
+        }
+    }
+    *country = (wifi_country_t) {
+        .cc = { plan->cc[0], plan->cc[1], 0 },
+        .schan = plan->schan,
+        .nchan = plan->nchan,
+        .max_tx_power = plan->max_tx_power,
+        .policy = WIFI_COUNTRY_POLICY_AUTO
+    };
+    #if (CONFIG_SOC_WIFI_SUPPORT_5G == 1)
+    for(int i=0; i<WM_5G_CHANNELS; i++) {
+        if(plan->band5 & wm_5g_chans[i].unii) country->wifi_5g_channel_mask |= WM_5G_BIT(WM_24G_CHANNELS + i);
+    }
+    #endif
+    return err;
+}
+
+static uint8_t wm_clamp_channel(const wifi_country_t *country, uint8_t channel) {
+    if(!channel) return 0;
+    if(channel > WM_24G_CHANNELS) return wm_chan_allowed(country, channel, true) ? channel : wm_clamp_channel(country, CONFIG_WIFIMGR_DEFAULT_AP_CHANNEL);
+    if(channel < country->schan) return country->schan;
+    if(channel >= country->schan + country->nchan) return country->schan + country->nchan - 1;
+    return channel;
 }
 
 /**
- * Other functions
+ * Channel table functions
 */
 
-static void wm_apply_ap_driver_config() {
-    strcpy((char *)wm_run_conf->ap.driver_config->ap.ssid, wm_run_conf->ap_conf.ssid);
-    wm_run_conf->ap.driver_config->ap.channel = (wm_run_conf->ap_channel != 0) ? wm_run_conf->ap_channel : CONFIG_WIFIMGR_DEFAULT_AP_CHANNEL;
-    wm_run_conf->ap.driver_config->ap.max_connection = 1;
-    wm_run_conf->ap.driver_config->ap.authmode = 
-        (strlen(strcpy((char *)wm_run_conf->ap.driver_config->ap.password, wm_run_conf->ap_conf.password)) != 0) ? WIFI_AUTH_WPA_PSK : WIFI_AUTH_OPEN;
-    wm_run_conf->ap.driver_config->ap.pairwise_cipher = WIFI_CIPHER_TYPE_TKIP; //Kconfig param...
-    wm_run_conf->ap.driver_config->ap.pmf_cfg = (wifi_pmf_config_t) { .required = true };
+static int wm_chan_slot(uint8_t channel) {
+    if((channel >= 1) && (channel <= WM_24G_CHANNELS)) return channel - 1;
+    #if (CONFIG_SOC_WIFI_SUPPORT_5G == 1)
+    for(int i=0; i<WM_5G_CHANNELS; i++) {
+        if(wm_5g_chans[i].channel == channel) return WM_24G_CHANNELS + i;
+    }
+    #endif
+    return -1;
+}
+
+static uint8_t wm_slot_chan(int slot) {
+    #if (CONFIG_SOC_WIFI_SUPPORT_5G == 1)
+    if(slot >= WM_24G_CHANNELS) return wm_5g_chans[slot - WM_24G_CHANNELS].channel;
+    #endif
+    return slot + 1;
+}
+
+static bool wm_chan_allowed(const wifi_country_t *country, uint8_t channel, bool ap) {
+    int slot = wm_chan_slot(channel);
+    if(slot < 0) return false;
+    if(slot < WM_24G_CHANNELS) return (channel >= country->schan) && (channel < country->schan + country->nchan);
+    #if (CONFIG_SOC_WIFI_SUPPORT_5G == 1)
+    if(!(country->wifi_5g_channel_mask & WM_5G_BIT(slot))) return false;
+    #if (CONFIG_WIFIMGR_AP_5G == 1)
+    /* softAP has no radar detection - DFS channels are STA only */
+    if(ap) return !(wm_5g_chans[slot - WM_24G_CHANNELS].unii & (WM_5G_UNII2 | WM_5G_UNII2E));
+    return true;
+    #else
+    return !ap;
+    #endif
+    #else
+    return false;
+    #endif
+}
+
+static uint8_t wm_next_channel(uint8_t channel, bool ap) {
+    int slot = wm_chan_slot(channel);   /* -1 for channel 0 */
+    for(int i=1; i<=WM_CHAN_SLOTS; i++) {
+        uint8_t next = wm_slot_chan((slot + i) % WM_CHAN_SLOTS);
+        if(wm_chan_allowed(&wm_run_conf->country, next, ap)) return next;
+    }
+    return 0;
+}
+
+static uint8_t wm_chan_count(bool ap) {
+    uint8_t count = 0;
+    for(int i=0; i<WM_CHAN_SLOTS; i++) count += wm_chan_allowed(&wm_run_conf->country, wm_slot_chan(i), ap);
+    return count;
+}
+
+static void wm_chan_bitmap_set(wifi_scan_channel_bitmap_t *bitmap, uint8_t channel) {
+    int slot = wm_chan_slot(channel);
+    if(slot < 0) return;
+    if(slot < WM_24G_CHANNELS) bitmap->ghz_2_channels |= (1 << channel);
+    else bitmap->ghz_5_channels |= WM_5G_BIT(slot);
+}
+
+static bool wm_chan_bitmap_has(const wifi_scan_channel_bitmap_t *bitmap, uint8_t channel) {
+    int slot = wm_chan_slot(channel);
+    if(slot < 0) return false;
+    if(slot < WM_24G_CHANNELS) return bitmap->ghz_2_channels & (1 << channel);
+    return bitmap->ghz_5_channels & WM_5G_BIT(slot);
+}
+
+static int wm_ap_score(const wifi_ap_record_t *record) {
+    #if (CONFIG_SOC_WIFI_SUPPORT_5G == 1)
+    if((record->primary > WM_24G_CHANNELS) && (record->rssi >= WM_5G_MIN_RSSI)) return record->rssi + CONFIG_WIFIMGR_5G_MARGIN;
+    #endif
+    return record->rssi;
+}
+
+#if (CONFIG_WIFIMGR_AP_CHANNEL == 0)
+static void wm_airband_add(wm_airband_rank_t *airband, const wifi_ap_record_t *record) {
+    int slot = wm_chan_slot(record->primary);
+    if(slot < 0) return;    /* Channel outside table */
+    wm_airband_mark(airband, slot, record->rssi);
+    if(slot >= WM_24G_CHANNELS) {
+        /* 5 GHz channels do not overlap. HT40 occupies pair channel */
+        int second = -1;
+        if(record->second == WIFI_SECOND_CHAN_ABOVE) second = wm_chan_slot(record->primary + 4);
+        if(record->second == WIFI_SECOND_CHAN_BELOW) second = wm_chan_slot(record->primary - 4);
+        if(second >= WM_24G_CHANNELS) wm_airband_mark(airband, second, record->rssi);
+        return;
+    }
+    /* 2.4 GHz 20 MHz channel overlaps neighbours. HT40 spreads 4 channels more to secondary side */
+    if(slot > 0) wm_airband_mark(airband, slot - 1, record->rssi);
+    if(slot < WM_24G_CHANNELS - 1) wm_airband_mark(airband, slot + 1, record->rssi);
+    for(int b=2; (b<6) && (record->second != WIFI_SECOND_CHAN_NONE); b++) {
+        int i = (record->second == WIFI_SECOND_CHAN_ABOVE) ? slot + b : slot - b;
+        if((i >= 0) && (i < WM_24G_CHANNELS)) wm_airband_mark(airband, i, record->rssi);
+    }
 }
 
+static void wm_airband_mark(wm_airband_rank_t *airband, int slot, int8_t rssi) {
+    if(airband->channel[slot] < UINT8_MAX) airband->channel[slot]++;
+    if(airband->rssi[slot] < rssi) airband->rssi[slot] = rssi;
+}
+
+static float wm_airband_score(const wm_airband_rank_t *airband, int slot) {
+    #if (CONFIG_SOC_WIFI_SUPPORT_5G == 1)
+    if(slot >= WM_24G_CHANNELS) return (float)(airband->channel[slot] + (airband->rssi[slot] - CONFIG_WIFIMGR_5G_MARGIN)*10);
+    #endif
+    int sum = 0, count = 0;
+    for(int i=slot-1; i<=slot+1; i++) {
+        if((i < 0) || (i >= WM_24G_CHANNELS) || !wm_chan_allowed(&wm_run_conf->country, i + 1, true)) continue;
+        sum += airband->channel[i] + airband->rssi[i]*10;
+        count++;
+    }
+    return (float)sum / count;
+}
+#endif
+
 static void wm_apply_netif_dns(esp_netif_t *iface, esp_ip4_addr_t *dns_server_ip, esp_netif_dns_type_t type ) {
-    esp_netif_dns_info_t *dns = (esp_netif_dns_info_t *)calloc(1, sizeof(esp_netif_dns_info_t));
+    esp_netif_dns_info_t *dns = (esp_netif_dns_info_t *)wm_fp_calloc(1, sizeof(esp_netif_dns_info_t));
     *dns = (esp_netif_dns_info_t) { .ip = (esp_ip_addr_t){.u_addr.ip4 = *dns_server_ip, .type = ESP_IPADDR_TYPE_V4 }};
     esp_err_t err = esp_netif_set_dns_info(iface, type, dns);
-    free(dns);
+    wm_fp_free(dns);
     if(ESP_OK != err) wm_event_post(WM_EVENT_DNS_CHANGE_FAIL, NULL, 0);
     return;
 }
@@ -1043,7 +4647,7 @@ void wm_set_interface_ip( wifi_interface_t iface, wm_net_ip_config_t *ip_info)
     esp_err_t err;
 
     if(iface != WIFI_IF_STA && iface != WIFI_IF_AP) return;
-    esp_netif_ip_info_t *new_ip_info = (esp_netif_ip_info_t *)calloc(1, sizeof(esp_netif_ip_info_t));
+    esp_netif_ip_info_t *new_ip_info = (esp_netif_ip_info_t *)wm_fp_calloc(1, sizeof(esp_netif_ip_info_t));
     if( ip_info == NULL ) {
        *new_ip_info = (WIFI_IF_AP == iface) ? (esp_netif_ip_info_t) {
             .ip = { ((u32_t)0x0104A8C0UL) }, 
@@ -1104,37 +4708,230 @@ void wm_set_interface_ip( wifi_interface_t iface, wm_net_ip_config_t *ip_info)
             }
         }
     }
-    free(new_ip_info);
+    wm_fp_free(new_ip_info);
     wm_event_post(_ok ? WM_EVENT_IP_SET_OK : WM_EVENT_IP_SET_FAIL, NULL, 0);
     return;
 }
 
 static void wm_clear_pointers(void) {
-    if(wm_run_conf->ap.driver_config) free(wm_run_conf->ap.driver_config);
-    if(wm_run_conf->sta.driver_config) free(wm_run_conf->sta.driver_config);
-    free(wm_run_conf);
+    if(wm_run_conf->wifi_evt) esp_event_handler_instance_unregister(WIFI_EVENT, ESP_EVENT_ANY_ID, wm_run_conf->wifi_evt);
+    if(wm_run_conf->ip_evt) esp_event_handler_instance_unregister(IP_EVENT, ESP_EVENT_ANY_ID, wm_run_conf->ip_evt);
+    #if (CONFIG_WIFIMGR_LINK_MONITOR == 1)
+    if(wm_run_conf->link_mon.timer) xTimerDelete(wm_run_conf->link_mon.timer, portMAX_DELAY);
+    #endif
+    #if (CONFIG_WIFIMGR_DNS_RACE == 1)
+    if(wm_run_conf->dns.timer) xTimerDelete(wm_run_conf->dns.timer, portMAX_DELAY);
+    #endif
+    if(wm_run_conf->retry_timer) xTimerDelete(wm_run_conf->retry_timer, portMAX_DELAY);
+    if(wm_run_conf->wd.timer) xTimerDelete(wm_run_conf->wd.timer, portMAX_DELAY);
+    if(wm_run_conf->mgr_queue) vQueueDelete(wm_run_conf->mgr_queue);
+    while(wm_run_conf->known_networks_head) {
+        wm_ll_known_network_node_t *node = wm_run_conf->known_networks_head;
+        wm_run_conf->known_networks_head = node->next;
+        wm_free_known_network_node(node);
+    }
+    while(wm_run_conf->blacklist_head) {
+        wm_ll_blacklist_node_t *bnode = wm_run_conf->blacklist_head;
+        wm_run_conf->blacklist_head = bnode->next;
+        wm_fp_free(bnode);
+    }
+    if(wm_run_conf->kn_snapshot) wm_kn_snapshot_release(wm_run_conf->kn_snapshot);
+    if(wm_run_conf->scan_snapshot) wm_scan_snapshot_release(wm_run_conf->scan_snapshot);
+    if(wm_run_conf->ap.iface) esp_netif_destroy_default_wifi(wm_run_conf->ap.iface);
+    if(wm_run_conf->sta.iface) esp_netif_destroy_default_wifi(wm_run_conf->sta.iface);
+    if(wm_run_conf->ap.driver_config) wm_fp_free(wm_run_conf->ap.driver_config);
+    if(wm_run_conf->sta.driver_config) wm_fp_free(wm_run_conf->sta.driver_config);
+    wm_fp_free(wm_run_conf);
+    wm_run_conf = NULL;
+    wm_fp_cancel();
+}
+
+static esp_err_t wm_init_abort(esp_err_t err, bool driver) {
+    if(driver) {
+        esp_wifi_stop();
+        esp_wifi_deinit();
+    }
+    wm_clear_pointers();
+    return err;
 }
 
 static esp_err_t wm_check_ssid_pwd(char *ssid, char *pwd) {
-    size_t pwd_length = strlen(pwd);
-    return ((strlen(ssid) < 2) || ( pwd_length>0 && pwd_length<8));
+    /* 64 characters PSK is not NULL terminated */
+    size_t pwd_length = strnlen(pwd, 64);
+    return ((strnlen(ssid, 33) < 2) || ( pwd_length>0 && pwd_length<8));
 }
 
 static void wm_restart_ap(void) {
-    wifi_mode_t *wifi_run_mode = (wifi_mode_t *)calloc(1, sizeof(wifi_mode_t));
+    wifi_mode_t *wifi_run_mode = (wifi_mode_t *)wm_fp_calloc(1, sizeof(wifi_mode_t));
     esp_wifi_get_mode(wifi_run_mode);
+    wm_wd_disarm(WM_WD_MODE);
     if(*wifi_run_mode != WIFI_MODE_APSTA) {
         if(esp_wifi_set_mode(WIFI_MODE_APSTA) != ESP_OK) {
+            wm_run_conf->wd.mode = WIFI_MODE_APSTA;
+            wm_wd_arm(WM_WD_MODE);
             wm_event_post(WM_EVENT_APSTA_MODE_FAIL, NULL, 0);
         } else { 
-            esp_wifi_set_channel(wm_run_conf->ap.driver_config->ap.channel, WIFI_SECOND_CHAN_NONE);
+            wm_apply_ap_profile();
+            esp_wifi_set_channel(wm_run_conf->ap.driver_config->ap.channel, (wm_run_conf->ap_profile.bandwidth == WIFI_BW_HT40) ? wm_run_conf->ap_second : WIFI_SECOND_CHAN_NONE);
             wm_event_post(WM_EVENT_AP_START, NULL, 0);
+            #if (CONFIG_WIFIMGR_PORTAL == 1)
+            wm_portal_start(wm_run_conf->ap.iface);
+            #endif
+            wm_apply_power_state();
         }
     }
-    free(wifi_run_mode);
+    wm_fp_free(wifi_run_mode);
     return;
 }
 
+static void wm_stop_ap(void) {
+    wm_wd_disarm(WM_WD_MODE);
+    if(esp_wifi_set_mode(WIFI_MODE_STA) != ESP_OK) {
+        /* It's a warning state - Station connected, but AP is still running */
+        wm_run_conf->wd.mode = WIFI_MODE_STA;
+        wm_wd_arm(WM_WD_MODE);
+        wm_event_post(WM_EVENT_STA_MODE_FAIL, NULL, 0);
+    } else {
+        #if (CONFIG_WIFIMGR_PORTAL == 1)
+        wm_portal_stop();
+        #endif
+        wm_event_post(WM_EVENT_AP_STOP, NULL, 0);
+    }
+    wm_apply_power_state();
+}
+
+#if (CONFIG_WIFIMGR_INET_CHECK == 1)
+/**
+ * Internet reachability functions
+*/
+
+static void wm_inet_probe_done(wm_inet_probe_result_t *result, uint8_t link_seq) {
+    wm_run_conf->inet_probing = 0;
+    if(result->status != WM_INET_NOT_CHECKED) {
+        portENTER_CRITICAL(&wm_stats_lock);
+        wm_run_conf->inet.result = *result;
+        portEXIT_CRITICAL(&wm_stats_lock);
+    }
+    /* Result is stale if link was lost during probe */
+    if(link_seq != wm_run_conf->inet.link_seq) return;
+    if(result->status == WM_INET_NOT_CHECKED) {
+        wm_stop_ap();
+        return;
+    }
+    if(result->status == WM_INET_OK) {
+        wm_event_post(WM_EVENT_INET_OK, result, sizeof(wm_inet_probe_result_t));
+        wm_stop_ap();
+    } else {
+        wm_event_post((result->status == WM_INET_CAPTIVE) ? WM_EVENT_CAPTIVE_PORTAL : WM_EVENT_INET_FAIL, result, sizeof(wm_inet_probe_result_t));
+        /* Blacklist AP and give up retries - scan will select next candidate */
+        wm_run_conf->blacklist_reason = 1;
+        wm_run_conf->sta_connect_retry = wm_run_conf->max_sta_connect_retry;
+        esp_wifi_disconnect();
+    }
+}
+#endif
+
+static void wm_sta_validate(void) {
+    #if (CONFIG_WIFIMGR_INET_CHECK == 1)
+    /* Keep AP running until upstream is validated */
+    if(wm_run_conf->inet.host[0]) {
+        if(!wm_run_conf->inet_probing) {
+            /* Probe task works on own copy - target may be changed while probe runs */
+            wm_inet_probe_t *probe = (wm_inet_probe_t *)wm_fp_malloc(sizeof(wm_inet_probe_t));
+            wm_run_conf->inet_probing = 1;
+            if(probe) *probe = wm_run_conf->inet;
+            if(!probe || (pdPASS != xTaskCreate(vInetProbeTask, "winet", 3072, probe, 5, NULL))) {
+                wm_fp_free(probe);
+                wm_run_conf->inet_probing = 0;
+                wm_stop_ap();
+            }
+        }
+        return;
+    }
+    #endif
+    wm_stop_ap();
+}
+
+#if (CONFIG_WIFIMGR_DNS_RACE == 1)
+/**
+ * DNS race functions
+*/
+
+static bool wm_dns_race_start(void) {
+    wm_dns_race_state_t *race = &wm_run_conf->dns;
+    if(race->probing || !wm_run_conf->sta_connected) return false;
+    wm_msg_t *msg = (wm_msg_t *)wm_fp_calloc(1, sizeof(wm_msg_t));
+    if(!msg) return false;
+    msg->type = WM_MSG_DNS_RESULT;
+    msg->dns.link_seq = race->link_seq;
+    wm_dns_health_t *health = &msg->dns.health;
+    /* Servers in use, from DHCP or static config, then configured secondary. Current order first */
+    esp_ip4_addr_t candidates[4] = { 0 };
+    const esp_netif_dns_type_t types[3] = { ESP_NETIF_DNS_MAIN, ESP_NETIF_DNS_BACKUP, ESP_NETIF_DNS_FALLBACK };
+    esp_netif_dns_info_t dns;
+    for(int i=0; i<3; i++) {
+        if((ESP_OK == esp_netif_get_dns_info(wm_run_conf->sta.iface, types[i], &dns)) && (dns.ip.type == ESP_IPADDR_TYPE_V4)) candidates[i] = dns.ip.u_addr.ip4;
+    }
+    candidates[3] = wm_run_conf->sec_dns_server;
+    for(int i=0; i<4; i++) {
+        if(candidates[i].addr == IPADDR_ANY) continue;
+        bool dup = false;
+        for(int j=0; j<health->count; j++) dup |= (health->server[j].addr == candidates[i].addr);
+        if(dup) continue;
+        if(health->count < WM_DNS_MAX_SERVERS) health->server[health->count++] = candidates[i];
+        /* All slots in use - configured secondary takes FALLBACK slot, never dropped */
+        else if(i == 3) health->server[WM_DNS_MAX_SERVERS - 1] = candidates[i];
+    }
+    if(health->count < 2) {     /* Nothing to select from */
+        wm_fp_free(msg);
+        return false;
+    }
+    race->probing = true;
+    if(pdPASS != xTaskCreate(vDnsRaceTask, "wdnsrace", 3072, msg, 5, NULL)) {
+        race->probing = false;
+        wm_fp_free(msg);
+        return false;
+    }
+    return true;
+}
+
+static void wm_dns_race_done(wm_dns_health_t *health, uint8_t link_seq) {
+    wm_dns_race_state_t *race = &wm_run_conf->dns;
+    race->probing = false;
+    /* Result is stale if link was lost during race */
+    if(link_seq != race->link_seq) return;
+    uint8_t order[WM_DNS_MAX_SERVERS];
+    wm_dns_rank(health->rtt_ms, health->count, order);
+    const esp_netif_dns_type_t types[3] = { ESP_NETIF_DNS_MAIN, ESP_NETIF_DNS_BACKUP, ESP_NETIF_DNS_FALLBACK };
+    bool answered = false;
+    wm_dns_health_t ranked = { .count = health->count };
+    for(int i=0; i<health->count; i++) {
+        ranked.server[i] = health->server[order[i]];
+        ranked.rtt_ms[i] = health->rtt_ms[order[i]];
+        answered |= (ranked.rtt_ms[i] != WM_DNS_RTT_FAIL);
+        /* Rewrite changed slots only - moved server or secondary in place of FALLBACK */
+        esp_netif_dns_info_t dns;
+        if((ESP_OK != esp_netif_get_dns_info(wm_run_conf->sta.iface, types[i], &dns)) || (dns.ip.type != ESP_IPADDR_TYPE_V4) || 
+           (dns.ip.u_addr.ip4.addr != ranked.server[i].addr)) wm_apply_netif_dns(wm_run_conf->sta.iface, &ranked.server[i], types[i]);
+    }
+    portENTER_CRITICAL(&wm_stats_lock);
+    race->health = ranked;
+    portEXIT_CRITICAL(&wm_stats_lock);
+    wm_event_post(WM_EVENT_DNS_RANKED, &ranked, sizeof(wm_dns_health_t));
+    xTimerChangePeriod(race->timer, WM_S_TO_TICKS(answered ? CONFIG_WIFIMGR_DNS_RACE_PERIOD : CONFIG_WIFIMGR_DNS_RACE_RETRY), 0);
+    if(race->validate) {
+        race->validate = false;
+        wm_sta_validate();
+    }
+}
+
+static void wm_dns_race_stop(void) {
+    wm_run_conf->dns.link_seq++;
+    wm_run_conf->dns.validate = false;
+    xTimerStop(wm_run_conf->dns.timer, 0);
+}
+#endif
+
 /**
  * System functions
 */
@@ -1142,41 +4939,241 @@ static void wm_restart_ap(void) {
 #if (CONFIG_WIFIMGR_RUN_SNTP_WHEN_STA == 1)
 static void wm_sntp_sync_cb(struct timeval *tv) {
     wm_event_post(WM_EVENT_GOT_TIME, tv, sizeof(struct timeval));
+    /* Close profiled attempt in manager task. Signal is not lost on full queue */
+    wm_mgr_signal(WM_MSG_SNTP_SYNC);
+}
+#endif
+
+#if (CONFIG_WIFIMGR_LINK_MONITOR == 1)
+static void vLinkMonitorTimer(TimerHandle_t xTimer) {
+    /* Driver TX power and link state are owned by manager task */
+    wm_mgr_signal(WM_MSG_LINK_SAMPLE);
+}
+
+static void wm_link_sample(void) {
+    wm_link_monitor_t *mon = &wm_run_conf->link_mon;
+    wifi_ap_record_t *ap_info = (wifi_ap_record_t *)wm_fp_calloc(1, sizeof(wifi_ap_record_t));
+    if(!ap_info) return;
+    if(ESP_OK == esp_wifi_sta_get_ap_info(ap_info)) {
+        /* Sample is built aside and published whole - readers never see half of it */
+        wm_link_quality_t link = mon->link;
+        /* First sample seeds average */
+        if(!link.samples) mon->rssi_ewma = ap_info->rssi * 16;
+        else mon->rssi_ewma += ((ap_info->rssi * 16) - mon->rssi_ewma) >> CONFIG_WIFIMGR_LINK_EWMA_SHIFT;
+        link.samples++;
+        link.rssi = ap_info->rssi;
+        link.rssi_avg = (int8_t)(mon->rssi_ewma / 16);
+        link.phy_mode = (ap_info->phy_11b ? WM_LINK_PHY_11B : 0) | (ap_info->phy_11g ? WM_LINK_PHY_11G : 0) | 
+                        (ap_info->phy_11n ? WM_LINK_PHY_11N : 0) | (ap_info->phy_lr ? WM_LINK_PHY_LR : 0) |
+                        (ap_info->phy_11ax ? WM_LINK_PHY_11AX : 0);
+        link.beacon_loss = mon->beacon_loss;
+        mon->beacon_loss = 0;
+        /* Link state of current sample drives TX power step */
+        int32_t event_id = -1;
+        if(!link.degraded) {
+            if((link.rssi_avg < CONFIG_WIFIMGR_LINK_RSSI_LOW) || link.beacon_loss) {
+                link.degraded = 1;
+                event_id = WM_EVENT_LINK_DEGRADED;
+            }
+        } else {
+            if((link.rssi_avg >= (CONFIG_WIFIMGR_LINK_RSSI_LOW + CONFIG_WIFIMGR_LINK_RSSI_HYST)) && !link.beacon_loss) {
+                link.degraded = 0;
+                event_id = WM_EVENT_LINK_RECOVERED;
+            }
+        }
+        #if (CONFIG_WIFIMGR_TXP_CONTROL == 1)
+        wm_txp_update(mon, &link);
+        #endif
+        esp_wifi_get_max_tx_power(&link.tx_power);
+        portENTER_CRITICAL(&wm_stats_lock);
+        mon->link = link;
+        portEXIT_CRITICAL(&wm_stats_lock);
+        if(event_id >= 0) wm_event_post(event_id, &link, sizeof(wm_link_quality_t));
+    }
+    wm_fp_free(ap_info);
+}
+
+static void wm_link_monitor_run(bool run) {
+    wm_link_monitor_t *mon = &wm_run_conf->link_mon;
+    if(!mon->timer) return;
+    if(run) {
+        mon->rssi_ewma = 0;
+        mon->beacon_loss = 0;
+        portENTER_CRITICAL(&wm_stats_lock);
+        memset(&mon->link, 0, sizeof(wm_link_quality_t));
+        portEXIT_CRITICAL(&wm_stats_lock);
+        xTimerStart(mon->timer, 0);
+    } else xTimerStop(mon->timer, 0);
+    #if (CONFIG_WIFIMGR_TXP_CONTROL == 1)
+    /* Every association and reconnect attempt starts at full power */
+    wm_txp_set(WM_TXP_FULL);
+    #endif
+}
+
+#if (CONFIG_WIFIMGR_TXP_CONTROL == 1)
+static void wm_txp_update(wm_link_monitor_t *mon, const wm_link_quality_t *link) {
+    if(link->degraded || link->beacon_loss) {
+        wm_txp_set(WM_TXP_FULL);
+        return;
+    }
+    /* Symmetric path assumed - AP receives our frames reduced by applied backoff */
+    int backoff = (mon->txp_full - mon->txp) / 4;
+    int margin = link->rssi_avg - backoff - (CONFIG_WIFIMGR_LINK_RSSI_LOW + CONFIG_WIFIMGR_TXP_MARGIN);
+    int txp = mon->txp;
+    if(margin >= CONFIG_WIFIMGR_TXP_STEP_DOWN) txp -= CONFIG_WIFIMGR_TXP_STEP_DOWN * 4;
+    else if(margin < 0) txp += ((-margin < CONFIG_WIFIMGR_TXP_STEP_UP) ? -margin : CONFIG_WIFIMGR_TXP_STEP_UP) * 4;
+    if(txp < CONFIG_WIFIMGR_TXP_MIN * 4) txp = CONFIG_WIFIMGR_TXP_MIN * 4;
+    if(txp > mon->txp_full) txp = mon->txp_full;
+    wm_txp_set((int8_t)txp);
+}
+
+static void wm_txp_set(int8_t txp) {
+    wm_link_monitor_t *mon = &wm_run_conf->link_mon;
+    mon->txp_full = (wm_run_conf->country.max_tx_power * 4 < WM_TXP_FULL) ? wm_run_conf->country.max_tx_power * 4 : WM_TXP_FULL;
+    if(mon->txp_full < WM_TXP_MIN) mon->txp_full = WM_TXP_MIN;
+    if(txp > mon->txp_full) txp = mon->txp_full;
+    if(txp == mon->txp) return;
+    if(ESP_OK == esp_wifi_set_max_tx_power(txp)) mon->txp = txp;
+}
+#endif
+#endif
+
+#if (CONFIG_WIFIMGR_INET_CHECK == 1)
+static void vInetProbeTask(void *pvParameters) {
+    wm_inet_probe_t *probe = (wm_inet_probe_t *)pvParameters;
+    wm_msg_t msg = { .type = WM_MSG_INET_RESULT, .inet = { .link_seq = probe->link_seq } };
+    wm_inet_probe(probe->host, probe->port, probe->path, probe->expected_status, CONFIG_WIFIMGR_INET_CHECK_TIMEOUT, &msg.inet.result);
+    wm_fp_free(probe);
+    xQueueSend(wm_run_conf->mgr_queue, &msg, portMAX_DELAY);
+    vTaskDelete(NULL);
 }
 #endif
 
+#if (CONFIG_WIFIMGR_DNS_RACE == 1)
+static void vDnsRaceTask(void *pvParameters) {
+    wm_msg_t *msg = (wm_msg_t *)pvParameters;
+    wm_dns_health_t *health = &msg->dns.health;
+    uint32_t servers[WM_DNS_MAX_SERVERS];
+    for(int i=0; i<health->count; i++) servers[i] = health->server[i].addr;
+    wm_dns_race(servers, health->count, WM_DNS_PORT, CONFIG_WIFIMGR_DNS_RACE_HOST, CONFIG_WIFIMGR_DNS_RACE_TIMEOUT, health->rtt_ms);
+    xQueueSend(wm_run_conf->mgr_queue, msg, portMAX_DELAY);
+    wm_fp_free(msg);
+    vTaskDelete(NULL);
+}
+
+static void vDnsRaceTimer(TimerHandle_t xTimer) {
+    /* Not lost on full queue */
+    wm_mgr_signal(WM_MSG_DNS_CHECK);
+}
+#endif
+
+static void wm_mgr_process(wm_msg_t *msg) {
+    wm_capture_msg(msg);
+    switch(msg->type) {
+        case WM_MSG_CMD: {
+            wm_cmd_id_t cmd_id = msg->cmd.cmd.cmd_id;
+            bool kn_op = (cmd_id == WM_CMD_KN_ADD) || (cmd_id == WM_CMD_KN_DEL) || (cmd_id == WM_CMD_KN_BULK);
+            if(kn_op) wm_fp_begin(WM_FP_KN);
+            esp_err_t err = wm_cmd_process(&msg->cmd.cmd);
+            if(kn_op) wm_fp_end(WM_FP_KN);
+            if(msg->cmd.done_cb) msg->cmd.done_cb(&msg->cmd.cmd, err, msg->cmd.cb_arg);
+            break;
+        }
+        case WM_MSG_WIFI_EVENT:
+            wm_wifi_event_handler(NULL, WIFI_EVENT, msg->event.event_id, &msg->event.event_data);
+            break;
+        case WM_MSG_IP_EVENT:
+            wm_ip_event_handler(NULL, IP_EVENT, msg->event.event_id, &msg->event.event_data);
+            break;
+        case WM_MSG_SCAN_TICK:
+            wm_scan_tick();
+            break;
+        #if (CONFIG_WIFIMGR_INET_CHECK == 1)
+        case WM_MSG_INET_RESULT:
+            wm_inet_probe_done(&msg->inet.result, msg->inet.link_seq);
+            break;
+        #endif
+        case WM_MSG_SNTP_SYNC:
+            wm_prof_mark(WM_PHASE_SNTP);
+            wm_prof_finish();
+            break;
+        case WM_MSG_RECONNECT:
+            if(wm_run_conf->suspended) break;
+            wm_prof_mark(WM_PHASE_CONNECT);
+            esp_wifi_connect();
+            break;
+        case WM_MSG_WATCHDOG:
+            wm_wd_check();
+            break;
+        #if (CONFIG_WIFIMGR_DNS_RACE == 1)
+        case WM_MSG_DNS_CHECK:
+            /* Race restarts timer when done */
+            if(!wm_dns_race_start() && wm_run_conf->sta_connected) xTimerChangePeriod(wm_run_conf->dns.timer, WM_S_TO_TICKS(CONFIG_WIFIMGR_DNS_RACE_PERIOD), 0);
+            break;
+        case WM_MSG_DNS_RESULT:
+            wm_dns_race_done(&msg->dns.health, msg->dns.link_seq);
+            break;
+        #endif
+        case WM_MSG_RESYNC:
+            wm_driver_resync(msg);
+            break;
+        #if (CONFIG_WIFIMGR_LINK_MONITOR == 1)
+        case WM_MSG_LINK_SAMPLE:
+            wm_link_sample();
+            break;
+        #endif
+        #if (CONFIG_WIFIMGR_DIRECT_CB == 1)
+        case WM_MSG_DIRECT:
+            wm_direct_dispatch(msg->direct.event_id, (msg->direct.size) ? &msg->direct.data : NULL, msg->direct.size);
+            break;
+        #endif
+        default:
+            break;
+    }
+}
+
+static void vManagerTask(void *pvParameters) {
+    wm_msg_t *msg = (wm_msg_t *)wm_fp_calloc(1, sizeof(wm_msg_t));
+    while(!msg) {
+        vTaskDelay(100 / portTICK_PERIOD_MS);
+        msg = (wm_msg_t *)wm_fp_calloc(1, sizeof(wm_msg_t));
+    }
+    while(true) {
+        if(xQueueReceive(wm_run_conf->mgr_queue, msg, portMAX_DELAY) != pdTRUE) continue;
+        if(msg->type == WM_MSG_EXIT) wm_run_conf->exiting = 1;
+        else {
+            /* Wake message only runs pending signals */
+            if(msg->type != WM_MSG_SIGNAL) wm_mgr_process(msg);
+            wm_mgr_signals(msg);
+            wm_fp_track();
+            wm_capture_heap();
+        }
+        /* Radio is stopped - running probe fails fast and its result is last message */
+        if(wm_run_conf->exiting && !wm_mgr_probe_running()) {
+            wm_fp_free(msg);
+            xTaskNotifyGive(wm_run_conf->lifecycle_waiter);
+            vTaskDelete(NULL);
+        }
+    }
+}
+
+static bool wm_mgr_probe_running(void) {
+    #if (CONFIG_WIFIMGR_INET_CHECK == 1)
+    if(wm_run_conf->inet_probing) return true;
+    #endif
+    #if (CONFIG_WIFIMGR_DNS_RACE == 1)
+    if(wm_run_conf->dns.probing) return true;
+    #endif
+    return false;
+}
+
 static void vScanTask(void *pvParameters)
 {
     wm_event_post(WM_EVENT_SCAN_TASK_START, NULL, 0);
-    wifi_mode_t wifi_run_mode = WIFI_MODE_MAX;
-    TickType_t xDelayTicks = (2500 / portTICK_PERIOD_MS);
-    wifi_scan_config_t cfg = {NULL, NULL, 0, true, WIFI_SCAN_TYPE_ACTIVE, (wifi_scan_time_t){{0, 120}, 320}, 255, (wifi_scan_channel_bitmap_t){0UL, 0UL}};
-    while(true) {
-        if(esp_wifi_get_mode(&wifi_run_mode) == ESP_OK) {
-            if((wm_run_conf->sta_connect_retry >= wm_run_conf->max_sta_connect_retry) || (wifi_run_mode == WIFI_MODE_APSTA) || ((wifi_run_mode == WIFI_MODE_STA) && (wm_run_conf->sta_connected))) {
-                if ( !(wm_run_conf->sta_connecting) && (wm_run_conf->scanning) ) {
-                    if(wm_run_conf->known_networks_head) {
-                        wm_run_conf->scanning = wm_run_conf->station_connected_to_ap; // Reenable scan mode if station is connected to AP
-                        if(!(wm_run_conf->sta_connected)) {
-                            if(!(wm_run_conf->station_connected_to_ap)) {
-                                cfg.channel = 0;
-                                wm_run_conf->scanned_channel = 0;
-                                esp_wifi_scan_start(&cfg, false);
-                            }
-                        } 
-                        #if (CONFIG_WIFIMGR_AP_CHANNEL == 0)
-                        else {
-                            cfg.channel++;
-                            if(cfg.channel > wm_run_conf->country.nchan) cfg.channel = 1;
-                            wm_run_conf->scanned_channel = cfg.channel;
-                            esp_wifi_scan_start(&cfg, false);
-                        }
-                        #endif
-                        xDelayTicks = (wm_run_conf->sta_connected) ? (5000 / portTICK_PERIOD_MS) : (2500 / portTICK_PERIOD_MS);
-                    } else wm_restart_ap();
-                } 
-            } else { xDelayTicks = (1000 / portTICK_PERIOD_MS); }
-        } else { xDelayTicks = (500 / portTICK_PERIOD_MS); }
-        vTaskDelay(xDelayTicks);
-    }
+    do {
+        /* Scan state is owned by manager task */
+        wm_mgr_signal(WM_MSG_SCAN_TICK);
+    } while(!ulTaskNotifyTake(pdTRUE, wm_run_conf->scan_delay));    /* Deinit notification stops task */
+    xTaskNotifyGive(wm_run_conf->lifecycle_waiter);
+    vTaskDelete(NULL);
 }
\ No newline at end of file
@@ -0,0 +1,338 @@
+/*
+ * SPDX-FileCopyrightText: 2024 Rossen Dobrinov
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/*
+ * Copyright 2024 Rossen Dobrinov
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "wm_config_codec.h"
+#include <string.h>
+
+/**
+ * @brief Type of image writer / reader cursor
+*/
+typedef struct wm_cfg_cursor {
+    uint8_t *buf;       /*!< Image buffer. NULL counts size only    */
+    size_t size;        /*!< Buffer size                            */
+    size_t pos;         /*!< Current position                       */
+} wm_cfg_cursor_t;
+
+/**
+ * Writer functions
+*/
+
+/**
+ * @brief Append bytes to image. Position advances past buffer end to report required size
+ *
+ * @param[in] cur Cursor
+ * @param[in] data Bytes
+ * @param[in] len Bytes count
+ *
+ * @return
+*/
+static void wm_cfg_put(wm_cfg_cursor_t *cur, const void *data, size_t len);
+
+/**
+ * @brief Append little-endian unsigned integer
+ *
+ * @param[in] cur Cursor
+ * @param[in] value Value
+ * @param[in] len Bytes count
+ *
+ * @return
+*/
+static void wm_cfg_put_uint(wm_cfg_cursor_t *cur, uint32_t value, size_t len);
+
+/**
+ * @brief Append length prefixed string
+ *
+ * @param[in] cur Cursor
+ * @param[in] str String, not longer than max_len
+ * @param[in] max_len Max string length
+ *
+ * @return
+*/
+static void wm_cfg_put_str(wm_cfg_cursor_t *cur, const char *str, size_t max_len);
+
+/**
+ * @brief Append AP or known network record
+ *
+ * @param[in] cur Cursor
+ * @param[in] type WM_CFG_REC_AP or WM_CFG_REC_KN
+ * @param[in] net Network
+ * @param[in] channel AP channel, not written for known network
+ *
+ * @return
+*/
+static void wm_cfg_put_net(wm_cfg_cursor_t *cur, wm_cfg_rec_t type, const wm_cfg_net_t *net, uint8_t channel);
+
+/**
+ * Reader functions
+*/
+
+/**
+ * @brief Read little-endian unsigned integer
+ *
+ * @param[in] cur Cursor
+ * @param[out] value Value
+ * @param[in] len Bytes count
+ *
+ * @return
+ *  - true Succeed
+ *  - false Record data exhausted
+*/
+static bool wm_cfg_get_uint(wm_cfg_cursor_t *cur, uint32_t *value, size_t len);
+
+/**
+ * @brief Read length prefixed string
+ *
+ * @param[in] cur Cursor
+ * @param[out] str Output, NULL terminated
+ * @param[in] max_len Max string length without terminator
+ *
+ * @return
+ *  - true Succeed
+ *  - false Record data exhausted or string too long
+*/
+static bool wm_cfg_get_str(wm_cfg_cursor_t *cur, char *str, size_t max_len);
+
+/**
+ * @brief Read AP or known network record value
+ *
+ * @param[in] cur Cursor over record value
+ * @param[out] net Network
+ * @param[out] channel AP channel. NULL for known network
+ *
+ * @return
+ *  - true Succeed
+ *  - false Malformed record
+*/
+static bool wm_cfg_get_net(wm_cfg_cursor_t *cur, wm_cfg_net_t *net, uint8_t *channel);
+
+/**
+ * Public functions
+*/
+
+size_t wm_cfg_encode(const wm_cfg_image_t *image, uint8_t *buf, size_t buf_size) {
+    if(!image || (image->kn_count > WM_CFG_MAX_NETS)) return 0;
+    wm_cfg_cursor_t cur = { .buf = buf, .size = (buf) ? buf_size : 0, .pos = 0 };
+    wm_cfg_put(&cur, "WMCF", 4);
+    wm_cfg_put_uint(&cur, WM_CFG_VERSION, 1);
+    wm_cfg_put_uint(&cur, 0, 1);
+    wm_cfg_put_uint(&cur, 0, 2);    /* Records length, patched below */
+
+    wm_cfg_put_net(&cur, WM_CFG_REC_AP, &image->ap, image->ap_channel);
+    for(uint8_t i=0; i<image->kn_count; i++) wm_cfg_put_net(&cur, WM_CFG_REC_KN, &image->kn[i], 0);
+
+    wm_cfg_put_uint(&cur, WM_CFG_REC_COUNTRY, 1);
+    wm_cfg_put_uint(&cur, 2, 1);
+    wm_cfg_put(&cur, image->country, 2);
+
+    wm_cfg_put_uint(&cur, WM_CFG_REC_SEC_DNS, 1);
+    wm_cfg_put_uint(&cur, 4, 1);
+    wm_cfg_put(&cur, &image->sec_dns, 4);   /* lwIP layout is network byte order in memory */
+
+    wm_cfg_put_uint(&cur, WM_CFG_REC_POLICY, 1);
+    wm_cfg_put_uint(&cur, 2, 1);
+    wm_cfg_put_uint(&cur, image->power_profile, 1);
+    wm_cfg_put_uint(&cur, image->max_sta_retry, 1);
+
+    if(image->inet_host[0]) {
+        wm_cfg_put_uint(&cur, WM_CFG_REC_INET_PROBE, 1);
+        wm_cfg_put_uint(&cur, 6 + strnlen(image->inet_host, 63) + strnlen(image->inet_path, 63), 1);
+        wm_cfg_put_uint(&cur, image->inet_port, 2);
+        wm_cfg_put_uint(&cur, image->inet_status, 2);
+        wm_cfg_put_str(&cur, image->inet_host, 63);
+        wm_cfg_put_str(&cur, image->inet_path, 63);
+    }
+
+    if(image->has_ap_profile) {
+        wm_cfg_put_uint(&cur, WM_CFG_REC_AP_PROFILE, 1);
+        wm_cfg_put_uint(&cur, 7, 1);
+        wm_cfg_put_uint(&cur, image->ap_security, 1);
+        wm_cfg_put_uint(&cur, image->ap_bandwidth, 1);
+        wm_cfg_put_uint(&cur, image->ap_max_clients, 1);
+        wm_cfg_put_uint(&cur, image->ap_beacon_interval, 2);
+        wm_cfg_put_uint(&cur, image->ap_inactive_time, 2);
+    }
+
+    size_t records = cur.pos - WM_CFG_HDR_SIZE;
+    if(records > UINT16_MAX) return 0;
+    if(!buf) return cur.pos + 4;
+    if(cur.pos + 4 > buf_size) return 0;
+    buf[6] = (uint8_t)(records & 0xFF);
+    buf[7] = (uint8_t)(records >> 8);
+    wm_cfg_put_uint(&cur, wm_cfg_crc32(0, buf, cur.pos), 4);
+    return cur.pos;
+}
+
+wm_cfg_err_t wm_cfg_decode(const uint8_t *buf, size_t size, wm_cfg_image_t *image) {
+    if(!buf || !image || (size < WM_CFG_HDR_SIZE + 4)) return WM_CFG_ERR_SIZE;
+    if(memcmp(buf, "WMCF", 4)) return WM_CFG_ERR_MAGIC;
+    if(buf[4] != WM_CFG_VERSION) return WM_CFG_ERR_VERSION;
+    size_t records = buf[6] | (buf[7] << 8);
+    if(WM_CFG_HDR_SIZE + records + 4 > size) return WM_CFG_ERR_SIZE;
+    wm_cfg_cursor_t cur = { .buf = (uint8_t *)buf, .size = WM_CFG_HDR_SIZE + records + 4, .pos = WM_CFG_HDR_SIZE + records };
+    uint32_t crc = 0;
+    wm_cfg_get_uint(&cur, &crc, 4);
+    if(crc != wm_cfg_crc32(0, buf, WM_CFG_HDR_SIZE + records)) return WM_CFG_ERR_CRC;
+
+    memset(image, 0, sizeof(wm_cfg_image_t));
+    cur.pos = WM_CFG_HDR_SIZE;
+    size_t end = WM_CFG_HDR_SIZE + records;
+    while(cur.pos < end) {
+        if(cur.pos + 2 > end) return WM_CFG_ERR_FORMAT;
+        uint8_t type = buf[cur.pos];
+        uint8_t len = buf[cur.pos + 1];
+        if(cur.pos + 2 + len > end) return WM_CFG_ERR_FORMAT;
+        /* Record value reader */
+        wm_cfg_cursor_t rec = { .buf = (uint8_t *)buf, .size = cur.pos + 2 + len, .pos = cur.pos + 2 };
+        uint32_t value = 0;
+        bool ok = true;
+        switch(type) {
+            case WM_CFG_REC_AP:
+                ok = wm_cfg_get_net(&rec, &image->ap, &image->ap_channel);
+                break;
+            case WM_CFG_REC_KN:
+                if(image->kn_count >= WM_CFG_MAX_NETS) return WM_CFG_ERR_FORMAT;
+                ok = wm_cfg_get_net(&rec, &image->kn[image->kn_count++], NULL);
+                break;
+            case WM_CFG_REC_COUNTRY:
+                ok = (len == 2);
+                if(ok) memcpy(image->country, &buf[rec.pos], 2);
+                break;
+            case WM_CFG_REC_SEC_DNS:
+                ok = (len == 4);
+                if(ok) memcpy(&image->sec_dns, &buf[rec.pos], 4);
+                break;
+            case WM_CFG_REC_POLICY:
+                ok = wm_cfg_get_uint(&rec, &value, 1);
+                image->power_profile = value;
+                ok = ok && wm_cfg_get_uint(&rec, &value, 1);
+                image->max_sta_retry = value;
+                break;
+            case WM_CFG_REC_INET_PROBE:
+                ok = wm_cfg_get_uint(&rec, &value, 2);
+                image->inet_port = value;
+                ok = ok && wm_cfg_get_uint(&rec, &value, 2);
+                image->inet_status = value;
+                ok = ok && wm_cfg_get_str(&rec, image->inet_host, 63) && wm_cfg_get_str(&rec, image->inet_path, 63);
+                break;
+            case WM_CFG_REC_AP_PROFILE:
+                ok = wm_cfg_get_uint(&rec, &value, 1);
+                image->ap_security = value;
+                ok = ok && wm_cfg_get_uint(&rec, &value, 1);
+                image->ap_bandwidth = value;
+                ok = ok && wm_cfg_get_uint(&rec, &value, 1);
+                image->ap_max_clients = value;
+                ok = ok && wm_cfg_get_uint(&rec, &value, 2);
+                image->ap_beacon_interval = value;
+                ok = ok && wm_cfg_get_uint(&rec, &value, 2);
+                image->ap_inactive_time = value;
+                image->has_ap_profile = ok;
+                break;
+            default:
+                break;  /* Newer record - skipped */
+        }
+        if(!ok) return WM_CFG_ERR_FORMAT;
+        cur.pos += 2 + len;
+    }
+    return WM_CFG_OK;
+}
+
+uint32_t wm_cfg_crc32(uint32_t crc, const uint8_t *buf, size_t len) {
+    crc = ~crc;
+    while(len--) {
+        crc ^= *buf++;
+        for(int i=0; i<8; i++) crc = (crc >> 1) ^ (0xEDB88320UL & (0 - (crc & 1)));
+    }
+    return ~crc;
+}
+
+/**
+ * Writer functions
+*/
+
+static void wm_cfg_put(wm_cfg_cursor_t *cur, const void *data, size_t len) {
+    if(cur->buf && (cur->pos + len <= cur->size)) memcpy(&cur->buf[cur->pos], data, len);
+    cur->pos += len;
+}
+
+static void wm_cfg_put_uint(wm_cfg_cursor_t *cur, uint32_t value, size_t len) {
+    uint8_t bytes[4];
+    for(size_t i=0; i<len; i++) bytes[i] = (uint8_t)(value >> (8 * i));
+    wm_cfg_put(cur, bytes, len);
+}
+
+static void wm_cfg_put_str(wm_cfg_cursor_t *cur, const char *str, size_t max_len) {
+    size_t len = strnlen(str, max_len);
+    wm_cfg_put_uint(cur, len, 1);
+    wm_cfg_put(cur, str, len);
+}
+
+static void wm_cfg_put_net(wm_cfg_cursor_t *cur, wm_cfg_rec_t type, const wm_cfg_net_t *net, uint8_t channel) {
+    size_t ssid_len = strnlen(net->ssid, 32);
+    size_t pwd_len = strnlen(net->password, 64);
+    wm_cfg_put_uint(cur, type, 1);
+    wm_cfg_put_uint(cur, ((type == WM_CFG_REC_AP) ? 1 : 0) + 1 + 16 + 1 + ssid_len + 1 + pwd_len, 1);
+    if(type == WM_CFG_REC_AP) wm_cfg_put_uint(cur, channel, 1);
+    wm_cfg_put_uint(cur, (net->hidden) ? 1 : 0, 1);
+    wm_cfg_put(cur, &net->ip, 4);
+    wm_cfg_put(cur, &net->netmask, 4);
+    wm_cfg_put(cur, &net->gw, 4);
+    wm_cfg_put(cur, &net->dns, 4);
+    wm_cfg_put_str(cur, net->ssid, 32);
+    wm_cfg_put_str(cur, net->password, 64);
+}
+
+/**
+ * Reader functions
+*/
+
+static bool wm_cfg_get_uint(wm_cfg_cursor_t *cur, uint32_t *value, size_t len) {
+    if(cur->pos + len > cur->size) return false;
+    *value = 0;
+    for(size_t i=0; i<len; i++) *value |= (uint32_t)cur->buf[cur->pos + i] << (8 * i);
+    cur->pos += len;
+    return true;
+}
+
+static bool wm_cfg_get_str(wm_cfg_cursor_t *cur, char *str, size_t max_len) {
+    uint32_t len = 0;
+    if(!wm_cfg_get_uint(cur, &len, 1) || (len > max_len) || (cur->pos + len > cur->size)) return false;
+    memcpy(str, &cur->buf[cur->pos], len);
+    str[len] = 0;
+    cur->pos += len;
+    return true;
+}
+
+static bool wm_cfg_get_net(wm_cfg_cursor_t *cur, wm_cfg_net_t *net, uint8_t *channel) {
+    uint32_t value = 0;
+    if(channel) {
+        if(!wm_cfg_get_uint(cur, &value, 1)) return false;
+        *channel = value;
+    }
+    if(!wm_cfg_get_uint(cur, &value, 1) || (cur->pos + 16 > cur->size)) return false;
+    net->hidden = value & 1;
+    memcpy(&net->ip, &cur->buf[cur->pos], 4);
+    memcpy(&net->netmask, &cur->buf[cur->pos + 4], 4);
+    memcpy(&net->gw, &cur->buf[cur->pos + 8], 4);
+    memcpy(&net->dns, &cur->buf[cur->pos + 12], 4);
+    cur->pos += 16;
+    return wm_cfg_get_str(cur, net->ssid, 32) && wm_cfg_get_str(cur, net->password, 64);
+}
@@ -0,0 +1,151 @@
+/*
+ * SPDX-FileCopyrightText: 2024 Rossen Dobrinov
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/*
+ * Copyright 2024 Rossen Dobrinov
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "wm_dns_probe.h"
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#ifdef ESP_PLATFORM
+#include "lwip/sockets.h"
+#else
+#include <sys/socket.h>
+#include <sys/select.h>
+#include <netinet/in.h>
+#endif
+
+#define WM_DNS_HDR_SIZE     12      /*!< DNS header size                    */
+#define WM_DNS_MSG_SIZE     512     /*!< Max DNS message size over UDP      */
+
+/**
+ * @brief Get monotonic time
+ *
+ * @return
+ *  - Time in ms
+*/
+static int64_t wm_dns_now_ms(void);
+
+/**
+ * DNS message functions
+*/
+
+size_t wm_dns_query(uint8_t *buf, size_t size, uint16_t id, const char *host) {
+    size_t host_len = strlen(host);
+    /* Header, labels with terminating zero, type and class */
+    if((host_len == 0) || (host_len > 253) || ((WM_DNS_HDR_SIZE + host_len + 2 + 4) > size)) return 0;
+    const uint8_t hdr[WM_DNS_HDR_SIZE] = { id >> 8, id & 0xFF, 0x01, 0x00, 0x00, 0x01, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 };
+    memcpy(buf, hdr, WM_DNS_HDR_SIZE);
+    size_t pos = WM_DNS_HDR_SIZE;
+    const char *label = host;
+    while(*label) {
+        const char *dot = strchr(label, '.');
+        size_t len = dot ? (size_t)(dot - label) : strlen(label);
+        if((len == 0) || (len > 63)) return 0;
+        buf[pos++] = (uint8_t)len;
+        memcpy(&buf[pos], label, len);
+        pos += len;
+        label += len + (dot ? 1 : 0);
+    }
+    const uint8_t tail[5] = { 0x00, 0x00, 0x01, 0x00, 0x01 };  /* Root, type A, class IN */
+    memcpy(&buf[pos], tail, sizeof(tail));
+    return pos + sizeof(tail);
+}
+
+bool wm_dns_response_ok(const uint8_t *buf, size_t len, uint16_t id) {
+    if((len < WM_DNS_HDR_SIZE) || (((buf[0] << 8) | buf[1]) != id) || !(buf[2] & 0x80)) return false;
+    uint8_t rcode = buf[3] & 0x0F;
+    return (rcode == 0) || (rcode == 3);
+}
+
+/**
+ * Racing functions
+*/
+
+size_t wm_dns_race(const uint32_t *servers, size_t count, uint16_t port, const char *host, uint32_t timeout_ms, int32_t *rtt_ms) {
+    uint8_t buf[WM_DNS_MSG_SIZE];
+    int64_t sent[WM_DNS_MAX_SERVERS];
+    uint16_t ids[WM_DNS_MAX_SERVERS];
+    size_t answered = 0, pending = 0;
+    if(count > WM_DNS_MAX_SERVERS) count = WM_DNS_MAX_SERVERS;
+    for(size_t i=0; i<count; i++) rtt_ms[i] = WM_DNS_RTT_FAIL;
+    int sock = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+    if(sock < 0) return 0;
+    /* Different ID per server - late answer of one server never matches another */
+    uint16_t base_id = (uint16_t)(wm_dns_now_ms() * 2654435761u >> 8);
+    for(size_t i=0; i<count; i++) {
+        ids[i] = base_id + i;
+        size_t len = wm_dns_query(buf, sizeof(buf), ids[i], host);
+        struct sockaddr_in to = { .sin_family = AF_INET, .sin_port = htons(port), .sin_addr.s_addr = servers[i] };
+        sent[i] = wm_dns_now_ms();
+        if(len && (sendto(sock, buf, len, 0, (struct sockaddr *)&to, sizeof(to)) == (int)len)) pending |= (1u << i);
+    }
+    int64_t deadline = wm_dns_now_ms() + timeout_ms;
+    while(pending) {
+        int64_t left = deadline - wm_dns_now_ms();
+        if(left <= 0) break;
+        fd_set rfds;
+        FD_ZERO(&rfds);
+        FD_SET(sock, &rfds);
+        struct timeval tv = { .tv_sec = left / 1000, .tv_usec = (left % 1000) * 1000 };
+        if(select(sock + 1, &rfds, NULL, NULL, &tv) <= 0) break;
+        struct sockaddr_in from;
+        socklen_t from_len = sizeof(from);
+        int len = recvfrom(sock, buf, sizeof(buf), 0, (struct sockaddr *)&from, &from_len);
+        if(len <= 0) continue;
+        for(size_t i=0; i<count; i++) {
+            if(!(pending & (1u << i)) || (from.sin_addr.s_addr != servers[i]) || (from.sin_port != htons(port))) continue;
+            if(((buf[0] << 8) | buf[1]) != ids[i]) continue;
+            pending &= ~(1u << i);
+            if(wm_dns_response_ok(buf, len, ids[i])) {
+                rtt_ms[i] = (int32_t)(wm_dns_now_ms() - sent[i]);
+                answered++;
+            }
+            break;
+        }
+    }
+    close(sock);
+    return answered;
+}
+
+void wm_dns_rank(const int32_t *rtt_ms, size_t count, uint8_t *order) {
+    if(count > WM_DNS_MAX_SERVERS) count = WM_DNS_MAX_SERVERS;
+    for(size_t i=0; i<count; i++) order[i] = i;
+    /* Stable insertion sort - few servers */
+    for(size_t i=1; i<count; i++) {
+        uint8_t cur = order[i];
+        size_t j = i;
+        while(j > 0) {
+            int32_t a = rtt_ms[order[j - 1]], b = rtt_ms[cur];
+            bool after = (b != WM_DNS_RTT_FAIL) && ((a == WM_DNS_RTT_FAIL) || (b < a));
+            if(!after) break;
+            order[j] = order[j - 1];
+            j--;
+        }
+        order[j] = cur;
+    }
+}
+
+static int64_t wm_dns_now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
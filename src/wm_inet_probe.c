@@ -0,0 +1,150 @@
+/*
+ * SPDX-FileCopyrightText: 2024 Rossen Dobrinov
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/*
+ * Copyright 2024 Rossen Dobrinov
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "wm_inet_probe.h"
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#ifdef ESP_PLATFORM
+#include "lwip/sockets.h"
+#include "lwip/netdb.h"
+#else
+#include <sys/socket.h>
+#include <sys/select.h>
+#include <netinet/in.h>
+#include <netdb.h>
+#endif
+
+#define WM_INET_BUF_SIZE    192     /*!< Request and status line buffer     */
+
+/**
+ * @brief TCP connect with timeout
+ * 
+ * @param[in] sock Socket descriptor
+ * @param[in] addr Remote address
+ * @param[in] timeout_ms Connect timeout
+ * 
+ * @return 
+ *  - true Connected
+ *  - false Connect failed or timed out
+*/
+static bool wm_inet_connect(int sock, struct addrinfo *addr, uint32_t timeout_ms);
+
+/**
+ * @brief Get monotonic time
+ *
+ * @return
+ *  - Time in ms
+*/
+static int64_t wm_inet_now_ms(void);
+
+/**
+ * Probe functions
+*/
+
+bool wm_inet_parse_status(const char *buf, size_t len, uint16_t *http_status) {
+    char line[16];
+    unsigned int status = 0;
+    /* "HTTP/x.y nnn" - copy terminated, response may be cut anywhere */
+    if(len < 12) return false;
+    memcpy(line, buf, 12);
+    line[12] = 0;
+    if((1 != sscanf(line, "HTTP/%*u.%*u %3u", &status)) || (status < 100) || (status > 599)) return false;
+    *http_status = status;
+    return true;
+}
+
+void wm_inet_probe(const char *host, uint16_t port, const char *path, uint16_t expected_status, uint32_t timeout_ms, wm_inet_probe_result_t *result) {
+    struct addrinfo hints = { .ai_family = AF_INET, .ai_socktype = SOCK_STREAM };
+    struct addrinfo *addr = NULL;
+    char port_str[6];
+    memset(result, 0, sizeof(wm_inet_probe_result_t));
+    snprintf(port_str, sizeof(port_str), "%u", port);
+
+    int64_t start = wm_inet_now_ms();
+    if(!host[0] || (0 != getaddrinfo(host, port_str, &hints, &addr)) || !addr) {
+        result->status = WM_INET_DNS_FAIL;
+        return;
+    }
+    result->dns_ms = wm_inet_now_ms() - start;
+
+    start = wm_inet_now_ms();
+    int sock = socket(addr->ai_family, addr->ai_socktype, 0);
+    if((sock < 0) || !wm_inet_connect(sock, addr, timeout_ms)) {
+        if(sock >= 0) close(sock);
+        freeaddrinfo(addr);
+        result->status = WM_INET_CONNECT_FAIL;
+        return;
+    }
+    freeaddrinfo(addr);
+    result->connect_ms = wm_inet_now_ms() - start;
+
+    start = wm_inet_now_ms();
+    struct timeval tv = { .tv_sec = timeout_ms / 1000, .tv_usec = (timeout_ms % 1000) * 1000 };
+    setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    setsockopt(sock, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+    char buffer[WM_INET_BUF_SIZE];
+    result->status = WM_INET_HTTP_FAIL;
+    int len = snprintf(buffer, sizeof(buffer), "GET %s HTTP/1.1\r\nHost: %s\r\nConnection: close\r\n\r\n", path, host);
+    if((len > 0) && (len < (int)sizeof(buffer)) && (send(sock, buffer, len, 0) == len)) {
+        /* Status line may arrive in several segments */
+        size_t got = 0;
+        while(got < 12) {
+            len = recv(sock, &buffer[got], sizeof(buffer) - got, 0);
+            if(len <= 0) break;
+            got += len;
+        }
+        if(wm_inet_parse_status(buffer, got, &result->http_status)) {
+            result->http_ms = wm_inet_now_ms() - start;
+            result->status = (result->http_status == expected_status) ? WM_INET_OK : WM_INET_CAPTIVE;
+        }
+    }
+    close(sock);
+}
+
+static bool wm_inet_connect(int sock, struct addrinfo *addr, uint32_t timeout_ms) {
+    int flags = fcntl(sock, F_GETFL, 0);
+    fcntl(sock, F_SETFL, flags | O_NONBLOCK);
+    if(0 != connect(sock, addr->ai_addr, addr->ai_addrlen)) {
+        if(errno != EINPROGRESS) return false;
+        fd_set wfds;
+        FD_ZERO(&wfds);
+        FD_SET(sock, &wfds);
+        struct timeval tv = { .tv_sec = timeout_ms / 1000, .tv_usec = (timeout_ms % 1000) * 1000 };
+        if(select(sock + 1, NULL, &wfds, NULL, &tv) <= 0) return false;
+        int sock_err = 0;
+        socklen_t err_len = sizeof(sock_err);
+        if((0 != getsockopt(sock, SOL_SOCKET, SO_ERROR, &sock_err, &err_len)) || sock_err) return false;
+    }
+    fcntl(sock, F_SETFL, flags);
+    return true;
+}
+
+static int64_t wm_inet_now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
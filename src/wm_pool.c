@@ -0,0 +1,68 @@
+/*
+ * SPDX-FileCopyrightText: 2024 Rossen Dobrinov
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/*
+ * Copyright 2024 Rossen Dobrinov
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "wm_pool.h"
+#include <stdlib.h>
+#include <string.h>
+
+void wm_pool_init(wm_pool_t *pool, void *base, size_t item_size, size_t count) {
+    pool->base = (uint8_t *)base;
+    pool->item_size = item_size;
+    pool->count = count;
+    pool->available = 0;
+    pool->free_list = NULL;
+    pool->heap_calloc = calloc;
+    pool->heap_free = free;
+    /* Link in reverse - first allocation gets first item */
+    for(size_t i=count; i>0; i--) wm_pool_free(pool, &pool->base[(i - 1) * item_size]);
+}
+
+void wm_pool_set_heap(wm_pool_t *pool, wm_pool_calloc_t heap_calloc, wm_pool_free_t heap_free) {
+    pool->heap_calloc = (heap_calloc) ? heap_calloc : calloc;
+    pool->heap_free = (heap_free) ? heap_free : free;
+}
+
+void *wm_pool_alloc(wm_pool_t *pool) {
+    void *item = pool->free_list;
+    if(!item) return pool->heap_calloc(1, pool->item_size);
+    memcpy(&pool->free_list, item, sizeof(void *));
+    pool->available--;
+    memset(item, 0, pool->item_size);
+    return item;
+}
+
+void wm_pool_free(wm_pool_t *pool, void *item) {
+    if(!item) return;
+    if(!wm_pool_owns(pool, item)) {
+        pool->heap_free(item);
+        return;
+    }
+    memcpy(item, &pool->free_list, sizeof(void *));
+    pool->free_list = item;
+    pool->available++;
+}
+
+bool wm_pool_owns(const wm_pool_t *pool, const void *item) {
+    const uint8_t *p = (const uint8_t *)item;
+    return (p >= pool->base) && (p < pool->base + pool->count * pool->item_size);
+}
@@ -0,0 +1,275 @@
+/*
+ * SPDX-FileCopyrightText: 2024 Rossen Dobrinov
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/*
+ * Copyright 2024 Rossen Dobrinov
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "wm_portal.h"
+#include "wm_portal_proto.h"
+#include "idf_wifi_manager.h"
+
+#include "esp_http_server.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "sdkconfig.h"
+#include "lwip/sockets.h"
+
+#include <string.h>
+#include <stdlib.h>
+
+#define WM_PORTAL_DNS_POLL_MS   200     /*!< DNS socket receive timeout - stop request latency  */
+#define WM_PORTAL_FORM_MAX      256     /*!< Max /connect form body                             */
+
+/**
+ * @brief Portal page compressed at build time and embedded in flash
+*/
+extern const uint8_t wm_portal_index_start[] asm("_binary_index_html_gz_start");
+extern const uint8_t wm_portal_index_end[] asm("_binary_index_html_gz_end");
+
+/**
+ * @brief Type of portal running state
+*/
+typedef struct wm_portal {
+    httpd_handle_t server;      /*!< HTTP server handle                 */
+    TaskHandle_t dns_task;      /*!< DNS catch-all task handle          */
+    TaskHandle_t waiter;        /*!< Task waiting for DNS task exit     */
+    uint32_t ip;                /*!< softAP address, network byte order */
+    char location[24];          /*!< Portal page URL for redirects      */
+} wm_portal_t;
+
+static wm_portal_t wm_portal = { 0 };  /*!< Portal running state */
+
+/**
+ * Portal handlers
+*/
+
+/**
+ * @brief GET / - send compressed portal page directly from flash
+ *
+ * @param[in] req HTTP request
+ *
+ * @return
+ *  - ESP_OK Succeed
+*/
+static esp_err_t wm_portal_index_get(httpd_req_t *req);
+
+/**
+ * @brief GET /scan - send cached scan results as JSON array
+ *
+ * @param[in] req HTTP request
+ *
+ * @return
+ *  - ESP_OK Succeed
+*/
+static esp_err_t wm_portal_scan_get(httpd_req_t *req);
+
+/**
+ * @brief POST /connect - add known network from form fields
+ *
+ * @param[in] req HTTP request
+ *
+ * @return
+ *  - ESP_OK Succeed
+*/
+static esp_err_t wm_portal_connect_post(httpd_req_t *req);
+
+/**
+ * @brief Redirect unknown URI to portal page. Triggers OS captive portal login
+ *
+ * @param[in] req HTTP request
+ * @param[in] error HTTP error
+ *
+ * @return
+ *  - ESP_OK Succeed
+*/
+static esp_err_t wm_portal_redirect(httpd_req_t *req, httpd_err_code_t error);
+
+/**
+ * @brief DNS catch-all task. Exits on notification
+ *
+ * @param[in] pvParameters Unused
+ *
+ * @return
+*/
+static void vPortalDnsTask(void *pvParameters);
+
+static const httpd_uri_t wm_portal_uris[] = {
+    { .uri = "/", .method = HTTP_GET, .handler = wm_portal_index_get },
+    { .uri = "/scan", .method = HTTP_GET, .handler = wm_portal_scan_get },
+    { .uri = "/connect", .method = HTTP_POST, .handler = wm_portal_connect_post }
+};
+
+/**
+ * Control functions
+*/
+
+esp_err_t wm_portal_start(esp_netif_t *ap_iface) {
+    if(wm_portal.server) return ESP_OK;
+    esp_netif_ip_info_t ip_info;
+    if(!ap_iface || (ESP_OK != esp_netif_get_ip_info(ap_iface, &ip_info)) || !ip_info.ip.addr) return ESP_ERR_INVALID_STATE;
+    wm_portal.ip = ip_info.ip.addr;
+    const uint8_t *addr = (const uint8_t *)&wm_portal.ip;
+    snprintf(wm_portal.location, sizeof(wm_portal.location), "http://%u.%u.%u.%u/", addr[0], addr[1], addr[2], addr[3]);
+
+    httpd_config_t config = HTTPD_DEFAULT_CONFIG();
+    config.max_open_sockets = CONFIG_WIFIMGR_PORTAL_MAX_SOCKETS;
+    /* Idle captive portal probes must not lock out new clients */
+    config.lru_purge_enable = true;
+    esp_err_t err = httpd_start(&wm_portal.server, &config);
+    if(err != ESP_OK) {
+        wm_portal.server = NULL;
+        return err;
+    }
+    for(size_t i=0; i<(sizeof(wm_portal_uris) / sizeof(httpd_uri_t)); i++) httpd_register_uri_handler(wm_portal.server, &wm_portal_uris[i]);
+    httpd_register_err_handler(wm_portal.server, HTTPD_404_NOT_FOUND, wm_portal_redirect);
+    if(pdPASS != xTaskCreate(vPortalDnsTask, "wportdns", 3072, NULL, 5, &wm_portal.dns_task)) {
+        wm_portal.dns_task = NULL;
+        wm_portal_stop();
+        return ESP_ERR_NO_MEM;
+    }
+    return ESP_OK;
+}
+
+void wm_portal_stop(void) {
+    if(wm_portal.dns_task) {
+        wm_portal.waiter = xTaskGetCurrentTaskHandle();
+        xTaskNotifyGive(wm_portal.dns_task);
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        wm_portal.dns_task = NULL;
+    }
+    if(wm_portal.server) httpd_stop(wm_portal.server);
+    wm_portal.server = NULL;
+}
+
+/**
+ * Portal handlers
+*/
+
+static esp_err_t wm_portal_index_get(httpd_req_t *req) {
+    wm_ap_activity_notify();
+    httpd_resp_set_type(req, "text/html");
+    httpd_resp_set_hdr(req, "Content-Encoding", "gzip");
+    httpd_resp_set_hdr(req, "Cache-Control", "no-cache");
+    return httpd_resp_send(req, (const char *)wm_portal_index_start, wm_portal_index_end - wm_portal_index_start);
+}
+
+static esp_err_t wm_portal_scan_get(httpd_req_t *req) {
+    /* Page polling is client traffic - scan slices wait for idle window */
+    wm_ap_activity_notify();
+    wm_scan_entry_t *entries = (wm_scan_entry_t *)calloc(CONFIG_WIFIMGR_SCAN_CACHE_SIZE, sizeof(wm_scan_entry_t));
+    if(!entries) return httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, NULL);
+    /* Coalesced by manager - page polling never floods radio with scans. Not waited for,
+       manager task may be stopping this server. Page gets fresh results on next poll */
+    wm_cmd_t cmd = { .cmd_id = WM_CMD_SCAN_NOW };
+    wm_cmd_submit(&cmd, NULL, NULL);
+    size_t count = wm_get_scan_results(NULL, entries, CONFIG_WIFIMGR_SCAN_CACHE_SIZE);
+    char ssid[67];
+    char item[128];
+    httpd_resp_set_type(req, "application/json");
+    httpd_resp_set_hdr(req, "Cache-Control", "no-store");
+    esp_err_t err = httpd_resp_sendstr_chunk(req, "[");
+    for(size_t i=0; (err == ESP_OK) && (i<count); i++) {
+        wm_json_escape(ssid, sizeof(ssid), entries[i].ssid);
+        snprintf(item, sizeof(item), "%s{\"ssid\":\"%s\",\"rssi\":%d,\"channel\":%u,\"auth\":%d}", 
+            (i) ? "," : "", ssid, entries[i].rssi, entries[i].channel, entries[i].authmode);
+        err = httpd_resp_sendstr_chunk(req, item);
+    }
+    free(entries);
+    if(err == ESP_OK) err = httpd_resp_sendstr_chunk(req, "]");
+    if(err == ESP_OK) err = httpd_resp_sendstr_chunk(req, NULL);
+    return err;
+}
+
+static esp_err_t wm_portal_connect_post(httpd_req_t *req) {
+    wm_ap_activity_notify();
+    if(req->content_len >= WM_PORTAL_FORM_MAX) return httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Form too large");
+    char *body = (char *)calloc(1, WM_PORTAL_FORM_MAX);
+    wm_cmd_t *cmd = (wm_cmd_t *)calloc(1, sizeof(wm_cmd_t));
+    if(!body || !cmd) {
+        free(body);
+        free(cmd);
+        return httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, NULL);
+    }
+    size_t received = 0;
+    while(received < req->content_len) {
+        int ret = httpd_req_recv(req, body + received, req->content_len - received);
+        if(ret == HTTPD_SOCK_ERR_TIMEOUT) continue;
+        if(ret <= 0) break;
+        received += ret;
+    }
+    esp_err_t err = ESP_ERR_INVALID_ARG;
+    char hidden[2] = "";
+    char password[65];      /* 64 characters PSK fills net_config.password without NULL */
+    wm_net_base_config_t *net = &cmd->net_config;
+    if((received == req->content_len) && wm_form_value(body, "ssid", net->ssid, sizeof(net->ssid)) &&
+       wm_form_value(body, "password", password, sizeof(password)) && (strlen(net->ssid) >= 2) && wm_form_password_valid(password)) {
+        memcpy(net->password, password, sizeof(net->password));
+        wm_form_value(body, "hidden", hidden, sizeof(hidden));
+        net->hidden = (hidden[0] == '1');
+        /* DHCP - static addresses stay IPADDR_ANY. Queued only, manager task may be stopping this 
+           server and would wait for this handler. Result is reported by known network events */
+        cmd->cmd_id = WM_CMD_KN_ADD;
+        err = wm_cmd_submit(cmd, NULL, NULL);
+    }
+    free(body);
+    free(cmd);
+    if(err == ESP_ERR_INVALID_ARG) return httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Invalid SSID or password");
+    if(err != ESP_OK) return httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, esp_err_to_name(err));
+    httpd_resp_set_type(req, "application/json");
+    return httpd_resp_sendstr(req, "{\"result\":\"ok\"}");
+}
+
+static esp_err_t wm_portal_redirect(httpd_req_t *req, httpd_err_code_t error) {
+    wm_ap_activity_notify();
+    httpd_resp_set_status(req, "302 Found");
+    httpd_resp_set_hdr(req, "Location", wm_portal.location);
+    return httpd_resp_send(req, NULL, 0);
+}
+
+/**
+ * DNS catch-all functions
+*/
+
+static void vPortalDnsTask(void *pvParameters) {
+    bool stop = false;
+    int sock = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+    if(sock >= 0) {
+        struct sockaddr_in addr = { .sin_family = AF_INET, .sin_port = htons(53), .sin_addr.s_addr = htonl(INADDR_ANY) };
+        struct timeval timeout = { .tv_sec = 0, .tv_usec = WM_PORTAL_DNS_POLL_MS * 1000 };
+        setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+        if(0 == bind(sock, (struct sockaddr *)&addr, sizeof(addr))) {
+            uint8_t msg[WM_DNS_MAX_MSG];
+            while(!(stop = ulTaskNotifyTake(pdTRUE, 0))) {
+                struct sockaddr_in from;
+                socklen_t from_len = sizeof(from);
+                int len = recvfrom(sock, msg, sizeof(msg), 0, (struct sockaddr *)&from, &from_len);
+                if(len <= 0) continue;
+                wm_ap_activity_notify();
+                size_t answer = wm_dns_catch_all(msg, len, sizeof(msg), wm_portal.ip);
+                if(answer) sendto(sock, msg, answer, 0, (struct sockaddr *)&from, from_len);
+            }
+        }
+        close(sock);
+    }
+    /* Socket failure - wait for stop request */
+    if(!stop) ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+    xTaskNotifyGive(wm_portal.waiter);
+    vTaskDelete(NULL);
+}
@@ -0,0 +1,142 @@
+/*
+ * SPDX-FileCopyrightText: 2024 Rossen Dobrinov
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/*
+ * Copyright 2024 Rossen Dobrinov
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "wm_portal_proto.h"
+#include <string.h>
+
+#define WM_DNS_HDR_SIZE     12      /*!< DNS header size                    */
+#define WM_DNS_ANS_SIZE     16      /*!< Compressed A record answer size    */
+#define WM_DNS_TTL          60      /*!< Answer TTL in seconds              */
+
+/**
+ * @brief Convert hex digit to value
+ *
+ * @param[in] c Hex digit
+ *
+ * @return
+ *  - Digit value. -1 when not a hex digit
+*/
+static int wm_hex_value(char c);
+
+/**
+ * DNS functions
+*/
+
+size_t wm_dns_catch_all(uint8_t *msg, size_t len, size_t buf_size, uint32_t ip) {
+    if((len < WM_DNS_HDR_SIZE) || (len > buf_size)) return 0;
+    /* Standard queries only, single question */
+    if((msg[2] & 0xF8) != 0 || (((msg[4] << 8) | msg[5]) != 1)) return 0;
+    size_t pos = WM_DNS_HDR_SIZE;
+    while((pos < len) && msg[pos]) {
+        /* Compression is not allowed in question name */
+        if(msg[pos] & 0xC0) return 0;
+        pos += msg[pos] + 1;
+    }
+    if((pos + 5) > len) return 0;
+    uint16_t qtype = (msg[pos + 1] << 8) | msg[pos + 2];
+    uint16_t qclass = (msg[pos + 3] << 8) | msg[pos + 4];
+    pos += 5;
+    bool answer = (qtype == 1) && (qclass == 1);
+    if(answer && ((pos + WM_DNS_ANS_SIZE) > buf_size)) return 0;
+    /* Response, recursion desired copied, recursion available, no error */
+    msg[2] = 0x80 | (msg[2] & 0x01);
+    msg[3] = 0x80;
+    msg[6] = 0;
+    msg[7] = answer ? 1 : 0;
+    memset(&msg[8], 0, 4);
+    if(!answer) return pos;
+    const uint8_t *addr = (const uint8_t *)&ip;
+    const uint8_t rr[WM_DNS_ANS_SIZE] = {
+        0xC0, WM_DNS_HDR_SIZE,                  /* Name pointer to question */
+        0x00, 0x01, 0x00, 0x01,                 /* Type A, class IN         */
+        0x00, 0x00, 0x00, WM_DNS_TTL,           /* TTL                      */
+        0x00, 0x04,                             /* Address length           */
+        addr[0], addr[1], addr[2], addr[3]
+    };
+    memcpy(&msg[pos], rr, WM_DNS_ANS_SIZE);
+    return pos + WM_DNS_ANS_SIZE;
+}
+
+/**
+ * Form and JSON functions
+*/
+
+bool wm_form_value(const char *body, const char *key, char *value, size_t value_size) {
+    size_t key_len = strlen(key);
+    const char *p = body;
+    while(p && *p) {
+        if(!strncmp(p, key, key_len) && (p[key_len] == '=')) {
+            p += key_len + 1;
+            size_t n = 0;
+            while(*p && (*p != '&')) {
+                char c = *p++;
+                if(c == '+') c = ' ';
+                else if((c == '%') && (wm_hex_value(p[0]) >= 0) && (wm_hex_value(p[1]) >= 0)) {
+                    c = (char)((wm_hex_value(p[0]) << 4) | wm_hex_value(p[1]));
+                    p += 2;
+                }
+                if((n + 1) >= value_size) return false;
+                value[n++] = c;
+            }
+            value[n] = '\0';
+            return true;
+        }
+        p = strchr(p, '&');
+        if(p) p++;
+    }
+    return false;
+}
+
+bool wm_form_password_valid(const char *password) {
+    size_t len = strlen(password);
+    if(len == 64) {
+        for(size_t i=0; i<len; i++) if(wm_hex_value(password[i]) < 0) return false;
+        return true;
+    }
+    if(!len) return true;
+    if((len < 8) || (len > 63)) return false;
+    for(size_t i=0; i<len; i++) if(((unsigned char)password[i] < 0x20) || ((unsigned char)password[i] > 0x7E)) return false;
+    return true;
+}
+
+size_t wm_json_escape(char *dst, size_t dst_size, const char *src) {
+    size_t n = 0;
+    if(!dst_size) return 0;
+    for(; *src; src++) {
+        unsigned char c = (unsigned char)*src;
+        if(c < 0x20) continue;
+        size_t need = ((c == '"') || (c == '\\')) ? 2 : 1;
+        if((n + need) >= dst_size) break;
+        if(need == 2) dst[n++] = '\\';
+        dst[n++] = (char)c;
+    }
+    dst[n] = '\0';
+    return n;
+}
+
+static int wm_hex_value(char c) {
+    if((c >= '0') && (c <= '9')) return c - '0';
+    if((c >= 'a') && (c <= 'f')) return c - 'a' + 10;
+    if((c >= 'A') && (c <= 'F')) return c - 'A' + 10;
+    return -1;
+}
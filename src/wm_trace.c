@@ -0,0 +1,221 @@
+/*
+ * SPDX-FileCopyrightText: 2024 Rossen Dobrinov
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/*
+ * Copyright 2024 Rossen Dobrinov
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "wm_trace.h"
+#include <string.h>
+
+#define WM_TRACE_AP_FIXED   10      /*!< Scan record data without SSID      */
+
+static const uint8_t wm_trace_magic[4] = { 'W', 'M', 'T', 'R' };
+
+/**
+ * @brief Store little-endian unsigned integer
+ *
+ * @param[out] buf Destination
+ * @param[in] value Value
+ * @param[in] len Bytes count
+ *
+ * @return
+*/
+static void wm_trace_put_uint(uint8_t *buf, uint32_t value, size_t len);
+
+/**
+ * @brief Load little-endian unsigned integer
+ *
+ * @param[in] buf Source
+ * @param[in] len Bytes count
+ *
+ * @return
+ *  - Value
+*/
+static uint32_t wm_trace_get_uint(const uint8_t *buf, size_t len);
+
+/**
+ * Writer functions
+*/
+
+static void wm_trace_put_uint(uint8_t *buf, uint32_t value, size_t len) {
+    for(size_t i=0; i<len; i++) buf[i] = (uint8_t)(value >> (8 * i));
+}
+
+bool wm_trace_start(wm_trace_writer_t *w, uint8_t *buf, size_t size, uint32_t now_ms) {
+    memset(w, 0, sizeof(wm_trace_writer_t));
+    if(!buf || (size < WM_TRACE_HDR_SIZE)) return false;
+    memcpy(buf, wm_trace_magic, sizeof(wm_trace_magic));
+    buf[4] = WM_TRACE_VERSION;
+    buf[5] = 0;
+    wm_trace_put_uint(&buf[6], now_ms, 4);
+    w->buf = buf;
+    w->size = size;
+    w->len = WM_TRACE_HDR_SIZE;
+    w->last_ms = now_ms;
+    return true;
+}
+
+bool wm_trace_put(wm_trace_writer_t *w, wm_trace_rec_t type, uint16_t id, uint32_t now_ms, const void *data, size_t len) {
+    if(!w->buf) return false;
+    if(len > WM_TRACE_DATA_MAX) len = WM_TRACE_DATA_MAX;
+    uint8_t rec[4 + 5];
+    rec[0] = (uint8_t)type;
+    wm_trace_put_uint(&rec[1], id, 2);
+    rec[3] = (uint8_t)len;
+    size_t pos = 4;
+    uint32_t delta = now_ms - w->last_ms;   /* Wraps with uptime counter */
+    do {
+        rec[pos] = delta & 0x7F;
+        delta >>= 7;
+        if(delta) rec[pos] |= 0x80;
+        pos++;
+    } while(delta);
+    if(w->dropped || ((w->len + pos + len) > w->size)) {
+        w->dropped++;
+        w->buf[5] |= WM_TRACE_TRUNCATED;
+        return false;
+    }
+    memcpy(&w->buf[w->len], rec, pos);
+    if(len) memcpy(&w->buf[w->len + pos], data, len);
+    w->len += pos + len;
+    w->last_ms = now_ms;
+    return true;
+}
+
+bool wm_trace_put_ap(wm_trace_writer_t *w, uint32_t now_ms, const wm_trace_ap_t *ap) {
+    uint8_t rec[WM_TRACE_AP_FIXED + 32];
+    size_t ssid_len = strnlen(ap->ssid, 32);
+    memcpy(rec, ap->bssid, 6);
+    rec[6] = ap->primary;
+    rec[7] = ap->second;
+    rec[8] = (uint8_t)ap->rssi;
+    rec[9] = ap->authmode;
+    memcpy(&rec[WM_TRACE_AP_FIXED], ap->ssid, ssid_len);
+    return wm_trace_put(w, WM_TRACE_REC_SCAN_AP, 0, now_ms, rec, WM_TRACE_AP_FIXED + ssid_len);
+}
+
+/**
+ * Reader functions
+*/
+
+static uint32_t wm_trace_get_uint(const uint8_t *buf, size_t len) {
+    uint32_t value = 0;
+    for(size_t i=0; i<len; i++) value |= (uint32_t)buf[i] << (8 * i);
+    return value;
+}
+
+wm_trace_err_t wm_trace_open(wm_trace_reader_t *r, const uint8_t *buf, size_t len) {
+    memset(r, 0, sizeof(wm_trace_reader_t));
+    if(!buf || (len < WM_TRACE_HDR_SIZE)) return WM_TRACE_ERR_SIZE;
+    if(memcmp(buf, wm_trace_magic, sizeof(wm_trace_magic))) return WM_TRACE_ERR_MAGIC;
+    if(buf[4] != WM_TRACE_VERSION) return WM_TRACE_ERR_VERSION;
+    r->buf = buf;
+    r->len = len;
+    r->pos = WM_TRACE_HDR_SIZE;
+    return WM_TRACE_OK;
+}
+
+wm_trace_err_t wm_trace_next(wm_trace_reader_t *r, wm_trace_item_t *item) {
+    if(r->pos >= r->len) return WM_TRACE_END;
+    if((r->len - r->pos) < 5) return WM_TRACE_ERR_SIZE;
+    const uint8_t *rec = &r->buf[r->pos];
+    if((rec[0] < WM_TRACE_REC_WIFI) || (rec[0] > WM_TRACE_REC_HEAP)) return WM_TRACE_ERR_FORMAT;
+    size_t pos = 4;
+    uint32_t delta = 0;
+    for(int shift=0; ; shift += 7) {
+        if((r->pos + pos) >= r->len) return WM_TRACE_ERR_SIZE;
+        if(shift > 28) return WM_TRACE_ERR_FORMAT;
+        uint8_t b = rec[pos++];
+        delta |= (uint32_t)(b & 0x7F) << shift;
+        if(!(b & 0x80)) break;
+    }
+    if((r->len - r->pos - pos) < rec[3]) return WM_TRACE_ERR_SIZE;
+    r->time_ms += delta;
+    item->type = (wm_trace_rec_t)rec[0];
+    item->id = (uint16_t)wm_trace_get_uint(&rec[1], 2);
+    item->time_ms = r->time_ms;
+    item->len = rec[3];
+    item->data = &rec[pos];
+    r->pos += pos + rec[3];
+    return WM_TRACE_OK;
+}
+
+bool wm_trace_get_ap(const wm_trace_item_t *item, wm_trace_ap_t *ap) {
+    memset(ap, 0, sizeof(wm_trace_ap_t));
+    if((item->type != WM_TRACE_REC_SCAN_AP) || (item->len < WM_TRACE_AP_FIXED) || (item->len > (WM_TRACE_AP_FIXED + 32))) return false;
+    memcpy(ap->bssid, item->data, 6);
+    ap->primary = item->data[6];
+    ap->second = item->data[7];
+    ap->rssi = (int8_t)item->data[8];
+    ap->authmode = item->data[9];
+    memcpy(ap->ssid, &item->data[WM_TRACE_AP_FIXED], item->len - WM_TRACE_AP_FIXED);
+    return true;
+}
+
+/**
+ * Replay functions
+*/
+
+wm_trace_err_t wm_trace_replay(const uint8_t *buf, size_t len, const wm_trace_replay_ops_t *ops, void *arg, wm_trace_summary_t *summary) {
+    wm_trace_summary_t sum = { 0 };
+    wm_trace_reader_t r;
+    wm_trace_item_t item;
+    wm_trace_ap_t ap;
+    uint32_t last_input_ms = 0;
+    uint64_t latency_sum = 0;
+    wm_trace_err_t err = wm_trace_open(&r, buf, len);
+    if(err == WM_TRACE_OK) sum.truncated = !!(buf[5] & WM_TRACE_TRUNCATED);
+    while((err == WM_TRACE_OK) && ((err = wm_trace_next(&r, &item)) == WM_TRACE_OK)) {
+        sum.duration_ms = item.time_ms;
+        switch(item.type) {
+            case WM_TRACE_REC_WIFI:
+            case WM_TRACE_REC_IP:
+            case WM_TRACE_REC_MSG:
+                sum.inputs++;
+                last_input_ms = item.time_ms;
+                if(ops && ops->input) ops->input(&item, arg);
+                break;
+            case WM_TRACE_REC_SCAN_AP:
+                if(!wm_trace_get_ap(&item, &ap)) { err = WM_TRACE_ERR_FORMAT; break; }
+                sum.scan_aps++;
+                if(ops && ops->scan_ap) ops->scan_ap(&ap, arg);
+                break;
+            case WM_TRACE_REC_EVENT: {
+                uint32_t latency = item.time_ms - last_input_ms;
+                if(!sum.decisions || (latency < sum.latency_min_ms)) sum.latency_min_ms = latency;
+                if(latency > sum.latency_max_ms) sum.latency_max_ms = latency;
+                latency_sum += latency;
+                sum.decisions++;
+                if(ops && ops->decision) ops->decision(&item, latency, arg);
+                break;
+            }
+            case WM_TRACE_REC_HEAP: {
+                if(item.len != 4) { err = WM_TRACE_ERR_FORMAT; break; }
+                uint32_t free_heap = wm_trace_get_uint(item.data, 4);
+                if(!sum.heap_first) sum.heap_first = sum.heap_min = free_heap;
+                if(free_heap < sum.heap_min) sum.heap_min = free_heap;
+                break;
+            }
+        }
+    }
+    if(sum.decisions) sum.latency_avg_ms = (uint32_t)(latency_sum / sum.decisions);
+    sum.heap_peak_used = sum.heap_first - sum.heap_min;
+    if(summary) *summary = sum;
+    return (err == WM_TRACE_END) ? WM_TRACE_OK : err;
+}
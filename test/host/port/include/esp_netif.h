@@ -0,0 +1,23 @@
+#pragma once
+#include "esp_netif_types.h"
+#include "esp_event.h"
+#include "lwip/ip4_addr.h"
+extern esp_event_base_t const IP_EVENT;
+typedef enum { IP_EVENT_STA_GOT_IP, IP_EVENT_STA_LOST_IP, IP_EVENT_AP_STAIPASSIGNED } ip_event_t;
+typedef struct { esp_netif_t *esp_netif; esp_netif_ip_info_t ip_info; bool ip_changed; } ip_event_got_ip_t;
+esp_err_t esp_netif_init(void);
+esp_err_t esp_netif_deinit(void);
+esp_netif_t *esp_netif_create_default_wifi_ap(void);
+esp_netif_t *esp_netif_create_default_wifi_sta(void);
+void esp_netif_destroy_default_wifi(void *esp_netif);
+void esp_netif_destroy(esp_netif_t *n);
+esp_err_t esp_netif_get_ip_info(esp_netif_t *n, esp_netif_ip_info_t *i);
+esp_err_t esp_netif_set_ip_info(esp_netif_t *n, const esp_netif_ip_info_t *i);
+esp_err_t esp_netif_set_dns_info(esp_netif_t *n, esp_netif_dns_type_t t, esp_netif_dns_info_t *d);
+esp_err_t esp_netif_get_dns_info(esp_netif_t *n, esp_netif_dns_type_t t, esp_netif_dns_info_t *d);
+esp_err_t esp_netif_dhcps_get_status(esp_netif_t *n, esp_netif_dhcp_status_t *s);
+esp_err_t esp_netif_dhcpc_get_status(esp_netif_t *n, esp_netif_dhcp_status_t *s);
+esp_err_t esp_netif_dhcps_stop(esp_netif_t *n);
+esp_err_t esp_netif_dhcps_start(esp_netif_t *n);
+esp_err_t esp_netif_dhcpc_stop(esp_netif_t *n);
+esp_err_t esp_netif_dhcpc_start(esp_netif_t *n);
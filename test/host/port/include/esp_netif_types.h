@@ -0,0 +1,14 @@
+#pragma once
+#include <stdint.h>
+#include "esp_err.h"
+typedef struct { uint32_t addr; } esp_ip4_addr_t;
+typedef struct { uint32_t addr[4]; uint8_t zone; } esp_ip6_addr_t;
+typedef struct { union { esp_ip6_addr_t ip6; esp_ip4_addr_t ip4; } u_addr; uint8_t type; } esp_ip_addr_t;
+#define ESP_IPADDR_TYPE_V4 0
+typedef struct { esp_ip4_addr_t ip, netmask, gw; } esp_netif_ip_info_t;
+typedef struct { esp_ip_addr_t ip; } esp_netif_dns_info_t;
+typedef enum { ESP_NETIF_DNS_MAIN = 0, ESP_NETIF_DNS_BACKUP, ESP_NETIF_DNS_FALLBACK, ESP_NETIF_DNS_MAX } esp_netif_dns_type_t;
+typedef enum { ESP_NETIF_DHCP_INIT = 0, ESP_NETIF_DHCP_STARTED, ESP_NETIF_DHCP_STOPPED } esp_netif_dhcp_status_t;
+typedef struct esp_netif_obj esp_netif_t;
+#define ESP_ERR_ESP_NETIF_DHCP_ALREADY_STARTED 0x5005
+#define ESP_ERR_ESP_NETIF_DHCP_ALREADY_STOPPED 0x5006
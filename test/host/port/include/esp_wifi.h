@@ -0,0 +1,103 @@
+#pragma once
+#include "sdkconfig.h"
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_err.h"
+#include "esp_event.h"
+#include "esp_netif.h"
+extern esp_event_base_t const WIFI_EVENT;
+typedef enum { WIFI_MODE_NULL = 0, WIFI_MODE_STA, WIFI_MODE_AP, WIFI_MODE_APSTA, WIFI_MODE_NAN, WIFI_MODE_MAX } wifi_mode_t;
+typedef enum { WIFI_IF_STA = 0, WIFI_IF_AP, WIFI_IF_NAN, WIFI_IF_MAX } wifi_interface_t;
+typedef enum { WIFI_COUNTRY_POLICY_AUTO, WIFI_COUNTRY_POLICY_MANUAL } wifi_country_policy_t;
+typedef struct { char cc[3]; uint8_t schan; uint8_t nchan; int8_t max_tx_power; wifi_country_policy_t policy;
+#if CONFIG_SOC_WIFI_SUPPORT_5G
+uint32_t wifi_5g_channel_mask;
+#endif
+} wifi_country_t;
+typedef enum { WIFI_BAND_MODE_2G_ONLY = 1, WIFI_BAND_MODE_5G_ONLY = 2, WIFI_BAND_MODE_AUTO = 3 } wifi_band_mode_t;
+esp_err_t esp_wifi_set_band_mode(wifi_band_mode_t m);
+typedef enum { WIFI_AUTH_OPEN = 0, WIFI_AUTH_WEP, WIFI_AUTH_WPA_PSK, WIFI_AUTH_WPA2_PSK, WIFI_AUTH_WPA_WPA2_PSK, WIFI_AUTH_ENTERPRISE, WIFI_AUTH_WPA3_PSK, WIFI_AUTH_WPA2_WPA3_PSK, WIFI_AUTH_MAX } wifi_auth_mode_t;
+typedef enum { WIFI_CIPHER_TYPE_NONE = 0, WIFI_CIPHER_TYPE_WEP40, WIFI_CIPHER_TYPE_WEP104, WIFI_CIPHER_TYPE_TKIP, WIFI_CIPHER_TYPE_CCMP, WIFI_CIPHER_TYPE_TKIP_CCMP, WIFI_CIPHER_TYPE_AES_CMAC128, WIFI_CIPHER_TYPE_SMS4, WIFI_CIPHER_TYPE_GCMP, WIFI_CIPHER_TYPE_GCMP256, WIFI_CIPHER_TYPE_UNKNOWN } wifi_cipher_type_t;
+typedef enum { WIFI_SECOND_CHAN_NONE = 0, WIFI_SECOND_CHAN_ABOVE, WIFI_SECOND_CHAN_BELOW } wifi_second_chan_t;
+typedef enum { WIFI_BW_HT20 = 1, WIFI_BW_HT40 = 2 } wifi_bandwidth_t;
+typedef enum { WIFI_PS_NONE, WIFI_PS_MIN_MODEM, WIFI_PS_MAX_MODEM } wifi_ps_type_t;
+typedef enum { WIFI_SCAN_TYPE_ACTIVE = 0, WIFI_SCAN_TYPE_PASSIVE } wifi_scan_type_t;
+typedef struct { uint32_t min; uint32_t max; } wifi_active_scan_time_t;
+typedef struct { wifi_active_scan_time_t active; uint32_t passive; } wifi_scan_time_t;
+typedef struct { uint16_t ghz_2_channels; uint32_t ghz_5_channels; } wifi_scan_channel_bitmap_t;
+typedef struct { uint8_t *ssid; uint8_t *bssid; uint8_t channel; bool show_hidden; wifi_scan_type_t scan_type; wifi_scan_time_t scan_time; uint8_t home_chan_dwell_time; wifi_scan_channel_bitmap_t channel_bitmap; } wifi_scan_config_t;
+typedef enum { WIFI_ANT_ANT0 } wifi_ant_t;
+typedef struct { uint8_t bssid[6]; uint8_t ssid[33]; uint8_t primary; wifi_second_chan_t second; int8_t rssi; wifi_auth_mode_t authmode; wifi_cipher_type_t pairwise_cipher; wifi_cipher_type_t group_cipher; wifi_ant_t ant; uint32_t phy_11b:1, phy_11g:1, phy_11n:1, phy_lr:1, phy_11ax:1, wps:1, ftm_responder:1, ftm_initiator:1, reserved:24; wifi_country_t country; } wifi_ap_record_t;
+typedef struct { bool capable; bool required; } wifi_pmf_config_t;
+typedef enum { WPA3_SAE_PWE_UNSPECIFIED, WPA3_SAE_PWE_HUNT_AND_PECK, WPA3_SAE_PWE_HASH_TO_ELEMENT, WPA3_SAE_PWE_BOTH } wifi_sae_pwe_method_t;
+typedef struct { uint8_t ssid[32]; uint8_t password[64]; uint8_t ssid_len; uint8_t channel; wifi_auth_mode_t authmode; uint8_t ssid_hidden; uint8_t max_connection; uint16_t beacon_interval; wifi_cipher_type_t pairwise_cipher; bool ftm_responder; wifi_pmf_config_t pmf_cfg; wifi_sae_pwe_method_t sae_pwe_h2e; } wifi_ap_config_t;
+typedef enum { WIFI_FAST_SCAN = 0, WIFI_ALL_CHANNEL_SCAN } wifi_scan_method_t;
+typedef enum { WIFI_CONNECT_AP_BY_SIGNAL = 0, WIFI_CONNECT_AP_BY_SECURITY } wifi_sort_method_t;
+typedef struct { int8_t rssi; wifi_auth_mode_t authmode; } wifi_scan_threshold_t;
+typedef struct { uint8_t ssid[32]; uint8_t password[64]; wifi_scan_method_t scan_method; bool bssid_set; uint8_t bssid[6]; uint8_t channel; uint16_t listen_interval; wifi_sort_method_t sort_method; wifi_scan_threshold_t threshold; wifi_pmf_config_t pmf_cfg; uint32_t rm_enabled:1, btm_enabled:1, mbo_enabled:1, ft_enabled:1, owe_enabled:1, transition_disable:1, reserved:26; wifi_sae_pwe_method_t sae_pwe_h2e; uint8_t failure_retry_cnt; } wifi_sta_config_t;
+typedef union { wifi_ap_config_t ap; wifi_sta_config_t sta; } wifi_config_t;
+typedef struct { int x; } wifi_init_config_t;
+#define WIFI_INIT_CONFIG_DEFAULT() { 0 }
+typedef enum { WIFI_STORAGE_FLASH, WIFI_STORAGE_RAM } wifi_storage_t;
+typedef enum { WIFI_EVENT_WIFI_READY = 0, WIFI_EVENT_SCAN_DONE, WIFI_EVENT_STA_START, WIFI_EVENT_STA_STOP, WIFI_EVENT_STA_CONNECTED, WIFI_EVENT_STA_DISCONNECTED, WIFI_EVENT_STA_AUTHMODE_CHANGE, WIFI_EVENT_STA_WPS_ER_SUCCESS, WIFI_EVENT_STA_WPS_ER_FAILED, WIFI_EVENT_STA_WPS_ER_TIMEOUT, WIFI_EVENT_STA_WPS_ER_PIN, WIFI_EVENT_STA_WPS_ER_PBC_OVERLAP, WIFI_EVENT_AP_START, WIFI_EVENT_AP_STOP, WIFI_EVENT_AP_STACONNECTED, WIFI_EVENT_AP_STADISCONNECTED, WIFI_EVENT_AP_PROBEREQRECVED, WIFI_EVENT_FTM_REPORT, WIFI_EVENT_STA_BSS_RSSI_LOW, WIFI_EVENT_ACTION_TX_STATUS, WIFI_EVENT_ROC_DONE, WIFI_EVENT_STA_BEACON_TIMEOUT, WIFI_EVENT_MAX } wifi_event_t;
+typedef struct { uint32_t status; uint8_t number; uint8_t scan_id; } wifi_event_sta_scan_done_t;
+typedef struct { uint8_t ssid[32]; uint8_t ssid_len; uint8_t bssid[6]; uint8_t channel; wifi_auth_mode_t authmode; uint16_t aid; } wifi_event_sta_connected_t;
+typedef struct { uint8_t ssid[32]; uint8_t ssid_len; uint8_t bssid[6]; uint8_t reason; int8_t rssi; } wifi_event_sta_disconnected_t;
+typedef struct { uint8_t mac[6]; uint8_t aid; bool is_mesh_child; } wifi_event_ap_staconnected_t;
+typedef struct { uint8_t mac[6]; uint8_t aid; bool is_mesh_child; uint8_t reason; } wifi_event_ap_stadisconnected_t;
+typedef struct { int32_t rssi; } wifi_event_bss_rssi_low_t;
+typedef enum {
+    WIFI_REASON_UNSPECIFIED = 1, WIFI_REASON_AUTH_EXPIRE = 2, WIFI_REASON_AUTH_LEAVE = 3, WIFI_REASON_ASSOC_EXPIRE = 4, WIFI_REASON_ASSOC_TOOMANY = 5,
+    WIFI_REASON_NOT_AUTHED = 6, WIFI_REASON_NOT_ASSOCED = 7, WIFI_REASON_ASSOC_LEAVE = 8, WIFI_REASON_ASSOC_NOT_AUTHED = 9,
+    WIFI_REASON_DISASSOC_PWRCAP_BAD = 10, WIFI_REASON_DISASSOC_SUPCHAN_BAD = 11, WIFI_REASON_BSS_TRANSITION_DISASSOC = 12,
+    WIFI_REASON_IE_INVALID = 13, WIFI_REASON_MIC_FAILURE = 14, WIFI_REASON_4WAY_HANDSHAKE_TIMEOUT = 15, WIFI_REASON_GROUP_KEY_UPDATE_TIMEOUT = 16,
+    WIFI_REASON_IE_IN_4WAY_DIFFERS = 17, WIFI_REASON_GROUP_CIPHER_INVALID = 18, WIFI_REASON_PAIRWISE_CIPHER_INVALID = 19, WIFI_REASON_AKMP_INVALID = 20,
+    WIFI_REASON_UNSUPP_RSN_IE_VERSION = 21, WIFI_REASON_INVALID_RSN_IE_CAP = 22, WIFI_REASON_802_1X_AUTH_FAILED = 23, WIFI_REASON_CIPHER_SUITE_REJECTED = 24,
+    WIFI_REASON_INVALID_PMKID = 53,
+    WIFI_REASON_BEACON_TIMEOUT = 200, WIFI_REASON_NO_AP_FOUND = 201, WIFI_REASON_AUTH_FAIL = 202, WIFI_REASON_ASSOC_FAIL = 203, WIFI_REASON_HANDSHAKE_TIMEOUT = 204,
+    WIFI_REASON_CONNECTION_FAIL = 205, WIFI_REASON_AP_TSF_RESET = 206, WIFI_REASON_ROAMING = 207, WIFI_REASON_ASSOC_COMEBACK_TIME_TOO_LONG = 208, WIFI_REASON_SA_QUERY_TIMEOUT = 209,
+    WIFI_REASON_NO_AP_FOUND_W_COMPATIBLE_SECURITY = 210, WIFI_REASON_NO_AP_FOUND_IN_AUTHMODE_THRESHOLD = 211, WIFI_REASON_NO_AP_FOUND_IN_RSSI_THRESHOLD = 212,
+} wifi_err_reason_t;
+typedef enum { WIFI_PHY_RATE_1M_L = 0, WIFI_PHY_RATE_MCS7_SGI = 0x1F, WIFI_PHY_RATE_MAX } wifi_phy_rate_t;
+typedef struct { uint8_t mac[6]; int8_t rssi; uint32_t phy_11b:1, phy_11g:1, phy_11n:1, phy_lr:1, phy_11ax:1, is_mesh_child:1, reserved:26; } wifi_sta_info_t;
+typedef struct { wifi_sta_info_t sta[15]; int num; } wifi_sta_list_t;
+esp_err_t esp_wifi_init(const wifi_init_config_t *c);
+esp_err_t esp_wifi_deinit(void);
+esp_err_t esp_wifi_set_storage(wifi_storage_t s);
+esp_err_t esp_wifi_set_country(const wifi_country_t *c);
+esp_err_t esp_wifi_get_country(wifi_country_t *c);
+esp_err_t esp_wifi_set_mode(wifi_mode_t m);
+esp_err_t esp_wifi_get_mode(wifi_mode_t *m);
+esp_err_t esp_wifi_set_config(wifi_interface_t i, wifi_config_t *c);
+esp_err_t esp_wifi_get_config(wifi_interface_t i, wifi_config_t *c);
+esp_err_t esp_wifi_set_bandwidth(wifi_interface_t i, wifi_bandwidth_t bw);
+esp_err_t esp_wifi_start(void);
+esp_err_t esp_wifi_stop(void);
+esp_err_t esp_wifi_connect(void);
+esp_err_t esp_wifi_disconnect(void);
+esp_err_t esp_wifi_scan_start(const wifi_scan_config_t *c, bool block);
+esp_err_t esp_wifi_scan_stop(void);
+esp_err_t esp_wifi_scan_get_ap_num(uint16_t *n);
+esp_err_t esp_wifi_scan_get_ap_records(uint16_t *n, wifi_ap_record_t *r);
+esp_err_t esp_wifi_clear_ap_list(void);
+esp_err_t esp_wifi_set_channel(uint8_t p, wifi_second_chan_t s);
+esp_err_t esp_wifi_get_channel(uint8_t *p, wifi_second_chan_t *s);
+esp_err_t esp_wifi_set_ps(wifi_ps_type_t t);
+esp_err_t esp_wifi_get_ps(wifi_ps_type_t *t);
+esp_err_t esp_wifi_sta_get_ap_info(wifi_ap_record_t *r);
+esp_err_t esp_wifi_sta_get_rssi(int *rssi);
+esp_err_t esp_wifi_set_max_tx_power(int8_t p);
+esp_err_t esp_wifi_get_max_tx_power(int8_t *p);
+esp_err_t esp_wifi_ap_get_sta_list(wifi_sta_list_t *l);
+esp_err_t esp_wifi_set_rssi_threshold(int32_t rssi);
+esp_err_t esp_wifi_set_inactive_time(wifi_interface_t i, uint16_t sec);
+esp_err_t esp_wifi_set_country_code(const char *cc, bool ieee80211d_enabled);
+#define ESP_ERR_WIFI_BASE 0x3000
+#define ESP_ERR_WIFI_NOT_INIT (ESP_ERR_WIFI_BASE + 1)
+#define ESP_ERR_WIFI_NOT_STARTED (ESP_ERR_WIFI_BASE + 2)
+#define ESP_ERR_WIFI_NOT_STOPPED (ESP_ERR_WIFI_BASE + 3)
+#define ESP_ERR_WIFI_IF (ESP_ERR_WIFI_BASE + 4)
+#define ESP_ERR_WIFI_MODE (ESP_ERR_WIFI_BASE + 5)
+#define ESP_ERR_WIFI_STATE (ESP_ERR_WIFI_BASE + 6)
+#define ESP_ERR_WIFI_CONN (ESP_ERR_WIFI_BASE + 7)
+#define ESP_ERR_WIFI_NOT_CONNECT (ESP_ERR_WIFI_BASE + 15)
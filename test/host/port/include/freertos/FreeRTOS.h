@@ -0,0 +1,53 @@
+/*
+ * SPDX-FileCopyrightText: 2024 Rossen Dobrinov
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/**
+ * Host port of the FreeRTOS subset used by the WiFi manager. Tasks are
+ * pthreads, ticks are milliseconds of CLOCK_MONOTONIC, critical sections
+ * are a recursive mutex per portMUX_TYPE. Build with _GNU_SOURCE.
+*/
+
+#pragma once
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <string.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include "sdkconfig.h"
+
+typedef uint32_t TickType_t;
+typedef int BaseType_t;
+typedef unsigned int UBaseType_t;
+#define pdTRUE 1
+#define pdFALSE 0
+#define pdPASS 1
+#define pdFAIL 0
+#define errQUEUE_FULL 0
+#define portMAX_DELAY ((TickType_t)0xFFFFFFFFUL)
+#define configTICK_RATE_HZ 1000
+#define portTICK_PERIOD_MS 1
+#define pdMS_TO_TICKS(x) ((TickType_t)(((uint64_t)(x) * configTICK_RATE_HZ) / 1000U))
+#define tskNO_AFFINITY 0x7FFFFFFF
+#define configSTACK_DEPTH_TYPE uint32_t
+
+typedef struct { pthread_mutex_t mux; } portMUX_TYPE;
+#define portMUX_INITIALIZER_UNLOCKED { PTHREAD_RECURSIVE_MUTEX_INITIALIZER_NP }
+#define portENTER_CRITICAL(m) pthread_mutex_lock(&(m)->mux)
+#define portEXIT_CRITICAL(m) pthread_mutex_unlock(&(m)->mux)
+#define taskENTER_CRITICAL(m) portENTER_CRITICAL(m)
+#define taskEXIT_CRITICAL(m) portEXIT_CRITICAL(m)
+
+typedef struct wm_port_queue *QueueHandle_t;
+typedef struct wm_port_queue *SemaphoreHandle_t;
+typedef struct wm_port_task *TaskHandle_t;
+typedef struct wm_port_timer *TimerHandle_t;
+typedef void *EventGroupHandle_t;
+typedef void (*TaskFunction_t)(void *);
+
+TickType_t xTaskGetTickCount(void);
+#include "freertos/semphr.h"
+#include "freertos/queue.h"
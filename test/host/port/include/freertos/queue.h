@@ -0,0 +1,7 @@
+#pragma once
+QueueHandle_t xQueueCreate(UBaseType_t len, UBaseType_t size);
+BaseType_t xQueueSend(QueueHandle_t q, const void *i, TickType_t t);
+BaseType_t xQueueSendToFront(QueueHandle_t q, const void *i, TickType_t t);
+BaseType_t xQueueReceive(QueueHandle_t q, void *i, TickType_t t);
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t q);
+void vQueueDelete(QueueHandle_t q);
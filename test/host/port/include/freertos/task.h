@@ -0,0 +1,9 @@
+#pragma once
+#include "freertos/FreeRTOS.h"
+BaseType_t xTaskCreate(TaskFunction_t f, const char *n, uint32_t st, void *p, UBaseType_t prio, TaskHandle_t *h);
+void vTaskDelay(TickType_t t);
+void vTaskDelete(TaskHandle_t t);
+TaskHandle_t xTaskGetCurrentTaskHandle(void);
+UBaseType_t uxTaskGetStackHighWaterMark(TaskHandle_t t);
+uint32_t ulTaskNotifyTake(BaseType_t clear, TickType_t t);
+BaseType_t xTaskNotifyGive(TaskHandle_t t);
@@ -0,0 +1,10 @@
+#pragma once
+#include "freertos/FreeRTOS.h"
+typedef void (*TimerCallbackFunction_t)(TimerHandle_t);
+TimerHandle_t xTimerCreate(const char *n, TickType_t p, UBaseType_t r, void *id, TimerCallbackFunction_t cb);
+BaseType_t xTimerStart(TimerHandle_t t, TickType_t w);
+BaseType_t xTimerStop(TimerHandle_t t, TickType_t w);
+BaseType_t xTimerDelete(TimerHandle_t t, TickType_t w);
+BaseType_t xTimerChangePeriod(TimerHandle_t t, TickType_t p, TickType_t w);
+BaseType_t xTimerReset(TimerHandle_t t, TickType_t w);
+void *pvTimerGetTimerID(TimerHandle_t t);
@@ -0,0 +1,7 @@
+#pragma once
+#include <stdint.h>
+typedef uint32_t u32_t;
+typedef uint16_t u16_t;
+typedef uint8_t u8_t;
+#define IPADDR_ANY ((u32_t)0x00000000UL)
+#define IPADDR_NONE ((u32_t)0xffffffffUL)
@@ -0,0 +1,132 @@
+/*
+ * SPDX-FileCopyrightText: 2024 Rossen Dobrinov
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/**
+ * Host build configuration. Kconfig defaults except where noted; targets
+ * override single options with compile definitions.
+*/
+
+#pragma once
+
+#define CONFIG_WIFIMGR_COUNTRY_CODE "BG"
+#define CONFIG_WIFIMGR_AP_SSID "WIFIMGR_AP_SSID"
+#define CONFIG_WIFIMGR_AP_PWD ""
+#define CONFIG_WIFIMGR_AP_CHANNEL 0
+#define CONFIG_WIFIMGR_DEFAULT_AP_CHANNEL 11
+#define CONFIG_WIFIMGR_AP_MAX_CLIENTS 4
+#define CONFIG_WIFIMGR_AP_BEACON_INTERVAL 100
+#define CONFIG_WIFIMGR_AP_INACTIVE_TIME 300
+#define CONFIG_WIFIMGR_MAX_KNOWN_NETWORKS 5
+#define CONFIG_WIFIMGR_MAX_STA_RETRY 3
+#define CONFIG_WIFIMGR_HIDDEN_SCAN_TIME 60
+#define CONFIG_WIFIMGR_5G_MARGIN 8
+#define CONFIG_WIFIMGR_POWER_PROFILE_BALANCED 1
+#define CONFIG_WIFIMGR_PS_LISTEN_INTERVAL 10
+#define CONFIG_WIFIMGR_CMD_QUEUE_LEN 16
+#define CONFIG_WIFIMGR_CMD_TIMEOUT 1000
+#define CONFIG_WIFIMGR_MGR_TASK_STACK 4096
+#define CONFIG_WIFIMGR_SCAN_TASK_STACK 2048
+#ifndef CONFIG_WIFIMGR_RETRY_BACKOFF
+#define CONFIG_WIFIMGR_RETRY_BACKOFF 250
+#endif
+#ifndef CONFIG_WIFIMGR_BLACKLIST_SHORT_TIME
+#define CONFIG_WIFIMGR_BLACKLIST_SHORT_TIME 30
+#endif
+#define CONFIG_WIFIMGR_BLACKLIST_TIME 600
+#ifndef CONFIG_WIFIMGR_WD_CONNECT_TIME
+#define CONFIG_WIFIMGR_WD_CONNECT_TIME 30000
+#endif
+#ifndef CONFIG_WIFIMGR_WD_DHCP_TIME
+#define CONFIG_WIFIMGR_WD_DHCP_TIME 20000
+#endif
+#ifndef CONFIG_WIFIMGR_WD_MODE_TIME
+#define CONFIG_WIFIMGR_WD_MODE_TIME 5000
+#endif
+#ifndef CONFIG_WIFIMGR_WD_SCAN_TIME
+#define CONFIG_WIFIMGR_WD_SCAN_TIME 10000
+#endif
+#define CONFIG_WIFIMGR_SCAN_CACHE_SIZE 20
+#define CONFIG_WIFIMGR_SCAN_CACHE_MAX_AGE 300
+#ifndef CONFIG_WIFIMGR_SCAN_COALESCE_TIME
+#define CONFIG_WIFIMGR_SCAN_COALESCE_TIME 5000
+#endif
+#ifndef CONFIG_WIFIMGR_AP_SCAN_MAX_OFFCHAN
+#define CONFIG_WIFIMGR_AP_SCAN_MAX_OFFCHAN 10
+#endif
+#define CONFIG_WIFIMGR_AP_SCAN_DWELL 50
+#ifndef CONFIG_WIFIMGR_AP_SCAN_IDLE_TIME
+#define CONFIG_WIFIMGR_AP_SCAN_IDLE_TIME 1000
+#endif
+#ifndef CONFIG_WIFIMGR_AP_SCAN_SLICE_INTERVAL
+#define CONFIG_WIFIMGR_AP_SCAN_SLICE_INTERVAL 250
+#endif
+#define CONFIG_WIFIMGR_AP_SEC_WPA2 1
+#define CONFIG_WIFIMGR_RUN_SNTP_WHEN_STA 1
+
+#define CONFIG_WIFIMGR_LINK_MONITOR 1
+#ifndef CONFIG_WIFIMGR_LINK_SAMPLE_PERIOD
+#define CONFIG_WIFIMGR_LINK_SAMPLE_PERIOD 1000
+#endif
+#ifndef CONFIG_WIFIMGR_LINK_EWMA_SHIFT
+#define CONFIG_WIFIMGR_LINK_EWMA_SHIFT 2
+#endif
+#define CONFIG_WIFIMGR_LINK_RSSI_LOW -75
+#define CONFIG_WIFIMGR_LINK_RSSI_HYST 5
+
+#ifndef CONFIG_WIFIMGR_TXP_CONTROL
+#define CONFIG_WIFIMGR_TXP_CONTROL 0
+#endif
+#define CONFIG_WIFIMGR_TXP_MARGIN 15
+#define CONFIG_WIFIMGR_TXP_STEP_DOWN 1
+#define CONFIG_WIFIMGR_TXP_STEP_UP 4
+#define CONFIG_WIFIMGR_TXP_MIN 8
+
+#define CONFIG_WIFIMGR_CONN_PROFILER 1
+#define CONFIG_WIFIMGR_CONN_PROFILE_HISTORY 4
+
+#define CONFIG_WIFIMGR_DIRECT_CB 1
+#define CONFIG_WIFIMGR_DIRECT_CB_MAX 4
+
+/* Reachability probe needs a real network - tests opt in */
+#ifndef CONFIG_WIFIMGR_INET_CHECK
+#define CONFIG_WIFIMGR_INET_CHECK 0
+#endif
+#define CONFIG_WIFIMGR_INET_CHECK_HOST "connectivitycheck.gstatic.com"
+#define CONFIG_WIFIMGR_INET_CHECK_PORT 80
+#define CONFIG_WIFIMGR_INET_CHECK_PATH "/generate_204"
+#define CONFIG_WIFIMGR_INET_CHECK_STATUS 204
+#define CONFIG_WIFIMGR_INET_CHECK_TIMEOUT 3000
+
+#ifndef CONFIG_WIFIMGR_DNS_RACE
+#define CONFIG_WIFIMGR_DNS_RACE 0
+#endif
+#define CONFIG_WIFIMGR_DNS_RACE_HOST "connectivitycheck.gstatic.com"
+#define CONFIG_WIFIMGR_DNS_RACE_TIMEOUT 1500
+#ifndef CONFIG_WIFIMGR_DNS_RACE_PERIOD
+#define CONFIG_WIFIMGR_DNS_RACE_PERIOD 600
+#endif
+#define CONFIG_WIFIMGR_DNS_RACE_RETRY 30
+
+/* HTTP server listens on loopback - tests opt in */
+#ifndef CONFIG_WIFIMGR_PORTAL
+#define CONFIG_WIFIMGR_PORTAL 0
+#endif
+#define CONFIG_WIFIMGR_PORTAL_MAX_SOCKETS 4
+
+#ifndef CONFIG_WIFIMGR_TRACE
+#define CONFIG_WIFIMGR_TRACE 0
+#endif
+#define CONFIG_WIFIMGR_TRACE_SIZE 8192
+
+#ifndef CONFIG_WIFIMGR_FOOTPRINT
+#define CONFIG_WIFIMGR_FOOTPRINT 0
+#endif
+#define CONFIG_WIFIMGR_FP_INIT_HEAP 8192
+#define CONFIG_WIFIMGR_FP_SCAN_HEAP 8192
+#define CONFIG_WIFIMGR_FP_KN_HEAP 4096
+#define CONFIG_WIFIMGR_FP_CONNECT_HEAP 4096
+#define CONFIG_WIFIMGR_FP_STACK_MIN_FREE 512
+#define CONFIG_WIFIMGR_FP_ABORT 0
@@ -0,0 +1,266 @@
+/*
+ * SPDX-FileCopyrightText: 2024 Rossen Dobrinov
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/**
+ * Event loops. Each loop has a dispatch thread; posted data is copied.
+ * Handler list changes wait for the event being dispatched, a handler
+ * unregistered from a handler is released after dispatch.
+*/
+
+#include <errno.h>
+#include "esp_event.h"
+#include "freertos/task.h"
+#include "wm_port.h"
+
+#define WM_PORT_DEFAULT_QUEUE 32
+
+struct wm_port_handler {
+    esp_event_base_t base;
+    int32_t id;
+    esp_event_handler_t fn;
+    void *arg;
+    bool removed;
+    struct wm_port_handler *next;
+};
+
+typedef struct wm_port_event {
+    esp_event_base_t base;
+    int32_t id;
+    size_t size;
+    struct wm_port_event *next;
+    uint8_t data[];
+} wm_port_event_t;
+
+struct wm_port_loop {
+    pthread_mutex_t lock;               /* Handler list, held while dispatching */
+    pthread_mutex_t qlock;
+    pthread_cond_t qcond;
+    pthread_cond_t qspace;
+    wm_port_event_t *head;
+    wm_port_event_t *tail;
+    int32_t count;
+    int32_t max;
+    bool stop;
+    bool dispatching;
+    bool has_thread;
+    pthread_t thread;
+    struct wm_port_handler *handlers;
+};
+
+static esp_event_loop_handle_t default_loop;
+static pthread_mutex_t default_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static void loop_sweep(esp_event_loop_handle_t l) {
+    for(struct wm_port_handler **pp = &l->handlers; *pp;) {
+        struct wm_port_handler *h = *pp;
+        if(h->removed) {
+            *pp = h->next;
+            free(h);
+        } else pp = &h->next;
+    }
+}
+
+static void loop_dispatch(esp_event_loop_handle_t l, wm_port_event_t *e) {
+    pthread_mutex_lock(&l->lock);
+    l->dispatching = true;
+    for(struct wm_port_handler *h = l->handlers; h; h = h->next) {
+        if(h->removed) continue;
+        if(h->base && (h->base != e->base)) continue;
+        if((h->id != ESP_EVENT_ANY_ID) && (h->id != e->id)) continue;
+        h->fn(h->arg, e->base, e->id, e->size ? e->data : NULL);
+    }
+    l->dispatching = false;
+    loop_sweep(l);
+    pthread_mutex_unlock(&l->lock);
+}
+
+static void *loop_task(void *arg) {
+    esp_event_loop_handle_t l = (esp_event_loop_handle_t)arg;
+    pthread_mutex_lock(&l->qlock);
+    while(true) {
+        while(!l->head && !l->stop) pthread_cond_wait(&l->qcond, &l->qlock);
+        if(!l->head) break;
+        wm_port_event_t *e = l->head;
+        l->head = e->next;
+        if(!l->head) l->tail = NULL;
+        l->count--;
+        pthread_cond_signal(&l->qspace);
+        pthread_mutex_unlock(&l->qlock);
+        loop_dispatch(l, e);
+        free(e);
+        pthread_mutex_lock(&l->qlock);
+    }
+    pthread_mutex_unlock(&l->qlock);
+    return NULL;
+}
+
+esp_err_t esp_event_loop_create(const esp_event_loop_args_t *a, esp_event_loop_handle_t *h) {
+    if(!a || !h) return ESP_ERR_INVALID_ARG;
+    esp_event_loop_handle_t l = (esp_event_loop_handle_t)calloc(1, sizeof(struct wm_port_loop));
+    if(!l) return ESP_ERR_NO_MEM;
+    pthread_mutexattr_t attr;
+    pthread_mutexattr_init(&attr);
+    pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+    pthread_mutex_init(&l->lock, &attr);
+    pthread_mutexattr_destroy(&attr);
+    pthread_mutex_init(&l->qlock, NULL);
+    wm_port_cond_init(&l->qcond);
+    wm_port_cond_init(&l->qspace);
+    l->max = (a->queue_size > 0) ? a->queue_size : WM_PORT_DEFAULT_QUEUE;
+    if(a->task_name) {
+        if(pthread_create(&l->thread, NULL, loop_task, l)) {
+            free(l);
+            return ESP_FAIL;
+        }
+        l->has_thread = true;
+    }
+    *h = l;
+    return ESP_OK;
+}
+
+esp_err_t esp_event_loop_delete(esp_event_loop_handle_t l) {
+    if(!l) return ESP_ERR_INVALID_ARG;
+    pthread_mutex_lock(&l->qlock);
+    l->stop = true;
+    pthread_cond_broadcast(&l->qcond);
+    pthread_mutex_unlock(&l->qlock);
+    if(l->has_thread) pthread_join(l->thread, NULL);
+    while(l->head) {
+        wm_port_event_t *e = l->head;
+        l->head = e->next;
+        free(e);
+    }
+    while(l->handlers) {
+        struct wm_port_handler *h = l->handlers;
+        l->handlers = h->next;
+        free(h);
+    }
+    pthread_mutex_destroy(&l->lock);
+    pthread_mutex_destroy(&l->qlock);
+    pthread_cond_destroy(&l->qcond);
+    pthread_cond_destroy(&l->qspace);
+    free(l);
+    return ESP_OK;
+}
+
+esp_err_t esp_event_loop_create_default(void) {
+    pthread_mutex_lock(&default_lock);
+    esp_err_t err = ESP_ERR_INVALID_STATE;
+    if(!default_loop) {
+        const esp_event_loop_args_t args = { .queue_size = WM_PORT_DEFAULT_QUEUE, .task_name = "sys_evt" };
+        err = esp_event_loop_create(&args, &default_loop);
+    }
+    pthread_mutex_unlock(&default_lock);
+    return err;
+}
+
+esp_err_t esp_event_loop_delete_default(void) {
+    pthread_mutex_lock(&default_lock);
+    esp_event_loop_handle_t l = default_loop;
+    default_loop = NULL;
+    pthread_mutex_unlock(&default_lock);
+    return l ? esp_event_loop_delete(l) : ESP_ERR_INVALID_STATE;
+}
+
+esp_err_t esp_event_handler_instance_register_with(esp_event_loop_handle_t l, esp_event_base_t b, int32_t id, esp_event_handler_t h, void *arg, esp_event_handler_instance_t *inst) {
+    if(!l || !h) return ESP_ERR_INVALID_ARG;
+    struct wm_port_handler *n = (struct wm_port_handler *)calloc(1, sizeof(struct wm_port_handler));
+    if(!n) return ESP_ERR_NO_MEM;
+    n->base = b;
+    n->id = id;
+    n->fn = h;
+    n->arg = arg;
+    pthread_mutex_lock(&l->lock);
+    struct wm_port_handler **pp = &l->handlers;
+    while(*pp) pp = &(*pp)->next;
+    *pp = n;
+    pthread_mutex_unlock(&l->lock);
+    if(inst) *inst = n;
+    return ESP_OK;
+}
+
+esp_err_t esp_event_handler_instance_unregister_with(esp_event_loop_handle_t l, esp_event_base_t b, int32_t id, esp_event_handler_instance_t inst) {
+    (void)b;
+    (void)id;
+    if(!l || !inst) return ESP_ERR_INVALID_ARG;
+    esp_err_t err = ESP_ERR_NOT_FOUND;
+    pthread_mutex_lock(&l->lock);
+    for(struct wm_port_handler *h = l->handlers; h; h = h->next) {
+        if((h == inst) && !h->removed) {
+            h->removed = true;
+            err = ESP_OK;
+        }
+    }
+    if(!l->dispatching) loop_sweep(l);
+    pthread_mutex_unlock(&l->lock);
+    return err;
+}
+
+esp_err_t esp_event_handler_instance_register(esp_event_base_t b, int32_t id, esp_event_handler_t h, void *arg, esp_event_handler_instance_t *inst) {
+    if(!default_loop) return ESP_ERR_INVALID_STATE;
+    return esp_event_handler_instance_register_with(default_loop, b, id, h, arg, inst);
+}
+
+esp_err_t esp_event_handler_instance_unregister(esp_event_base_t b, int32_t id, esp_event_handler_instance_t inst) {
+    if(!default_loop) return ESP_ERR_INVALID_STATE;
+    return esp_event_handler_instance_unregister_with(default_loop, b, id, inst);
+}
+
+esp_err_t esp_event_post_to(esp_event_loop_handle_t l, esp_event_base_t b, int32_t id, const void *d, size_t s, TickType_t t) {
+    if(!l) return ESP_ERR_INVALID_ARG;
+    if(!d) s = 0;
+    wm_port_event_t *e = (wm_port_event_t *)malloc(sizeof(wm_port_event_t) + s);
+    if(!e) return ESP_ERR_NO_MEM;
+    e->base = b;
+    e->id = id;
+    e->size = s;
+    e->next = NULL;
+    if(s) memcpy(e->data, d, s);
+    struct timespec ts;
+    if(t && (t != portMAX_DELAY)) wm_port_deadline(&ts, t);
+    pthread_mutex_lock(&l->qlock);
+    while(l->count >= l->max) {
+        if(!t || (ETIMEDOUT == ((t == portMAX_DELAY) ? pthread_cond_wait(&l->qspace, &l->qlock) : pthread_cond_timedwait(&l->qspace, &l->qlock, &ts)))) break;
+    }
+    if(l->count >= l->max) {
+        pthread_mutex_unlock(&l->qlock);
+        free(e);
+        return ESP_ERR_TIMEOUT;
+    }
+    if(l->tail) l->tail->next = e;
+    else l->head = e;
+    l->tail = e;
+    l->count++;
+    pthread_cond_signal(&l->qcond);
+    pthread_mutex_unlock(&l->qlock);
+    return ESP_OK;
+}
+
+esp_err_t esp_event_post(esp_event_base_t b, int32_t id, const void *d, size_t s, TickType_t t) {
+    if(!default_loop) return ESP_ERR_INVALID_STATE;
+    return esp_event_post_to(default_loop, b, id, d, s, t);
+}
+
+bool wm_port_events_idle(uint32_t timeout_ms) {
+    TickType_t start = xTaskGetTickCount();
+    while(true) {
+        pthread_mutex_lock(&default_lock);
+        esp_event_loop_handle_t l = default_loop;
+        bool idle = true;
+        if(l) {
+            pthread_mutex_lock(&l->qlock);
+            idle = !l->count;
+            pthread_mutex_unlock(&l->qlock);
+            pthread_mutex_lock(&l->lock);
+            idle &= !l->dispatching;
+            pthread_mutex_unlock(&l->lock);
+        }
+        pthread_mutex_unlock(&default_lock);
+        if(idle) return true;
+        if((xTaskGetTickCount() - start) >= pdMS_TO_TICKS(timeout_ms)) return false;
+        vTaskDelay(1);
+    }
+}
@@ -0,0 +1,135 @@
+/*
+ * SPDX-FileCopyrightText: 2024 Rossen Dobrinov
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/**
+ * Counting allocator. Link with -Wl,--wrap=malloc,--wrap=calloc,--wrap=realloc,--wrap=free
+*/
+
+#include <malloc.h>
+#include <errno.h>
+#include "wm_port.h"
+
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t n, size_t size);
+void *__real_realloc(void *ptr, size_t size);
+void __real_free(void *ptr);
+
+static size_t heap_live;
+static size_t heap_blocks;
+static size_t heap_peak;
+static uint64_t heap_allocs;
+static uint32_t heap_fail;
+static pthread_mutex_t heap_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static bool heap_fail_now(void) {
+    bool fail = false;
+    pthread_mutex_lock(&heap_lock);
+    heap_allocs++;
+    if(heap_fail && (--heap_fail == 0)) fail = true;
+    pthread_mutex_unlock(&heap_lock);
+    if(fail) errno = ENOMEM;
+    return fail;
+}
+
+static void heap_add(void *ptr) {
+    if(!ptr) return;
+    pthread_mutex_lock(&heap_lock);
+    heap_live += malloc_usable_size(ptr);
+    heap_blocks++;
+    if(heap_live > heap_peak) heap_peak = heap_live;
+    pthread_mutex_unlock(&heap_lock);
+}
+
+static void heap_sub(void *ptr) {
+    if(!ptr) return;
+    pthread_mutex_lock(&heap_lock);
+    heap_live -= malloc_usable_size(ptr);
+    heap_blocks--;
+    pthread_mutex_unlock(&heap_lock);
+}
+
+void *__wrap_malloc(size_t size) {
+    if(heap_fail_now()) return NULL;
+    void *ptr = __real_malloc(size);
+    heap_add(ptr);
+    return ptr;
+}
+
+void *__wrap_calloc(size_t n, size_t size) {
+    if(heap_fail_now()) return NULL;
+    void *ptr = __real_calloc(n, size);
+    heap_add(ptr);
+    return ptr;
+}
+
+void *__wrap_realloc(void *ptr, size_t size) {
+    if(!ptr) return __wrap_malloc(size);
+    if(heap_fail_now()) return NULL;
+    size_t old = malloc_usable_size(ptr);
+    void *res = __real_realloc(ptr, size);
+    if(!res) return NULL;
+    pthread_mutex_lock(&heap_lock);
+    heap_live = heap_live - old + malloc_usable_size(res);
+    if(heap_live > heap_peak) heap_peak = heap_live;
+    pthread_mutex_unlock(&heap_lock);
+    return res;
+}
+
+void __wrap_free(void *ptr) {
+    heap_sub(ptr);
+    __real_free(ptr);
+}
+
+void wm_port_heap_get(wm_port_heap_t *heap) {
+    pthread_mutex_lock(&heap_lock);
+    heap->live_bytes = heap_live;
+    heap->live_blocks = heap_blocks;
+    heap->peak_bytes = heap_peak;
+    heap->allocs = heap_allocs;
+    pthread_mutex_unlock(&heap_lock);
+}
+
+void wm_port_heap_peak_reset(void) {
+    pthread_mutex_lock(&heap_lock);
+    heap_peak = heap_live;
+    pthread_mutex_unlock(&heap_lock);
+}
+
+void wm_port_heap_fail(uint32_t nth) {
+    pthread_mutex_lock(&heap_lock);
+    heap_fail = nth;
+    pthread_mutex_unlock(&heap_lock);
+}
+
+size_t heap_caps_get_free_size(uint32_t caps) {
+    (void)caps;
+    wm_port_heap_t heap;
+    wm_port_heap_get(&heap);
+    return (heap.live_bytes < WM_PORT_HEAP_TOTAL) ? WM_PORT_HEAP_TOTAL - heap.live_bytes : 0;
+}
+
+size_t heap_caps_get_minimum_free_size(uint32_t caps) {
+    (void)caps;
+    wm_port_heap_t heap;
+    wm_port_heap_get(&heap);
+    return (heap.peak_bytes < WM_PORT_HEAP_TOTAL) ? WM_PORT_HEAP_TOTAL - heap.peak_bytes : 0;
+}
+
+size_t heap_caps_get_allocated_size(void *ptr) {
+    return (ptr) ? malloc_usable_size(ptr) : 0;
+}
+
+size_t heap_caps_get_largest_free_block(uint32_t caps) {
+    return heap_caps_get_free_size(caps);
+}
+
+uint32_t esp_get_free_heap_size(void) {
+    return heap_caps_get_free_size(0);
+}
+
+uint32_t esp_get_minimum_free_heap_size(void) {
+    return heap_caps_get_minimum_free_size(0);
+}
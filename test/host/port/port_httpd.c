@@ -0,0 +1,278 @@
+/*
+ * SPDX-FileCopyrightText: 2024 Rossen Dobrinov
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/**
+ * HTTP server. One server thread accepts connections on a loopback ephemeral
+ * port and runs one request per connection, handlers run in server thread like
+ * ESP-IDF httpd. httpd_stop waits until a running handler returns.
+*/
+
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <strings.h>
+#include <errno.h>
+#include <pthread.h>
+#include <poll.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include "esp_http_server.h"
+#include "wm_port.h"
+
+#define HTTPD_POLL_MS       50
+#define HTTPD_HDR_MAX       2048
+#define HTTPD_RESP_HDRS     8
+
+typedef struct {
+    int fd;
+    char hdr[HTTPD_HDR_MAX];
+    size_t body_pos;            /* Body bytes already read with headers */
+    size_t body_len;
+    size_t body_read;
+    const char *status;
+    const char *type;
+    const char *hdr_field[HTTPD_RESP_HDRS];
+    const char *hdr_value[HTTPD_RESP_HDRS];
+    int hdr_count;
+    bool chunked;
+    bool sent;
+} httpd_conn_t;
+
+typedef struct {
+    int listen_fd;
+    uint16_t port;
+    volatile bool stop;
+    pthread_t thread;
+    httpd_uri_t *uris;
+    int uri_count;
+    int uri_max;
+    httpd_err_handler_func_t err_handler[HTTPD_ERR_CODE_MAX];
+} httpd_server_t;
+
+static pthread_mutex_t httpd_lock = PTHREAD_MUTEX_INITIALIZER;
+static uint16_t httpd_port;
+
+static const char *httpd_err_status(httpd_err_code_t error) {
+    switch(error) {
+        case HTTPD_400_BAD_REQUEST: return "400 Bad Request";
+        case HTTPD_404_NOT_FOUND: return "404 Not Found";
+        case HTTPD_405_METHOD_NOT_ALLOWED: return "405 Method Not Allowed";
+        case HTTPD_408_REQ_TIMEOUT: return "408 Request Timeout";
+        case HTTPD_413_CONTENT_TOO_LARGE: return "413 Content Too Large";
+        default: return "500 Internal Server Error";
+    }
+}
+
+static bool httpd_write(int fd, const void *buf, size_t len) {
+    const char *p = (const char *)buf;
+    while(len) {
+        ssize_t n = send(fd, p, len, MSG_NOSIGNAL);
+        if(n <= 0) return false;
+        p += n;
+        len -= n;
+    }
+    return true;
+}
+
+static bool httpd_write_head(httpd_conn_t *c, ssize_t content_len) {
+    char head[1024];
+    int n = snprintf(head, sizeof(head), "HTTP/1.1 %s\r\nContent-Type: %s\r\nConnection: close\r\n",
+        (c->status) ? c->status : "200 OK", (c->type) ? c->type : "text/html");
+    for(int i=0; i<c->hdr_count; i++) n += snprintf(head + n, sizeof(head) - n, "%s: %s\r\n", c->hdr_field[i], c->hdr_value[i]);
+    if(content_len >= 0) n += snprintf(head + n, sizeof(head) - n, "Content-Length: %zd\r\n\r\n", content_len);
+    else n += snprintf(head + n, sizeof(head) - n, "Transfer-Encoding: chunked\r\n\r\n");
+    c->sent = true;
+    return httpd_write(c->fd, head, n);
+}
+
+static const httpd_uri_t *httpd_match(httpd_server_t *s, const char *uri, int method) {
+    /* Query string is not part of match */
+    size_t len = strcspn(uri, "?");
+    for(int i=0; i<s->uri_count; i++) {
+        if(((int)s->uris[i].method == method) && (strlen(s->uris[i].uri) == len) && !strncmp(s->uris[i].uri, uri, len)) return &s->uris[i];
+    }
+    return NULL;
+}
+
+static void httpd_serve(httpd_server_t *s, int fd) {
+    httpd_conn_t *c = (httpd_conn_t *)calloc(1, sizeof(httpd_conn_t));
+    httpd_req_t *req = (httpd_req_t *)calloc(1, sizeof(httpd_req_t));
+    if(!c || !req) goto done;
+    c->fd = fd;
+    struct timeval tv = { .tv_sec = 5 };
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    size_t len = 0;
+    char *end = NULL;
+    while(!end && (len < sizeof(c->hdr) - 1)) {
+        ssize_t n = recv(fd, c->hdr + len, sizeof(c->hdr) - 1 - len, 0);
+        if(n <= 0) goto done;
+        len += n;
+        c->hdr[len] = 0;
+        end = strstr(c->hdr, "\r\n\r\n");
+    }
+    if(!end) goto done;
+    c->body_pos = (end + 4) - c->hdr;
+    c->body_len = len - c->body_pos;
+    char method[8] = "", uri[HTTPD_MAX_URI_LEN + 1] = "";
+    if(2 != sscanf(c->hdr, "%7s %512s", method, uri)) goto done;
+    for(char *line = strstr(c->hdr, "\r\n"); line && (line < end); line = strstr(line + 2, "\r\n")) {
+        if(!strncasecmp(line + 2, "Content-Length:", 15)) req->content_len = strtoul(line + 17, NULL, 10);
+    }
+    req->handle = s;
+    req->method = !strcmp(method, "POST") ? HTTP_POST : !strcmp(method, "GET") ? HTTP_GET : -1;
+    memcpy((char *)req->uri, uri, sizeof(uri));
+    req->aux = c;
+    const httpd_uri_t *h = httpd_match(s, uri, req->method);
+    if(h) {
+        req->user_ctx = h->user_ctx;
+        if((ESP_OK != h->handler(req)) && !c->sent) httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, NULL);
+    } else if(s->err_handler[HTTPD_404_NOT_FOUND]) s->err_handler[HTTPD_404_NOT_FOUND](req, HTTPD_404_NOT_FOUND);
+    else httpd_resp_send_err(req, HTTPD_404_NOT_FOUND, NULL);
+done:
+    free(req);
+    free(c);
+    close(fd);
+}
+
+static void *httpd_thread(void *arg) {
+    httpd_server_t *s = (httpd_server_t *)arg;
+    while(!s->stop) {
+        struct pollfd pfd = { .fd = s->listen_fd, .events = POLLIN };
+        if(poll(&pfd, 1, HTTPD_POLL_MS) <= 0) continue;
+        int fd = accept(s->listen_fd, NULL, NULL);
+        if(fd >= 0) httpd_serve(s, fd);
+    }
+    return NULL;
+}
+
+uint16_t wm_port_httpd_port(void) {
+    pthread_mutex_lock(&httpd_lock);
+    uint16_t port = httpd_port;
+    pthread_mutex_unlock(&httpd_lock);
+    return port;
+}
+
+esp_err_t httpd_start(httpd_handle_t *handle, const httpd_config_t *config) {
+    if(!handle || !config) return ESP_ERR_INVALID_ARG;
+    httpd_server_t *s = (httpd_server_t *)calloc(1, sizeof(httpd_server_t));
+    if(!s) return ESP_ERR_NO_MEM;
+    s->uri_max = config->max_uri_handlers;
+    s->uris = (httpd_uri_t *)calloc(s->uri_max, sizeof(httpd_uri_t));
+    s->listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in addr = { .sin_family = AF_INET, .sin_addr.s_addr = htonl(INADDR_LOOPBACK) };
+    socklen_t addr_len = sizeof(addr);
+    if(!s->uris || (s->listen_fd < 0) || bind(s->listen_fd, (struct sockaddr *)&addr, sizeof(addr)) ||
+       listen(s->listen_fd, config->backlog_conn) || getsockname(s->listen_fd, (struct sockaddr *)&addr, &addr_len) ||
+       pthread_create(&s->thread, NULL, httpd_thread, s)) {
+        if(s->listen_fd >= 0) close(s->listen_fd);
+        free(s->uris);
+        free(s);
+        return ESP_FAIL;
+    }
+    s->port = ntohs(addr.sin_port);
+    pthread_mutex_lock(&httpd_lock);
+    httpd_port = s->port;
+    pthread_mutex_unlock(&httpd_lock);
+    *handle = s;
+    return ESP_OK;
+}
+
+esp_err_t httpd_stop(httpd_handle_t handle) {
+    httpd_server_t *s = (httpd_server_t *)handle;
+    if(!s) return ESP_ERR_INVALID_ARG;
+    /* Running handler finishes first */
+    s->stop = true;
+    pthread_join(s->thread, NULL);
+    close(s->listen_fd);
+    pthread_mutex_lock(&httpd_lock);
+    if(httpd_port == s->port) httpd_port = 0;
+    pthread_mutex_unlock(&httpd_lock);
+    free(s->uris);
+    free(s);
+    return ESP_OK;
+}
+
+esp_err_t httpd_register_uri_handler(httpd_handle_t handle, const httpd_uri_t *uri_handler) {
+    httpd_server_t *s = (httpd_server_t *)handle;
+    if(!s || !uri_handler) return ESP_ERR_INVALID_ARG;
+    if(s->uri_count >= s->uri_max) return ESP_ERR_NO_MEM;
+    s->uris[s->uri_count++] = *uri_handler;
+    return ESP_OK;
+}
+
+esp_err_t httpd_register_err_handler(httpd_handle_t handle, httpd_err_code_t error, httpd_err_handler_func_t handler_fn) {
+    httpd_server_t *s = (httpd_server_t *)handle;
+    if(!s || (error >= HTTPD_ERR_CODE_MAX)) return ESP_ERR_INVALID_ARG;
+    s->err_handler[error] = handler_fn;
+    return ESP_OK;
+}
+
+esp_err_t httpd_resp_set_type(httpd_req_t *r, const char *type) {
+    ((httpd_conn_t *)r->aux)->type = type;
+    return ESP_OK;
+}
+
+esp_err_t httpd_resp_set_hdr(httpd_req_t *r, const char *field, const char *value) {
+    httpd_conn_t *c = (httpd_conn_t *)r->aux;
+    if(c->hdr_count >= HTTPD_RESP_HDRS) return ESP_ERR_NO_MEM;
+    c->hdr_field[c->hdr_count] = field;
+    c->hdr_value[c->hdr_count++] = value;
+    return ESP_OK;
+}
+
+esp_err_t httpd_resp_set_status(httpd_req_t *r, const char *status) {
+    ((httpd_conn_t *)r->aux)->status = status;
+    return ESP_OK;
+}
+
+esp_err_t httpd_resp_send(httpd_req_t *r, const char *buf, ssize_t buf_len) {
+    httpd_conn_t *c = (httpd_conn_t *)r->aux;
+    if(buf_len == HTTPD_RESP_USE_STRLEN) buf_len = (buf) ? (ssize_t)strlen(buf) : 0;
+    if(!httpd_write_head(c, buf_len)) return ESP_FAIL;
+    return (!buf_len || httpd_write(c->fd, buf, buf_len)) ? ESP_OK : ESP_FAIL;
+}
+
+esp_err_t httpd_resp_send_chunk(httpd_req_t *r, const char *buf, ssize_t buf_len) {
+    httpd_conn_t *c = (httpd_conn_t *)r->aux;
+    if(buf_len == HTTPD_RESP_USE_STRLEN) buf_len = (buf) ? (ssize_t)strlen(buf) : 0;
+    if(!c->chunked) {
+        c->chunked = true;
+        if(!httpd_write_head(c, -1)) return ESP_FAIL;
+    }
+    char size[16];
+    int n = snprintf(size, sizeof(size), "%zx\r\n", buf_len);
+    if(!httpd_write(c->fd, size, n) || (buf_len && !httpd_write(c->fd, buf, buf_len)) || !httpd_write(c->fd, "\r\n", 2)) return ESP_FAIL;
+    return ESP_OK;
+}
+
+esp_err_t httpd_resp_send_err(httpd_req_t *r, httpd_err_code_t error, const char *msg) {
+    httpd_conn_t *c = (httpd_conn_t *)r->aux;
+    c->status = httpd_err_status(error);
+    c->type = "text/plain";
+    return httpd_resp_send(r, (msg) ? msg : c->status, HTTPD_RESP_USE_STRLEN);
+}
+
+int httpd_req_recv(httpd_req_t *r, char *buf, size_t buf_len) {
+    httpd_conn_t *c = (httpd_conn_t *)r->aux;
+    size_t left = r->content_len - c->body_read;
+    if(!left) return 0;
+    if(buf_len > left) buf_len = left;
+    if(c->body_len) {
+        /* Body bytes received with headers first */
+        size_t n = (buf_len < c->body_len) ? buf_len : c->body_len;
+        memcpy(buf, c->hdr + c->body_pos, n);
+        c->body_pos += n;
+        c->body_len -= n;
+        c->body_read += n;
+        return (int)n;
+    }
+    ssize_t n = recv(c->fd, buf, buf_len, 0);
+    if(n < 0) return ((errno == EAGAIN) || (errno == EWOULDBLOCK)) ? HTTPD_SOCK_ERR_TIMEOUT : HTTPD_SOCK_ERR_FAIL;
+    c->body_read += n;
+    return (int)n;
+}
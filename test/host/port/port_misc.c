@@ -0,0 +1,57 @@
+/*
+ * SPDX-FileCopyrightText: 2024 Rossen Dobrinov
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/**
+ * NVS, log, ROM and timer shims.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "esp_err.h"
+#include "esp_log.h"
+#include "esp_rom_crc.h"
+#include "esp_timer.h"
+#include "esp_system.h"
+#include "nvs_flash.h"
+
+esp_err_t nvs_flash_init(void) {
+    return ESP_OK;
+}
+
+esp_err_t nvs_flash_erase(void) {
+    return ESP_OK;
+}
+
+void esp_log_level_set(const char *tag, esp_log_level_t l) {
+    (void)tag;
+    (void)l;
+}
+
+const char *esp_err_to_name(esp_err_t e) {
+    static __thread char name[16];
+    snprintf(name, sizeof(name), "0x%x", e);
+    return name;
+}
+
+uint32_t esp_rom_crc32_le(uint32_t crc, uint8_t const *buf, uint32_t len) {
+    crc = ~crc;
+    while(len--) {
+        crc ^= *buf++;
+        for(int i=0; i<8; i++) crc = (crc >> 1) ^ (0xEDB88320UL & (0U - (crc & 1U)));
+    }
+    return ~crc;
+}
+
+int64_t esp_timer_get_time(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+uint32_t esp_random(void) {
+    return ((uint32_t)rand() << 16) ^ (uint32_t)rand();
+}
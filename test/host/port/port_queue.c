@@ -0,0 +1,150 @@
+/*
+ * SPDX-FileCopyrightText: 2024 Rossen Dobrinov
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/**
+ * Queues and semaphores. A semaphore is a queue of zero sized items.
+*/
+
+#include <errno.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+#include "wm_port.h"
+
+struct wm_port_queue {
+    pthread_mutex_t lock;
+    pthread_cond_t not_empty;
+    pthread_cond_t not_full;
+    size_t len;
+    size_t size;
+    size_t head;
+    size_t count;
+    uint8_t buf[];
+};
+
+static int queue_count;
+static pthread_mutex_t queue_count_lock = PTHREAD_MUTEX_INITIALIZER;
+
+QueueHandle_t xQueueCreate(UBaseType_t len, UBaseType_t size) {
+    if(!len) return NULL;
+    struct wm_port_queue *q = (struct wm_port_queue *)calloc(1, sizeof(struct wm_port_queue) + (size_t)len * size);
+    if(!q) return NULL;
+    pthread_mutex_init(&q->lock, NULL);
+    wm_port_cond_init(&q->not_empty);
+    wm_port_cond_init(&q->not_full);
+    q->len = len;
+    q->size = size;
+    pthread_mutex_lock(&queue_count_lock);
+    queue_count++;
+    pthread_mutex_unlock(&queue_count_lock);
+    return q;
+}
+
+void vQueueDelete(QueueHandle_t q) {
+    if(!q) return;
+    pthread_mutex_destroy(&q->lock);
+    pthread_cond_destroy(&q->not_empty);
+    pthread_cond_destroy(&q->not_full);
+    free(q);
+    pthread_mutex_lock(&queue_count_lock);
+    queue_count--;
+    pthread_mutex_unlock(&queue_count_lock);
+}
+
+int wm_port_queues_alive(void) {
+    pthread_mutex_lock(&queue_count_lock);
+    int count = queue_count;
+    pthread_mutex_unlock(&queue_count_lock);
+    return count;
+}
+
+static BaseType_t queue_send(QueueHandle_t q, const void *i, TickType_t t, bool front) {
+    struct timespec ts;
+    if(t && (t != portMAX_DELAY)) wm_port_deadline(&ts, t);
+    pthread_mutex_lock(&q->lock);
+    bool full = (q->count == q->len);
+    while(full) {
+        if(!t) break;
+        if(t == portMAX_DELAY) pthread_cond_wait(&q->not_full, &q->lock);
+        else if(ETIMEDOUT == pthread_cond_timedwait(&q->not_full, &q->lock, &ts)) {
+            full = (q->count == q->len);
+            break;
+        }
+        full = (q->count == q->len);
+    }
+    if(full) {
+        pthread_mutex_unlock(&q->lock);
+        return errQUEUE_FULL;
+    }
+    size_t slot;
+    if(front) {
+        q->head = (q->head + q->len - 1) % q->len;
+        slot = q->head;
+    } else slot = (q->head + q->count) % q->len;
+    if(q->size) memcpy(&q->buf[slot * q->size], i, q->size);
+    q->count++;
+    pthread_cond_signal(&q->not_empty);
+    pthread_mutex_unlock(&q->lock);
+    return pdTRUE;
+}
+
+BaseType_t xQueueSend(QueueHandle_t q, const void *i, TickType_t t) {
+    return queue_send(q, i, t, false);
+}
+
+BaseType_t xQueueSendToFront(QueueHandle_t q, const void *i, TickType_t t) {
+    return queue_send(q, i, t, true);
+}
+
+BaseType_t xQueueReceive(QueueHandle_t q, void *i, TickType_t t) {
+    struct timespec ts;
+    if(t && (t != portMAX_DELAY)) wm_port_deadline(&ts, t);
+    pthread_mutex_lock(&q->lock);
+    while(!q->count) {
+        if(!t) break;
+        if(t == portMAX_DELAY) pthread_cond_wait(&q->not_empty, &q->lock);
+        else if(ETIMEDOUT == pthread_cond_timedwait(&q->not_empty, &q->lock, &ts)) break;
+    }
+    if(!q->count) {
+        pthread_mutex_unlock(&q->lock);
+        return pdFALSE;
+    }
+    if(q->size) memcpy(i, &q->buf[q->head * q->size], q->size);
+    q->head = (q->head + 1) % q->len;
+    q->count--;
+    pthread_cond_signal(&q->not_full);
+    pthread_mutex_unlock(&q->lock);
+    return pdTRUE;
+}
+
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t q) {
+    pthread_mutex_lock(&q->lock);
+    UBaseType_t count = q->count;
+    pthread_mutex_unlock(&q->lock);
+    return count;
+}
+
+SemaphoreHandle_t xSemaphoreCreateBinary(void) {
+    return xQueueCreate(1, 0);
+}
+
+SemaphoreHandle_t xSemaphoreCreateMutex(void) {
+    SemaphoreHandle_t s = xQueueCreate(1, 0);
+    if(s) xQueueSend(s, NULL, 0);
+    return s;
+}
+
+BaseType_t xSemaphoreTake(SemaphoreHandle_t s, TickType_t t) {
+    return xQueueReceive(s, NULL, t);
+}
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t s) {
+    return xQueueSend(s, NULL, 0);
+}
+
+void vSemaphoreDelete(SemaphoreHandle_t s) {
+    vQueueDelete(s);
+}
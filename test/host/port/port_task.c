@@ -0,0 +1,248 @@
+/*
+ * SPDX-FileCopyrightText: 2024 Rossen Dobrinov
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/**
+ * Tasks on pthreads. Stacks are painted mappings so the high water mark is
+ * measured; host code needs more stack than the target, so a task gets
+ * WM_PORT_STACK_SCALE times the requested depth and reports free bytes scaled
+ * back. Deleted tasks are joined and released by the next create or count.
+*/
+
+#include <stdio.h>
+#include <time.h>
+#include <errno.h>
+#include <sys/mman.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "wm_port.h"
+
+#define WM_PORT_STACK_SCALE 8
+#define WM_PORT_STACK_MIN (64 * 1024)
+#define WM_PORT_STACK_PAINT 0xA5
+
+struct wm_port_task {
+    pthread_t thread;
+    TaskFunction_t fn;
+    void *arg;
+    char name[16];
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    uint32_t notify;
+    uint8_t *stack;
+    size_t stack_size;
+    uint32_t depth;
+    bool foreign;
+    struct wm_port_task *next;
+};
+
+static pthread_key_t task_key;
+static pthread_once_t task_once = PTHREAD_ONCE_INIT;
+static pthread_mutex_t task_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct wm_port_task *task_zombies;
+static char task_fail_name[16];
+static int task_count;
+
+static void task_release(struct wm_port_task *t) {
+    pthread_mutex_destroy(&t->lock);
+    pthread_cond_destroy(&t->cond);
+    if(t->stack) munmap(t->stack, t->stack_size);
+    free(t);
+}
+
+static void task_foreign_exit(void *p) {
+    struct wm_port_task *t = (struct wm_port_task *)p;
+    if(t && t->foreign) task_release(t);
+}
+
+static void task_key_init(void) {
+    pthread_key_create(&task_key, task_foreign_exit);
+}
+
+static void task_reap(void) {
+    pthread_mutex_lock(&task_lock);
+    struct wm_port_task *t = task_zombies;
+    task_zombies = NULL;
+    pthread_mutex_unlock(&task_lock);
+    while(t) {
+        struct wm_port_task *next = t->next;
+        pthread_join(t->thread, NULL);
+        task_release(t);
+        t = next;
+    }
+}
+
+static struct wm_port_task *task_alloc(void) {
+    struct wm_port_task *t = (struct wm_port_task *)calloc(1, sizeof(struct wm_port_task));
+    if(!t) return NULL;
+    pthread_mutex_init(&t->lock, NULL);
+    wm_port_cond_init(&t->cond);
+    return t;
+}
+
+static void *task_entry(void *p) {
+    struct wm_port_task *t = (struct wm_port_task *)p;
+    pthread_setspecific(task_key, t);
+    t->fn(t->arg);
+    fprintf(stderr, "task %s returned without vTaskDelete\n", t->name);
+    abort();
+    return NULL;
+}
+
+void wm_port_cond_init(pthread_cond_t *cond) {
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(cond, &attr);
+    pthread_condattr_destroy(&attr);
+}
+
+void wm_port_deadline(struct timespec *ts, TickType_t ticks) {
+    clock_gettime(CLOCK_MONOTONIC, ts);
+    uint64_t ms = (uint64_t)ticks * 1000U / configTICK_RATE_HZ;
+    ts->tv_sec += ms / 1000U;
+    ts->tv_nsec += (ms % 1000U) * 1000000L;
+    if(ts->tv_nsec >= 1000000000L) {
+        ts->tv_sec++;
+        ts->tv_nsec -= 1000000000L;
+    }
+}
+
+TickType_t xTaskGetTickCount(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    uint64_t ms = (uint64_t)ts.tv_sec * 1000U + (uint64_t)ts.tv_nsec / 1000000U;
+    return (TickType_t)(ms * configTICK_RATE_HZ / 1000U);
+}
+
+void wm_port_task_fail(const char *name) {
+    pthread_mutex_lock(&task_lock);
+    snprintf(task_fail_name, sizeof(task_fail_name), "%s", name ? name : "");
+    pthread_mutex_unlock(&task_lock);
+}
+
+int wm_port_tasks_alive(void) {
+    task_reap();
+    pthread_mutex_lock(&task_lock);
+    int count = task_count;
+    pthread_mutex_unlock(&task_lock);
+    return count;
+}
+
+BaseType_t xTaskCreate(TaskFunction_t f, const char *n, uint32_t st, void *p, UBaseType_t prio, TaskHandle_t *h) {
+    (void)prio;
+    pthread_once(&task_once, task_key_init);
+    task_reap();
+    if(h) *h = NULL;
+    pthread_mutex_lock(&task_lock);
+    bool fail = task_fail_name[0] && n && !strcmp(task_fail_name, n);
+    if(fail) task_fail_name[0] = 0;
+    pthread_mutex_unlock(&task_lock);
+    if(fail) return pdFAIL;
+
+    struct wm_port_task *t = task_alloc();
+    if(!t) return pdFAIL;
+    t->fn = f;
+    t->arg = p;
+    t->depth = st;
+    snprintf(t->name, sizeof(t->name), "%s", n ? n : "");
+    t->stack_size = (size_t)st * WM_PORT_STACK_SCALE;
+    if(t->stack_size < WM_PORT_STACK_MIN) t->stack_size = WM_PORT_STACK_MIN;
+    t->stack = (uint8_t *)mmap(NULL, t->stack_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if(t->stack == MAP_FAILED) {
+        t->stack = NULL;
+        task_release(t);
+        return pdFAIL;
+    }
+    memset(t->stack, WM_PORT_STACK_PAINT, t->stack_size);
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setstack(&attr, t->stack, t->stack_size);
+    /* Handle is valid before task runs */
+    if(h) *h = t;
+    int res = pthread_create(&t->thread, &attr, task_entry, t);
+    pthread_attr_destroy(&attr);
+    if(res) {
+        if(h) *h = NULL;
+        task_release(t);
+        return pdFAIL;
+    }
+    pthread_mutex_lock(&task_lock);
+    task_count++;
+    pthread_mutex_unlock(&task_lock);
+    return pdPASS;
+}
+
+void vTaskDelete(TaskHandle_t t) {
+    struct wm_port_task *self = xTaskGetCurrentTaskHandle();
+    if(t && (t != self)) {
+        fprintf(stderr, "vTaskDelete of other task is not supported\n");
+        abort();
+    }
+    if(self->foreign) {
+        fprintf(stderr, "vTaskDelete of foreign thread\n");
+        abort();
+    }
+    pthread_setspecific(task_key, NULL);
+    pthread_mutex_lock(&task_lock);
+    self->next = task_zombies;
+    task_zombies = self;
+    task_count--;
+    pthread_mutex_unlock(&task_lock);
+    pthread_exit(NULL);
+}
+
+TaskHandle_t xTaskGetCurrentTaskHandle(void) {
+    pthread_once(&task_once, task_key_init);
+    struct wm_port_task *t = (struct wm_port_task *)pthread_getspecific(task_key);
+    if(t) return t;
+    /* Thread not created by xTaskCreate */
+    t = task_alloc();
+    if(!t) abort();
+    t->foreign = true;
+    t->thread = pthread_self();
+    snprintf(t->name, sizeof(t->name), "foreign");
+    pthread_setspecific(task_key, t);
+    return t;
+}
+
+UBaseType_t uxTaskGetStackHighWaterMark(TaskHandle_t t) {
+    if(!t) t = xTaskGetCurrentTaskHandle();
+    if(!t->stack) return 0;
+    /* Stack grows down - count paint left at the bottom */
+    size_t unused = 0;
+    while((unused < t->stack_size) && (t->stack[unused] == WM_PORT_STACK_PAINT)) unused++;
+    unused /= WM_PORT_STACK_SCALE;
+    return (unused < t->depth) ? (UBaseType_t)unused : t->depth;
+}
+
+void vTaskDelay(TickType_t t) {
+    uint64_t ms = (uint64_t)t * 1000U / configTICK_RATE_HZ;
+    struct timespec ts = { .tv_sec = ms / 1000U, .tv_nsec = (ms % 1000U) * 1000000L };
+    while(nanosleep(&ts, &ts) && (errno == EINTR));
+}
+
+uint32_t ulTaskNotifyTake(BaseType_t clear, TickType_t t) {
+    struct wm_port_task *self = xTaskGetCurrentTaskHandle();
+    struct timespec ts;
+    if(t != portMAX_DELAY) wm_port_deadline(&ts, t);
+    pthread_mutex_lock(&self->lock);
+    while(!self->notify && t) {
+        if(t == portMAX_DELAY) pthread_cond_wait(&self->cond, &self->lock);
+        else if(ETIMEDOUT == pthread_cond_timedwait(&self->cond, &self->lock, &ts)) break;
+    }
+    uint32_t value = self->notify;
+    if(value) self->notify = clear ? 0 : value - 1;
+    pthread_mutex_unlock(&self->lock);
+    return value;
+}
+
+BaseType_t xTaskNotifyGive(TaskHandle_t t) {
+    pthread_mutex_lock(&t->lock);
+    t->notify++;
+    pthread_cond_signal(&t->cond);
+    pthread_mutex_unlock(&t->lock);
+    return pdPASS;
+}
@@ -0,0 +1,156 @@
+/*
+ * SPDX-FileCopyrightText: 2024 Rossen Dobrinov
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/**
+ * Software timers. One service thread runs callbacks in expiry order like
+ * the FreeRTOS timer task. A timer deleted while its callback runs is
+ * released when the callback returns.
+*/
+
+#include <stdio.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/timers.h"
+#include "wm_port.h"
+
+struct wm_port_timer {
+    char name[16];
+    TickType_t period;
+    TickType_t expiry;
+    bool reload;
+    bool active;
+    bool deleted;
+    void *id;
+    TimerCallbackFunction_t cb;
+    struct wm_port_timer *next;
+};
+
+static pthread_mutex_t timer_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t timer_cond;
+static pthread_once_t timer_once = PTHREAD_ONCE_INIT;
+static struct wm_port_timer *timer_list;
+static struct wm_port_timer *timer_running;
+static int timer_count;
+
+static struct wm_port_timer *timer_next_due(void) {
+    struct wm_port_timer *due = NULL;
+    for(struct wm_port_timer *t = timer_list; t; t = t->next) {
+        if(!t->active) continue;
+        if(!due || ((int32_t)(t->expiry - due->expiry) < 0)) due = t;
+    }
+    return due;
+}
+
+static void *timer_service(void *arg) {
+    (void)arg;
+    pthread_mutex_lock(&timer_lock);
+    while(true) {
+        struct wm_port_timer *t = timer_next_due();
+        if(!t) {
+            pthread_cond_wait(&timer_cond, &timer_lock);
+            continue;
+        }
+        int32_t left = (int32_t)(t->expiry - xTaskGetTickCount());
+        if(left > 0) {
+            struct timespec ts;
+            wm_port_deadline(&ts, (TickType_t)left);
+            pthread_cond_timedwait(&timer_cond, &timer_lock, &ts);
+            continue;
+        }
+        if(t->reload) t->expiry += t->period;
+        else t->active = false;
+        timer_running = t;
+        pthread_mutex_unlock(&timer_lock);
+        t->cb(t);
+        pthread_mutex_lock(&timer_lock);
+        timer_running = NULL;
+        if(t->deleted) free(t);
+    }
+    return NULL;
+}
+
+static void timer_service_start(void) {
+    wm_port_cond_init(&timer_cond);
+    pthread_t thread;
+    if(pthread_create(&thread, NULL, timer_service, NULL)) abort();
+    pthread_detach(thread);
+}
+
+int wm_port_timers_alive(void) {
+    pthread_mutex_lock(&timer_lock);
+    int count = timer_count;
+    pthread_mutex_unlock(&timer_lock);
+    return count;
+}
+
+TimerHandle_t xTimerCreate(const char *n, TickType_t p, UBaseType_t r, void *id, TimerCallbackFunction_t cb) {
+    if(!p || !cb) return NULL;
+    pthread_once(&timer_once, timer_service_start);
+    struct wm_port_timer *t = (struct wm_port_timer *)calloc(1, sizeof(struct wm_port_timer));
+    if(!t) return NULL;
+    snprintf(t->name, sizeof(t->name), "%s", n ? n : "");
+    t->period = p;
+    t->reload = r;
+    t->id = id;
+    t->cb = cb;
+    pthread_mutex_lock(&timer_lock);
+    t->next = timer_list;
+    timer_list = t;
+    timer_count++;
+    pthread_mutex_unlock(&timer_lock);
+    return t;
+}
+
+BaseType_t xTimerChangePeriod(TimerHandle_t t, TickType_t p, TickType_t w) {
+    (void)w;
+    if(!p) return pdFAIL;
+    pthread_mutex_lock(&timer_lock);
+    t->period = p;
+    t->expiry = xTaskGetTickCount() + p;
+    t->active = true;
+    pthread_cond_signal(&timer_cond);
+    pthread_mutex_unlock(&timer_lock);
+    return pdPASS;
+}
+
+BaseType_t xTimerStart(TimerHandle_t t, TickType_t w) {
+    return xTimerChangePeriod(t, t->period, w);
+}
+
+BaseType_t xTimerReset(TimerHandle_t t, TickType_t w) {
+    return xTimerStart(t, w);
+}
+
+BaseType_t xTimerStop(TimerHandle_t t, TickType_t w) {
+    (void)w;
+    pthread_mutex_lock(&timer_lock);
+    t->active = false;
+    pthread_cond_signal(&timer_cond);
+    pthread_mutex_unlock(&timer_lock);
+    return pdPASS;
+}
+
+BaseType_t xTimerDelete(TimerHandle_t t, TickType_t w) {
+    (void)w;
+    pthread_mutex_lock(&timer_lock);
+    for(struct wm_port_timer **pp = &timer_list; *pp; pp = &(*pp)->next) {
+        if(*pp == t) {
+            *pp = t->next;
+            break;
+        }
+    }
+    timer_count--;
+    if(timer_running == t) {
+        t->active = false;
+        t->deleted = true;
+    } else free(t);
+    pthread_cond_signal(&timer_cond);
+    pthread_mutex_unlock(&timer_lock);
+    return pdPASS;
+}
+
+void *pvTimerGetTimerID(TimerHandle_t t) {
+    return t->id;
+}
@@ -0,0 +1,1052 @@
+/*
+ * SPDX-FileCopyrightText: 2024 Rossen Dobrinov
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/**
+ * Simulated WiFi driver and default netifs. Driver calls change state under
+ * one lock and queue their events; the simulator thread posts queued events
+ * in due order so a caller never blocks on a full event loop.
+*/
+
+#include <stdio.h>
+#include <errno.h>
+#include "esp_wifi.h"
+#include "esp_netif.h"
+#include "esp_netif_sntp.h"
+#include "wm_sim.h"
+#include "wm_port.h"
+
+#define SIM_ACTIONS 64
+#define SIM_DATA_SIZE 64
+#define SIM_CLIENTS 15
+
+ESP_EVENT_DEFINE_BASE(WIFI_EVENT);
+ESP_EVENT_DEFINE_BASE(IP_EVENT);
+
+typedef enum {
+    SIM_ACT_EVENT = 0,
+    SIM_ACT_SCAN_DONE,
+    SIM_ACT_ASSOC,
+    SIM_ACT_DHCP,
+} sim_act_kind_t;
+
+typedef struct {
+    bool used;
+    sim_act_kind_t kind;
+    TickType_t due;
+    uint32_t seq;
+    uint32_t drv_gen;
+    uint32_t link_gen;          /* 0 - not bound to link */
+    esp_event_base_t base;
+    int32_t id;
+    size_t size;
+    uint8_t data[SIM_DATA_SIZE];
+} sim_action_t;
+
+struct esp_netif_obj {
+    bool ap;
+    esp_netif_ip_info_t ip;
+    esp_netif_dns_info_t dns[ESP_NETIF_DNS_MAX];
+    esp_netif_dhcp_status_t dhcpc;
+    esp_netif_dhcp_status_t dhcps;
+};
+
+static struct {
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    sim_action_t act[SIM_ACTIONS];
+    uint32_t seq;
+    int busy;
+    wm_sim_ap_t aps[WM_SIM_MAX_APS];
+    bool ap_used[WM_SIM_MAX_APS];
+    uint32_t scan_ms;
+    uint32_t connect_ms;
+    uint32_t dhcp_ms;
+    uint32_t dhcp_dns[2];
+    bool inited;
+    bool started;
+    wifi_mode_t mode;
+    wifi_config_t cfg[2];
+    wifi_country_t country;
+    wifi_band_mode_t band_mode;
+    wifi_bandwidth_t ap_bw;
+    wifi_second_chan_t ap_second;
+    uint32_t set_config_fail;
+    uint32_t stall;
+    wifi_ps_type_t ps;
+    int8_t txp;
+    uint32_t drv_gen;
+    bool scanning;
+    wifi_ap_record_t pending[WM_SIM_MAX_APS];
+    uint16_t pending_count;
+    wifi_ap_record_t results[WM_SIM_MAX_APS];
+    uint16_t result_count;
+    uint32_t link_gen;
+    bool connecting;
+    bool linked;
+    int link_ap;
+    uint8_t clients[SIM_CLIENTS][6];
+    int client_count;
+    esp_netif_t *sta_netif;
+    esp_netif_t *ap_netif;
+    esp_sntp_time_cb_t sntp_cb;
+    bool replay;
+    wm_sim_stats_t stats;
+} sim = {
+    .lock = PTHREAD_RECURSIVE_MUTEX_INITIALIZER_NP,
+    .scan_ms = 20,
+    .connect_ms = 20,
+    .dhcp_ms = 20,
+    .dhcp_dns = { 0x0132A8C0UL, 0 },
+    .txp = 80,
+    .link_ap = -1,
+};
+static pthread_once_t sim_once = PTHREAD_ONCE_INIT;
+
+static void sim_post(const sim_action_t *a) {
+    esp_event_post(a->base, a->id, a->size ? a->data : NULL, a->size, portMAX_DELAY);
+}
+
+/* Lock held */
+static void sim_queue(sim_act_kind_t kind, uint32_t delay_ms, uint32_t link_gen, esp_event_base_t base, int32_t id, const void *data, size_t size) {
+    /* Replayed log is the only event source */
+    if(sim.replay) return;
+    for(int i=0; i<SIM_ACTIONS; i++) {
+        sim_action_t *a = &sim.act[i];
+        if(a->used) continue;
+        *a = (sim_action_t){ .used = true, .kind = kind, .due = xTaskGetTickCount() + pdMS_TO_TICKS(delay_ms), .seq = sim.seq++,
+            .drv_gen = sim.drv_gen, .link_gen = link_gen, .base = base, .id = id, .size = size };
+        if(size) memcpy(a->data, data, size);
+        pthread_cond_broadcast(&sim.cond);
+        return;
+    }
+    fprintf(stderr, "simulator action queue full\n");
+    abort();
+}
+
+static void sim_event(int32_t id, const void *data, size_t size) {
+    sim_queue(SIM_ACT_EVENT, 0, 0, WIFI_EVENT, id, data, size);
+}
+
+static int sim_find_ap(const uint8_t bssid[6]) {
+    for(int i=0; i<WM_SIM_MAX_APS; i++) {
+        if(sim.ap_used[i] && !memcmp(sim.aps[i].bssid, bssid, 6)) return i;
+    }
+    return -1;
+}
+
+static void sim_record(const wm_sim_ap_t *ap, wifi_ap_record_t *rec, bool show_ssid) {
+    memset(rec, 0, sizeof(wifi_ap_record_t));
+    memcpy(rec->bssid, ap->bssid, 6);
+    if(show_ssid) memcpy(rec->ssid, ap->ssid, sizeof(rec->ssid));
+    rec->primary = ap->channel;
+    rec->rssi = ap->rssi;
+    rec->authmode = ap->authmode;
+    rec->pairwise_cipher = (ap->authmode == WIFI_AUTH_OPEN) ? WIFI_CIPHER_TYPE_NONE : WIFI_CIPHER_TYPE_CCMP;
+    rec->group_cipher = rec->pairwise_cipher;
+    rec->phy_11b = 1;
+    rec->phy_11g = 1;
+    rec->phy_11n = 1;
+    memcpy(rec->country.cc, sim.country.cc, sizeof(rec->country.cc));
+}
+
+/* Lock held. Drop link, clear STA address and report reason */
+static void sim_link_down(uint8_t reason) {
+    bool report = (sim.linked || sim.connecting) && !(sim.stall & WM_SIM_STALL_DISCONNECT);
+    wifi_event_sta_disconnected_t disc = { .reason = reason };
+    if(sim.link_ap >= 0) {
+        const wm_sim_ap_t *ap = &sim.aps[sim.link_ap];
+        memcpy(disc.ssid, ap->ssid, sizeof(disc.ssid));
+        disc.ssid_len = strnlen(ap->ssid, sizeof(disc.ssid));
+        memcpy(disc.bssid, ap->bssid, 6);
+        disc.rssi = ap->rssi;
+    }
+    sim.link_gen++;
+    sim.linked = false;
+    sim.connecting = false;
+    sim.link_ap = -1;
+    if(sim.sta_netif && (sim.sta_netif->dhcpc != ESP_NETIF_DHCP_STOPPED)) memset(&sim.sta_netif->ip, 0, sizeof(esp_netif_ip_info_t));
+    if(report) sim_event(WIFI_EVENT_STA_DISCONNECTED, &disc, sizeof(disc));
+}
+
+/* Lock held. Queue lease when DHCP client runs on linked STA */
+static void sim_dhcp_kick(void) {
+    if(!sim.linked || !sim.sta_netif || (sim.stall & WM_SIM_STALL_DHCP)) return;
+    if(sim.sta_netif->dhcpc == ESP_NETIF_DHCP_STOPPED) return;
+    sim_queue(SIM_ACT_DHCP, sim.dhcp_ms, sim.link_gen, IP_EVENT, IP_EVENT_STA_GOT_IP, NULL, 0);
+}
+
+/* Lock held. Static address on linked STA is reported at once */
+static void sim_static_ip(void) {
+    if(!sim.linked || !sim.sta_netif) return;
+    if((sim.sta_netif->dhcpc != ESP_NETIF_DHCP_STOPPED) || !sim.sta_netif->ip.ip.addr) return;
+    ip_event_got_ip_t got = { .esp_netif = sim.sta_netif, .ip_info = sim.sta_netif->ip, .ip_changed = true };
+    sim_queue(SIM_ACT_EVENT, 0, sim.link_gen, IP_EVENT, IP_EVENT_STA_GOT_IP, &got, sizeof(got));
+}
+
+/* Lock held. Strongest AP matching STA configuration, -1 none */
+static int sim_pick_ap(void) {
+    const wifi_sta_config_t *sta = &sim.cfg[WIFI_IF_STA].sta;
+    int best = -1;
+    for(int i=0; i<WM_SIM_MAX_APS; i++) {
+        if(!sim.ap_used[i]) continue;
+        const wm_sim_ap_t *ap = &sim.aps[i];
+        if(strncmp(ap->ssid, (const char *)sta->ssid, sizeof(sta->ssid))) continue;
+        if(sta->bssid_set && memcmp(ap->bssid, sta->bssid, 6)) continue;
+        if((best < 0) || (ap->rssi > sim.aps[best].rssi)) best = i;
+    }
+    return best;
+}
+
+static void sim_assoc(void) {
+    const wifi_sta_config_t *sta = &sim.cfg[WIFI_IF_STA].sta;
+    int best = sim_pick_ap();
+    if(best < 0) {
+        sim_link_down(WIFI_REASON_NO_AP_FOUND);
+        return;
+    }
+    const wm_sim_ap_t *ap = &sim.aps[best];
+    sim.link_ap = best;
+    if((ap->authmode != WIFI_AUTH_OPEN) && strncmp(ap->password, (const char *)sta->password, sizeof(sta->password))) {
+        sim_link_down(WIFI_REASON_4WAY_HANDSHAKE_TIMEOUT);
+        return;
+    }
+    sim.connecting = false;
+    sim.linked = true;
+    wifi_event_sta_connected_t conn = { .channel = ap->channel, .authmode = ap->authmode, .aid = 1 };
+    memcpy(conn.ssid, ap->ssid, sizeof(conn.ssid));
+    conn.ssid_len = strnlen(ap->ssid, sizeof(conn.ssid));
+    memcpy(conn.bssid, ap->bssid, 6);
+    sim_queue(SIM_ACT_EVENT, 0, sim.link_gen, WIFI_EVENT, WIFI_EVENT_STA_CONNECTED, &conn, sizeof(conn));
+    sim_dhcp_kick();
+    sim_static_ip();
+}
+
+static void sim_dhcp(sim_action_t *a) {
+    esp_netif_t *n = sim.sta_netif;
+    if(!n || (n->dhcpc == ESP_NETIF_DHCP_STOPPED)) {
+        a->size = 0;
+        return;
+    }
+    n->dhcpc = ESP_NETIF_DHCP_STARTED;
+    n->ip.ip.addr = 0x6432A8C0UL;           /* 192.168.50.100 */
+    n->ip.gw.addr = 0x0132A8C0UL;
+    n->ip.netmask.addr = 0x00FFFFFFUL;
+    for(int i=0; i<2; i++) {
+        n->dns[i] = (esp_netif_dns_info_t){ .ip = { .u_addr.ip4.addr = sim.dhcp_dns[i], .type = ESP_IPADDR_TYPE_V4 } };
+    }
+    ip_event_got_ip_t got = { .esp_netif = n, .ip_info = n->ip, .ip_changed = true };
+    memcpy(a->data, &got, sizeof(got));
+    a->size = sizeof(got);
+}
+
+static void *sim_task(void *arg) {
+    (void)arg;
+    pthread_mutex_lock(&sim.lock);
+    while(true) {
+        sim_action_t *next = NULL;
+        for(int i=0; i<SIM_ACTIONS; i++) {
+            sim_action_t *a = &sim.act[i];
+            if(!a->used) continue;
+            if(!next || ((int32_t)(a->due - next->due) < 0) || ((a->due == next->due) && ((int32_t)(a->seq - next->seq) < 0))) next = a;
+        }
+        if(!next) {
+            pthread_cond_wait(&sim.cond, &sim.lock);
+            continue;
+        }
+        int32_t left = (int32_t)(next->due - xTaskGetTickCount());
+        if(left > 0) {
+            struct timespec ts;
+            wm_port_deadline(&ts, (TickType_t)left);
+            pthread_cond_timedwait(&sim.cond, &sim.lock, &ts);
+            continue;
+        }
+        sim_action_t a = *next;
+        next->used = false;
+        bool stale = (a.drv_gen != sim.drv_gen) || (a.link_gen && (a.link_gen != sim.link_gen));
+        bool post = !stale;
+        if(!stale) {
+            switch(a.kind) {
+                case SIM_ACT_SCAN_DONE: {
+                    sim.scanning = false;
+                    memcpy(sim.results, sim.pending, sizeof(sim.results));
+                    sim.result_count = sim.pending_count;
+                    wifi_event_sta_scan_done_t done = { .status = 0, .number = (uint8_t)sim.result_count };
+                    memcpy(a.data, &done, sizeof(done));
+                    a.size = sizeof(done);
+                    break;
+                }
+                case SIM_ACT_ASSOC:
+                    sim_assoc();
+                    post = false;
+                    break;
+                case SIM_ACT_DHCP:
+                    sim_dhcp(&a);
+                    post = (a.size != 0);
+                    break;
+                default:
+                    break;
+            }
+        }
+        sim.busy++;
+        pthread_mutex_unlock(&sim.lock);
+        if(post) sim_post(&a);
+        pthread_mutex_lock(&sim.lock);
+        sim.busy--;
+        pthread_cond_broadcast(&sim.cond);
+    }
+    return NULL;
+}
+
+static void sim_start(void) {
+    wm_port_cond_init(&sim.cond);
+    pthread_t thread;
+    if(pthread_create(&thread, NULL, sim_task, NULL)) abort();
+    pthread_detach(thread);
+}
+
+static void sim_lock(void) {
+    pthread_once(&sim_once, sim_start);
+    pthread_mutex_lock(&sim.lock);
+}
+
+static void sim_unlock(void) {
+    pthread_mutex_unlock(&sim.lock);
+}
+
+void wm_sim_reset(void) {
+    sim_lock();
+    memset(sim.ap_used, 0, sizeof(sim.ap_used));
+    sim.scan_ms = 20;
+    sim.connect_ms = 20;
+    sim.dhcp_ms = 20;
+    sim.dhcp_dns[0] = 0x0132A8C0UL;
+    sim.dhcp_dns[1] = 0;
+    sim.set_config_fail = 0;
+    sim.stall = 0;
+    sim.replay = false;
+    memset(&sim.stats, 0, sizeof(sim.stats));
+    sim_unlock();
+}
+
+void wm_sim_timing(uint32_t scan_ms, uint32_t connect_ms, uint32_t dhcp_ms) {
+    sim_lock();
+    sim.scan_ms = scan_ms;
+    sim.connect_ms = connect_ms;
+    sim.dhcp_ms = dhcp_ms;
+    sim_unlock();
+}
+
+int wm_sim_add_ap(const wm_sim_ap_t *ap) {
+    int slot = -1;
+    sim_lock();
+    for(int i=0; i<WM_SIM_MAX_APS; i++) {
+        if(!sim.ap_used[i]) {
+            sim.aps[i] = *ap;
+            sim.ap_used[i] = true;
+            slot = i;
+            break;
+        }
+    }
+    sim_unlock();
+    return slot;
+}
+
+void wm_sim_remove_ap(const uint8_t bssid[6]) {
+    sim_lock();
+    int i = sim_find_ap(bssid);
+    if(i >= 0) {
+        if((sim.link_ap == i) && sim.linked) sim_link_down(WIFI_REASON_BEACON_TIMEOUT);
+        sim.ap_used[i] = false;
+    }
+    sim_unlock();
+}
+
+void wm_sim_disconnect(uint8_t reason) {
+    sim_lock();
+    sim_link_down(reason);
+    sim_unlock();
+}
+
+void wm_sim_set_rssi(const uint8_t bssid[6], int8_t rssi) {
+    sim_lock();
+    int i = sim_find_ap(bssid);
+    if(i >= 0) sim.aps[i].rssi = rssi;
+    sim_unlock();
+}
+
+void wm_sim_ap_client(const uint8_t mac[6], bool join) {
+    sim_lock();
+    bool ap_on = sim.started && ((sim.mode == WIFI_MODE_AP) || (sim.mode == WIFI_MODE_APSTA));
+    int found = -1;
+    for(int i=0; i<sim.client_count; i++) {
+        if(!memcmp(sim.clients[i], mac, 6)) found = i;
+    }
+    if(ap_on && join && (found < 0) && (sim.client_count < SIM_CLIENTS)) {
+        memcpy(sim.clients[sim.client_count], mac, 6);
+        wifi_event_ap_staconnected_t ev = { .aid = (uint8_t)++sim.client_count };
+        memcpy(ev.mac, mac, 6);
+        sim_event(WIFI_EVENT_AP_STACONNECTED, &ev, sizeof(ev));
+    } else if(!join && (found >= 0)) {
+        wifi_event_ap_stadisconnected_t ev = { .aid = (uint8_t)(found + 1), .reason = WIFI_REASON_ASSOC_LEAVE };
+        memcpy(ev.mac, mac, 6);
+        memmove(sim.clients[found], sim.clients[found + 1], (size_t)(sim.client_count - found - 1) * 6);
+        sim.client_count--;
+        sim_event(WIFI_EVENT_AP_STADISCONNECTED, &ev, sizeof(ev));
+    }
+    sim_unlock();
+}
+
+void wm_sim_dhcp_dns(uint32_t main_dns, uint32_t backup_dns) {
+    sim_lock();
+    sim.dhcp_dns[0] = main_dns;
+    sim.dhcp_dns[1] = backup_dns;
+    sim_unlock();
+}
+
+void wm_sim_set_config_fail(uint32_t nth) {
+    sim_lock();
+    sim.set_config_fail = nth;
+    sim_unlock();
+}
+
+void wm_sim_stall(uint32_t stages) {
+    sim_lock();
+    sim.stall = stages;
+    sim_unlock();
+}
+
+void wm_sim_get_stats(wm_sim_stats_t *stats) {
+    sim_lock();
+    *stats = sim.stats;
+    stats->inited = sim.inited;
+    stats->started = sim.started;
+    stats->linked = sim.linked;
+    stats->mode = sim.mode;
+    stats->max_tx_power = sim.txp;
+    memcpy(stats->country, sim.country.cc, 2);
+    stats->ap_channel = sim.cfg[WIFI_IF_AP].ap.channel;
+    stats->ap_second = sim.ap_second;
+    stats->ap_bandwidth = sim.ap_bw;
+    stats->band_mode = sim.band_mode;
+    if(sim.linked && (sim.link_ap >= 0)) memcpy(stats->bssid, sim.aps[sim.link_ap].bssid, 6);
+    sim_unlock();
+}
+
+bool wm_sim_idle(uint32_t timeout_ms) {
+    struct timespec ts;
+    wm_port_deadline(&ts, pdMS_TO_TICKS(timeout_ms));
+    sim_lock();
+    while(true) {
+        bool pending = (sim.busy != 0);
+        for(int i=0; i<SIM_ACTIONS; i++) pending |= sim.act[i].used;
+        if(!pending) break;
+        if(ETIMEDOUT == pthread_cond_timedwait(&sim.cond, &sim.lock, &ts)) {
+            sim_unlock();
+            return false;
+        }
+    }
+    sim_unlock();
+    return true;
+}
+
+void wm_sim_sntp_sync(void) {
+    sim_lock();
+    esp_sntp_time_cb_t cb = sim.sntp_cb;
+    sim_unlock();
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    if(cb) cb(&tv);
+}
+
+void wm_sim_replay(bool on) {
+    sim_lock();
+    sim.replay = on;
+    sim_unlock();
+}
+
+void wm_sim_replay_scan(const wifi_ap_record_t *records, uint16_t count) {
+    sim_lock();
+    sim.pending_count = (count < WM_SIM_MAX_APS) ? count : WM_SIM_MAX_APS;
+    memcpy(sim.pending, records, sim.pending_count * sizeof(wifi_ap_record_t));
+    sim_unlock();
+}
+
+void wm_sim_replay_event(esp_event_base_t base, int32_t id, const void *data, size_t size) {
+    uint8_t buf[256];
+    if(size > sizeof(buf)) size = sizeof(buf);
+    if(size) memcpy(buf, data, size);
+    sim_lock();
+    if(base == WIFI_EVENT) {
+        switch(id) {
+            case WIFI_EVENT_SCAN_DONE:
+                sim.scanning = false;
+                memcpy(sim.results, sim.pending, sizeof(sim.results));
+                sim.result_count = sim.pending_count;
+                break;
+            case WIFI_EVENT_STA_CONNECTED:
+                sim.connecting = false;
+                sim.linked = true;
+                sim.link_ap = sim_pick_ap();
+                break;
+            case WIFI_EVENT_STA_DISCONNECTED:
+                sim.link_gen++;
+                sim.linked = false;
+                sim.connecting = false;
+                sim.link_ap = -1;
+                if(sim.sta_netif && (sim.sta_netif->dhcpc != ESP_NETIF_DHCP_STOPPED)) memset(&sim.sta_netif->ip, 0, sizeof(esp_netif_ip_info_t));
+                break;
+            default:
+                break;
+        }
+    } else if((base == IP_EVENT) && (id == IP_EVENT_STA_GOT_IP) && (size >= sizeof(ip_event_got_ip_t)) && sim.sta_netif) {
+        ip_event_got_ip_t *got = (ip_event_got_ip_t *)buf;
+        /* Captured netif pointer belongs to capture run */
+        got->esp_netif = sim.sta_netif;
+        sim.sta_netif->ip = got->ip_info;
+        if(sim.sta_netif->dhcpc != ESP_NETIF_DHCP_STOPPED) sim.sta_netif->dhcpc = ESP_NETIF_DHCP_STARTED;
+    }
+    sim.busy++;
+    sim_unlock();
+    esp_event_post(base, id, size ? buf : NULL, size, portMAX_DELAY);
+    sim_lock();
+    sim.busy--;
+    pthread_cond_broadcast(&sim.cond);
+    sim_unlock();
+}
+
+/* Driver */
+
+esp_err_t esp_wifi_init(const wifi_init_config_t *c) {
+    if(!c) return ESP_ERR_INVALID_ARG;
+    sim_lock();
+    if(!sim.inited) {
+        sim.inited = true;
+        sim.mode = WIFI_MODE_NULL;
+        memset(sim.cfg, 0, sizeof(sim.cfg));
+        sim.ps = WIFI_PS_MIN_MODEM;
+        sim.txp = 80;
+        sim.result_count = 0;
+        sim.client_count = 0;
+    }
+    sim_unlock();
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_deinit(void) {
+    esp_err_t err = ESP_OK;
+    sim_lock();
+    if(!sim.inited) err = ESP_ERR_WIFI_NOT_INIT;
+    else if(sim.started) err = ESP_ERR_WIFI_NOT_STOPPED;
+    else {
+        sim.inited = false;
+        sim.drv_gen++;
+    }
+    sim_unlock();
+    return err;
+}
+
+esp_err_t esp_wifi_set_storage(wifi_storage_t s) {
+    (void)s;
+    return sim.inited ? ESP_OK : ESP_ERR_WIFI_NOT_INIT;
+}
+
+esp_err_t esp_wifi_set_country(const wifi_country_t *c) {
+    if(!c || !c->nchan) return ESP_ERR_INVALID_ARG;
+    sim_lock();
+    esp_err_t err = sim.inited ? ESP_OK : ESP_ERR_WIFI_NOT_INIT;
+    if(err == ESP_OK) sim.country = *c;
+    sim_unlock();
+    return err;
+}
+
+esp_err_t esp_wifi_get_country(wifi_country_t *c) {
+    sim_lock();
+    *c = sim.country;
+    sim_unlock();
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_set_mode(wifi_mode_t m) {
+    if(m >= WIFI_MODE_NAN) return ESP_ERR_INVALID_ARG;
+    sim_lock();
+    if(!sim.inited) {
+        sim_unlock();
+        return ESP_ERR_WIFI_NOT_INIT;
+    }
+    if((sim.stall & WM_SIM_STALL_MODE) && (m != sim.mode)) {
+        sim_unlock();
+        return ESP_FAIL;
+    }
+    bool ap_was = (sim.mode == WIFI_MODE_AP) || (sim.mode == WIFI_MODE_APSTA);
+    bool ap_now = (m == WIFI_MODE_AP) || (m == WIFI_MODE_APSTA);
+    sim.mode = m;
+    if(sim.started && (ap_was != ap_now)) {
+        if(!ap_now) sim.client_count = 0;
+        sim_event(ap_now ? WIFI_EVENT_AP_START : WIFI_EVENT_AP_STOP, NULL, 0);
+    }
+    sim_unlock();
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_get_mode(wifi_mode_t *m) {
+    sim_lock();
+    esp_err_t err = sim.inited ? ESP_OK : ESP_ERR_WIFI_NOT_INIT;
+    *m = sim.mode;
+    sim_unlock();
+    return err;
+}
+
+esp_err_t esp_wifi_set_config(wifi_interface_t i, wifi_config_t *c) {
+    if((i > WIFI_IF_AP) || !c) return ESP_ERR_INVALID_ARG;
+    sim_lock();
+    esp_err_t err = sim.inited ? ESP_OK : ESP_ERR_WIFI_NOT_INIT;
+    if((err == ESP_OK) && sim.set_config_fail && (--sim.set_config_fail == 0)) err = ESP_ERR_WIFI_STATE;
+    if(err == ESP_OK) sim.cfg[i] = *c;
+    sim_unlock();
+    return err;
+}
+
+esp_err_t esp_wifi_get_config(wifi_interface_t i, wifi_config_t *c) {
+    if(i > WIFI_IF_AP) return ESP_ERR_INVALID_ARG;
+    sim_lock();
+    *c = sim.cfg[i];
+    sim_unlock();
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_set_bandwidth(wifi_interface_t i, wifi_bandwidth_t bw) {
+    if((i > WIFI_IF_AP) || ((bw != WIFI_BW_HT20) && (bw != WIFI_BW_HT40))) return ESP_ERR_INVALID_ARG;
+    sim_lock();
+    esp_err_t err = sim.inited ? ESP_OK : ESP_ERR_WIFI_NOT_INIT;
+    if((err == ESP_OK) && (i == WIFI_IF_AP)) sim.ap_bw = bw;
+    sim_unlock();
+    return err;
+}
+
+esp_err_t esp_wifi_set_band_mode(wifi_band_mode_t m) {
+    if((m < WIFI_BAND_MODE_2G_ONLY) || (m > WIFI_BAND_MODE_AUTO)) return ESP_ERR_INVALID_ARG;
+    sim_lock();
+    esp_err_t err = sim.inited ? ESP_OK : ESP_ERR_WIFI_NOT_INIT;
+    if(err == ESP_OK) sim.band_mode = m;
+    sim_unlock();
+    return err;
+}
+
+esp_err_t esp_wifi_start(void) {
+    sim_lock();
+    if(!sim.inited) {
+        sim_unlock();
+        return ESP_ERR_WIFI_NOT_INIT;
+    }
+    sim.stats.starts++;
+    if(!sim.started) {
+        sim.started = true;
+        if(sim.mode != WIFI_MODE_AP) sim_event(WIFI_EVENT_STA_START, NULL, 0);
+        if((sim.mode == WIFI_MODE_AP) || (sim.mode == WIFI_MODE_APSTA)) sim_event(WIFI_EVENT_AP_START, NULL, 0);
+    }
+    sim_unlock();
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_stop(void) {
+    sim_lock();
+    if(!sim.inited) {
+        sim_unlock();
+        return ESP_ERR_WIFI_NOT_INIT;
+    }
+    sim.stats.stops++;
+    if(sim.started) {
+        /* Pending scan, association and lease are dropped */
+        sim.drv_gen++;
+        sim.scanning = false;
+        sim_link_down(WIFI_REASON_ASSOC_LEAVE);
+        sim.started = false;
+        sim.client_count = 0;
+        if(sim.mode != WIFI_MODE_AP) sim_event(WIFI_EVENT_STA_STOP, NULL, 0);
+        if((sim.mode == WIFI_MODE_AP) || (sim.mode == WIFI_MODE_APSTA)) sim_event(WIFI_EVENT_AP_STOP, NULL, 0);
+    }
+    sim_unlock();
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_connect(void) {
+    sim_lock();
+    esp_err_t err = ESP_OK;
+    if(!sim.inited) err = ESP_ERR_WIFI_NOT_INIT;
+    else if(!sim.started) err = ESP_ERR_WIFI_NOT_STARTED;
+    else if(sim.mode == WIFI_MODE_AP) err = ESP_ERR_WIFI_MODE;
+    else if(sim.linked) err = ESP_ERR_WIFI_CONN;
+    else {
+        sim.stats.connects++;
+        sim.link_gen++;
+        sim.connecting = true;
+        if(!(sim.stall & WM_SIM_STALL_ASSOC)) sim_queue(SIM_ACT_ASSOC, sim.connect_ms, sim.link_gen, WIFI_EVENT, 0, NULL, 0);
+    }
+    sim_unlock();
+    return err;
+}
+
+esp_err_t esp_wifi_disconnect(void) {
+    sim_lock();
+    esp_err_t err = ESP_OK;
+    if(!sim.inited) err = ESP_ERR_WIFI_NOT_INIT;
+    else if(!sim.started) err = ESP_ERR_WIFI_NOT_STARTED;
+    else sim_link_down(WIFI_REASON_ASSOC_LEAVE);
+    sim_unlock();
+    return err;
+}
+
+/* 5 GHz channel bitmap - bit n+1 is n-th channel of this table */
+static const uint8_t sim_5g_chans[] = { 36, 40, 44, 48, 52, 56, 60, 64, 100, 104, 108, 112, 116, 120, 124, 128, 132, 136, 140, 144, 149, 153, 157, 161, 165 };
+
+static bool sim_scan_channel(const wifi_scan_config_t *c, uint8_t channel) {
+    if(!c) return true;
+    if(c->channel) return c->channel == channel;
+    const wifi_scan_channel_bitmap_t *bitmap = &c->channel_bitmap;
+    if(!bitmap->ghz_2_channels && !bitmap->ghz_5_channels) return true;
+    if(channel <= 14) return (bitmap->ghz_2_channels & (1U << channel)) != 0;
+    for(size_t i=0; i<sizeof(sim_5g_chans); i++) {
+        if(sim_5g_chans[i] == channel) return (bitmap->ghz_5_channels & (1UL << (i + 1))) != 0;
+    }
+    return false;
+}
+
+esp_err_t esp_wifi_scan_start(const wifi_scan_config_t *c, bool block) {
+    sim_lock();
+    esp_err_t err = ESP_OK;
+    if(!sim.inited) err = ESP_ERR_WIFI_NOT_INIT;
+    else if(!sim.started) err = ESP_ERR_WIFI_NOT_STARTED;
+    else if(sim.mode == WIFI_MODE_AP) err = ESP_ERR_WIFI_MODE;
+    else if(sim.scanning) err = ESP_ERR_WIFI_STATE;
+    if(err != ESP_OK) {
+        sim_unlock();
+        return err;
+    }
+    sim.stats.scans++;
+    if(c && c->channel) sim.stats.channel_scans++;
+    uint16_t count = 0;
+    for(int i=0; i<WM_SIM_MAX_APS; i++) {
+        if(!sim.ap_used[i]) continue;
+        const wm_sim_ap_t *ap = &sim.aps[i];
+        if(!sim_scan_channel(c, ap->channel)) continue;
+        if(c && c->bssid && memcmp(c->bssid, ap->bssid, 6)) continue;
+        bool directed = c && c->ssid && !strncmp((const char *)c->ssid, ap->ssid, 32);
+        if(c && c->ssid && !directed) continue;
+        if(ap->hidden && !directed && !(c && c->show_hidden)) continue;
+        wifi_ap_record_t rec;
+        sim_record(ap, &rec, !ap->hidden || directed);
+        /* Strongest first */
+        int pos = count;
+        while((pos > 0) && (sim.pending[pos - 1].rssi < rec.rssi)) {
+            sim.pending[pos] = sim.pending[pos - 1];
+            pos--;
+        }
+        sim.pending[pos] = rec;
+        count++;
+    }
+    sim.pending_count = count;
+    if(block) {
+        memcpy(sim.results, sim.pending, sizeof(sim.results));
+        sim.result_count = count;
+        wifi_event_sta_scan_done_t done = { .status = 0, .number = (uint8_t)count };
+        sim_event(WIFI_EVENT_SCAN_DONE, &done, sizeof(done));
+    } else {
+        sim.scanning = true;
+        if(!(sim.stall & WM_SIM_STALL_SCAN)) sim_queue(SIM_ACT_SCAN_DONE, sim.scan_ms, 0, WIFI_EVENT, WIFI_EVENT_SCAN_DONE, NULL, 0);
+    }
+    sim_unlock();
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_scan_stop(void) {
+    sim_lock();
+    if(sim.scanning) {
+        /* Queued scan done is dropped with old generation */
+        for(int i=0; i<SIM_ACTIONS; i++) {
+            if(sim.act[i].used && (sim.act[i].kind == SIM_ACT_SCAN_DONE)) sim.act[i].used = false;
+        }
+        sim.scanning = false;
+    }
+    sim_unlock();
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_scan_get_ap_num(uint16_t *n) {
+    sim_lock();
+    *n = sim.result_count;
+    sim_unlock();
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_scan_get_ap_records(uint16_t *n, wifi_ap_record_t *r) {
+    sim_lock();
+    uint16_t count = (*n < sim.result_count) ? *n : sim.result_count;
+    memcpy(r, sim.results, count * sizeof(wifi_ap_record_t));
+    *n = count;
+    /* Driver frees its list */
+    sim.result_count = 0;
+    sim_unlock();
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_clear_ap_list(void) {
+    sim_lock();
+    sim.result_count = 0;
+    sim_unlock();
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_set_channel(uint8_t p, wifi_second_chan_t s) {
+    if(!p) return ESP_ERR_INVALID_ARG;
+    sim_lock();
+    esp_err_t err = sim.inited ? ESP_OK : ESP_ERR_WIFI_NOT_INIT;
+    if((err == ESP_OK) && ((sim.mode == WIFI_MODE_AP) || (sim.mode == WIFI_MODE_APSTA))) {
+        /* Moves softAP */
+        sim.cfg[WIFI_IF_AP].ap.channel = p;
+        sim.ap_second = s;
+    }
+    sim_unlock();
+    return err;
+}
+
+esp_err_t esp_wifi_set_ps(wifi_ps_type_t t) {
+    sim_lock();
+    sim.ps = t;
+    sim_unlock();
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_get_ps(wifi_ps_type_t *t) {
+    sim_lock();
+    *t = sim.ps;
+    sim_unlock();
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_sta_get_ap_info(wifi_ap_record_t *r) {
+    sim_lock();
+    esp_err_t err = ESP_ERR_WIFI_NOT_CONNECT;
+    if(sim.linked && (sim.link_ap >= 0)) {
+        sim_record(&sim.aps[sim.link_ap], r, true);
+        err = ESP_OK;
+    }
+    sim_unlock();
+    return err;
+}
+
+esp_err_t esp_wifi_sta_get_rssi(int *rssi) {
+    wifi_ap_record_t rec;
+    esp_err_t err = esp_wifi_sta_get_ap_info(&rec);
+    if(err == ESP_OK) *rssi = rec.rssi;
+    return err;
+}
+
+esp_err_t esp_wifi_set_max_tx_power(int8_t p) {
+    if((p < 8) || (p > 84)) return ESP_ERR_INVALID_ARG;
+    sim_lock();
+    esp_err_t err = sim.started ? ESP_OK : ESP_ERR_WIFI_NOT_STARTED;
+    if(err == ESP_OK) sim.txp = p;
+    sim_unlock();
+    return err;
+}
+
+esp_err_t esp_wifi_get_max_tx_power(int8_t *p) {
+    sim_lock();
+    *p = sim.txp;
+    sim_unlock();
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_ap_get_sta_list(wifi_sta_list_t *l) {
+    sim_lock();
+    memset(l, 0, sizeof(wifi_sta_list_t));
+    for(int i=0; i<sim.client_count; i++) {
+        memcpy(l->sta[i].mac, sim.clients[i], 6);
+        l->sta[i].rssi = -50;
+    }
+    l->num = sim.client_count;
+    sim_unlock();
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_set_rssi_threshold(int32_t rssi) {
+    (void)rssi;
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_set_inactive_time(wifi_interface_t i, uint16_t sec) {
+    (void)i;
+    return (sec < 10) ? ESP_ERR_INVALID_ARG : ESP_OK;
+}
+
+esp_err_t esp_wifi_set_country_code(const char *cc, bool ieee80211d_enabled) {
+    (void)ieee80211d_enabled;
+    sim_lock();
+    memcpy(sim.country.cc, cc, 2);
+    sim_unlock();
+    return ESP_OK;
+}
+
+/* Netif */
+
+esp_err_t esp_netif_init(void) {
+    return ESP_OK;
+}
+
+esp_err_t esp_netif_deinit(void) {
+    return ESP_OK;
+}
+
+static esp_netif_t *netif_create(bool ap) {
+    esp_netif_t *n = (esp_netif_t *)calloc(1, sizeof(esp_netif_t));
+    if(!n) return NULL;
+    n->ap = ap;
+    if(ap) {
+        n->ip.ip.addr = 0x0104A8C0UL;       /* 192.168.4.1 */
+        n->ip.gw.addr = 0x0104A8C0UL;
+        n->ip.netmask.addr = 0x00FFFFFFUL;
+        n->dhcps = ESP_NETIF_DHCP_STARTED;
+        n->dhcpc = ESP_NETIF_DHCP_STOPPED;
+    } else {
+        n->dhcps = ESP_NETIF_DHCP_STOPPED;
+        n->dhcpc = ESP_NETIF_DHCP_INIT;
+    }
+    sim_lock();
+    if(ap) sim.ap_netif = n;
+    else sim.sta_netif = n;
+    sim_unlock();
+    return n;
+}
+
+esp_netif_t *esp_netif_create_default_wifi_ap(void) {
+    return netif_create(true);
+}
+
+esp_netif_t *esp_netif_create_default_wifi_sta(void) {
+    return netif_create(false);
+}
+
+void esp_netif_destroy(esp_netif_t *n) {
+    if(!n) return;
+    sim_lock();
+    if(sim.ap_netif == n) sim.ap_netif = NULL;
+    if(sim.sta_netif == n) sim.sta_netif = NULL;
+    sim_unlock();
+    free(n);
+}
+
+void esp_netif_destroy_default_wifi(void *esp_netif) {
+    esp_netif_destroy((esp_netif_t *)esp_netif);
+}
+
+esp_err_t esp_netif_get_ip_info(esp_netif_t *n, esp_netif_ip_info_t *i) {
+    if(!n || !i) return ESP_ERR_INVALID_ARG;
+    sim_lock();
+    *i = n->ip;
+    sim_unlock();
+    return ESP_OK;
+}
+
+esp_err_t esp_netif_set_ip_info(esp_netif_t *n, const esp_netif_ip_info_t *i) {
+    if(!n || !i) return ESP_ERR_INVALID_ARG;
+    sim_lock();
+    esp_err_t err = ESP_OK;
+    if((n->ap && (n->dhcps != ESP_NETIF_DHCP_STOPPED)) || (!n->ap && (n->dhcpc != ESP_NETIF_DHCP_STOPPED))) err = ESP_ERR_INVALID_STATE;
+    else {
+        n->ip = *i;
+        if(n == sim.sta_netif) sim_static_ip();
+    }
+    sim_unlock();
+    return err;
+}
+
+esp_err_t esp_netif_set_dns_info(esp_netif_t *n, esp_netif_dns_type_t t, esp_netif_dns_info_t *d) {
+    if(!n || !d || (t >= ESP_NETIF_DNS_MAX)) return ESP_ERR_INVALID_ARG;
+    sim_lock();
+    n->dns[t] = *d;
+    sim_unlock();
+    return ESP_OK;
+}
+
+esp_err_t esp_netif_get_dns_info(esp_netif_t *n, esp_netif_dns_type_t t, esp_netif_dns_info_t *d) {
+    if(!n || !d || (t >= ESP_NETIF_DNS_MAX)) return ESP_ERR_INVALID_ARG;
+    sim_lock();
+    *d = n->dns[t];
+    sim_unlock();
+    return ESP_OK;
+}
+
+esp_err_t esp_netif_dhcps_get_status(esp_netif_t *n, esp_netif_dhcp_status_t *s) {
+    sim_lock();
+    *s = n->dhcps;
+    sim_unlock();
+    return ESP_OK;
+}
+
+esp_err_t esp_netif_dhcpc_get_status(esp_netif_t *n, esp_netif_dhcp_status_t *s) {
+    sim_lock();
+    *s = n->dhcpc;
+    sim_unlock();
+    return ESP_OK;
+}
+
+esp_err_t esp_netif_dhcps_stop(esp_netif_t *n) {
+    sim_lock();
+    esp_err_t err = (n->dhcps == ESP_NETIF_DHCP_STOPPED) ? ESP_ERR_ESP_NETIF_DHCP_ALREADY_STOPPED : ESP_OK;
+    n->dhcps = ESP_NETIF_DHCP_STOPPED;
+    sim_unlock();
+    return err;
+}
+
+esp_err_t esp_netif_dhcps_start(esp_netif_t *n) {
+    sim_lock();
+    esp_err_t err = (n->dhcps == ESP_NETIF_DHCP_STARTED) ? ESP_ERR_ESP_NETIF_DHCP_ALREADY_STARTED : ESP_OK;
+    n->dhcps = ESP_NETIF_DHCP_STARTED;
+    sim_unlock();
+    return err;
+}
+
+esp_err_t esp_netif_dhcpc_stop(esp_netif_t *n) {
+    sim_lock();
+    esp_err_t err = (n->dhcpc == ESP_NETIF_DHCP_STOPPED) ? ESP_ERR_ESP_NETIF_DHCP_ALREADY_STOPPED : ESP_OK;
+    if(err == ESP_OK) {
+        n->dhcpc = ESP_NETIF_DHCP_STOPPED;
+        /* Drop pending lease */
+        for(int i=0; i<SIM_ACTIONS; i++) {
+            if(sim.act[i].used && (sim.act[i].kind == SIM_ACT_DHCP)) sim.act[i].used = false;
+        }
+    }
+    sim_unlock();
+    return err;
+}
+
+esp_err_t esp_netif_dhcpc_start(esp_netif_t *n) {
+    sim_lock();
+    esp_err_t err = (n->dhcpc == ESP_NETIF_DHCP_STARTED) ? ESP_ERR_ESP_NETIF_DHCP_ALREADY_STARTED : ESP_OK;
+    if(err == ESP_OK) {
+        n->dhcpc = ESP_NETIF_DHCP_STARTED;
+        memset(&n->ip, 0, sizeof(n->ip));
+        if(n == sim.sta_netif) sim_dhcp_kick();
+    }
+    sim_unlock();
+    return err;
+}
+
+/* SNTP */
+
+esp_err_t esp_netif_sntp_init(const esp_sntp_config_t *c) {
+    sim_lock();
+    esp_err_t err = sim.sntp_cb ? ESP_ERR_INVALID_STATE : ESP_OK;
+    if(err == ESP_OK) sim.sntp_cb = c->sync_cb;
+    sim_unlock();
+    return err;
+}
+
+void esp_netif_sntp_deinit(void) {
+    sim_lock();
+    sim.sntp_cb = NULL;
+    sim_unlock();
+}
@@ -0,0 +1,45 @@
+/*
+ * SPDX-FileCopyrightText: 2024 Rossen Dobrinov
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/**
+ * Host port test hooks: heap accounting, fault injection and object counts.
+*/
+
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+#include "freertos/FreeRTOS.h"
+
+/* Heap reported to heap_caps_* as total - live bytes */
+#define WM_PORT_HEAP_TOTAL (320 * 1024)
+
+typedef struct {
+    size_t live_bytes;          /* Bytes allocated and not freed */
+    size_t live_blocks;         /* Blocks allocated and not freed */
+    size_t peak_bytes;          /* Highest live_bytes since last reset */
+    uint64_t allocs;            /* Allocation calls */
+} wm_port_heap_t;
+
+void wm_port_heap_get(wm_port_heap_t *heap);
+void wm_port_heap_peak_reset(void);
+/* Fail nth allocation from now (1 = next), 0 disables */
+void wm_port_heap_fail(uint32_t nth);
+
+/* Fail next xTaskCreate of task with name */
+void wm_port_task_fail(const char *name);
+/* Join deleted tasks and return number of tasks alive */
+int wm_port_tasks_alive(void);
+int wm_port_timers_alive(void);
+int wm_port_queues_alive(void);
+/* Wait until default event loop has no queued or running event */
+bool wm_port_events_idle(uint32_t timeout_ms);
+/* Loopback port of running HTTP server, 0 when none */
+uint16_t wm_port_httpd_port(void);
+
+/* Port internals */
+void wm_port_deadline(struct timespec *ts, TickType_t ticks);
+void wm_port_cond_init(pthread_cond_t *cond);
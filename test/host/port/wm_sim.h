@@ -0,0 +1,85 @@
+/*
+ * SPDX-FileCopyrightText: 2024 Rossen Dobrinov
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/**
+ * Simulated WiFi driver control for host tests. Radio environment is a list
+ * of APs; driver events are posted to the default event loop from the
+ * simulator thread after the configured delays.
+*/
+
+#pragma once
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_wifi.h"
+
+#define WM_SIM_MAX_APS 32
+
+/* Driver stalls, wm_sim_stall bitmask */
+#define WM_SIM_STALL_ASSOC      0x01    /* Association never completes */
+#define WM_SIM_STALL_DISCONNECT 0x02    /* Dropped link or attempt is not reported */
+#define WM_SIM_STALL_DHCP       0x04    /* DHCP lease never arrives */
+#define WM_SIM_STALL_SCAN       0x08    /* Scan done is never reported */
+#define WM_SIM_STALL_MODE       0x10    /* WiFi mode switch fails */
+
+typedef struct {
+    char ssid[33];
+    char password[65];
+    uint8_t bssid[6];
+    uint8_t channel;
+    int8_t rssi;
+    wifi_auth_mode_t authmode;
+    bool hidden;
+} wm_sim_ap_t;
+
+typedef struct {
+    uint32_t scans;             /* Scans started */
+    uint32_t channel_scans;     /* Scans started on single channel */
+    uint32_t connects;          /* esp_wifi_connect calls accepted */
+    uint32_t starts;            /* esp_wifi_start calls */
+    uint32_t stops;             /* esp_wifi_stop calls */
+    bool inited;
+    bool started;
+    bool linked;                /* STA associated */
+    uint8_t bssid[6];           /* Associated AP */
+    wifi_mode_t mode;
+    int8_t max_tx_power;
+    char country[3];            /* Driver country code */
+    uint8_t ap_channel;         /* softAP configured channel */
+    wifi_second_chan_t ap_second;   /* softAP HT40 secondary from last esp_wifi_set_channel */
+    wifi_bandwidth_t ap_bandwidth;  /* 0 until set */
+    wifi_band_mode_t band_mode;     /* 0 until set */
+} wm_sim_stats_t;
+
+/* Remove all APs, restore default timing, clear stalls. Driver state is kept */
+void wm_sim_reset(void);
+/* Delays in ms for scan done, association and DHCP lease */
+void wm_sim_timing(uint32_t scan_ms, uint32_t connect_ms, uint32_t dhcp_ms);
+int wm_sim_add_ap(const wm_sim_ap_t *ap);
+/* Remove AP, associated STA gets beacon timeout */
+void wm_sim_remove_ap(const uint8_t bssid[6]);
+/* Drop STA link, driver reports disconnect with reason */
+void wm_sim_disconnect(uint8_t reason);
+void wm_sim_set_rssi(const uint8_t bssid[6], int8_t rssi);
+/* Station joins or leaves softAP */
+void wm_sim_ap_client(const uint8_t mac[6], bool join);
+/* DNS servers handed out with DHCP lease, 0 for none */
+void wm_sim_dhcp_dns(uint32_t main_dns, uint32_t backup_dns);
+/* nth next esp_wifi_set_config call fails, 0 disables */
+void wm_sim_set_config_fail(uint32_t nth);
+/* Stall driver stages, WM_SIM_STALL_* bits. Applies to calls made after it, 0 clears */
+void wm_sim_stall(uint32_t stages);
+void wm_sim_get_stats(wm_sim_stats_t *stats);
+/* Wait until no driver event is pending. false on timeout */
+bool wm_sim_idle(uint32_t timeout_ms);
+/* Report SNTP time sync to registered callback */
+void wm_sim_sntp_sync(void);
+/* Replay mode: driver calls keep changing state, but driver posts no events
+ * of its own - events come from wm_sim_replay_event */
+void wm_sim_replay(bool on);
+/* Scan records reported by next replayed WIFI_EVENT_SCAN_DONE */
+void wm_sim_replay_scan(const wifi_ap_record_t *records, uint16_t count);
+/* Apply captured driver event to driver state and post it to default event loop */
+void wm_sim_replay_event(esp_event_base_t base, int32_t id, const void *data, size_t size);
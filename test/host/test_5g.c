@@ -0,0 +1,173 @@
+/*
+ * SPDX-FileCopyrightText: 2024 Rossen Dobrinov
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/**
+ * Dual band on the host port: known 5 GHz AP wins over stronger 2.4 GHz AP
+ * within WIFIMGR_5G_MARGIN, but only above minimum 5 GHz RSSI. Hidden AP on
+ * 5 GHz channel is probed on its own channel bitmap bit. softAP channel and HT40
+ * secondary are ranked only over channels of country 5 GHz sub-bands without DFS.
+*/
+
+#include <string.h>
+#include "idf_wifi_manager.h"
+#include "wm_port.h"
+#include "wm_sim.h"
+#include "wm_test.h"
+
+#define WAIT_MS     10000
+
+static const wm_sim_ap_t near_ap = {
+    .ssid = "near",
+    .password = "password1",
+    .bssid = { 0x02, 0x00, 0x00, 0x00, 0x00, 0x01 },
+    .channel = 6,
+    .authmode = WIFI_AUTH_WPA2_PSK,
+};
+
+static const wm_sim_ap_t fast_ap = {
+    .ssid = "fast",
+    .password = "password1",
+    .bssid = { 0x02, 0x00, 0x00, 0x00, 0x00, 0x02 },
+    .channel = 44,
+    .authmode = WIFI_AUTH_WPA2_PSK,
+};
+
+/* Hidden on UNII-2e channel - STA only, 9th channel of 5 GHz table */
+static const wm_sim_ap_t hidden_ap = {
+    .ssid = "attic",
+    .password = "password1",
+    .bssid = { 0x02, 0x00, 0x00, 0x00, 0x00, 0x03 },
+    .channel = 100,
+    .rssi = -60,
+    .authmode = WIFI_AUTH_WPA2_PSK,
+    .hidden = true,
+};
+
+static volatile bool ap_started;
+
+static void ap_start_cb(void *arg, esp_event_base_t event_base, int32_t id, void *data) {
+    (void)arg;
+    (void)event_base;
+    (void)id;
+    (void)data;
+    ap_started = true;
+}
+
+static bool wait_link(const uint8_t bssid[6]) {
+    for(int i=0; i<WAIT_MS / 10; i++) {
+        wm_sim_stats_t stats;
+        wm_sim_get_stats(&stats);
+        if(stats.linked && (stats.mode == WIFI_MODE_STA) && !memcmp(stats.bssid, bssid, 6)) return true;
+        vTaskDelay(pdMS_TO_TICKS(10));
+    }
+    return false;
+}
+
+/* Both known APs appear in one scan - manager picks by score */
+static void test_margin(int8_t near_rssi, int8_t fast_rssi, const wm_sim_ap_t *expected) {
+    wm_sim_ap_t near = near_ap, fast = fast_ap;
+    near.rssi = near_rssi;
+    fast.rssi = fast_rssi;
+    wm_sim_reset();
+    wm_sim_timing(5, 5, 5);
+    WM_CHECK_EQ(wm_init_wifi_manager(NULL, NULL), ESP_OK);
+    WM_CHECK_EQ(wm_add_known_network("near", "password1"), ESP_OK);
+    WM_CHECK_EQ(wm_add_known_network("fast", "password1"), ESP_OK);
+    wm_sim_add_ap(&near);
+    wm_sim_add_ap(&fast);
+    if(!wait_link(expected->bssid)) {
+        fprintf(stderr, "near %d fast %d: not linked to %s\n", near_rssi, fast_rssi, expected->ssid);
+        WM_CHECK(false);
+    }
+    wm_sim_stats_t stats;
+    wm_sim_get_stats(&stats);
+    WM_CHECK_EQ(stats.band_mode, WIFI_BAND_MODE_AUTO);
+    WM_CHECK_EQ(wm_deinit_wifi_manager(), ESP_OK);
+}
+
+/* Directed probe goes only to channels with hidden APs seen in broadcast scan */
+static void test_hidden(void) {
+    wm_sim_reset();
+    wm_sim_timing(5, 5, 5);
+    wm_sim_add_ap(&hidden_ap);
+    WM_CHECK_EQ(wm_init_wifi_manager(NULL, NULL), ESP_OK);
+    wm_net_base_config_t attic = { .ssid = "attic", .password = "password1", .hidden = true };
+    WM_CHECK_EQ(wm_add_known_network_config(&attic), ESP_OK);
+    WM_CHECK(wait_link(hidden_ap.bssid));
+    WM_CHECK_EQ(wm_deinit_wifi_manager(), ESP_OK);
+}
+
+/**
+ * @brief softAP channel ranking after STA link is lost. 2.4 GHz and UNII-1 channels
+ * are busy, everything else is free
+ *
+ * @param[in] cc Country code
+ * @param[in] busy_5g Busy 5 GHz channels, 0 terminated
+ * @param[in] channel Expected softAP channel
+ * @param[in] second Expected HT40 secondary channel
+*/
+static void test_ap_channel(char *cc, const uint8_t *busy_5g, uint8_t channel, wifi_second_chan_t second) {
+    wm_sim_ap_t home = near_ap;
+    home.rssi = -50;
+    wm_sim_reset();
+    wm_sim_timing(5, 5, 5);
+    wm_sim_add_ap(&home);
+    WM_CHECK_EQ(wm_init_wifi_manager(NULL, NULL), ESP_OK);
+    wm_set_country(cc);
+    WM_CHECK_EQ(wm_add_known_network("near", "password1"), ESP_OK);
+    WM_CHECK(wait_link(home.bssid));
+
+    /* Strong APs all over 2.4 GHz band */
+    wm_sim_ap_t busy = { .ssid = "busy", .rssi = -40, .authmode = WIFI_AUTH_OPEN };
+    for(uint8_t ch=1; ch<=13; ch+=3) {
+        busy.bssid[5] = 0x10 + ch;
+        busy.channel = ch;
+        wm_sim_add_ap(&busy);
+    }
+    for(int i=0; busy_5g[i]; i++) {
+        busy.bssid[5] = busy_5g[i];
+        busy.channel = busy_5g[i];
+        wm_sim_add_ap(&busy);
+    }
+    ap_started = false;
+    wm_sim_remove_ap(home.bssid);
+    for(int i=0; (i < WAIT_MS) && !ap_started; i++) vTaskDelay(pdMS_TO_TICKS(1));
+    WM_CHECK(ap_started);
+    wm_sim_stats_t stats;
+    wm_sim_get_stats(&stats);
+    if((stats.ap_channel != channel) || (stats.ap_second != second)) {
+        fprintf(stderr, "%s: softAP on %u second %d, expected %u second %d\n", cc, stats.ap_channel, stats.ap_second, channel, second);
+        WM_CHECK(false);
+    }
+    WM_CHECK_EQ(stats.ap_bandwidth, (second != WIFI_SECOND_CHAN_NONE) ? WIFI_BW_HT40 : WIFI_BW_HT20);
+    WM_CHECK_EQ(wm_deinit_wifi_manager(), ESP_OK);
+}
+
+int main(void) {
+    WM_CHECK_EQ(esp_event_loop_create_default(), ESP_OK);
+    WM_CHECK_EQ(esp_event_handler_instance_register(WM_EVENT, WM_EVENT_AP_START, ap_start_cb, NULL, NULL), ESP_OK);
+
+    /* Margin 8 dB: 5 GHz -65 and -74 (+8) beat 2.4 GHz -60 and -68, below -75 no margin */
+    test_margin(-60, -65, &fast_ap);
+    test_margin(-68, -74, &fast_ap);
+    test_margin(-70, -76, &near_ap);
+
+    test_hidden();
+
+    /* BG - UNII-1 and DFS sub-bands. Busy UNII-1 wins over free DFS channel */
+    static const uint8_t unii1[] = { 36, 40, 44, 48, 0 };
+    test_ap_channel("BG", unii1, 36, WIFI_SECOND_CHAN_NONE);
+    /* Free pair 44/48 - HT40 above, busy pair channel - HT20 */
+    static const uint8_t unii1_low[] = { 36, 40, 0 };
+    test_ap_channel("BG", unii1_low, 44, WIFI_SECOND_CHAN_ABOVE);
+    static const uint8_t unii1_44[] = { 36, 44, 0 };
+    test_ap_channel("BG", unii1_44, 40, WIFI_SECOND_CHAN_NONE);
+    /* US - UNII-3 allowed for softAP */
+    test_ap_channel("US", unii1, 149, WIFI_SECOND_CHAN_ABOVE);
+    static const uint8_t unii3[] = { 36, 40, 44, 48, 149, 153, 157, 161, 0 };
+    test_ap_channel("US", unii3, 165, WIFI_SECOND_CHAN_NONE);
+    return WM_TEST_RESULT();
+}
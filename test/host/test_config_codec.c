@@ -0,0 +1,172 @@
+/*
+ * SPDX-FileCopyrightText: 2024 Rossen Dobrinov
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/**
+ * Configuration image codec: full image must survive encode and decode
+ * unchanged, damaged or foreign images must be rejected with matching error
+ * and unknown records from newer writers must be skipped. Images without AP
+ * profile record decode with profile absent.
+*/
+
+#include <string.h>
+#include "wm_config_codec.h"
+#include "wm_test.h"
+
+static wm_cfg_image_t image, decoded;
+static uint8_t buf[WM_CFG_MAX_SIZE];
+
+static void image_fill(wm_cfg_image_t *img, uint8_t kn_count) {
+    memset(img, 0, sizeof(wm_cfg_image_t));
+    strcpy(img->ap.ssid, "wm-setup");
+    strcpy(img->ap.password, "setup-pass");
+    img->ap.ip = 0x0104A8C0UL;
+    img->ap.netmask = 0x00FFFFFFUL;
+    img->ap.gw = 0x0104A8C0UL;
+    img->ap_channel = 6;
+    strcpy(img->country, "DE");
+    img->sec_dns = 0x08080808UL;
+    img->power_profile = 2;
+    img->max_sta_retry = 4;
+    strcpy(img->inet_host, "probe.example.com");
+    strcpy(img->inet_path, "/generate_204");
+    img->inet_port = 80;
+    img->inet_status = 204;
+    img->has_ap_profile = true;
+    img->ap_security = 1;
+    img->ap_bandwidth = 2;
+    img->ap_max_clients = 8;
+    img->ap_beacon_interval = 300;
+    img->ap_inactive_time = 600;
+    for(uint8_t i=0; i<kn_count; i++) {
+        snprintf(img->kn[i].ssid, sizeof(img->kn[i].ssid), "net-%u", i);
+        snprintf(img->kn[i].password, sizeof(img->kn[i].password), "password-%u", i);
+        img->kn[i].hidden = (i & 1);
+    }
+    img->kn_count = kn_count;
+    /* 64 characters PSK and 32 characters SSID use full field */
+    if(kn_count) {
+        memset(img->kn[0].password, 'a', 64);
+        memset(img->kn[0].ssid, 's', 32);
+    }
+}
+
+/* Recompute trailer after image bytes were edited */
+static void image_reseal(uint8_t *img, size_t size) {
+    uint32_t crc = wm_cfg_crc32(0, img, size - 4);
+    for(int i=0; i<4; i++) img[size - 4 + i] = (uint8_t)(crc >> (8 * i));
+}
+
+static void test_roundtrip(void) {
+    image_fill(&image, WM_CFG_MAX_NETS);
+    size_t size = wm_cfg_encode(&image, NULL, 0);
+    WM_CHECK(size > WM_CFG_HDR_SIZE + 4);
+    WM_CHECK(size <= WM_CFG_MAX_SIZE);
+    WM_CHECK_EQ(wm_cfg_encode(&image, buf, size - 1), 0);
+    WM_CHECK_EQ(wm_cfg_encode(&image, buf, sizeof(buf)), size);
+    WM_CHECK_EQ(wm_cfg_decode(buf, size, &decoded), WM_CFG_OK);
+    WM_CHECK(!memcmp(&image, &decoded, sizeof(wm_cfg_image_t)));
+
+    /* Probe record is optional */
+    image_fill(&image, 0);
+    memset(image.inet_host, 0, sizeof(image.inet_host));
+    memset(image.inet_path, 0, sizeof(image.inet_path));
+    image.inet_port = image.inet_status = 0;
+    size = wm_cfg_encode(&image, buf, sizeof(buf));
+    WM_CHECK_EQ(wm_cfg_decode(buf, size, &decoded), WM_CFG_OK);
+    WM_CHECK(!memcmp(&image, &decoded, sizeof(wm_cfg_image_t)));
+
+    /* Image of older writer has no AP profile record */
+    image.has_ap_profile = false;
+    image.ap_security = image.ap_bandwidth = image.ap_max_clients = 0;
+    image.ap_beacon_interval = image.ap_inactive_time = 0;
+    size_t old_size = wm_cfg_encode(&image, buf, sizeof(buf));
+    WM_CHECK_EQ(old_size, size - 9);
+    WM_CHECK_EQ(wm_cfg_decode(buf, old_size, &decoded), WM_CFG_OK);
+    WM_CHECK(!decoded.has_ap_profile);
+    WM_CHECK(!memcmp(&image, &decoded, sizeof(wm_cfg_image_t)));
+
+    image.kn_count = WM_CFG_MAX_NETS + 1;
+    WM_CHECK_EQ(wm_cfg_encode(&image, NULL, 0), 0);
+}
+
+static void test_damaged(void) {
+    image_fill(&image, 3);
+    size_t size = wm_cfg_encode(&image, buf, sizeof(buf));
+    WM_CHECK_EQ(wm_cfg_decode(buf, size - 1, &decoded), WM_CFG_ERR_SIZE);
+    WM_CHECK_EQ(wm_cfg_decode(buf, WM_CFG_HDR_SIZE, &decoded), WM_CFG_ERR_SIZE);
+    WM_CHECK_EQ(wm_cfg_decode(NULL, size, &decoded), WM_CFG_ERR_SIZE);
+    /* Every flipped record or trailer byte is caught */
+    for(size_t i=WM_CFG_HDR_SIZE; i<size; i++) {
+        buf[i] ^= 0x01;
+        WM_CHECK_EQ(wm_cfg_decode(buf, size, &decoded), WM_CFG_ERR_CRC);
+        buf[i] ^= 0x01;
+    }
+    buf[0] = 'X';
+    WM_CHECK_EQ(wm_cfg_decode(buf, size, &decoded), WM_CFG_ERR_MAGIC);
+    buf[0] = 'W';
+    buf[4] = WM_CFG_VERSION + 1;
+    WM_CHECK_EQ(wm_cfg_decode(buf, size, &decoded), WM_CFG_ERR_VERSION);
+    buf[4] = WM_CFG_VERSION;
+    WM_CHECK_EQ(wm_cfg_decode(buf, size, &decoded), WM_CFG_OK);
+}
+
+static void test_records(void) {
+    /* Header, unknown record, country record with valid and wrong length */
+    uint8_t img[] = { 'W', 'M', 'C', 'F', WM_CFG_VERSION, 0, 8, 0,
+        0x7F, 2, 0xAA, 0x55,
+        WM_CFG_REC_COUNTRY, 2, 'J', 'P',
+        0, 0, 0, 0 };
+    image_reseal(img, sizeof(img));
+    WM_CHECK_EQ(wm_cfg_decode(img, sizeof(img), &decoded), WM_CFG_OK);
+    WM_CHECK(!strcmp(decoded.country, "JP"));
+
+    img[13] = 1;
+    image_reseal(img, sizeof(img));
+    WM_CHECK_EQ(wm_cfg_decode(img, sizeof(img), &decoded), WM_CFG_ERR_FORMAT);
+
+    /* Record length past records end */
+    img[13] = 3;
+    image_reseal(img, sizeof(img));
+    WM_CHECK_EQ(wm_cfg_decode(img, sizeof(img), &decoded), WM_CFG_ERR_FORMAT);
+
+    /* AP profile record decodes, truncated one is malformed */
+    uint8_t prof[] = { 'W', 'M', 'C', 'F', WM_CFG_VERSION, 0, 9, 0,
+        WM_CFG_REC_AP_PROFILE, 7, 2, 1, 4, 0x64, 0x00, 0x2C, 0x01,
+        0, 0, 0, 0 };
+    image_reseal(prof, sizeof(prof));
+    WM_CHECK_EQ(wm_cfg_decode(prof, sizeof(prof), &decoded), WM_CFG_OK);
+    WM_CHECK(decoded.has_ap_profile);
+    WM_CHECK_EQ(decoded.ap_security, 2);
+    WM_CHECK_EQ(decoded.ap_max_clients, 4);
+    WM_CHECK_EQ(decoded.ap_beacon_interval, 100);
+    WM_CHECK_EQ(decoded.ap_inactive_time, 300);
+    prof[9] = 5;
+    image_reseal(prof, sizeof(prof));
+    WM_CHECK_EQ(wm_cfg_decode(prof, sizeof(prof), &decoded), WM_CFG_ERR_FORMAT);
+
+    /* Known networks beyond image limit */
+    image_fill(&image, WM_CFG_MAX_NETS);
+    size_t size = wm_cfg_encode(&image, buf, sizeof(buf));
+    size_t rec = WM_CFG_HDR_SIZE + 2 + buf[WM_CFG_HDR_SIZE + 1];
+    size_t rec_len = 2 + buf[rec + 1];
+    size_t records = buf[6] | (buf[7] << 8);
+    memmove(&buf[rec + rec_len], &buf[rec], size - rec);
+    size += rec_len;
+    records += rec_len;
+    buf[6] = records & 0xFF;
+    buf[7] = records >> 8;
+    image_reseal(buf, size);
+    WM_CHECK_EQ(wm_cfg_decode(buf, size, &decoded), WM_CFG_ERR_FORMAT);
+}
+
+int main(void) {
+    /* IEEE 802.3 check value */
+    WM_CHECK_EQ(wm_cfg_crc32(0, (const uint8_t *)"123456789", 9), 0xCBF43926UL);
+    test_roundtrip();
+    test_damaged();
+    test_records();
+    return WM_TEST_RESULT();
+}
@@ -0,0 +1,186 @@
+/*
+ * SPDX-FileCopyrightText: 2024 Rossen Dobrinov
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/**
+ * Configuration import on the host port: rejected image or driver failure
+ * part way through must leave running configuration and driver country as
+ * before, WM_EVENT_CFG_IMPORTED is posted for applied image only. AP profile
+ * travels with image, image without it keeps running profile.
+*/
+
+#include <string.h>
+#include "idf_wifi_manager.h"
+#include "wm_config_codec.h"
+#include "wm_port.h"
+#include "wm_sim.h"
+#include "wm_test.h"
+
+#define WAIT_MS 10000
+
+static wm_cfg_image_t image, running;
+static uint8_t base[WM_CFG_MAX_SIZE], buf[WM_CFG_MAX_SIZE];
+static size_t base_size;
+static uint32_t kn_version;
+static volatile int imported;
+
+static void wm_event_cb(void *arg, esp_event_base_t event_base, int32_t id, void *data) {
+    (void)arg;
+    (void)event_base;
+    (void)data;
+    if(id == WM_EVENT_CFG_IMPORTED) imported++;
+}
+
+/* Running configuration and driver country match state before import */
+static void check_unchanged(const char *cc) {
+    size_t size = sizeof(buf);
+    WM_CHECK_EQ(wm_export_config(buf, &size), ESP_OK);
+    WM_CHECK_EQ(size, base_size);
+    WM_CHECK(!memcmp(buf, base, base_size));
+    wm_sim_stats_t stats;
+    wm_sim_get_stats(&stats);
+    WM_CHECK(!strcmp(stats.country, cc));
+}
+
+static esp_err_t import(const wm_cfg_image_t *img) {
+    size_t size = wm_cfg_encode(img, buf, sizeof(buf));
+    WM_CHECK(size);
+    esp_err_t err = wm_import_config(buf, size);
+    WM_CHECK(wm_port_events_idle(WAIT_MS));
+    return err;
+}
+
+static void image_new(void) {
+    WM_CHECK_EQ(wm_cfg_decode(base, base_size, &image), WM_CFG_OK);
+    strcpy(image.ap.ssid, "imported-ap");
+    strcpy(image.ap.password, "imported-pass");
+    strcpy(image.country, "JP");
+    image.ap_channel = 14;
+    image.max_sta_retry = 5;
+    image.has_ap_profile = true;
+    image.ap_security = WM_AP_SEC_WPA3;
+    image.ap_bandwidth = WIFI_BW_HT20;
+    image.ap_max_clients = 7;
+    image.ap_beacon_interval = 200;
+    image.ap_inactive_time = 120;
+    image.kn_count = 2;
+    memset(image.kn, 0, sizeof(image.kn));
+    strcpy(image.kn[0].ssid, "office");
+    strcpy(image.kn[0].password, "office-pass");
+    strcpy(image.kn[1].ssid, "lab");
+    memset(image.kn[1].password, 'f', 64);
+}
+
+static void test_rejected(void) {
+    image_new();
+    strcpy(image.country, "ZZ");
+    WM_CHECK_EQ(import(&image), ESP_ERR_INVALID_ARG);
+    check_unchanged("BG");
+
+    image_new();
+    image.max_sta_retry = 0;
+    WM_CHECK_EQ(import(&image), ESP_ERR_INVALID_ARG);
+    image.max_sta_retry = 6;
+    WM_CHECK_EQ(import(&image), ESP_ERR_INVALID_ARG);
+    check_unchanged("BG");
+
+    image_new();
+    image.ap_max_clients = 11;
+    WM_CHECK_EQ(import(&image), ESP_ERR_INVALID_ARG);
+    image_new();
+    image.ap_security = WM_AP_SEC_MAX;
+    WM_CHECK_EQ(import(&image), ESP_ERR_INVALID_ARG);
+    check_unchanged("BG");
+
+    image_new();
+    image.ap_channel = 15;
+    WM_CHECK_EQ(import(&image), ESP_ERR_INVALID_ARG);
+    image_new();
+    strcpy(image.kn[1].password, "short");
+    WM_CHECK_EQ(import(&image), ESP_ERR_INVALID_ARG);
+    image_new();
+    image.kn_count = CONFIG_WIFIMGR_MAX_KNOWN_NETWORKS + 1;
+    for(uint8_t i=0; i<image.kn_count; i++) {
+        snprintf(image.kn[i].ssid, sizeof(image.kn[i].ssid), "net-%u", i);
+        strcpy(image.kn[i].password, "password1");
+    }
+    WM_CHECK_EQ(import(&image), ESP_ERR_NOT_ALLOWED);
+    check_unchanged("BG");
+
+    /* Damaged image */
+    image_new();
+    size_t size = wm_cfg_encode(&image, buf, sizeof(buf));
+    buf[size - 1] ^= 0xFF;
+    WM_CHECK_EQ(wm_import_config(buf, size), ESP_ERR_INVALID_CRC);
+    check_unchanged("BG");
+    WM_CHECK_EQ(imported, 0);
+}
+
+static void test_rollback(void) {
+    /* Country is applied, AP configuration is rejected by driver */
+    image_new();
+    wm_sim_set_config_fail(1);
+    WM_CHECK_EQ(import(&image), ESP_ERR_WIFI_STATE);
+    wm_sim_set_config_fail(0);
+    check_unchanged("BG");
+    WM_CHECK_EQ(imported, 0);
+    WM_CHECK_EQ(wm_get_known_networks_version(), kn_version);
+}
+
+static void test_applied(void) {
+    image_new();
+    strcpy(image.country, "US");
+    image.ap_channel = 13;     /* Clamped to US plan */
+    WM_CHECK_EQ(import(&image), ESP_OK);
+    WM_CHECK_EQ(imported, 1);
+    size_t size = sizeof(buf);
+    WM_CHECK_EQ(wm_export_config(buf, &size), ESP_OK);
+    WM_CHECK_EQ(wm_cfg_decode(buf, size, &running), WM_CFG_OK);
+    WM_CHECK(!strcmp(running.country, "US"));
+    WM_CHECK_EQ(running.ap_channel, 11);
+    WM_CHECK_EQ(running.max_sta_retry, 5);
+    WM_CHECK(!strcmp(running.ap.ssid, "imported-ap"));
+    WM_CHECK_EQ(running.kn_count, 2);
+    WM_CHECK(!strcmp(running.kn[0].ssid, "office"));
+    WM_CHECK(!memcmp(running.kn[1].password, image.kn[1].password, 65));
+    WM_CHECK(running.has_ap_profile);
+    wm_ap_profile_t profile;
+    wm_get_ap_profile(&profile);
+    WM_CHECK_EQ(profile.security, WM_AP_SEC_WPA3);
+    WM_CHECK_EQ(profile.bandwidth, WIFI_BW_HT20);
+    WM_CHECK_EQ(profile.max_clients, 7);
+    WM_CHECK_EQ(profile.beacon_interval, 200);
+    WM_CHECK_EQ(profile.inactive_time, 120);
+    wm_sim_stats_t stats;
+    wm_sim_get_stats(&stats);
+    WM_CHECK(!strcmp(stats.country, "US"));
+    WM_CHECK(stats.ap_channel <= 11);
+
+    /* Older image without AP profile record */
+    image.has_ap_profile = false;
+    image.ap_max_clients = 0;
+    image.max_sta_retry = 3;
+    WM_CHECK_EQ(import(&image), ESP_OK);
+    WM_CHECK_EQ(imported, 2);
+    wm_get_ap_profile(&profile);
+    WM_CHECK_EQ(profile.max_clients, 7);
+    WM_CHECK_EQ(profile.security, WM_AP_SEC_WPA3);
+}
+
+int main(void) {
+    wm_sim_reset();
+    wm_sim_timing(5, 5, 5);
+    WM_CHECK_EQ(wm_init_wifi_manager(NULL, NULL), ESP_OK);
+    WM_CHECK_EQ(esp_event_handler_instance_register(WM_EVENT, ESP_EVENT_ANY_ID, wm_event_cb, NULL, NULL), ESP_OK);
+    WM_CHECK_EQ(wm_add_known_network("home", "password1"), ESP_OK);
+    base_size = sizeof(base);
+    WM_CHECK_EQ(wm_export_config(base, &base_size), ESP_OK);
+    kn_version = wm_get_known_networks_version();
+    test_rejected();
+    test_rollback();
+    test_applied();
+    WM_CHECK_EQ(wm_deinit_wifi_manager(), ESP_OK);
+    return WM_TEST_RESULT();
+}
@@ -0,0 +1,192 @@
+/*
+ * SPDX-FileCopyrightText: 2024 Rossen Dobrinov
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/**
+ * Direct callbacks on the host port: latency of STA got IP from driver event to
+ * direct callback and to event loop handler is measured over reconnect cycles,
+ * direct callback must never run later. Events posted outside manager task
+ * (SNTP) reach direct callbacks in manager task. Manager API calls from callback
+ * are deferred after current event, calls waiting for completion are refused.
+ * Event not queued for direct callbacks is counted as lost like driver events.
+*/
+
+#include "esp_timer.h"
+#include "idf_wifi_manager.h"
+#include "freertos/semphr.h"
+#include "wm_port.h"
+#include "wm_sim.h"
+#include "wm_test.h"
+
+#define WAIT_MS     10000
+#define CYCLES      20
+
+static const wm_sim_ap_t home_ap = {
+    .ssid = "home",
+    .password = "password1",
+    .bssid = { 0x02, 0x00, 0x00, 0x00, 0x00, 0x01 },
+    .channel = 6,
+    .rssi = -50,
+    .authmode = WIFI_AUTH_WPA2_PSK,
+};
+
+/**
+ * @brief Latency of one event delivery path, microseconds
+*/
+typedef struct {
+    int64_t min;
+    int64_t max;
+    int64_t sum;
+    int count;
+} latency_t;
+
+static volatile int64_t t_origin, t_direct, t_loop;
+static TaskHandle_t ip_task, time_task;
+static volatile int time_calls;
+static esp_err_t nested_err, nested_bulk_err;
+static wm_power_profile_t nested_profile;
+static SemaphoreHandle_t mgr_release;
+static volatile bool mgr_released;
+
+static void latency_add(latency_t *l, int64_t us) {
+    if(!l->count || (us < l->min)) l->min = us;
+    if(!l->count || (us > l->max)) l->max = us;
+    l->sum += us;
+    l->count++;
+}
+
+static void latency_print(const char *name, const latency_t *l) {
+    printf("%-12s min %6lld avg %6lld max %6lld us (%d)\n", name, (long long)l->min,
+        (long long)((l->count) ? l->sum / l->count : 0), (long long)l->max, l->count);
+}
+
+/* Registered before manager forwarder - driver event time */
+static void ip_event_cb(void *arg, esp_event_base_t event_base, int32_t id, void *data) {
+    (void)arg;
+    (void)event_base;
+    (void)data;
+    if(id == IP_EVENT_STA_GOT_IP) t_origin = esp_timer_get_time();
+}
+
+static void wm_event_cb(void *arg, esp_event_base_t event_base, int32_t id, void *data) {
+    (void)arg;
+    (void)event_base;
+    (void)data;
+    if((id == WM_EVENT_GOT_IP) && t_origin && !t_loop) t_loop = esp_timer_get_time();
+}
+
+static void direct_ip_cb(int32_t event_id, const void *event_data, size_t event_data_size, void *cb_arg) {
+    (void)event_id;
+    (void)event_data;
+    (void)event_data_size;
+    (void)cb_arg;
+    if(t_origin && !t_direct) t_direct = esp_timer_get_time();
+    ip_task = xTaskGetCurrentTaskHandle();
+}
+
+static void direct_time_cb(int32_t event_id, const void *event_data, size_t event_data_size, void *cb_arg) {
+    (void)event_id;
+    (void)event_data;
+    (void)cb_arg;
+    time_task = xTaskGetCurrentTaskHandle();
+    WM_CHECK_EQ(event_data_size, sizeof(struct timeval));
+    /* Queued, applied after callback returns */
+    nested_err = wm_set_power_profile(WM_POWER_LOW);
+    wm_power_stats_t stats;
+    wm_get_power_stats(&stats);
+    nested_profile = stats.profile;
+    wm_kn_bulk_entry_t entry = { 0 };
+    nested_bulk_err = wm_bulk_known_networks(&entry, 1, false);
+    time_calls++;
+}
+
+/* Completion callback holding manager task until released */
+static void mgr_hold(const wm_cmd_t *cmd, esp_err_t result, void *arg) {
+    (void)cmd;
+    (void)result;
+    (void)arg;
+    xSemaphoreTake(mgr_release, portMAX_DELAY);
+    mgr_released = true;
+}
+
+static bool wait_set(volatile int64_t *t) {
+    for(int i=0; (i < WAIT_MS) && !*t; i++) vTaskDelay(pdMS_TO_TICKS(1));
+    return *t != 0;
+}
+
+int main(void) {
+    wm_sim_reset();
+    wm_sim_timing(5, 5, 5);
+    wm_sim_add_ap(&home_ap);
+    WM_CHECK_EQ(esp_event_loop_create_default(), ESP_OK);
+    WM_CHECK_EQ(esp_event_handler_instance_register(IP_EVENT, IP_EVENT_STA_GOT_IP, ip_event_cb, NULL, NULL), ESP_OK);
+    WM_CHECK_EQ(wm_init_wifi_manager(NULL, NULL), ESP_OK);
+    WM_CHECK_EQ(esp_event_handler_instance_register(WM_EVENT, WM_EVENT_GOT_IP, wm_event_cb, NULL, NULL), ESP_OK);
+    WM_CHECK_EQ(wm_register_direct_cb(WM_EVENT_GOT_IP, direct_ip_cb, NULL), ESP_OK);
+    WM_CHECK_EQ(wm_register_direct_cb(WM_EVENT_GOT_TIME, direct_time_cb, NULL), ESP_OK);
+    WM_CHECK_EQ(wm_add_known_network("home", "password1"), ESP_OK);
+    WM_CHECK(wait_set(&t_loop));
+    WM_CHECK(wm_port_events_idle(WAIT_MS));
+
+    /* Reconnect cycles - resume connects to last AP without scan */
+    latency_t direct = { 0 }, loop = { 0 };
+    for(int i=0; i<CYCLES; i++) {
+        WM_CHECK_EQ(wm_suspend_wifi_manager(), ESP_OK);
+        WM_CHECK(wm_port_events_idle(WAIT_MS));
+        t_origin = t_direct = t_loop = 0;
+        WM_CHECK_EQ(wm_resume_wifi_manager(), ESP_OK);
+        WM_CHECK(wait_set(&t_loop));
+        WM_CHECK(t_direct != 0);
+        WM_CHECK(t_direct <= t_loop);
+        latency_add(&direct, t_direct - t_origin);
+        latency_add(&loop, t_loop - t_origin);
+        WM_CHECK(wm_port_events_idle(WAIT_MS));
+    }
+    latency_print("direct", &direct);
+    latency_print("event loop", &loop);
+    WM_CHECK_EQ(direct.count, CYCLES);
+    WM_CHECK(direct.sum <= loop.sum);
+    WM_CHECK(ip_task && (ip_task != xTaskGetCurrentTaskHandle()));
+
+    /* SNTP callback runs outside manager task */
+    wm_power_stats_t stats;
+    wm_get_power_stats(&stats);
+    WM_CHECK(stats.profile != WM_POWER_LOW);
+    wm_power_profile_t before = stats.profile;
+    wm_sim_sntp_sync();
+    for(int i=0; (i < WAIT_MS) && !time_calls; i++) vTaskDelay(pdMS_TO_TICKS(1));
+    WM_CHECK_EQ(time_calls, 1);
+    WM_CHECK(time_task == ip_task);
+    WM_CHECK_EQ(nested_err, ESP_OK);
+    WM_CHECK_EQ(nested_profile, before);
+    WM_CHECK_EQ(nested_bulk_err, ESP_ERR_INVALID_STATE);
+    for(int i=0; i<WAIT_MS; i++) {
+        wm_get_power_stats(&stats);
+        if(stats.profile == WM_POWER_LOW) break;
+        vTaskDelay(pdMS_TO_TICKS(1));
+    }
+    WM_CHECK_EQ(stats.profile, WM_POWER_LOW);
+
+    WM_CHECK_EQ(wm_unregister_direct_cb(WM_EVENT_GOT_TIME, direct_time_cb), ESP_OK);
+
+    /* Full manager queue - SNTP events beyond queue length are lost and counted */
+    wm_wd_stats_t wd;
+    wm_get_wd_stats(&wd);
+    uint32_t lost = wd.lost_events;
+    mgr_release = xSemaphoreCreateBinary();
+    wm_cmd_t cmd = { .cmd_id = WM_CMD_POWER_PROFILE, .power_profile = WM_POWER_LOW };
+    WM_CHECK_EQ(wm_cmd_submit(&cmd, mgr_hold, NULL), ESP_OK);
+    for(int i=0; i<CONFIG_WIFIMGR_CMD_QUEUE_LEN + 2; i++) wm_sim_sntp_sync();
+    xSemaphoreGive(mgr_release);
+    WM_CHECK(wm_port_events_idle(WAIT_MS));
+    wm_get_wd_stats(&wd);
+    WM_CHECK(wd.lost_events > lost);
+    /* Semaphore is still in use until callback returns */
+    for(int i=0; (i < WAIT_MS) && !mgr_released; i++) vTaskDelay(pdMS_TO_TICKS(1));
+    WM_CHECK(mgr_released);
+    vSemaphoreDelete(mgr_release);
+    WM_CHECK_EQ(wm_deinit_wifi_manager(), ESP_OK);
+    return WM_TEST_RESULT();
+}
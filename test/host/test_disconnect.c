@@ -0,0 +1,134 @@
+/*
+ * SPDX-FileCopyrightText: 2024 Rossen Dobrinov
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/**
+ * Disconnect recovery actions on the host port: driver drops the link with a
+ * reason from each class. Retry reconnects at once, backoff reconnects after
+ * retry timer, rescan gives up AP and scans before reconnect, next and
+ * blacklist give up AP for other known network - short blacklist expires
+ * (built with 1 s), long one does not.
+*/
+
+#include <string.h>
+#include "idf_wifi_manager.h"
+#include "wm_port.h"
+#include "wm_sim.h"
+#include "wm_test.h"
+
+#define WAIT_MS     10000
+
+static const wm_sim_ap_t home_ap = {
+    .ssid = "home",
+    .password = "password1",
+    .bssid = { 0x02, 0x00, 0x00, 0x00, 0x00, 0x01 },
+    .channel = 1,
+    .rssi = -40,
+    .authmode = WIFI_AUTH_WPA2_PSK,
+};
+
+static const wm_sim_ap_t office_ap = {
+    .ssid = "office",
+    .password = "password1",
+    .bssid = { 0x02, 0x00, 0x00, 0x00, 0x00, 0x02 },
+    .channel = 6,
+    .rssi = -60,
+    .authmode = WIFI_AUTH_WPA2_PSK,
+};
+
+/**
+ * @brief Driver behaviour between dropped link and next connect attempt
+*/
+typedef struct {
+    uint32_t ms;        /* Time to next esp_wifi_connect */
+    bool scanned;       /* Scan started before it */
+} reconnect_t;
+
+static volatile int got_ip;
+
+static void wm_event_cb(void *arg, esp_event_base_t event_base, int32_t id, void *data) {
+    (void)arg;
+    (void)event_base;
+    (void)data;
+    if(id == WM_EVENT_GOT_IP) got_ip++;
+}
+
+/* Link to AP with address - manager is done with connect */
+static bool wait_ip(int count, const wm_sim_ap_t *ap) {
+    for(int i=0; i<WAIT_MS; i++) {
+        wm_sim_stats_t stats;
+        wm_sim_get_stats(&stats);
+        if((got_ip > count) && stats.linked && !memcmp(stats.bssid, ap->bssid, 6)) return true;
+        vTaskDelay(pdMS_TO_TICKS(1));
+    }
+    return false;
+}
+
+static void kick(uint8_t reason, const wm_sim_ap_t *next, reconnect_t *r) {
+    wm_sim_stats_t before, now;
+    wm_sim_get_stats(&before);
+    now = before;
+    int count = got_ip;
+    TickType_t start = xTaskGetTickCount();
+    wm_sim_disconnect(reason);
+    for(int i=0; (i < WAIT_MS) && (now.connects == before.connects); i++) {
+        vTaskDelay(pdMS_TO_TICKS(1));
+        wm_sim_get_stats(&now);
+    }
+    r->ms = (xTaskGetTickCount() - start) * portTICK_PERIOD_MS;
+    r->scanned = (now.scans != before.scans);
+    WM_CHECK(now.connects != before.connects);
+    if(!wait_ip(count, next)) {
+        fprintf(stderr, "reason %u: not linked to %s\n", reason, next->ssid);
+        WM_CHECK(false);
+    }
+}
+
+int main(void) {
+    reconnect_t r;
+    wm_sim_reset();
+    wm_sim_timing(5, 5, 5);
+    wm_sim_add_ap(&home_ap);
+    wm_sim_add_ap(&office_ap);
+    WM_CHECK_EQ(esp_event_loop_create_default(), ESP_OK);
+    WM_CHECK_EQ(esp_event_handler_instance_register(WM_EVENT, WM_EVENT_GOT_IP, wm_event_cb, NULL, NULL), ESP_OK);
+    WM_CHECK_EQ(wm_init_wifi_manager(NULL, NULL), ESP_OK);
+    int count = got_ip;
+    WM_CHECK_EQ(wm_add_known_network("home", "password1"), ESP_OK);
+    WM_CHECK_EQ(wm_add_known_network("office", "password1"), ESP_OK);
+    WM_CHECK(wait_ip(count, &home_ap));
+
+    /* Retry - same AP at once */
+    kick(WIFI_REASON_AUTH_EXPIRE, &home_ap, &r);
+    WM_CHECK(!r.scanned);
+    WM_CHECK(r.ms < CONFIG_WIFIMGR_RETRY_BACKOFF);
+
+    /* Backoff - same AP after retry timer */
+    kick(WIFI_REASON_AUTH_LEAVE, &home_ap, &r);
+    WM_CHECK(!r.scanned);
+    WM_CHECK(r.ms >= CONFIG_WIFIMGR_RETRY_BACKOFF);
+
+    /* Rescan - AP is not retried before scan and is not blacklisted */
+    kick(WIFI_REASON_BEACON_TIMEOUT, &home_ap, &r);
+    WM_CHECK(r.scanned);
+    WM_CHECK(r.ms < CONFIG_WIFIMGR_RETRY_BACKOFF);
+    kick(WIFI_REASON_NO_AP_FOUND, &home_ap, &r);
+    WM_CHECK(r.scanned);
+
+    /* Next - other network, stronger AP is back after short blacklist */
+    kick(WIFI_REASON_ASSOC_TOOMANY, &office_ap, &r);
+    WM_CHECK(r.scanned);
+    vTaskDelay(pdMS_TO_TICKS(CONFIG_WIFIMGR_BLACKLIST_SHORT_TIME * 1000 + 500));
+    kick(WIFI_REASON_BEACON_TIMEOUT, &home_ap, &r);
+
+    /* Blacklist - other network, stronger AP stays out */
+    kick(WIFI_REASON_AUTH_FAIL, &office_ap, &r);
+    WM_CHECK(r.scanned);
+    vTaskDelay(pdMS_TO_TICKS(CONFIG_WIFIMGR_BLACKLIST_SHORT_TIME * 1000 + 500));
+    kick(WIFI_REASON_BEACON_TIMEOUT, &office_ap, &r);
+
+    WM_CHECK_EQ(wm_deinit_wifi_manager(), ESP_OK);
+    return WM_TEST_RESULT();
+}
@@ -0,0 +1,125 @@
+/*
+ * SPDX-FileCopyrightText: 2024 Rossen Dobrinov
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/**
+ * STA DNS servers race on the host port against local stand-in servers with
+ * different answer delays: servers are reordered fastest first after GOT_IP,
+ * periodic race from timer keeps configured secondary server when all three
+ * netif slots are in use - it takes FALLBACK slot. Deinit during race returns
+ * after race task is done with manager queue.
+*/
+
+#include <string.h>
+#include <arpa/inet.h>
+#include "idf_wifi_manager.h"
+#include "wm_dns_probe.h"
+#include "wm_port.h"
+#include "wm_sim.h"
+#include "wm_test.h"
+#include "wm_test_net.h"
+
+#define WAIT_MS     10000
+
+static const wm_sim_ap_t home_ap = {
+    .ssid = "home",
+    .password = "password1",
+    .bssid = { 0x02, 0x00, 0x00, 0x00, 0x00, 0x01 },
+    .channel = 6,
+    .rssi = -50,
+    .authmode = WIFI_AUTH_WPA2_PSK,
+};
+
+/* Answer delays - secondary server is second fastest */
+static const uint32_t dns_delay_ms[4] = { 150, 5, 20, 60 };
+static wm_test_dns_server_t dns_srv[4];
+static uint32_t dns_ip[4];
+
+static volatile int ranked;
+static wm_dns_health_t health;
+static esp_netif_t *volatile sta_netif;
+
+static void wm_event_cb(void *arg, esp_event_base_t event_base, int32_t id, void *data) {
+    (void)arg;
+    (void)event_base;
+    if(id == WM_EVENT_DNS_RANKED) {
+        health = *(wm_dns_health_t *)data;
+        ranked++;
+    }
+}
+
+static void ip_event_cb(void *arg, esp_event_base_t event_base, int32_t id, void *data) {
+    (void)arg;
+    (void)event_base;
+    if(id == IP_EVENT_STA_GOT_IP) sta_netif = ((ip_event_got_ip_t *)data)->esp_netif;
+}
+
+static bool wait_ranked(int value) {
+    for(int i=0; (i < WAIT_MS / 10) && (ranked < value); i++) vTaskDelay(pdMS_TO_TICKS(10));
+    return (ranked >= value);
+}
+
+static uint32_t netif_dns(esp_netif_dns_type_t type) {
+    esp_netif_dns_info_t dns = { 0 };
+    esp_netif_get_dns_info(sta_netif, type, &dns);
+    return dns.ip.u_addr.ip4.addr;
+}
+
+static void netif_dns_set(esp_netif_dns_type_t type, uint32_t ip) {
+    esp_netif_dns_info_t dns = { .ip = { .u_addr.ip4.addr = ip, .type = ESP_IPADDR_TYPE_V4 } };
+    esp_netif_set_dns_info(sta_netif, type, &dns);
+}
+
+/* Race result and netif slots in order server 1, 3 and 0 */
+static void check_order(void) {
+    WM_CHECK_EQ(health.count, 3);
+    WM_CHECK_EQ(health.server[0].addr, dns_ip[1]);
+    WM_CHECK_EQ(health.server[1].addr, dns_ip[3]);
+    WM_CHECK_EQ(health.server[2].addr, dns_ip[0]);
+    WM_CHECK(health.rtt_ms[0] < health.rtt_ms[1]);
+    WM_CHECK(health.rtt_ms[1] < health.rtt_ms[2]);
+    WM_CHECK_EQ(netif_dns(ESP_NETIF_DNS_MAIN), dns_ip[1]);
+    WM_CHECK_EQ(netif_dns(ESP_NETIF_DNS_BACKUP), dns_ip[3]);
+    WM_CHECK_EQ(netif_dns(ESP_NETIF_DNS_FALLBACK), dns_ip[0]);
+}
+
+int main(void) {
+    for(int i=0; i<4; i++) {
+        dns_ip[i] = htonl(0x7F000001UL + i);
+        WM_CHECK_EQ(wm_test_dns_start(&dns_srv[i], dns_ip[i], WM_DNS_PORT, dns_delay_ms[i]), 0);
+    }
+    wm_sim_reset();
+    wm_sim_timing(5, 5, 5);
+    wm_sim_add_ap(&home_ap);
+    wm_sim_dhcp_dns(dns_ip[0], dns_ip[1]);
+    WM_CHECK_EQ(wm_init_wifi_manager(NULL, NULL), ESP_OK);
+    WM_CHECK_EQ(esp_event_handler_instance_register(WM_EVENT, ESP_EVENT_ANY_ID, wm_event_cb, NULL, NULL), ESP_OK);
+    WM_CHECK_EQ(esp_event_handler_instance_register(IP_EVENT, IP_EVENT_STA_GOT_IP, ip_event_cb, NULL, NULL), ESP_OK);
+    wm_set_secondary_dns((esp_ip4_addr_t){ .addr = dns_ip[3] });
+    WM_CHECK_EQ(wm_add_known_network("home", "password1"), ESP_OK);
+
+    /* Race after GOT_IP - DHCP servers and secondary */
+    WM_CHECK(wait_ranked(1));
+    WM_CHECK(sta_netif != NULL);
+    check_order();
+
+    /* All slots in use before periodic race - secondary replaces FALLBACK */
+    netif_dns_set(ESP_NETIF_DNS_MAIN, dns_ip[0]);
+    netif_dns_set(ESP_NETIF_DNS_BACKUP, dns_ip[1]);
+    netif_dns_set(ESP_NETIF_DNS_FALLBACK, dns_ip[2]);
+    int queries = dns_srv[2].queries;
+    WM_CHECK(wait_ranked(2));
+    check_order();
+    WM_CHECK_EQ(dns_srv[2].queries, queries);
+
+    /* Deinit while race waits for slow server - manager exits after race result */
+    queries = dns_srv[0].queries;
+    for(int i=0; (i < WAIT_MS) && (dns_srv[0].queries == queries); i++) vTaskDelay(pdMS_TO_TICKS(1));
+    WM_CHECK(dns_srv[0].queries != queries);
+    WM_CHECK_EQ(wm_deinit_wifi_manager(), ESP_OK);
+    WM_CHECK_EQ(wm_port_queues_alive(), 0);
+    for(int i=0; i<4; i++) wm_test_dns_stop(&dns_srv[i]);
+    return WM_TEST_RESULT();
+}
@@ -0,0 +1,161 @@
+/*
+ * SPDX-FileCopyrightText: 2024 Rossen Dobrinov
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/**
+ * Footprint benchmark on the host port: init, scan, known network command and
+ * connect cycle must be measured within Kconfig budgets while another task
+ * keeps allocating and freeing a large block - heap of other tasks is not
+ * attributed to manager. Failed init must not count or leave init open.
+ * Known network nodes taken from heap when node pool is exhausted by replace
+ * all bulk update are counted as manager heap.
+*/
+
+#include <string.h>
+#include "idf_wifi_manager.h"
+#include "wm_port.h"
+#include "wm_sim.h"
+#include "wm_test.h"
+
+#define WAIT_MS     10000
+#define NOISE_SIZE  (64 * 1024)
+
+static const wm_sim_ap_t home_ap = {
+    .ssid = "home",
+    .password = "password1",
+    .bssid = { 0x02, 0x00, 0x00, 0x00, 0x00, 0x01 },
+    .channel = 6,
+    .rssi = -50,
+    .authmode = WIFI_AUTH_WPA2_PSK,
+};
+
+static volatile bool noise_run;
+static volatile int over_events;
+
+/* Foreign heap use - free heap drop seen by every operation */
+static void vNoiseTask(void *arg) {
+    (void)arg;
+    while(noise_run) {
+        void *block = malloc(NOISE_SIZE);
+        vTaskDelay(pdMS_TO_TICKS(2));
+        free(block);
+        vTaskDelay(pdMS_TO_TICKS(1));
+    }
+    vTaskDelete(NULL);
+}
+
+static void wm_event_cb(void *arg, esp_event_base_t event_base, int32_t id, void *data) {
+    (void)arg;
+    (void)event_base;
+    (void)data;
+    if(id == WM_EVENT_FOOTPRINT_OVER) over_events++;
+}
+
+static bool wait_op(wm_fp_op_t op, uint32_t count) {
+    wm_footprint_t fp;
+    for(int i=0; i<WAIT_MS / 10; i++) {
+        wm_get_footprint(&fp);
+        if(fp.op[op].count >= count) return true;
+        vTaskDelay(pdMS_TO_TICKS(10));
+    }
+    return false;
+}
+
+static bool wait_connects(uint32_t count) {
+    wm_sim_stats_t stats;
+    for(int i=0; i<WAIT_MS / 10; i++) {
+        wm_sim_get_stats(&stats);
+        if(stats.connects >= count) return true;
+        vTaskDelay(pdMS_TO_TICKS(10));
+    }
+    return false;
+}
+
+/* Replace all known networks, returns heap used by bulk command */
+static uint32_t bulk_replace(const char *prefix, bool keep_home) {
+    wm_kn_bulk_entry_t entries[CONFIG_WIFIMGR_MAX_KNOWN_NETWORKS];
+    memset(entries, 0, sizeof(entries));
+    for(int i=0; i<CONFIG_WIFIMGR_MAX_KNOWN_NETWORKS; i++) {
+        entries[i].op = WM_KN_OP_ADD;
+        snprintf(entries[i].net_config.ssid, sizeof(entries[i].net_config.ssid), "%s%d", prefix, i);
+        strcpy(entries[i].net_config.password, "password1");
+    }
+    if(keep_home) strcpy(entries[0].net_config.ssid, "home");
+    wm_footprint_t fp;
+    wm_get_footprint(&fp);
+    uint32_t count = fp.op[WM_FP_KN].count;
+    WM_CHECK_EQ(wm_bulk_known_networks(entries, CONFIG_WIFIMGR_MAX_KNOWN_NETWORKS, true), ESP_OK);
+    WM_CHECK(wait_op(WM_FP_KN, count + 1));
+    wm_get_footprint(&fp);
+    return fp.op[WM_FP_KN].heap_last;
+}
+
+static void check_budgets(const wm_footprint_t *fp) {
+    for(int i=0; i<WM_FP_OP_MAX; i++) {
+        printf("op %d: count %u last %u peak %u budget %u\n", i, (unsigned)fp->op[i].count,
+            (unsigned)fp->op[i].heap_last, (unsigned)fp->op[i].heap_peak, (unsigned)fp->op[i].heap_budget);
+        WM_CHECK(fp->op[i].count > 0);
+        WM_CHECK_EQ(fp->op[i].over_budget, 0);
+        WM_CHECK(fp->op[i].heap_peak < NOISE_SIZE);
+        WM_CHECK(!fp->op[i].heap_budget || (fp->op[i].heap_peak <= fp->op[i].heap_budget));
+    }
+    WM_CHECK(!fp->mgr_stack_free || (fp->mgr_stack_free >= fp->stack_budget));
+    WM_CHECK(!fp->scan_stack_free || (fp->scan_stack_free >= fp->stack_budget));
+}
+
+int main(void) {
+    wm_sim_reset();
+    wm_sim_timing(20, 5, 5);
+    wm_sim_add_ap(&home_ap);
+    noise_run = true;
+    WM_CHECK_EQ(xTaskCreate(vNoiseTask, "noise", 4096, NULL, 5, NULL), pdPASS);
+
+    WM_CHECK_EQ(wm_init_wifi_manager(NULL, NULL), ESP_OK);
+    WM_CHECK_EQ(esp_event_handler_instance_register(WM_EVENT, ESP_EVENT_ANY_ID, wm_event_cb, NULL, NULL), ESP_OK);
+    wm_footprint_t fp;
+    wm_get_footprint(&fp);
+    WM_CHECK_EQ(fp.op[WM_FP_INIT].count, 1);
+    /* Running configuration alone */
+    WM_CHECK(fp.op[WM_FP_INIT].heap_last > 0);
+    /* STA start connect attempt without network fails - give up must not land inside measured scan */
+    WM_CHECK(wait_connects(1));
+    WM_CHECK(wm_sim_idle(WAIT_MS));
+    WM_CHECK(wm_port_events_idle(WAIT_MS));
+
+    WM_CHECK_EQ(wm_scan_now(), ESP_OK);
+    WM_CHECK(wait_op(WM_FP_SCAN, 1));
+    WM_CHECK_EQ(wm_add_known_network("home", "password1"), ESP_OK);
+    WM_CHECK(wait_op(WM_FP_KN, 1));
+    WM_CHECK(wait_op(WM_FP_CONNECT, 1));
+    wm_get_footprint(&fp);
+    check_budgets(&fp);
+    WM_CHECK(fp.op[WM_FP_SCAN].heap_peak > 0);
+    WM_CHECK(fp.op[WM_FP_KN].heap_peak > 0);
+    WM_CHECK(wm_port_events_idle(WAIT_MS));
+    WM_CHECK_EQ(over_events, 0);
+
+    /* New list beside one known network fits node pool, beside full list it does not */
+    uint32_t in_pool = bulk_replace("a", true);
+    uint32_t over_pool = bulk_replace("b", false);
+    printf("bulk replace: pool %u, pool and heap %u\n", (unsigned)in_pool, (unsigned)over_pool);
+    WM_CHECK(over_pool >= in_pool + (CONFIG_WIFIMGR_MAX_KNOWN_NETWORKS - 1) * sizeof(wm_net_base_config_t));
+    WM_CHECK(wm_port_events_idle(WAIT_MS));
+    WM_CHECK_EQ(wm_deinit_wifi_manager(), ESP_OK);
+
+    /* Failed init is not measured and next init starts clean */
+    WM_CHECK(wm_sim_idle(WAIT_MS));
+    wm_port_task_fail("wscan");
+    WM_CHECK_EQ(wm_init_wifi_manager(NULL, NULL), ESP_ERR_NO_MEM);
+    wm_port_task_fail("wmgr");
+    WM_CHECK_EQ(wm_init_wifi_manager(NULL, NULL), ESP_ERR_NO_MEM);
+    WM_CHECK_EQ(wm_init_wifi_manager(NULL, NULL), ESP_OK);
+    wm_get_footprint(&fp);
+    WM_CHECK_EQ(fp.op[WM_FP_INIT].count, 2);
+    WM_CHECK_EQ(fp.op[WM_FP_INIT].over_budget, 0);
+    WM_CHECK_EQ(wm_deinit_wifi_manager(), ESP_OK);
+
+    noise_run = false;
+    return WM_TEST_RESULT();
+}
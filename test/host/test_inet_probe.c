@@ -0,0 +1,132 @@
+/*
+ * SPDX-FileCopyrightText: 2024 Rossen Dobrinov
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/**
+ * Internet reachability probe against local stand-in HTTP servers: expected
+ * status, captive portal redirect, split status line, garbage, closed port,
+ * silent server and unresolvable host.
+*/
+
+#include <string.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include "wm_inet_probe.h"
+#include "wm_test.h"
+#include "wm_test_net.h"
+
+#define PROBE_TIMEOUT_MS    300
+
+/**
+ * @brief Type of stand-in server behaviour
+*/
+typedef struct http_stub {
+    const char *reply;      /*!< Raw reply, NULL keeps connection silent    */
+    int split;              /*!< Send reply in single bytes                 */
+    char request[256];      /*!< Last request head                          */
+} http_stub_t;
+
+static void http_stub_conn(int fd, void *arg) {
+    http_stub_t *stub = (http_stub_t *)arg;
+    if(wm_test_read_head(fd, stub->request, sizeof(stub->request)) < 0) return;
+    if(!stub->reply) {
+        usleep((PROBE_TIMEOUT_MS + 200) * 1000);
+        return;
+    }
+    size_t len = strlen(stub->reply);
+    if(stub->split) {
+        for(size_t i=0; i<len; i++) {
+            send(fd, &stub->reply[i], 1, 0);
+            usleep(1000);
+        }
+    } else {
+        send(fd, stub->reply, len, 0);
+    }
+}
+
+static void probe_stub(http_stub_t *stub, wm_inet_probe_result_t *result) {
+    wm_test_server_t srv;
+    memset(result, 0, sizeof(wm_inet_probe_result_t));
+    WM_CHECK_EQ(wm_test_server_start(&srv, http_stub_conn, stub), 0);
+    wm_inet_probe("127.0.0.1", srv.port, "/generate_204", 204, PROBE_TIMEOUT_MS, result);
+    wm_test_server_stop(&srv);
+}
+
+static void test_parse_status(void) {
+    uint16_t status = 0;
+    WM_CHECK(wm_inet_parse_status("HTTP/1.1 204 No Content", 23, &status));
+    WM_CHECK_EQ(status, 204);
+    WM_CHECK(wm_inet_parse_status("HTTP/1.0 302 ", 13, &status));
+    WM_CHECK_EQ(status, 302);
+    WM_CHECK(!wm_inet_parse_status("HTTP/1.1 20", 11, &status));
+    WM_CHECK(!wm_inet_parse_status("SSH-2.0-OpenSSH_9.6", 19, &status));
+    WM_CHECK(!wm_inet_parse_status("HTTP/1.1 999 Bad", 16, &status));
+}
+
+static void test_expected_status(void) {
+    http_stub_t stub = { .reply = "HTTP/1.1 204 No Content\r\nContent-Length: 0\r\n\r\n" };
+    wm_inet_probe_result_t result;
+    probe_stub(&stub, &result);
+    WM_CHECK_EQ(result.status, WM_INET_OK);
+    WM_CHECK_EQ(result.http_status, 204);
+    WM_CHECK(strncmp(stub.request, "GET /generate_204 HTTP/1.1\r\nHost: 127.0.0.1\r\n", 45) == 0);
+    WM_CHECK(result.http_ms < PROBE_TIMEOUT_MS);
+}
+
+static void test_captive_redirect(void) {
+    http_stub_t stub = { .reply = "HTTP/1.1 302 Found\r\nLocation: http://login.portal/\r\n\r\n" };
+    wm_inet_probe_result_t result;
+    probe_stub(&stub, &result);
+    WM_CHECK_EQ(result.status, WM_INET_CAPTIVE);
+    WM_CHECK_EQ(result.http_status, 302);
+}
+
+static void test_split_status_line(void) {
+    http_stub_t stub = { .reply = "HTTP/1.1 204 No Content\r\n\r\n", .split = 1 };
+    wm_inet_probe_result_t result;
+    probe_stub(&stub, &result);
+    WM_CHECK_EQ(result.status, WM_INET_OK);
+}
+
+static void test_not_http(void) {
+    http_stub_t stub = { .reply = "SSH-2.0-OpenSSH_9.6\r\n" };
+    wm_inet_probe_result_t result;
+    probe_stub(&stub, &result);
+    WM_CHECK_EQ(result.status, WM_INET_HTTP_FAIL);
+}
+
+static void test_silent_server(void) {
+    http_stub_t stub = { .reply = NULL };
+    wm_inet_probe_result_t result;
+    probe_stub(&stub, &result);
+    WM_CHECK_EQ(result.status, WM_INET_HTTP_FAIL);
+}
+
+static void test_closed_port(void) {
+    wm_inet_probe_result_t result;
+    wm_inet_probe("127.0.0.1", wm_test_closed_port(), "/", 204, PROBE_TIMEOUT_MS, &result);
+    WM_CHECK_EQ(result.status, WM_INET_CONNECT_FAIL);
+}
+
+static void test_dns_fail(void) {
+    wm_inet_probe_result_t result;
+    wm_inet_probe("", 80, "/", 204, PROBE_TIMEOUT_MS, &result);
+    WM_CHECK_EQ(result.status, WM_INET_DNS_FAIL);
+}
+
+int main(void) {
+    /* Stand-in server may write after probe closed connection */
+    signal(SIGPIPE, SIG_IGN);
+    test_parse_status();
+    test_expected_status();
+    test_captive_redirect();
+    test_split_status_line();
+    test_not_http();
+    test_silent_server();
+    test_closed_port();
+    test_dns_fail();
+    return WM_TEST_RESULT();
+}
@@ -0,0 +1,125 @@
+/*
+ * SPDX-FileCopyrightText: 2024 Rossen Dobrinov
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/**
+ * Manager lifecycle on the host port: repeated init, connect, suspend, resume
+ * and deinit cycles must return heap blocks, tasks, timers and queues to the
+ * level before first cycle. Failed scan or manager task creation must unwind
+ * init completely.
+*/
+
+#include <string.h>
+#include "idf_wifi_manager.h"
+#include "wm_port.h"
+#include "wm_sim.h"
+#include "wm_test.h"
+
+#define CYCLES          50
+#define CONNECT_CYCLES  10
+#define WAIT_MS         10000
+
+/**
+ * @brief Port object counts compared between cycles
+*/
+typedef struct {
+    wm_port_heap_t heap;
+    int tasks;
+    int timers;
+    int queues;
+} usage_t;
+
+static const wm_sim_ap_t home_ap = {
+    .ssid = "home",
+    .password = "password1",
+    .bssid = { 0x02, 0x00, 0x00, 0x00, 0x00, 0x01 },
+    .channel = 6,
+    .rssi = -50,
+    .authmode = WIFI_AUTH_WPA2_PSK,
+};
+
+static void settle(void) {
+    /* Driver events may still be queued after deinit */
+    WM_CHECK(wm_sim_idle(WAIT_MS));
+    WM_CHECK(wm_port_events_idle(WAIT_MS));
+    /* Scan task notifies deinit before it deletes itself */
+    for(int i=0; (i < WAIT_MS) && wm_port_tasks_alive(); i++) vTaskDelay(pdMS_TO_TICKS(1));
+}
+
+static void usage_get(usage_t *usage) {
+    settle();
+    usage->tasks = wm_port_tasks_alive();
+    usage->timers = wm_port_timers_alive();
+    usage->queues = wm_port_queues_alive();
+    wm_port_heap_get(&usage->heap);
+}
+
+static void usage_check(const usage_t *base, const char *what) {
+    usage_t now;
+    usage_get(&now);
+    if((now.heap.live_blocks != base->heap.live_blocks) || (now.heap.live_bytes != base->heap.live_bytes)) {
+        fprintf(stderr, "%s: heap %zu blocks %zu bytes, baseline %zu blocks %zu bytes\n", what,
+            now.heap.live_blocks, now.heap.live_bytes, base->heap.live_blocks, base->heap.live_bytes);
+    }
+    WM_CHECK_EQ(now.heap.live_blocks, base->heap.live_blocks);
+    WM_CHECK_EQ(now.heap.live_bytes, base->heap.live_bytes);
+    WM_CHECK_EQ(now.tasks, base->tasks);
+    WM_CHECK_EQ(now.timers, base->timers);
+    WM_CHECK_EQ(now.queues, base->queues);
+    wm_sim_stats_t stats;
+    wm_sim_get_stats(&stats);
+    WM_CHECK(!stats.inited);
+}
+
+/* Softap stops once STA is connected and validated */
+static bool wait_sta_mode(void) {
+    for(int i=0; i<WAIT_MS / 10; i++) {
+        wm_sim_stats_t stats;
+        wm_sim_get_stats(&stats);
+        if(stats.linked && (stats.mode == WIFI_MODE_STA)) return true;
+        vTaskDelay(pdMS_TO_TICKS(10));
+    }
+    return false;
+}
+
+static void cycle(bool connect) {
+    WM_CHECK_EQ(wm_init_wifi_manager(NULL, NULL), ESP_OK);
+    WM_CHECK_EQ(wm_add_known_network("home", "password1"), ESP_OK);
+    if(connect) WM_CHECK(wait_sta_mode());
+    WM_CHECK_EQ(wm_suspend_wifi_manager(), ESP_OK);
+    WM_CHECK_EQ(wm_resume_wifi_manager(), ESP_OK);
+    if(connect) WM_CHECK(wait_sta_mode());
+    WM_CHECK_EQ(wm_deinit_wifi_manager(), ESP_OK);
+}
+
+static void test_cycles(void) {
+    /* First cycle creates default event loop and port services */
+    cycle(true);
+    usage_t base;
+    usage_get(&base);
+    for(int i=0; i<CYCLES; i++) cycle(i < CONNECT_CYCLES);
+    usage_check(&base, "cycles");
+}
+
+static void test_task_fail(const char *name) {
+    usage_t base;
+    usage_get(&base);
+    wm_port_task_fail(name);
+    WM_CHECK_EQ(wm_init_wifi_manager(NULL, NULL), ESP_ERR_NO_MEM);
+    usage_check(&base, name);
+    /* Nothing left behind - next init works */
+    cycle(false);
+    usage_check(&base, name);
+}
+
+int main(void) {
+    wm_sim_reset();
+    wm_sim_timing(5, 5, 5);
+    wm_sim_add_ap(&home_ap);
+    test_cycles();
+    test_task_fail("wscan");
+    test_task_fail("wmgr");
+    return WM_TEST_RESULT();
+}
@@ -0,0 +1,91 @@
+/*
+ * SPDX-FileCopyrightText: 2024 Rossen Dobrinov
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/**
+ * Link monitor and adaptive TX power on the host port: strong link walks max
+ * TX power down to the floor, the sample that degrades the link restores full
+ * power before WM_EVENT_LINK_DEGRADED is posted, recovered link walks down
+ * again. Built without RSSI smoothing - single sample crosses the threshold.
+*/
+
+#include <string.h>
+#include "idf_wifi_manager.h"
+#include "wm_port.h"
+#include "wm_sim.h"
+#include "wm_test.h"
+
+#define WAIT_MS     10000
+#define TXP_FULL    80      /* BG plan 20 dBm */
+#define TXP_FLOOR   (CONFIG_WIFIMGR_TXP_MIN * 4)
+
+static const wm_sim_ap_t home_ap = {
+    .ssid = "home",
+    .password = "password1",
+    .bssid = { 0x02, 0x00, 0x00, 0x00, 0x00, 0x01 },
+    .channel = 6,
+    .rssi = -40,
+    .authmode = WIFI_AUTH_WPA2_PSK,
+};
+
+static volatile int degraded, recovered;
+static volatile int8_t degraded_txp;
+
+static void wm_event_cb(void *arg, esp_event_base_t event_base, int32_t id, void *data) {
+    (void)arg;
+    (void)event_base;
+    if(id == WM_EVENT_LINK_DEGRADED) {
+        degraded_txp = ((wm_link_quality_t *)data)->tx_power;
+        degraded++;
+    } else if(id == WM_EVENT_LINK_RECOVERED) recovered++;
+}
+
+static bool wait_txp(int8_t txp) {
+    for(int i=0; i<WAIT_MS / 10; i++) {
+        wm_sim_stats_t stats;
+        wm_sim_get_stats(&stats);
+        if(stats.linked && (stats.max_tx_power == txp)) return true;
+        vTaskDelay(pdMS_TO_TICKS(10));
+    }
+    return false;
+}
+
+static bool wait_count(volatile int *count, int value) {
+    for(int i=0; (i < WAIT_MS / 10) && (*count != value); i++) vTaskDelay(pdMS_TO_TICKS(10));
+    return (*count == value);
+}
+
+int main(void) {
+    wm_sim_reset();
+    wm_sim_timing(5, 5, 5);
+    wm_sim_add_ap(&home_ap);
+    WM_CHECK_EQ(wm_init_wifi_manager(NULL, NULL), ESP_OK);
+    WM_CHECK_EQ(esp_event_handler_instance_register(WM_EVENT, ESP_EVENT_ANY_ID, wm_event_cb, NULL, NULL), ESP_OK);
+    WM_CHECK_EQ(wm_add_known_network("home", "password1"), ESP_OK);
+
+    /* Strong link keeps margin down to power floor */
+    WM_CHECK(wait_txp(TXP_FLOOR));
+    wm_link_quality_t link;
+    wm_get_link_quality(&link);
+    WM_CHECK(link.samples > 0);
+    WM_CHECK_EQ(link.rssi, -40);
+    WM_CHECK_EQ(link.degraded, 0);
+
+    /* Degrading sample raises power to full in same step */
+    wm_sim_set_rssi(home_ap.bssid, -90);
+    WM_CHECK(wait_count(&degraded, 1));
+    WM_CHECK_EQ(degraded_txp, TXP_FULL);
+    wm_sim_stats_t stats;
+    wm_sim_get_stats(&stats);
+    WM_CHECK_EQ(stats.max_tx_power, TXP_FULL);
+
+    wm_sim_set_rssi(home_ap.bssid, -40);
+    WM_CHECK(wait_count(&recovered, 1));
+    WM_CHECK(wait_txp(TXP_FLOOR));
+    WM_CHECK_EQ(degraded, 1);
+
+    WM_CHECK_EQ(wm_deinit_wifi_manager(), ESP_OK);
+    return WM_TEST_RESULT();
+}
@@ -0,0 +1,153 @@
+/*
+ * SPDX-FileCopyrightText: 2024 Rossen Dobrinov
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/**
+ * Known network node pool: many add, replace and delete cycles must not touch
+ * heap, exhausted pool falls back to heap and heap items go back to heap.
+ * Heap calls are counted through linker wrapped calloc and free. Replaced heap
+ * functions get all heap items, default heap none.
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include "wm_pool.h"
+#include "wm_test.h"
+
+#define MAX_NETS    5           /*!< Known networks limit, pool holds one spare */
+#define CYCLES      100000
+
+/**
+ * @brief Type of stand-in known network node, same shape as manager node
+*/
+typedef struct kn_node {
+    char ssid[33];
+    char password[65];
+    uint32_t net_config_id;
+    struct kn_node *next;
+} kn_node_t;
+
+void *__real_calloc(size_t nmemb, size_t size);
+void __real_free(void *ptr);
+
+static size_t heap_allocs, heap_frees;
+static size_t owner_allocs, owner_frees;
+
+void *__wrap_calloc(size_t nmemb, size_t size) {
+    heap_allocs++;
+    return __real_calloc(nmemb, size);
+}
+
+void __wrap_free(void *ptr) {
+    if(ptr) heap_frees++;
+    __real_free(ptr);
+}
+
+/* Owner heap functions - manager accounting */
+static void *owner_calloc(size_t nmemb, size_t size) {
+    owner_allocs++;
+    return calloc(nmemb, size);
+}
+
+static void owner_free(void *ptr) {
+    if(ptr) owner_frees++;
+    free(ptr);
+}
+
+static void test_init(void) {
+    kn_node_t storage[MAX_NETS + 1];
+    wm_pool_t pool;
+    wm_pool_init(&pool, storage, sizeof(kn_node_t), MAX_NETS + 1);
+    WM_CHECK_EQ(pool.available, MAX_NETS + 1);
+    kn_node_t *first = (kn_node_t *)wm_pool_alloc(&pool);
+    WM_CHECK(first == &storage[0]);
+    WM_CHECK(wm_pool_owns(&pool, first));
+    WM_CHECK(!wm_pool_owns(&pool, &storage[MAX_NETS + 1]));
+    wm_pool_free(&pool, first);
+    wm_pool_free(&pool, NULL);
+    WM_CHECK_EQ(pool.available, MAX_NETS + 1);
+}
+
+static void test_steady_state_no_heap(void) {
+    static kn_node_t storage[MAX_NETS + 1];
+    kn_node_t *list[MAX_NETS] = { 0 };
+    wm_pool_t pool;
+    wm_pool_init(&pool, storage, sizeof(kn_node_t), MAX_NETS + 1);
+    size_t allocs = heap_allocs, frees = heap_frees;
+    unsigned int seed = 1;
+    for(int i=0; i<CYCLES; i++) {
+        int slot = rand_r(&seed) % MAX_NETS;
+        if(!list[slot]) {
+            /* Add */
+            list[slot] = (kn_node_t *)wm_pool_alloc(&pool);
+        } else if(rand_r(&seed) & 1) {
+            /* Replace in place - new node taken before old is released */
+            kn_node_t *node = (kn_node_t *)wm_pool_alloc(&pool);
+            WM_CHECK(node && (node->ssid[0] == 0) && (node->net_config_id == 0));
+            wm_pool_free(&pool, list[slot]);
+            list[slot] = node;
+        } else {
+            /* Delete */
+            wm_pool_free(&pool, list[slot]);
+            list[slot] = NULL;
+        }
+        if(list[slot]) {
+            WM_CHECK(wm_pool_owns(&pool, list[slot]));
+            memset(list[slot]->ssid, 'A', sizeof(list[slot]->ssid) - 1);
+            list[slot]->net_config_id = i + 1;
+        }
+    }
+    WM_CHECK_EQ(heap_allocs - allocs, 0);
+    WM_CHECK_EQ(heap_frees - frees, 0);
+    for(int i=0; i<MAX_NETS; i++) wm_pool_free(&pool, list[i]);
+    WM_CHECK_EQ(pool.available, MAX_NETS + 1);
+}
+
+static void test_exhausted_heap_fallback(void) {
+    kn_node_t storage[MAX_NETS + 1];
+    kn_node_t *nodes[MAX_NETS + 3];
+    wm_pool_t pool;
+    wm_pool_init(&pool, storage, sizeof(kn_node_t), MAX_NETS + 1);
+    size_t allocs = heap_allocs, frees = heap_frees;
+    /* Bulk transaction needs more nodes than pool holds */
+    for(int i=0; i<MAX_NETS + 3; i++) nodes[i] = (kn_node_t *)wm_pool_alloc(&pool);
+    WM_CHECK_EQ(heap_allocs - allocs, 2);
+    WM_CHECK_EQ(pool.available, 0);
+    WM_CHECK(!wm_pool_owns(&pool, nodes[MAX_NETS + 1]));
+    WM_CHECK(!wm_pool_owns(&pool, nodes[MAX_NETS + 2]));
+    for(int i=0; i<MAX_NETS + 3; i++) wm_pool_free(&pool, nodes[i]);
+    WM_CHECK_EQ(heap_frees - frees, 2);
+    WM_CHECK_EQ(pool.available, MAX_NETS + 1);
+}
+
+static void test_owner_heap(void) {
+    kn_node_t storage[MAX_NETS + 1];
+    kn_node_t *nodes[MAX_NETS + 3];
+    wm_pool_t pool;
+    wm_pool_init(&pool, storage, sizeof(kn_node_t), MAX_NETS + 1);
+    wm_pool_set_heap(&pool, owner_calloc, owner_free);
+    size_t allocs = heap_allocs, frees = heap_frees;
+    for(int i=0; i<MAX_NETS + 3; i++) nodes[i] = (kn_node_t *)wm_pool_alloc(&pool);
+    WM_CHECK_EQ(owner_allocs, 2);
+    WM_CHECK_EQ(heap_allocs - allocs, 2);
+    for(int i=0; i<MAX_NETS + 3; i++) wm_pool_free(&pool, nodes[i]);
+    WM_CHECK_EQ(owner_frees, 2);
+    WM_CHECK_EQ(heap_frees - frees, 2);
+    /* NULL restores default heap */
+    wm_pool_set_heap(&pool, NULL, NULL);
+    for(int i=0; i<MAX_NETS + 3; i++) nodes[i] = (kn_node_t *)wm_pool_alloc(&pool);
+    for(int i=0; i<MAX_NETS + 3; i++) wm_pool_free(&pool, nodes[i]);
+    WM_CHECK_EQ(owner_allocs, 2);
+    WM_CHECK_EQ(owner_frees, 2);
+    WM_CHECK_EQ(pool.available, MAX_NETS + 1);
+}
+
+int main(void) {
+    test_init();
+    test_steady_state_no_heap();
+    test_exhausted_heap_fallback();
+    test_owner_heap();
+    return WM_TEST_RESULT();
+}
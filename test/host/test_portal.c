@@ -0,0 +1,228 @@
+/*
+ * SPDX-FileCopyrightText: 2024 Rossen Dobrinov
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/**
+ * Provisioning portal on the host port with HTTP client over loopback: page,
+ * scan JSON, captive redirect and /connect form validation. /connect must
+ * answer while manager task is busy - handlers never wait for manager task
+ * which stops the server. Page polling by softAP client is client activity and
+ * holds off-channel scan slices. Accepted 64 hex digits PSK connects STA and
+ * softAP stop stops the portal.
+*/
+
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include "idf_wifi_manager.h"
+#include "freertos/semphr.h"
+#include "wm_port.h"
+#include "wm_sim.h"
+#include "wm_test.h"
+
+#define WAIT_MS     10000
+#define RESP_MAX    8192
+#define PSK_HEX     "00112233445566778899aabbccddeeff00112233445566778899aabbccddeeff"
+
+/* Page compressed by tools/gzip_asset.cmake, symbols as in component build */
+__asm__(".section .rodata\n"
+    ".global _binary_index_html_gz_start\n_binary_index_html_gz_start:\n"
+    ".incbin \"" WM_PORTAL_GZ "\"\n"
+    ".global _binary_index_html_gz_end\n_binary_index_html_gz_end:\n"
+    ".previous\n");
+
+static const wm_sim_ap_t home_ap = {
+    .ssid = "home",
+    .password = PSK_HEX,
+    .bssid = { 0x02, 0x00, 0x00, 0x00, 0x00, 0x01 },
+    .channel = 6,
+    .rssi = -50,
+    .authmode = WIFI_AUTH_WPA2_PSK,
+};
+
+static const uint8_t client_mac[6] = { 0x02, 0x00, 0x00, 0x00, 0x01, 0x01 };
+
+static char resp[RESP_MAX];
+static size_t resp_len;
+static SemaphoreHandle_t mgr_release;
+static volatile bool mgr_released;
+static volatile int ap_clients;
+
+static void wm_event_cb(void *arg, esp_event_base_t event_base, int32_t id, void *data) {
+    (void)arg;
+    (void)event_base;
+    (void)data;
+    if(id == WM_EVENT_AP_STA_CONNECTED) ap_clients++;
+}
+
+/* Send request and read whole response. Returns HTTP status, -1 on error */
+static int http(const char *method, const char *uri, const char *body) {
+    resp_len = 0;
+    uint16_t port = wm_port_httpd_port();
+    if(!port) return -1;
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in addr = { .sin_family = AF_INET, .sin_port = htons(port), .sin_addr.s_addr = htonl(INADDR_LOOPBACK) };
+    struct timeval tv = { .tv_sec = 5 };
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    if(connect(fd, (struct sockaddr *)&addr, sizeof(addr))) {
+        close(fd);
+        return -1;
+    }
+    char req[512];
+    int n = snprintf(req, sizeof(req), "%s %s HTTP/1.1\r\nHost: 192.168.4.1\r\nContent-Length: %zu\r\n\r\n%s",
+        method, uri, (body) ? strlen(body) : 0, (body) ? body : "");
+    send(fd, req, n, MSG_NOSIGNAL);
+    ssize_t got;
+    while((resp_len < sizeof(resp) - 1) && ((got = recv(fd, resp + resp_len, sizeof(resp) - 1 - resp_len, 0)) > 0)) resp_len += got;
+    resp[resp_len] = 0;
+    close(fd);
+    int status = -1;
+    return (1 == sscanf(resp, "HTTP/1.1 %d", &status)) ? status : -1;
+}
+
+static const char *resp_body(void) {
+    char *body = strstr(resp, "\r\n\r\n");
+    return (body) ? body + 4 : "";
+}
+
+/* Scan request and portal form only queue commands */
+static bool wait_scanned(const char *ssid) {
+    wm_scan_filter_t filter = { .ssid = ssid };
+    wm_scan_entry_t entry;
+    for(int i=0; (i < WAIT_MS / 10) && !wm_get_scan_results(&filter, &entry, 1); i++) vTaskDelay(pdMS_TO_TICKS(10));
+    return wm_get_scan_results(&filter, &entry, 1);
+}
+
+static wm_known_net_config_t *wait_known(size_t *count) {
+    wm_known_net_config_t *kn = NULL;
+    for(int i=0; i < WAIT_MS / 10; i++) {
+        kn = wm_get_known_networks(count);
+        if(*count) break;
+        free(kn);
+        kn = NULL;
+        vTaskDelay(pdMS_TO_TICKS(10));
+    }
+    return kn;
+}
+
+static bool wait_portal(bool running) {
+    for(int i=0; (i < WAIT_MS / 10) && ((wm_port_httpd_port() != 0) != running); i++) vTaskDelay(pdMS_TO_TICKS(10));
+    return ((wm_port_httpd_port() != 0) == running);
+}
+
+/* Completion callback holding manager task until released */
+static void mgr_hold(const wm_cmd_t *cmd, esp_err_t result, void *arg) {
+    (void)cmd;
+    (void)result;
+    (void)arg;
+    xSemaphoreTake(mgr_release, portMAX_DELAY);
+    mgr_released = true;
+}
+
+static void test_pages(void) {
+    WM_CHECK_EQ(http("GET", "/", NULL), 200);
+    WM_CHECK(strstr(resp, "Content-Encoding: gzip"));
+    const uint8_t *page = (const uint8_t *)resp_body();
+    WM_CHECK((page[0] == 0x1F) && (page[1] == 0x8B));
+
+    WM_CHECK_EQ(http("GET", "/scan?t=1", NULL), 200);
+    WM_CHECK(strstr(resp_body(), "\"ssid\":\"home\""));
+
+    WM_CHECK_EQ(http("GET", "/generate_204", NULL), 302);
+    WM_CHECK(strstr(resp, "Location: http://192.168.4.1/"));
+}
+
+static void test_connect_rejected(void) {
+    WM_CHECK_EQ(http("POST", "/connect", "ssid=home&password=short"), 400);
+    WM_CHECK_EQ(http("POST", "/connect", "ssid=h&password=password1"), 400);
+    /* 64 characters must be hex PSK */
+    char body[128];
+    snprintf(body, sizeof(body), "ssid=office&password=%.63sz", PSK_HEX);
+    WM_CHECK_EQ(http("POST", "/connect", body), 400);
+    snprintf(body, sizeof(body), "ssid=office&password=%s0", PSK_HEX);
+    WM_CHECK_EQ(http("POST", "/connect", body), 400);
+    WM_CHECK_EQ(http("POST", "/connect", "ssid=office&password=" PSK_HEX "&hidden=1"), 200);
+    /* 64 characters PSK fills password field */
+    size_t count = 0;
+    wm_known_net_config_t *kn = wait_known(&count);
+    WM_CHECK_EQ(count, 1);
+    if(count == 1) {
+        WM_CHECK(!strcmp(kn[0].net_config.ssid, "office"));
+        WM_CHECK(!memcmp(kn[0].net_config.password, PSK_HEX, 64));
+        WM_CHECK(kn[0].net_config.hidden);
+    }
+    free(kn);
+}
+
+static uint32_t channel_scans(void) {
+    wm_sim_stats_t stats;
+    wm_sim_get_stats(&stats);
+    return stats.channel_scans;
+}
+
+static void test_active_client(void) {
+    wm_sim_ap_client(client_mac, true);
+    for(int i=0; (i < WAIT_MS / 10) && !ap_clients; i++) vTaskDelay(pdMS_TO_TICKS(10));
+    WM_CHECK_EQ(ap_clients, 1);
+    /* Client polls page faster than idle time - no off-channel slice */
+    WM_CHECK_EQ(http("GET", "/scan", NULL), 200);
+    WM_CHECK(wm_sim_idle(WAIT_MS));
+    uint32_t before = channel_scans();
+    TickType_t start = xTaskGetTickCount();
+    while((xTaskGetTickCount() - start) < pdMS_TO_TICKS(3 * CONFIG_WIFIMGR_AP_SCAN_IDLE_TIME)) {
+        WM_CHECK_EQ(http("GET", "/scan", NULL), 200);
+        vTaskDelay(pdMS_TO_TICKS(CONFIG_WIFIMGR_AP_SCAN_IDLE_TIME / 5));
+    }
+    WM_CHECK_EQ(channel_scans(), before);
+    /* Idle client - slices resume */
+    for(int i=0; (i < WAIT_MS / 10) && (channel_scans() == before); i++) vTaskDelay(pdMS_TO_TICKS(10));
+    WM_CHECK(channel_scans() > before);
+    wm_sim_ap_client(client_mac, false);
+    WM_CHECK(wm_sim_idle(WAIT_MS));
+}
+
+static void test_connect_busy(void) {
+    /* Hold manager task - /connect only queues command and answers at once */
+    mgr_release = xSemaphoreCreateBinary();
+    wm_cmd_t cmd = { .cmd_id = WM_CMD_SCAN_NOW };
+    WM_CHECK_EQ(wm_cmd_submit(&cmd, mgr_hold, NULL), ESP_OK);
+    vTaskDelay(pdMS_TO_TICKS(50));
+    TickType_t start = xTaskGetTickCount();
+    WM_CHECK_EQ(http("POST", "/connect", "ssid=home&password=" PSK_HEX), 200);
+    WM_CHECK((xTaskGetTickCount() - start) < pdMS_TO_TICKS(CONFIG_WIFIMGR_CMD_TIMEOUT / 2));
+    WM_CHECK_EQ(http("GET", "/scan", NULL), 200);
+    WM_CHECK((xTaskGetTickCount() - start) < pdMS_TO_TICKS(CONFIG_WIFIMGR_CMD_TIMEOUT / 2));
+    xSemaphoreGive(mgr_release);
+
+    /* STA connects with queued PSK, softAP stop stops portal from manager task */
+    WM_CHECK(wait_portal(false));
+    wm_sim_stats_t stats;
+    wm_sim_get_stats(&stats);
+    WM_CHECK(stats.linked);
+    /* Semaphore is still in use until callback returns */
+    for(int i=0; (i < WAIT_MS / 10) && !mgr_released; i++) vTaskDelay(pdMS_TO_TICKS(10));
+    WM_CHECK(mgr_released);
+    vSemaphoreDelete(mgr_release);
+}
+
+int main(void) {
+    wm_sim_reset();
+    wm_sim_timing(5, 5, 5);
+    wm_sim_add_ap(&home_ap);
+    WM_CHECK_EQ(wm_init_wifi_manager(NULL, NULL), ESP_OK);
+    WM_CHECK_EQ(esp_event_handler_instance_register(WM_EVENT, WM_EVENT_AP_STA_CONNECTED, wm_event_cb, NULL, NULL), ESP_OK);
+    WM_CHECK(wait_portal(true));
+    WM_CHECK_EQ(wm_scan_now(), ESP_OK);
+    WM_CHECK(wait_scanned("home"));
+    test_pages();
+    test_connect_rejected();
+    test_active_client();
+    test_connect_busy();
+    WM_CHECK_EQ(wm_deinit_wifi_manager(), ESP_OK);
+    return WM_TEST_RESULT();
+}
@@ -0,0 +1,183 @@
+/*
+ * SPDX-FileCopyrightText: 2024 Rossen Dobrinov
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/**
+ * Scan results cache and scan requests on the host port: wm_scan_now returns
+ * while manager task is busy, request without softAP stations is a broadcast
+ * scan, with stations it is served by single channel slices only, within
+ * off-channel share of radio time. Reader task
+ * queries published cache during merges and must see consistent entries.
+*/
+
+#include <string.h>
+#include "idf_wifi_manager.h"
+#include "freertos/semphr.h"
+#include "wm_port.h"
+#include "wm_sim.h"
+#include "wm_test.h"
+
+#define WAIT_MS     10000
+#define RATIO_MS    2000
+/* Saved budget is capped at one round of 2.4 GHz channels */
+#define ROUND_MS    (14 * CONFIG_WIFIMGR_AP_SCAN_DWELL)
+
+static const wm_sim_ap_t cafe_ap = {
+    .ssid = "cafe",
+    .bssid = { 0x02, 0x00, 0x00, 0x00, 0x00, 0x01 },
+    .channel = 6,
+    .rssi = -60,
+    .authmode = WIFI_AUTH_OPEN,
+};
+
+static const wm_sim_ap_t office_ap = {
+    .ssid = "office",
+    .password = "password1",
+    .bssid = { 0x02, 0x00, 0x00, 0x00, 0x00, 0x02 },
+    .channel = 11,
+    .rssi = -70,
+    .authmode = WIFI_AUTH_WPA2_PSK,
+};
+
+static const uint8_t client_mac[6] = { 0x02, 0x00, 0x00, 0x00, 0x01, 0x01 };
+
+static volatile int results, ap_clients;
+static volatile bool reading;
+static volatile int reads, bad_reads;
+static SemaphoreHandle_t mgr_release, reader_done;
+static volatile bool mgr_released;
+
+static void wm_event_cb(void *arg, esp_event_base_t event_base, int32_t id, void *data) {
+    (void)arg;
+    (void)event_base;
+    (void)data;
+    if(id == WM_EVENT_SCAN_RESULTS) results++;
+    else if(id == WM_EVENT_AP_STA_CONNECTED) ap_clients++;
+}
+
+static bool wait_count(volatile int *count, int value) {
+    for(int i=0; (i < WAIT_MS / 10) && (*count < value); i++) vTaskDelay(pdMS_TO_TICKS(10));
+    return (*count >= value);
+}
+
+/* Completion callback holding manager task until released */
+static void mgr_hold(const wm_cmd_t *cmd, esp_err_t result, void *arg) {
+    (void)cmd;
+    (void)result;
+    (void)arg;
+    xSemaphoreTake(mgr_release, portMAX_DELAY);
+    mgr_released = true;
+}
+
+/* Every entry read from published cache is one of simulated APs */
+static void vReaderTask(void *pvParameters) {
+    (void)pvParameters;
+    wm_scan_entry_t entries[CONFIG_WIFIMGR_SCAN_CACHE_SIZE];
+    wm_scan_filter_t filter = { .ssid = "office" };
+    while(reading) {
+        size_t count = wm_get_scan_results((reads & 1) ? &filter : NULL, entries, CONFIG_WIFIMGR_SCAN_CACHE_SIZE);
+        for(size_t i=0; i<count; i++) {
+            const wm_sim_ap_t *ap = (entries[i].channel == cafe_ap.channel) ? &cafe_ap : &office_ap;
+            if(strcmp(entries[i].ssid, ap->ssid) || memcmp(entries[i].bssid, ap->bssid, 6)) bad_reads++;
+        }
+        reads++;
+        vTaskDelay(1);
+    }
+    xSemaphoreGive(reader_done);
+    vTaskDelete(NULL);
+}
+
+static void test_busy_manager(void) {
+    /* Request is queued - caller never waits for busy manager task */
+    mgr_release = xSemaphoreCreateBinary();
+    wm_cmd_t cmd = { .cmd_id = WM_CMD_POWER_PROFILE, .power_profile = WM_POWER_BALANCED };
+    WM_CHECK_EQ(wm_cmd_submit(&cmd, mgr_hold, NULL), ESP_OK);
+    vTaskDelay(pdMS_TO_TICKS(20));
+    TickType_t start = xTaskGetTickCount();
+    WM_CHECK_EQ(wm_scan_now(), ESP_OK);
+    WM_CHECK((xTaskGetTickCount() - start) < pdMS_TO_TICKS(CONFIG_WIFIMGR_CMD_TIMEOUT / 2));
+    xSemaphoreGive(mgr_release);
+    WM_CHECK(wait_count(&results, 1));
+    /* Semaphore is still in use until callback returns */
+    for(int i=0; (i < WAIT_MS / 10) && !mgr_released; i++) vTaskDelay(pdMS_TO_TICKS(10));
+    WM_CHECK(mgr_released);
+    vSemaphoreDelete(mgr_release);
+}
+
+static void test_broadcast(void) {
+    /* Results of queued request are counted before snapshot */
+    WM_CHECK(wm_sim_idle(WAIT_MS));
+    WM_CHECK(wm_port_events_idle(WAIT_MS));
+    wm_sim_stats_t before, after;
+    wm_sim_get_stats(&before);
+    int start = results;
+    WM_CHECK_EQ(wm_scan_now(), ESP_OK);
+    WM_CHECK(wait_count(&results, start + 1));
+    wm_sim_get_stats(&after);
+    WM_CHECK(after.scans > before.scans);
+    wm_scan_entry_t entries[4];
+    WM_CHECK_EQ(wm_get_scan_results(NULL, entries, 4), 2);
+    wm_scan_filter_t filter = { .ssid = "cafe" };
+    WM_CHECK_EQ(wm_get_scan_results(&filter, entries, 4), 1);
+    filter = (wm_scan_filter_t){ .min_rssi = -65 };
+    WM_CHECK_EQ(wm_get_scan_results(&filter, entries, 4), 1);
+}
+
+static void test_softap_slices(void) {
+    wm_sim_ap_client(client_mac, true);
+    /* Manager task took the station - no broadcast scan starts after this */
+    WM_CHECK(wait_count(&ap_clients, 1));
+    WM_CHECK(wm_sim_idle(WAIT_MS));
+    WM_CHECK(wm_port_events_idle(WAIT_MS));
+    wm_sim_stats_t before, after;
+    wm_sim_get_stats(&before);
+    int start = results;
+    WM_CHECK_EQ(wm_scan_now(), ESP_OK);
+    WM_CHECK(wait_count(&results, start + 1));
+    wm_sim_get_stats(&after);
+    /* One round of single channel slices, radio never leaves softAP channel for all channels */
+    WM_CHECK(after.channel_scans - before.channel_scans >= 13);
+    WM_CHECK_EQ(after.scans - before.scans, after.channel_scans - before.channel_scans);
+    /* Back to back requests - slices stay within off-channel share plus one saved round */
+    before = after;
+    TickType_t since = xTaskGetTickCount();
+    while((xTaskGetTickCount() - since) < pdMS_TO_TICKS(RATIO_MS)) {
+        WM_CHECK_EQ(wm_scan_now(), ESP_OK);
+        vTaskDelay(pdMS_TO_TICKS(CONFIG_WIFIMGR_AP_SCAN_SLICE_INTERVAL));
+    }
+    wm_sim_get_stats(&after);
+    uint32_t elapsed_ms = (xTaskGetTickCount() - since) * portTICK_PERIOD_MS;
+    uint32_t offchan_ms = (after.channel_scans - before.channel_scans) * CONFIG_WIFIMGR_AP_SCAN_DWELL;
+    printf("off-channel %u ms in %u ms\n", (unsigned)offchan_ms, (unsigned)elapsed_ms);
+    WM_CHECK(offchan_ms > 0);
+    WM_CHECK(offchan_ms * 100 <= elapsed_ms * CONFIG_WIFIMGR_AP_SCAN_MAX_OFFCHAN + ROUND_MS * 100);
+    wm_scan_entry_t entries[4];
+    WM_CHECK_EQ(wm_get_scan_results(NULL, entries, 4), 2);
+    wm_sim_ap_client(client_mac, false);
+}
+
+int main(void) {
+    wm_sim_reset();
+    wm_sim_timing(5, 5, 5);
+    wm_sim_add_ap(&cafe_ap);
+    wm_sim_add_ap(&office_ap);
+    WM_CHECK_EQ(wm_init_wifi_manager(NULL, NULL), ESP_OK);
+    WM_CHECK_EQ(esp_event_handler_instance_register(WM_EVENT, ESP_EVENT_ANY_ID, wm_event_cb, NULL, NULL), ESP_OK);
+    reader_done = xSemaphoreCreateBinary();
+    reading = true;
+    WM_CHECK_EQ(xTaskCreate(vReaderTask, "reader", 4096, NULL, 5, NULL), pdPASS);
+
+    test_busy_manager();
+    test_broadcast();
+    test_softap_slices();
+
+    reading = false;
+    xSemaphoreTake(reader_done, portMAX_DELAY);
+    vSemaphoreDelete(reader_done);
+    WM_CHECK(reads > 0);
+    WM_CHECK_EQ(bad_reads, 0);
+    WM_CHECK_EQ(wm_deinit_wifi_manager(), ESP_OK);
+    return WM_TEST_RESULT();
+}
@@ -0,0 +1,197 @@
+/*
+ * SPDX-FileCopyrightText: 2024 Rossen Dobrinov
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/**
+ * Trace capture and replay on the host port: connect and link loss run is
+ * captured, then captured driver events and scan records are replayed through
+ * real manager handlers on passive simulated driver. Replayed run must take
+ * same connection decisions in same order. Commands are not replayed - log
+ * keeps command IDs only, test issues same API calls.
+*/
+
+#include <string.h>
+#include "idf_wifi_manager.h"
+#include "wm_trace.h"
+#include "wm_port.h"
+#include "wm_sim.h"
+#include "wm_test.h"
+
+#define WAIT_MS     10000
+#define MAX_IDS     64
+
+static const wm_sim_ap_t home_ap = {
+    .ssid = "home",
+    .password = "password1",
+    .bssid = { 0x02, 0x00, 0x00, 0x00, 0x00, 0x01 },
+    .channel = 6,
+    .rssi = -50,
+    .authmode = WIFI_AUTH_WPA2_PSK,
+};
+
+static uint8_t captured[CONFIG_WIFIMGR_TRACE_SIZE], replayed[CONFIG_WIFIMGR_TRACE_SIZE];
+static uint8_t env_bssid[WM_SIM_MAX_APS][6];
+static int env_count;
+static volatile int disconnects, ap_starts;
+
+/**
+ * @brief Connection decisions of a log in order
+*/
+typedef struct {
+    uint16_t id[MAX_IDS];
+    int count;
+} decisions_t;
+
+static bool wait_mode(wifi_mode_t mode, bool linked) {
+    for(int i=0; i<WAIT_MS / 10; i++) {
+        wm_sim_stats_t stats;
+        wm_sim_get_stats(&stats);
+        if((stats.linked == linked) && (stats.mode == mode)) return true;
+        vTaskDelay(pdMS_TO_TICKS(10));
+    }
+    return false;
+}
+
+static void wm_event_cb(void *arg, esp_event_base_t event_base, int32_t id, void *data) {
+    (void)arg;
+    (void)event_base;
+    (void)data;
+    if(id == WM_EVENT_STA_DISCONNECT) disconnects++;
+    else if(id == WM_EVENT_AP_START) ap_starts++;
+}
+
+static bool wait_count(volatile int *counter, int count) {
+    for(int i=0; (i < WAIT_MS / 10) && (*counter < count); i++) vTaskDelay(pdMS_TO_TICKS(10));
+    return *counter >= count;
+}
+
+static void decisions_get(const uint8_t *log, size_t len, decisions_t *d) {
+    wm_trace_reader_t r;
+    wm_trace_item_t item;
+    memset(d, 0, sizeof(decisions_t));
+    WM_CHECK_EQ(wm_trace_open(&r, log, len), WM_TRACE_OK);
+    while(wm_trace_next(&r, &item) == WM_TRACE_OK) {
+        if(item.type != WM_TRACE_REC_EVENT) continue;
+        /* Link monitor, profiler and power decisions depend on timer phase */
+        if(item.id > WM_EVENT_GOT_IP) continue;
+        if(d->count < MAX_IDS) d->id[d->count++] = item.id;
+    }
+}
+
+static size_t capture(void) {
+    wm_sim_reset();
+    wm_sim_timing(5, 5, 5);
+    wm_sim_add_ap(&home_ap);
+    disconnects = 0;
+    WM_CHECK_EQ(wm_init_wifi_manager(NULL, NULL), ESP_OK);
+    /* Default event loop is created by first init and kept */
+    WM_CHECK_EQ(esp_event_handler_instance_register(WM_EVENT, WM_EVENT_STA_DISCONNECT, wm_event_cb, NULL, NULL), ESP_OK);
+    WM_CHECK_EQ(esp_event_handler_instance_register(WM_EVENT, WM_EVENT_AP_START, wm_event_cb, NULL, NULL), ESP_OK);
+    WM_CHECK_EQ(wm_add_known_network("home", "password1"), ESP_OK);
+    WM_CHECK(wait_mode(WIFI_MODE_STA, true));
+    /* Link loss - manager gives up on AP, rescan finds nothing and softAP is back */
+    int count = disconnects, starts = ap_starts;
+    wm_sim_remove_ap(home_ap.bssid);
+    WM_CHECK(wait_count(&disconnects, count + 1));
+    WM_CHECK(wait_count(&ap_starts, starts + 1));
+    WM_CHECK(wm_port_events_idle(WAIT_MS));
+    size_t len = wm_get_trace(captured, sizeof(captured), false);
+    WM_CHECK_EQ(wm_deinit_wifi_manager(), ESP_OK);
+    WM_CHECK(wm_sim_idle(WAIT_MS));
+    return len;
+}
+
+/* Scan records follow SCAN_DONE they were read by */
+static void replay_scan(wm_trace_reader_t r) {
+    wifi_ap_record_t records[WM_SIM_MAX_APS];
+    uint16_t count = 0;
+    wm_trace_item_t item;
+    wm_trace_ap_t ap;
+    while((wm_trace_next(&r, &item) == WM_TRACE_OK) && (item.type != WM_TRACE_REC_WIFI) && (item.type != WM_TRACE_REC_IP)) {
+        if(!wm_trace_get_ap(&item, &ap) || (count >= WM_SIM_MAX_APS)) continue;
+        wifi_ap_record_t *rec = &records[count++];
+        memset(rec, 0, sizeof(wifi_ap_record_t));
+        memcpy(rec->bssid, ap.bssid, sizeof(rec->bssid));
+        memcpy(rec->ssid, ap.ssid, sizeof(rec->ssid) - 1);
+        rec->primary = ap.primary;
+        rec->second = ap.second;
+        rec->rssi = ap.rssi;
+        rec->authmode = ap.authmode;
+        /* Link monitor reads associated AP from environment */
+        bool known = false;
+        for(int i=0; i<env_count; i++) known |= !memcmp(env_bssid[i], ap.bssid, 6);
+        if(known || (env_count >= WM_SIM_MAX_APS)) continue;
+        wm_sim_ap_t env = { .channel = ap.primary, .rssi = ap.rssi, .authmode = ap.authmode };
+        memcpy(env.bssid, ap.bssid, sizeof(env.bssid));
+        memcpy(env.ssid, ap.ssid, sizeof(env.ssid));
+        wm_sim_add_ap(&env);
+        memcpy(env_bssid[env_count++], ap.bssid, 6);
+    }
+    wm_sim_replay_scan(records, count);
+}
+
+static size_t replay(const uint8_t *log, size_t len, int disconnect_count, int ap_start_count) {
+    wm_sim_reset();
+    wm_sim_replay(true);
+    disconnects = 0;
+    ap_starts = 0;
+    WM_CHECK_EQ(wm_init_wifi_manager(NULL, NULL), ESP_OK);
+    WM_CHECK_EQ(wm_add_known_network("home", "password1"), ESP_OK);
+    TickType_t start = xTaskGetTickCount();
+    wm_trace_reader_t r;
+    wm_trace_item_t item;
+    WM_CHECK_EQ(wm_trace_open(&r, log, len), WM_TRACE_OK);
+    while(wm_trace_next(&r, &item) == WM_TRACE_OK) {
+        if((item.type != WM_TRACE_REC_WIFI) && (item.type != WM_TRACE_REC_IP)) continue;
+        /* Captured timing keeps manager timers in same phase */
+        TickType_t due = start + pdMS_TO_TICKS(item.time_ms);
+        if((int32_t)(due - xTaskGetTickCount()) > 0) vTaskDelay(due - xTaskGetTickCount());
+        if((item.type == WM_TRACE_REC_WIFI) && (item.id == WIFI_EVENT_SCAN_DONE)) replay_scan(r);
+        wm_sim_replay_event((item.type == WM_TRACE_REC_WIFI) ? WIFI_EVENT : IP_EVENT, item.id, item.data, item.len);
+    }
+    /* Manager task may still handle last replayed event */
+    WM_CHECK(wait_count(&disconnects, disconnect_count));
+    WM_CHECK(wait_count(&ap_starts, ap_start_count));
+    WM_CHECK(wm_port_events_idle(WAIT_MS));
+    /* Manager connected on replayed scan records and restarted softAP after link loss */
+    wm_sim_stats_t stats;
+    wm_sim_get_stats(&stats);
+    WM_CHECK(stats.connects > 0);
+    WM_CHECK_EQ(stats.mode, WIFI_MODE_APSTA);
+    size_t replay_len = wm_get_trace(replayed, sizeof(replayed), true);
+    /* Restart keeps capture running with empty log */
+    WM_CHECK_EQ(wm_get_trace(NULL, 0, false), WM_TRACE_HDR_SIZE);
+    WM_CHECK_EQ(wm_deinit_wifi_manager(), ESP_OK);
+    wm_sim_replay(false);
+    return replay_len;
+}
+
+int main(void) {
+    size_t len = capture();
+    wm_trace_summary_t summary;
+    WM_CHECK_EQ(wm_trace_replay(captured, len, NULL, NULL, &summary), WM_TRACE_OK);
+    WM_CHECK(!summary.truncated);
+    WM_CHECK(summary.inputs > 0);
+    WM_CHECK(summary.scan_aps > 0);
+    decisions_t expected, got;
+    decisions_get(captured, len, &expected);
+    /* AP start, got IP, STA connect, got IP, AP stop, STA disconnect, AP start */
+    WM_CHECK(expected.count >= 7);
+    int disconnect_count = 0, ap_start_count = 0;
+    for(int i=0; i<expected.count; i++) {
+        disconnect_count += (expected.id[i] == WM_EVENT_STA_DISCONNECT);
+        ap_start_count += (expected.id[i] == WM_EVENT_AP_START);
+    }
+
+    size_t replay_len = replay(captured, len, disconnect_count, ap_start_count);
+    WM_CHECK_EQ(wm_trace_replay(replayed, replay_len, NULL, NULL, &summary), WM_TRACE_OK);
+    decisions_get(replayed, replay_len, &got);
+    WM_CHECK_EQ(got.count, expected.count);
+    for(int i=0; (i < got.count) && (i < expected.count); i++) {
+        if(got.id[i] != expected.id[i]) fprintf(stderr, "decision %d: replayed %u, captured %u\n", i, got.id[i], expected.id[i]);
+        WM_CHECK_EQ(got.id[i], expected.id[i]);
+    }
+    return WM_TEST_RESULT();
+}
@@ -0,0 +1,161 @@
+/*
+ * SPDX-FileCopyrightText: 2024 Rossen Dobrinov
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/**
+ * Stage watchdog on the host port with short stage deadlines: simulated driver
+ * stalls association, DHCP, mode switch and scan. First recovery of connect and
+ * DHCP stall disconnects, silent driver escalates to giving up AP. Failed mode
+ * switch is retried until it succeeds, retries are not counted as recoveries.
+ * Every stalled scan is stopped and scanning goes on. Manager connects again
+ * once the stall is gone.
+*/
+
+#include <string.h>
+#include "idf_wifi_manager.h"
+#include "wm_port.h"
+#include "wm_sim.h"
+#include "wm_test.h"
+
+#define WAIT_MS     10000
+
+static const wm_sim_ap_t home_ap = {
+    .ssid = "home",
+    .password = "password1",
+    .bssid = { 0x02, 0x00, 0x00, 0x00, 0x00, 0x01 },
+    .channel = 6,
+    .rssi = -50,
+    .authmode = WIFI_AUTH_WPA2_PSK,
+};
+
+static volatile int got_ip, ap_starts;
+static volatile int recovery[WM_WD_STAGE_MAX];
+
+static void wm_event_cb(void *arg, esp_event_base_t event_base, int32_t id, void *data) {
+    (void)arg;
+    (void)event_base;
+    if(id == WM_EVENT_GOT_IP) got_ip++;
+    else if(id == WM_EVENT_AP_START) ap_starts++;
+    else if(id == WM_EVENT_WD_RECOVERY) recovery[*(wm_wd_stage_t *)data]++;
+}
+
+static bool wait_count(volatile int *counter, int count) {
+    for(int i=0; (i < WAIT_MS) && (*counter < count); i++) vTaskDelay(pdMS_TO_TICKS(1));
+    return *counter >= count;
+}
+
+/* Link to home AP with address */
+static bool wait_ip(int count) {
+    for(int i=0; i<WAIT_MS; i++) {
+        wm_sim_stats_t stats;
+        wm_sim_get_stats(&stats);
+        if((got_ip > count) && stats.linked && !memcmp(stats.bssid, home_ap.bssid, 6)) return true;
+        vTaskDelay(pdMS_TO_TICKS(1));
+    }
+    return false;
+}
+
+static bool wait_mode(wifi_mode_t mode) {
+    for(int i=0; i<WAIT_MS; i++) {
+        wm_sim_stats_t stats;
+        wm_sim_get_stats(&stats);
+        if(stats.mode == mode) return true;
+        vTaskDelay(pdMS_TO_TICKS(1));
+    }
+    return false;
+}
+
+/* Next connect attempt started - associated when assoc is true */
+static bool wait_attempt(uint32_t connects, bool assoc) {
+    for(int i=0; i<WAIT_MS; i++) {
+        wm_sim_stats_t stats;
+        wm_sim_get_stats(&stats);
+        if((stats.connects > connects) && (!assoc || stats.linked)) return true;
+        vTaskDelay(pdMS_TO_TICKS(1));
+    }
+    return false;
+}
+
+/**
+ * @brief Stall connect or DHCP of reconnect after link loss
+ *
+ * @param[in] stage WM_WD_CONNECT or WM_WD_DHCP
+ * @param[in] silent Driver does not report disconnect after first recovery
+*/
+static void test_link_stage(wm_wd_stage_t stage, bool silent) {
+    uint32_t stall = (stage == WM_WD_CONNECT) ? WM_SIM_STALL_ASSOC : WM_SIM_STALL_DHCP;
+    wm_wd_stats_t before, after;
+    wm_sim_stats_t sim;
+    wm_get_wd_stats(&before);
+    wm_sim_get_stats(&sim);
+    int events = recovery[stage], count = got_ip;
+    wm_sim_stall(stall);
+    wm_sim_disconnect(WIFI_REASON_BEACON_TIMEOUT);
+    WM_CHECK(wait_attempt(sim.connects, stage == WM_WD_DHCP));
+    if(silent) wm_sim_stall(stall | WM_SIM_STALL_DISCONNECT);
+    /* Escalation is one more deadline of same stall */
+    WM_CHECK(wait_count(&recovery[stage], events + (silent ? 2 : 1)));
+    wm_sim_stall(0);
+    wm_get_wd_stats(&after);
+    WM_CHECK_EQ(after.stage_recoveries[stage], before.stage_recoveries[stage] + 1);
+    WM_CHECK_EQ(after.recoveries, before.recoveries + 1);
+    /* AP given up for short blacklist time */
+    WM_CHECK(wait_ip(count));
+    WM_CHECK_EQ(recovery[stage], events + (silent ? 2 : 1));
+}
+
+int main(void) {
+    wm_sim_reset();
+    wm_sim_timing(5, 5, 5);
+    wm_sim_add_ap(&home_ap);
+    WM_CHECK_EQ(esp_event_loop_create_default(), ESP_OK);
+    WM_CHECK_EQ(esp_event_handler_instance_register(WM_EVENT, ESP_EVENT_ANY_ID, wm_event_cb, NULL, NULL), ESP_OK);
+    WM_CHECK_EQ(wm_init_wifi_manager(NULL, NULL), ESP_OK);
+    int count = got_ip;
+    WM_CHECK_EQ(wm_add_known_network("home", "password1"), ESP_OK);
+    WM_CHECK(wait_ip(count));
+
+    test_link_stage(WM_WD_CONNECT, false);
+    test_link_stage(WM_WD_CONNECT, true);
+    test_link_stage(WM_WD_DHCP, false);
+    test_link_stage(WM_WD_DHCP, true);
+
+    /* Mode - softAP restart after link loss fails until stall is gone */
+    WM_CHECK(wait_mode(WIFI_MODE_STA));
+    wm_wd_stats_t before, after;
+    wm_get_wd_stats(&before);
+    int events = recovery[WM_WD_MODE], starts = ap_starts;
+    wm_sim_stall(WM_SIM_STALL_MODE);
+    wm_sim_remove_ap(home_ap.bssid);
+    WM_CHECK(wait_count(&recovery[WM_WD_MODE], events + 2));
+    wm_get_wd_stats(&after);
+    WM_CHECK_EQ(after.stage_recoveries[WM_WD_MODE], before.stage_recoveries[WM_WD_MODE] + 1);
+    wm_sim_stats_t sim;
+    wm_sim_get_stats(&sim);
+    WM_CHECK_EQ(sim.mode, WIFI_MODE_STA);
+    wm_sim_stall(0);
+    WM_CHECK(wait_count(&ap_starts, starts + 1));
+    WM_CHECK(wait_mode(WIFI_MODE_APSTA));
+
+    /* Scan - each stalled scan is stopped, scanning goes on */
+    wm_get_wd_stats(&before);
+    events = recovery[WM_WD_SCAN];
+    wm_sim_stall(WM_SIM_STALL_SCAN);
+    WM_CHECK_EQ(wm_scan_now(), ESP_OK);
+    WM_CHECK(wait_count(&recovery[WM_WD_SCAN], events + 2));
+    wm_get_wd_stats(&after);
+    WM_CHECK_EQ(after.stage_recoveries[WM_WD_SCAN], before.stage_recoveries[WM_WD_SCAN] + 2);
+    wm_sim_stall(0);
+    count = got_ip;
+    wm_sim_add_ap(&home_ap);
+    WM_CHECK(wait_ip(count));
+
+    wm_get_wd_stats(&after);
+    uint32_t sum = 0;
+    for(int i=0; i<WM_WD_STAGE_MAX; i++) sum += after.stage_recoveries[i];
+    WM_CHECK_EQ(after.recoveries, sum);
+    WM_CHECK_EQ(wm_deinit_wifi_manager(), ESP_OK);
+    return WM_TEST_RESULT();
+}
@@ -0,0 +1,36 @@
+/*
+ * SPDX-FileCopyrightText: 2024 Rossen Dobrinov
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/**
+ * Minimal host test helpers. Failed check prints location and marks test failed,
+ * test keeps running to report all failures at once.
+*/
+
+#ifndef _WM_TEST_H_
+#define _WM_TEST_H_
+
+#include <stdio.h>
+
+static int wm_test_failures;
+
+#define WM_CHECK(cond) do { \
+        if(!(cond)) { \
+            fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+            wm_test_failures++; \
+        } \
+    } while(0)
+
+#define WM_CHECK_EQ(a, b) do { \
+        long long _a = (long long)(a), _b = (long long)(b); \
+        if(_a != _b) { \
+            fprintf(stderr, "%s:%d: check failed: %s == %s (%lld != %lld)\n", __FILE__, __LINE__, #a, #b, _a, _b); \
+            wm_test_failures++; \
+        } \
+    } while(0)
+
+#define WM_TEST_RESULT() (wm_test_failures ? (fprintf(stderr, "%d check(s) failed\n", wm_test_failures), 1) : (printf("OK\n"), 0))
+
+#endif /* _WM_TEST_H_ */
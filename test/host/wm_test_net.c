@@ -0,0 +1,126 @@
+/*
+ * SPDX-FileCopyrightText: 2024 Rossen Dobrinov
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include "wm_test_net.h"
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/select.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+static void *wm_test_accept_thread(void *arg) {
+    wm_test_server_t *srv = (wm_test_server_t *)arg;
+    while(!srv->stop) {
+        fd_set rfds;
+        FD_ZERO(&rfds);
+        FD_SET(srv->fd, &rfds);
+        struct timeval tv = { .tv_sec = 0, .tv_usec = 20000 };
+        if(select(srv->fd + 1, &rfds, NULL, NULL, &tv) <= 0) continue;
+        int conn = accept(srv->fd, NULL, NULL);
+        if(conn < 0) continue;
+        srv->cb(conn, srv->arg);
+        close(conn);
+    }
+    return NULL;
+}
+
+static int wm_test_bind(int type, uint16_t *port) {
+    int fd = socket(AF_INET, type, 0);
+    if(fd < 0) return -1;
+    struct sockaddr_in addr = { .sin_family = AF_INET, .sin_addr.s_addr = htonl(INADDR_LOOPBACK) };
+    socklen_t len = sizeof(addr);
+    if((0 != bind(fd, (struct sockaddr *)&addr, sizeof(addr))) || (0 != getsockname(fd, (struct sockaddr *)&addr, &len))) {
+        close(fd);
+        return -1;
+    }
+    *port = ntohs(addr.sin_port);
+    return fd;
+}
+
+int wm_test_server_start(wm_test_server_t *srv, wm_test_conn_cb_t cb, void *arg) {
+    memset(srv, 0, sizeof(wm_test_server_t));
+    srv->cb = cb;
+    srv->arg = arg;
+    srv->fd = wm_test_bind(SOCK_STREAM, &srv->port);
+    if(srv->fd < 0) return -1;
+    if((0 != listen(srv->fd, 4)) || (0 != pthread_create(&srv->thread, NULL, wm_test_accept_thread, srv))) {
+        close(srv->fd);
+        return -1;
+    }
+    return 0;
+}
+
+void wm_test_server_stop(wm_test_server_t *srv) {
+    srv->stop = 1;
+    pthread_join(srv->thread, NULL);
+    close(srv->fd);
+}
+
+uint16_t wm_test_closed_port(void) {
+    uint16_t port = 0;
+    int fd = wm_test_bind(SOCK_STREAM, &port);
+    if(fd >= 0) close(fd);
+    return port;
+}
+
+int wm_test_read_head(int fd, char *buf, int size) {
+    int got = 0;
+    struct timeval tv = { .tv_sec = 2, .tv_usec = 0 };
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    while(got < size - 1) {
+        int len = recv(fd, &buf[got], size - 1 - got, 0);
+        if(len <= 0) return -1;
+        got += len;
+        buf[got] = 0;
+        if(strstr(buf, "\r\n\r\n")) return got;
+    }
+    return -1;
+}
+
+static void *wm_test_dns_thread(void *arg) {
+    wm_test_dns_server_t *srv = (wm_test_dns_server_t *)arg;
+    uint8_t buf[512];
+    while(!srv->stop) {
+        fd_set rfds;
+        FD_ZERO(&rfds);
+        FD_SET(srv->fd, &rfds);
+        struct timeval tv = { .tv_sec = 0, .tv_usec = 20000 };
+        if(select(srv->fd + 1, &rfds, NULL, NULL, &tv) <= 0) continue;
+        struct sockaddr_in from;
+        socklen_t from_len = sizeof(from);
+        int len = recvfrom(srv->fd, buf, sizeof(buf), 0, (struct sockaddr *)&from, &from_len);
+        if(len < 12) continue;
+        srv->queries++;
+        usleep(srv->delay_ms * 1000);
+        /* Query echoed as response without answers */
+        buf[2] |= 0x80;
+        buf[3] &= 0xF0;
+        sendto(srv->fd, buf, len, 0, (struct sockaddr *)&from, from_len);
+    }
+    return NULL;
+}
+
+int wm_test_dns_start(wm_test_dns_server_t *srv, uint32_t ip, uint16_t port, uint32_t delay_ms) {
+    memset(srv, 0, sizeof(wm_test_dns_server_t));
+    srv->delay_ms = delay_ms;
+    srv->fd = socket(AF_INET, SOCK_DGRAM, 0);
+    if(srv->fd < 0) return -1;
+    int on = 1;
+    setsockopt(srv->fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+    struct sockaddr_in addr = { .sin_family = AF_INET, .sin_port = htons(port), .sin_addr.s_addr = ip };
+    if((0 != bind(srv->fd, (struct sockaddr *)&addr, sizeof(addr))) || (0 != pthread_create(&srv->thread, NULL, wm_test_dns_thread, srv))) {
+        close(srv->fd);
+        return -1;
+    }
+    return 0;
+}
+
+void wm_test_dns_stop(wm_test_dns_server_t *srv) {
+    srv->stop = 1;
+    pthread_join(srv->thread, NULL);
+    close(srv->fd);
+}
@@ -0,0 +1,91 @@
+/*
+ * SPDX-FileCopyrightText: 2024 Rossen Dobrinov
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/**
+ * Local stand-in servers for host tests. Servers listen on 127.0.0.1 with
+ * ephemeral port and serve each connection from own thread, one at a time.
+*/
+
+#ifndef _WM_TEST_NET_H_
+#define _WM_TEST_NET_H_
+
+#include <stdint.h>
+#include <pthread.h>
+
+/**
+ * @brief Connection handler. Connection is closed after return
+*/
+typedef void (*wm_test_conn_cb_t)(int fd, void *arg);
+
+/**
+ * @brief Type of local TCP server
+*/
+typedef struct wm_test_server {
+    int fd;                     /*!< Listening socket               */
+    uint16_t port;              /*!< Bound port, host byte order    */
+    pthread_t thread;           /*!< Accept thread                  */
+    wm_test_conn_cb_t cb;       /*!< Connection handler             */
+    void *arg;                  /*!< Handler argument               */
+    volatile int stop;          /*!< Stop request                   */
+} wm_test_server_t;
+
+/**
+ * @brief Start TCP server on 127.0.0.1
+ *
+ * @return
+ *  - 0 Started, -1 on error
+*/
+int wm_test_server_start(wm_test_server_t *srv, wm_test_conn_cb_t cb, void *arg);
+
+/**
+ * @brief Stop TCP server and join accept thread
+*/
+void wm_test_server_stop(wm_test_server_t *srv);
+
+/**
+ * @brief Get local TCP port without listener
+ *
+ * @return
+ *  - Port, host byte order
+*/
+uint16_t wm_test_closed_port(void);
+
+/**
+ * @brief Read HTTP request head up to empty line
+ *
+ * @return
+ *  - Head length, -1 on error or timeout
+*/
+int wm_test_read_head(int fd, char *buf, int size);
+
+/**
+ * @brief Type of local DNS server. Answers every query with NOERROR after delay
+*/
+typedef struct wm_test_dns_server {
+    int fd;                     /*!< UDP socket                     */
+    pthread_t thread;           /*!< Receive thread                 */
+    uint32_t delay_ms;          /*!< Answer delay                   */
+    volatile int queries;       /*!< Queries received               */
+    volatile int stop;          /*!< Stop request                   */
+} wm_test_dns_server_t;
+
+/**
+ * @brief Start DNS server on loopback address
+ *
+ * @param[in] ip Loopback address 127.x.x.x, network byte order
+ * @param[in] port UDP port, host byte order
+ *
+ * @return
+ *  - 0 Started, -1 on error
+*/
+int wm_test_dns_start(wm_test_dns_server_t *srv, uint32_t ip, uint16_t port, uint32_t delay_ms);
+
+/**
+ * @brief Stop DNS server and join receive thread
+*/
+void wm_test_dns_stop(wm_test_dns_server_t *srv);
+
+#endif /* _WM_TEST_NET_H_ */
@@ -0,0 +1,42 @@
+# Generate regulatory channel plan table from CSV
+#   cmake -DIN=<wm_channel_plan.csv> -DOUT=<wm_channel_plan.h> -P gen_channel_plan.cmake
+if(NOT IN OR NOT OUT)
+    message(FATAL_ERROR "IN and OUT must be set")
+endif()
+
+file(STRINGS "${IN}" rows)
+set(body "")
+set(count 0)
+foreach(row IN LISTS rows)
+    string(STRIP "${row}" row)
+    if(row STREQUAL "" OR row MATCHES "^#")
+        continue()
+    endif()
+    if(NOT row MATCHES "^([0-9A-Z][0-9A-Z]),([0-9]+),([0-9]+),(-?[0-9]+),([0-9]+)$")
+        message(FATAL_ERROR "${IN}: malformed row '${row}'")
+    endif()
+    set(cc "${CMAKE_MATCH_1}")
+    set(schan "${CMAKE_MATCH_2}")
+    set(nchan "${CMAKE_MATCH_3}")
+    set(power "${CMAKE_MATCH_4}")
+    set(band5 "${CMAKE_MATCH_5}")
+    math(EXPR last "${schan} + ${nchan} - 1")
+    if(schan LESS 1 OR nchan LESS 1 OR last GREATER 14)
+        message(FATAL_ERROR "${IN}: channel range out of 2.4 GHz band '${row}'")
+    endif()
+    if(band5 GREATER 15)
+        message(FATAL_ERROR "${IN}: unknown 5 GHz sub-band in mask '${row}'")
+    endif()
+    string(APPEND body "WM_CHAN_PLAN(\"${cc}\", ${schan}, ${nchan}, ${power}, ${band5})\n")
+    math(EXPR count "${count} + 1")
+endforeach()
+
+set(content "/* Generated from wm_channel_plan.csv by gen_channel_plan.cmake - do not edit */\n/* WM_CHAN_PLAN(cc, schan, nchan, max_tx_power, band5) - ${count} entries */\n${body}")
+# Keep timestamp when unchanged
+if(EXISTS "${OUT}")
+    file(READ "${OUT}" old)
+    if(old STREQUAL content)
+        return()
+    endif()
+endif()
+file(WRITE "${OUT}" "${content}")
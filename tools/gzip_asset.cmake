@@ -0,0 +1,12 @@
+# Compress portal asset for embedding in flash
+#   cmake -DIN=<asset> -DOUT=<asset.gz> -P gzip_asset.cmake
+# Raw gzip stream is served as is with Content-Encoding: gzip. Needs CMake 3.18+
+cmake_minimum_required(VERSION 3.18)
+if(NOT IN OR NOT OUT)
+    message(FATAL_ERROR "IN and OUT must be set")
+endif()
+
+file(ARCHIVE_CREATE OUTPUT "${OUT}" PATHS "${IN}" FORMAT raw COMPRESSION GZip COMPRESSION_LEVEL 9)
+file(SIZE "${IN}" in_size)
+file(SIZE "${OUT}" out_size)
+message(STATUS "Compressed ${IN}: ${in_size} -> ${out_size} bytes")